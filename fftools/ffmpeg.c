@@ -491,6 +491,7 @@ static void ffmpeg_cleanup(int ret)
 
     for (i = 0; i < nb_filtergraphs; i++) {
         FilterGraph *fg = filtergraphs[i];
+        print_filtergraph_profile(fg);
         avfilter_graph_free(&fg->graph);
         for (j = 0; j < fg->nb_inputs; j++) {
             while (av_fifo_size(fg->inputs[j]->frame_queue)) {
@@ -523,6 +524,9 @@ static void ffmpeg_cleanup(int ret)
         }
         av_freep(&fg->outputs);
         av_freep(&fg->graph_desc);
+        for (j = 0; j < fg->nb_profile; j++)
+            av_freep(&fg->profile[j].name);
+        av_freep(&fg->profile);
 
         av_freep(&filtergraphs[i]);
     }
@@ -279,6 +279,11 @@ typedef struct OutputFilter {
     int *sample_rates;
 } OutputFilter;
 
+typedef struct FilterProfileStats {
+    char         *name;
+    AVFilterStats stats;
+} FilterProfileStats;
+
 typedef struct FilterGraph {
     int            index;
     const char    *graph_desc;
@@ -290,6 +295,11 @@ typedef struct FilterGraph {
     int          nb_inputs;
     OutputFilter **outputs;
     int         nb_outputs;
+
+    /* profiling statistics of the filters, accumulated over all the
+       configurations of the graph */
+    FilterProfileStats *profile;
+    int              nb_profile;
 } FilterGraph;
 
 typedef struct InputStream {
@@ -609,6 +619,7 @@ extern char *videotoolbox_pixfmt;
 
 extern int filter_nbthreads;
 extern int filter_complex_nbthreads;
+extern int filter_profile;
 extern int vstats_version;
 
 extern const AVIOInterruptCB int_cb;
@@ -645,6 +656,7 @@ int ist_in_filtergraph(FilterGraph *fg, InputStream *ist);
 int filtergraph_is_simple(FilterGraph *fg);
 int init_simple_filtergraph(InputStream *ist, OutputStream *ost);
 int init_complex_filtergraph(FilterGraph *fg);
+void print_filtergraph_profile(FilterGraph *fg);
 
 void sub2video_update(InputStream *ist, AVSubtitle *sub);
 
@@ -992,6 +992,85 @@ static int configure_input_filter(FilterGraph *fg, InputFilter *ifilter,
     }
 }
 
+/* Add the statistics of the current graph to the ones of the previous
+ * configurations, matching the filters by name. */
+static void accumulate_filtergraph_profile(FilterGraph *fg)
+{
+    int i, j;
+
+    if (!fg->graph)
+        return;
+    for (i = 0; i < fg->graph->nb_filters; i++) {
+        const AVFilterContext *f = fg->graph->filters[i];
+        const AVFilterStats *st = avfilter_graph_get_stats(fg->graph, i);
+        const char *name = f->name ? f->name : f->filter->name;
+        AVFilterStats *acc;
+
+        if (!st)
+            continue;
+        for (j = 0; j < fg->nb_profile; j++)
+            if (!strcmp(fg->profile[j].name, name))
+                break;
+        if (j == fg->nb_profile) {
+            FilterProfileStats *entry;
+
+            if (av_reallocp_array(&fg->profile, fg->nb_profile + 1,
+                                  sizeof(*fg->profile)) < 0) {
+                fg->nb_profile = 0;
+                return;
+            }
+            entry = &fg->profile[fg->nb_profile];
+            memset(entry, 0, sizeof(*entry));
+            if (!(entry->name = av_strdup(name)))
+                return;
+            fg->nb_profile++;
+        }
+        acc = &fg->profile[j].stats;
+        acc->nb_activations      += st->nb_activations;
+        acc->activate_time       += st->activate_time;
+        acc->activate_cpu_time   += st->activate_cpu_time;
+        acc->frames_in           += st->frames_in;
+        acc->frames_out          += st->frames_out;
+        acc->queued_frames        = st->queued_frames;
+        acc->max_queued_frames    = FFMAX(acc->max_queued_frames,
+                                          st->max_queued_frames);
+        acc->nb_slice_executions += st->nb_slice_executions;
+        acc->nb_slice_jobs       += st->nb_slice_jobs;
+        acc->slice_time          += st->slice_time;
+        acc->slice_thread_time   += st->slice_thread_time;
+        acc->slice_busy_time     += st->slice_busy_time;
+    }
+}
+
+void print_filtergraph_profile(FilterGraph *fg)
+{
+    int i;
+
+    accumulate_filtergraph_profile(fg);
+    if (!fg->nb_profile)
+        return;
+
+    av_log(NULL, AV_LOG_INFO, "Filtergraph #%d profile:\n", fg->index);
+    av_log(NULL, AV_LOG_INFO, "%-24s %9s %10s %10s %8s %8s %6s %6s %6s\n",
+           "filter", "activ.", "time (ms)", "cpu (ms)", "in", "out",
+           "queued", "max q", "slice%");
+    for (i = 0; i < fg->nb_profile; i++) {
+        const AVFilterStats *st = &fg->profile[i].stats;
+        char util[16] = "-";
+
+        if (st->slice_thread_time)
+            snprintf(util, sizeof(util), "%.1f",
+                     100.0 * st->slice_busy_time / st->slice_thread_time);
+        av_log(NULL, AV_LOG_INFO,
+               "%-24.24s %9"PRId64" %10.3f %10.3f %8"PRId64" %8"PRId64
+               " %6"PRId64" %6"PRId64" %6s\n",
+               fg->profile[i].name, st->nb_activations,
+               st->activate_time / 1e6, st->activate_cpu_time / 1e6,
+               st->frames_in, st->frames_out, st->queued_frames,
+               st->max_queued_frames, util);
+    }
+}
+
 static void cleanup_filtergraph(FilterGraph *fg)
 {
     int i;
@@ -999,6 +1078,7 @@ static void cleanup_filtergraph(FilterGraph *fg)
         fg->outputs[i]->filter = (AVFilterContext *)NULL;
     for (i = 0; i < fg->nb_inputs; i++)
         fg->inputs[i]->filter = (AVFilterContext *)NULL;
+    accumulate_filtergraph_profile(fg);
     avfilter_graph_free(&fg->graph);
 }
 
@@ -1052,6 +1132,8 @@ int configure_filtergraph(FilterGraph *fg)
     } else {
         fg->graph->nb_threads = filter_complex_nbthreads;
     }
+    if (filter_profile)
+        av_opt_set_int(fg->graph, "profile", 1, 0);
 
     if ((ret = avfilter_graph_parse2(fg->graph, graph_desc, &inputs, &outputs)) < 0)
         goto fail;
@@ -42,6 +42,7 @@
 #include "libavutil/log.h"
 #include "libavutil/mathematics.h"
 #include "libavutil/time.h"
+#include "libavutil/tx.h"
 
 #if AVFFT
 #include "libavcodec/avfft.h"
@@ -359,7 +360,8 @@ static void help(void)
            "-r     (I)RDFT test\n"
            "-i     inverse transform test\n"
            "-n b   set the transform size to 2^b\n"
-           "-f x   set scale factor for output data of (I)MDCT to x\n");
+           "-f x   set scale factor for output data of (I)MDCT to x\n"
+           "-t     also measure the libavutil/tx transform in the speed test\n");
 }
 
 enum tf_transform {
@@ -373,6 +375,54 @@ enum tf_transform {
 #include "compat/getopt.c"
 #endif
 
+#if FFT_FLOAT
+/* The equivalent lavu transforms output half the IMDCT window and do not
+ * scale their output. */
+static void tx_speed(enum tf_transform transform, int do_inverse,
+                     int fft_size, double scale, FFTComplex *tab,
+                     FFTComplex *tab1)
+{
+    static const enum AVTXType types[] = {
+        [TRANSFORM_FFT]  = AV_TX_FLOAT_FFT,
+        [TRANSFORM_MDCT] = AV_TX_FLOAT_MDCT,
+        [TRANSFORM_RDFT] = AV_TX_FLOAT_RDFT,
+        [TRANSFORM_DCT]  = AV_TX_FLOAT_DCT,
+    };
+    const int len = transform == TRANSFORM_MDCT ? fft_size / 2 : fft_size;
+    const ptrdiff_t stride = transform == TRANSFORM_FFT ||
+                             transform == TRANSFORM_RDFT ? sizeof(FFTComplex)
+                                                         : sizeof(FFTSample);
+    const float fscale = scale;
+    int64_t time_start, duration;
+    AVTXContext *ctx;
+    av_tx_fn tx;
+    int it, nb_its;
+
+    if (av_tx_init(&ctx, &tx, types[transform], do_inverse, len, &fscale, 0) < 0) {
+        av_log(NULL, AV_LOG_ERROR, "Transform not supported by libavutil/tx\n");
+        return;
+    }
+
+    nb_its = 1;
+    for (;;) {
+        time_start = av_gettime_relative();
+        for (it = 0; it < nb_its; it++)
+            tx(ctx, tab, tab1, stride);
+        duration = av_gettime_relative() - time_start;
+        if (duration >= 1000000)
+            break;
+        nb_its *= 2;
+    }
+    av_log(NULL, AV_LOG_INFO,
+           "libavutil/tx time: %0.1f us/transform [total time=%0.2f s its=%d]\n",
+           (double) duration / nb_its,
+           (double) duration / 1000000.0,
+           nb_its);
+
+    av_tx_uninit(&ctx);
+}
+#endif /* FFT_FLOAT */
+
 int main(int argc, char **argv)
 {
     FFTComplex *tab, *tab1, *tab_ref;
@@ -384,7 +434,7 @@ int main(int argc, char **argv)
     DCTContext *d;
 #endif /* FFT_FLOAT */
     int it, i, err = 1;
-    int do_speed = 0, do_inverse = 0;
+    int do_speed = 0, do_inverse = 0, do_tx = 0;
     int fft_nbits = 9, fft_size;
     double scale = 1.0;
     AVLFG prng;
@@ -402,7 +452,7 @@ int main(int argc, char **argv)
     av_lfg_init(&prng, 1);
 
     for (;;) {
-        int c = getopt(argc, argv, "hsimrdn:f:c:");
+        int c = getopt(argc, argv, "hsimrdtn:f:c:");
         if (c == -1)
             break;
         switch (c) {
@@ -424,6 +474,9 @@ int main(int argc, char **argv)
         case 'd':
             transform = TRANSFORM_DCT;
             break;
+        case 't':
+            do_tx = 1;
+            break;
         case 'n':
             fft_nbits = atoi(optarg);
             break;
@@ -627,6 +680,10 @@ int main(int argc, char **argv)
                (double) duration / nb_its,
                (double) duration / 1000000.0,
                nb_its);
+#if FFT_FLOAT
+        if (do_tx)
+            tx_speed(transform, do_inverse, fft_size, scale, tab, tab1);
+#endif /* FFT_FLOAT */
     }
 
     switch (transform) {
@@ -29,6 +29,7 @@
 #include "libavutil/float_dsp.h"
 #include "libavutil/intreadwrite.h"
 #include "libavutil/opt.h"
+#include "libavutil/thread.h"
 #include "libavutil/xga_font_data.h"
 #include "libavcodec/avfft.h"
 
@@ -39,6 +40,25 @@
 #include "internal.h"
 #include "af_afir.h"
 
+/* frequency domain coefficients of an IR, shared by all filter instances
+ * converting the same IR with the same partitioning */
+typedef struct AudioFIRCoeffs {
+    struct AudioFIRCoeffs *next;
+    int refcount;
+
+    int nb_taps;
+    int nb_channels;
+    int min_part_size;
+    int max_part_size;
+    float *time;                /* the IR after gain and length are applied */
+
+    int nb_segments;
+    AVFrame **coeff;            /* the coeff frame of each segment */
+} AudioFIRCoeffs;
+
+static AVMutex coeffs_cache_lock = AV_MUTEX_INITIALIZER;
+static AudioFIRCoeffs *coeffs_cache;
+
 static void fcmul_add_c(float *sum, const float *t, const float *c, ptrdiff_t len)
 {
     int n;
@@ -56,96 +76,110 @@ static void fcmul_add_c(float *sum, const float *t, const float *c, ptrdiff_t le
     sum[2 * n] += t[2 * n] * c[2 * n];
 }
 
-static int fir_quantum(AVFilterContext *ctx, AVFrame *out, int ch, int offset)
+static int fir_quantum(AVFilterContext *ctx, AVFrame *out, int ch, int segment, int offset)
 {
     AudioFIRContext *s = ctx->priv;
+    AudioFIRSegment *seg = &s->seg[segment];
     const float *in = (const float *)s->in[0]->extended_data[ch] + offset;
     float *block, *buf, *ptr = (float *)out->extended_data[ch] + offset;
     const int nb_samples = FFMIN(s->min_part_size, out->nb_samples - offset);
+    float *src = (float *)seg->input->extended_data[ch] + seg->input_pos[ch];
+    float *dst = (float *)seg->output->extended_data[ch];
+    float *sum = (float *)seg->sum->extended_data[ch];
     int n, i, j;
 
-    for (int segment = 0; segment < s->nb_segments; segment++) {
-        AudioFIRSegment *seg = &s->seg[segment];
-        float *src = (float *)seg->input->extended_data[ch];
-        float *dst = (float *)seg->output->extended_data[ch];
-        float *sum = (float *)seg->sum->extended_data[ch];
+    s->fdsp->vector_fmul_scalar(src + seg->input_offset, in, s->dry_gain, FFALIGN(nb_samples, 4));
+    emms_c();
 
-        s->fdsp->vector_fmul_scalar(src + seg->input_offset, in, s->dry_gain, FFALIGN(nb_samples, 4));
-        emms_c();
+    seg->output_offset[ch] += s->min_part_size;
+    if (seg->output_offset[ch] == seg->part_size) {
+        seg->output_offset[ch] = 0;
+    } else {
+        dst += seg->output_offset[ch];
+        goto end;
+    }
 
-        seg->output_offset[ch] += s->min_part_size;
-        if (seg->output_offset[ch] == seg->part_size) {
-            seg->output_offset[ch] = 0;
-        } else {
-            memmove(src, src + s->min_part_size, (seg->input_size - s->min_part_size) * sizeof(*src));
+    memset(sum, 0, sizeof(*sum) * seg->fft_length);
+    block = (float *)seg->block->extended_data[ch] + seg->part_index[ch] * seg->block_size;
+    memset(block + seg->part_size, 0, sizeof(*block) * (seg->fft_length - seg->part_size));
 
-            dst += seg->output_offset[ch];
-            for (n = 0; n < nb_samples; n++) {
-                ptr[n] += dst[n];
-            }
-            continue;
-        }
+    memcpy(block, src, sizeof(*src) * seg->part_size);
 
-        memset(sum, 0, sizeof(*sum) * seg->fft_length);
-        block = (float *)seg->block->extended_data[ch] + seg->part_index[ch] * seg->block_size;
-        memset(block + seg->part_size, 0, sizeof(*block) * (seg->fft_length - seg->part_size));
+    av_rdft_calc(seg->rdft[ch], block);
+    block[2 * seg->part_size] = block[1];
+    block[1] = 0;
 
-        memcpy(block, src, sizeof(*src) * seg->part_size);
+    j = seg->part_index[ch];
 
-        av_rdft_calc(seg->rdft[ch], block);
-        block[2 * seg->part_size] = block[1];
-        block[1] = 0;
+    for (i = 0; i < seg->nb_partitions; i++) {
+        const int coffset = j * seg->coeff_size;
+        const float *block = (const float *)seg->block->extended_data[ch] + i * seg->block_size;
+        const FFTComplex *coeff = (const FFTComplex *)seg->coeff->extended_data[s->coeff_map[ch]] + coffset;
 
-        j = seg->part_index[ch];
+        s->afirdsp.fcmul_add(sum, block, (const float *)coeff, seg->part_size);
 
-        for (i = 0; i < seg->nb_partitions; i++) {
-            const int coffset = j * seg->coeff_size;
-            const float *block = (const float *)seg->block->extended_data[ch] + i * seg->block_size;
-            const FFTComplex *coeff = (const FFTComplex *)seg->coeff->extended_data[ch * !s->one2many] + coffset;
+        if (j == 0)
+            j = seg->nb_partitions;
+        j--;
+    }
 
-            s->afirdsp.fcmul_add(sum, block, (const float *)coeff, seg->part_size);
+    sum[1] = sum[2 * seg->part_size];
+    av_rdft_calc(seg->irdft[ch], sum);
 
-            if (j == 0)
-                j = seg->nb_partitions;
-            j--;
-        }
+    buf = (float *)seg->buffer->extended_data[ch];
+    for (n = 0; n < seg->part_size; n++) {
+        buf[n] += sum[n];
+    }
 
-        sum[1] = sum[2 * seg->part_size];
-        av_rdft_calc(seg->irdft[ch], sum);
+    memcpy(dst, buf, seg->part_size * sizeof(*dst));
 
-        buf = (float *)seg->buffer->extended_data[ch];
-        for (n = 0; n < seg->part_size; n++) {
-            buf[n] += sum[n];
-        }
+    buf = (float *)seg->buffer->extended_data[ch];
+    memcpy(buf, sum + seg->part_size, seg->part_size * sizeof(*buf));
+
+    seg->part_index[ch] = (seg->part_index[ch] + 1) % seg->nb_partitions;
 
-        memcpy(dst, buf, seg->part_size * sizeof(*dst));
+end:
+    /* Slide the input delay line, the samples are moved back to the start
+     * of the buffer only once the end of the buffer is reached. */
+    seg->input_pos[ch] += s->min_part_size;
+    if (seg->input_pos[ch] + seg->input_size > seg->input->nb_samples) {
+        float *start = (float *)seg->input->extended_data[ch];
+
+        memmove(start, start + seg->input_pos[ch],
+                (seg->input_size - s->min_part_size) * sizeof(*start));
+        seg->input_pos[ch] = 0;
+    }
 
-        buf = (float *)seg->buffer->extended_data[ch];
-        memcpy(buf, sum + seg->part_size, seg->part_size * sizeof(*buf));
+    for (n = 0; n < nb_samples; n++) {
+        ptr[n] += dst[n];
+    }
 
-        seg->part_index[ch] = (seg->part_index[ch] + 1) % seg->nb_partitions;
+    return 0;
+}
 
-        memmove(src, src + s->min_part_size, (seg->input_size - s->min_part_size) * sizeof(*src));
+static int fir_segment(AVFilterContext *ctx, AVFrame *out, int ch, int segment)
+{
+    AudioFIRContext *s = ctx->priv;
 
-        for (n = 0; n < nb_samples; n++) {
-            ptr[n] += dst[n];
-        }
+    for (int offset = 0; offset < out->nb_samples; offset += s->min_part_size) {
+        fir_quantum(ctx, out, ch, segment, offset);
     }
 
-    s->fdsp->vector_fmul_scalar(ptr, ptr, s->wet_gain, FFALIGN(nb_samples, 4));
-    emms_c();
-
     return 0;
 }
 
 static int fir_channel(AVFilterContext *ctx, AVFrame *out, int ch)
 {
     AudioFIRContext *s = ctx->priv;
+    float *ptr = (float *)out->extended_data[ch];
 
-    for (int offset = 0; offset < out->nb_samples; offset += s->min_part_size) {
-        fir_quantum(ctx, out, ch, offset);
+    for (int segment = 0; segment < s->nb_segments; segment++) {
+        fir_segment(ctx, out, ch, segment);
     }
 
+    s->fdsp->vector_fmul_scalar(ptr, ptr, s->wet_gain, FFALIGN(out->nb_samples, 4));
+    emms_c();
+
     return 0;
 }
 
@@ -162,10 +196,58 @@ static int fir_channels(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
     return 0;
 }
 
+/* Process every segment of every channel as a separate job, so that
+ * the expensive tail segments run in parallel with the head segments.
+ * Segments other than the first one are accumulated in their own
+ * frame and summed up in segment order by mix_segments(). */
+static int fir_segments(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    AudioFIRContext *s = ctx->priv;
+    AVFrame *out = arg;
+    const int nb_pairs = out->channels * s->nb_segments;
+    const int start = (nb_pairs * jobnr) / nb_jobs;
+    const int end = (nb_pairs * (jobnr+1)) / nb_jobs;
+
+    for (int i = start; i < end; i++) {
+        const int segment = i / out->channels;
+        const int ch = i % out->channels;
+
+        fir_segment(ctx, segment ? s->seg[segment].tmp : out, ch, segment);
+    }
+
+    return 0;
+}
+
+static int mix_segments(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    AudioFIRContext *s = ctx->priv;
+    AVFrame *out = arg;
+    const int start = (out->channels * jobnr) / nb_jobs;
+    const int end = (out->channels * (jobnr+1)) / nb_jobs;
+
+    for (int ch = start; ch < end; ch++) {
+        float *ptr = (float *)out->extended_data[ch];
+
+        for (int segment = 1; segment < s->nb_segments; segment++) {
+            const float *src = (const float *)s->seg[segment].tmp->extended_data[ch];
+
+            for (int n = 0; n < out->nb_samples; n++)
+                ptr[n] += src[n];
+        }
+
+        s->fdsp->vector_fmul_scalar(ptr, ptr, s->wet_gain, FFALIGN(out->nb_samples, 4));
+        emms_c();
+    }
+
+    return 0;
+}
+
 static int fir_frame(AudioFIRContext *s, AVFrame *in, AVFilterLink *outlink)
 {
     AVFilterContext *ctx = outlink->src;
+    const int nb_threads = ff_filter_get_nb_threads(ctx);
     AVFrame *out = NULL;
+    int ret = 0;
 
     out = ff_get_audio_buffer(outlink, in->nb_samples);
     if (!out) {
@@ -176,16 +258,40 @@ static int fir_frame(AudioFIRContext *s, AVFrame *in, AVFilterLink *outlink)
     if (s->pts == AV_NOPTS_VALUE)
         s->pts = in->pts;
     s->in[0] = in;
-    ctx->internal->execute(ctx, fir_channels, out, NULL, FFMIN(outlink->channels,
-                                                               ff_filter_get_nb_threads(ctx)));
+
+    if (s->nb_segments > 1 && nb_threads > outlink->channels) {
+        for (int segment = 1; segment < s->nb_segments; segment++) {
+            s->seg[segment].tmp = ff_get_audio_buffer(outlink, in->nb_samples);
+            if (!s->seg[segment].tmp) {
+                ret = AVERROR(ENOMEM);
+                goto fail;
+            }
+        }
+
+        ctx->internal->execute(ctx, fir_segments, out, NULL, FFMIN(outlink->channels * s->nb_segments,
+                                                                   nb_threads));
+        ctx->internal->execute(ctx, mix_segments, out, NULL, FFMIN(outlink->channels,
+                                                                   nb_threads));
+    } else {
+        ctx->internal->execute(ctx, fir_channels, out, NULL, FFMIN(outlink->channels,
+                                                                   nb_threads));
+    }
 
     out->pts = s->pts;
     if (s->pts != AV_NOPTS_VALUE)
         s->pts += av_rescale_q(out->nb_samples, (AVRational){1, outlink->sample_rate}, outlink->time_base);
 
+fail:
+    for (int segment = 1; segment < s->nb_segments; segment++)
+        av_frame_free(&s->seg[segment].tmp);
     av_frame_free(&in);
     s->in[0] = NULL;
 
+    if (ret < 0) {
+        av_frame_free(&out);
+        return ret;
+    }
+
     return ff_filter_frame(outlink, out);
 }
 
@@ -347,7 +453,8 @@ static int init_segment(AVFilterContext *ctx, AudioFIRSegment *seg,
 
     seg->part_index    = av_calloc(ctx->inputs[0]->channels, sizeof(*seg->part_index));
     seg->output_offset = av_calloc(ctx->inputs[0]->channels, sizeof(*seg->output_offset));
-    if (!seg->part_index || !seg->output_offset)
+    seg->input_pos     = av_calloc(ctx->inputs[0]->channels, sizeof(*seg->input_pos));
+    if (!seg->part_index || !seg->output_offset || !seg->input_pos)
         return AVERROR(ENOMEM);
 
     for (int ch = 0; ch < ctx->inputs[0]->channels; ch++) {
@@ -361,7 +468,7 @@ static int init_segment(AVFilterContext *ctx, AudioFIRSegment *seg,
     seg->block  = ff_get_audio_buffer(ctx->inputs[0], seg->nb_partitions * seg->block_size);
     seg->buffer = ff_get_audio_buffer(ctx->inputs[0], seg->part_size);
     seg->coeff  = ff_get_audio_buffer(ctx->inputs[1], seg->nb_partitions * seg->coeff_size * 2);
-    seg->input  = ff_get_audio_buffer(ctx->inputs[0], seg->input_size);
+    seg->input  = ff_get_audio_buffer(ctx->inputs[0], seg->input_size * 2);
     seg->output = ff_get_audio_buffer(ctx->inputs[0], seg->part_size);
     if (!seg->buffer || !seg->sum || !seg->block || !seg->coeff || !seg->input || !seg->output)
         return AVERROR(ENOMEM);
@@ -369,12 +476,114 @@ static int init_segment(AVFilterContext *ctx, AudioFIRSegment *seg,
     return 0;
 }
 
+static void free_coeffs(AudioFIRCoeffs *c)
+{
+    if (c->coeff) {
+        for (int i = 0; i < c->nb_segments; i++)
+            av_frame_free(&c->coeff[i]);
+    }
+    av_freep(&c->coeff);
+    av_freep(&c->time);
+    av_free(c);
+}
+
+/* must be called with coeffs_cache_lock held */
+static AudioFIRCoeffs *find_coeffs(const AudioFIRCoeffs *key)
+{
+    AudioFIRCoeffs *c;
+
+    for (c = coeffs_cache; c; c = c->next) {
+        if (c->nb_taps       == key->nb_taps &&
+            c->nb_channels   == key->nb_channels &&
+            c->min_part_size == key->min_part_size &&
+            c->max_part_size == key->max_part_size &&
+            !memcmp(c->time, key->time, key->nb_channels * key->nb_taps * sizeof(*c->time)))
+            break;
+    }
+
+    return c;
+}
+
+static void release_coeffs(AudioFIRCoeffs *c)
+{
+    if (!c)
+        return;
+
+    ff_mutex_lock(&coeffs_cache_lock);
+    if (!--c->refcount) {
+        AudioFIRCoeffs **p = &coeffs_cache;
+
+        while (*p != c)
+            p = &(*p)->next;
+        *p = c->next;
+        free_coeffs(c);
+    }
+    ff_mutex_unlock(&coeffs_cache_lock);
+}
+
+static int share_coeffs(AVFilterContext *ctx, AudioFIRCoeffs *c)
+{
+    AudioFIRContext *s = ctx->priv;
+
+    for (int segment = 0; segment < s->nb_segments; segment++) {
+        AudioFIRSegment *seg = &s->seg[segment];
+
+        av_frame_free(&seg->coeff);
+        seg->coeff = av_frame_clone(c->coeff[segment]);
+        if (!seg->coeff)
+            return AVERROR(ENOMEM);
+    }
+
+    return 0;
+}
+
+/**
+ * Publish the coefficients just computed, unless another instance did so
+ * for the same IR in the meantime, in which case its coefficients are used
+ * instead. The transforms are done without holding the lock.
+ */
+static int publish_coeffs(AVFilterContext *ctx, AudioFIRCoeffs *key)
+{
+    AudioFIRContext *s = ctx->priv;
+    AudioFIRCoeffs *c;
+
+    key->nb_segments = s->nb_segments;
+    key->coeff = av_calloc(s->nb_segments, sizeof(*key->coeff));
+    if (!key->coeff)
+        return AVERROR(ENOMEM);
+    for (int segment = 0; segment < s->nb_segments; segment++) {
+        key->coeff[segment] = av_frame_clone(s->seg[segment].coeff);
+        if (!key->coeff[segment])
+            return AVERROR(ENOMEM);
+    }
+
+    ff_mutex_lock(&coeffs_cache_lock);
+    c = find_coeffs(key);
+    if (c) {
+        c->refcount++;
+    } else {
+        key->refcount = 1;
+        key->next     = coeffs_cache;
+        coeffs_cache  = c = key;
+    }
+    ff_mutex_unlock(&coeffs_cache_lock);
+
+    s->coeffs = c;
+    if (c != key) {
+        free_coeffs(key);
+        return share_coeffs(ctx, c);
+    }
+
+    return 0;
+}
+
 static int convert_coeffs(AVFilterContext *ctx)
 {
     AudioFIRContext *s = ctx->priv;
     int left, offset = 0, part_size, max_part_size;
     int ret, i, ch, n;
     float power = 0;
+    AudioFIRCoeffs *key, *shared;
 
     s->nb_taps = ff_inlink_queued_samples(ctx->inputs[1]);
     if (s->nb_taps <= 0)
@@ -461,12 +670,73 @@ static int convert_coeffs(AVFilterContext *ctx)
     av_log(ctx, AV_LOG_DEBUG, "nb_taps: %d\n", s->nb_taps);
     av_log(ctx, AV_LOG_DEBUG, "nb_segments: %d\n", s->nb_segments);
 
+    s->coeff_map = av_calloc(s->nb_channels, sizeof(*s->coeff_map));
+    if (!s->coeff_map)
+        return AVERROR(ENOMEM);
+
+    key = av_mallocz(sizeof(*key));
+    if (!key)
+        return AVERROR(ENOMEM);
+    key->nb_taps       = s->nb_taps;
+    key->nb_channels   = ctx->inputs[1]->channels;
+    key->min_part_size = s->min_part_size;
+    key->max_part_size = max_part_size;
+    key->time = av_malloc_array(key->nb_channels * s->nb_taps, sizeof(*key->time));
+    if (!key->time) {
+        free_coeffs(key);
+        return AVERROR(ENOMEM);
+    }
+
     for (ch = 0; ch < ctx->inputs[1]->channels; ch++) {
         float *time = (float *)s->in[1]->extended_data[!s->one2many * ch];
-        int toffset = 0;
 
         for (i = FFMAX(1, s->length * s->nb_taps); i < s->nb_taps; i++)
             time[i] = 0;
+        memcpy(key->time + ch * s->nb_taps, time, s->nb_taps * sizeof(*time));
+    }
+
+    /* other instances may have transformed the same IR already */
+    ff_mutex_lock(&coeffs_cache_lock);
+    shared = find_coeffs(key);
+    if (shared)
+        shared->refcount++;
+    ff_mutex_unlock(&coeffs_cache_lock);
+
+    if (shared) {
+        av_log(ctx, AV_LOG_DEBUG, "Reusing already computed coefficients.\n");
+        free_coeffs(key);
+        key = NULL;
+        s->coeffs = shared;
+        ret = share_coeffs(ctx, shared);
+        if (ret < 0)
+            return ret;
+    }
+
+    for (ch = 0; ch < ctx->inputs[1]->channels; ch++) {
+        float *time = (float *)s->in[1]->extended_data[!s->one2many * ch];
+        int toffset = 0;
+
+        s->coeff_map[ch] = ch;
+
+        /* Channels with the same IR share one set of coefficients. */
+        for (i = 0; i < ch; i++) {
+            const float *prev = (const float *)s->in[1]->extended_data[i];
+
+            if (s->coeff_map[i] == i &&
+                !memcmp(prev, time, s->nb_taps * sizeof(*time))) {
+                s->coeff_map[ch] = i;
+                break;
+            }
+        }
+
+        if (s->coeff_map[ch] != ch) {
+            av_log(ctx, AV_LOG_DEBUG, "channel: %d shares IR of channel: %d\n",
+                   ch, s->coeff_map[ch]);
+            continue;
+        }
+
+        if (shared)
+            continue;
 
         av_log(ctx, AV_LOG_DEBUG, "channel: %d\n", ch);
 
@@ -510,6 +780,15 @@ static int convert_coeffs(AVFilterContext *ctx)
         }
     }
 
+    if (key) {
+        ret = publish_coeffs(ctx, key);
+        if (ret < 0) {
+            if (!s->coeffs)
+                free_coeffs(key);
+            return ret;
+        }
+    }
+
     av_frame_free(&s->in[1]);
     s->have_coeffs = 1;
 
@@ -708,6 +987,7 @@ static void uninit_segment(AVFilterContext *ctx, AudioFIRSegment *seg)
 
     av_freep(&seg->output_offset);
     av_freep(&seg->part_index);
+    av_freep(&seg->input_pos);
 
     av_frame_free(&seg->block);
     av_frame_free(&seg->sum);
@@ -715,6 +995,7 @@ static void uninit_segment(AVFilterContext *ctx, AudioFIRSegment *seg)
     av_frame_free(&seg->coeff);
     av_frame_free(&seg->input);
     av_frame_free(&seg->output);
+    av_frame_free(&seg->tmp);
     seg->input_size = 0;
 }
 
@@ -726,7 +1007,11 @@ static av_cold void uninit(AVFilterContext *ctx)
         uninit_segment(ctx, &s->seg[i]);
     }
 
+    release_coeffs(s->coeffs);
+    s->coeffs = NULL;
+
     av_freep(&s->fdsp);
+    av_freep(&s->coeff_map);
     av_frame_free(&s->in[1]);
 
     for (int i = 0; i < ctx->nb_outputs; i++)
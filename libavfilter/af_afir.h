@@ -42,6 +42,7 @@ typedef struct AudioFIRSegment {
 
     int *output_offset;
     int *part_index;
+    int *input_pos;
 
     AVFrame *sum;
     AVFrame *block;
@@ -49,6 +50,7 @@ typedef struct AudioFIRSegment {
     AVFrame *coeff;
     AVFrame *input;
     AVFrame *output;
+    AVFrame *tmp;
 
     RDFTContext **rdft, **irdft;
 } AudioFIRSegment;
@@ -83,6 +85,8 @@ typedef struct AudioFIRContext {
     int nb_channels;
     int nb_coef_channels;
     int one2many;
+    int *coeff_map;
+    struct AudioFIRCoeffs *coeffs;
 
     AudioFIRSegment seg[1024];
     int nb_segments;
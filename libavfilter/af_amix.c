@@ -173,6 +173,8 @@ typedef struct MixContext {
     float *weights;             /**< custom weights for every input */
     float weight_sum;           /**< sum of custom weights for every input */
     float *scale_norm;          /**< normalization factor for every input */
+    uint8_t **mix_data;         /**< samples read from an input */
+    int mix_samples;            /**< allocated size of mix_data, in samples */
     int64_t next_pts;           /**< calculated pts for next output frame */
     FrameList *frame_list;      /**< list of frame info for the first input */
 } MixContext;
@@ -289,8 +291,8 @@ static int output_frame(AVFilterLink *outlink)
 {
     AVFilterContext *ctx = outlink->src;
     MixContext      *s = ctx->priv;
-    AVFrame *out_buf, *in_buf;
-    int nb_samples, ns, i;
+    AVFrame *out_buf;
+    int nb_samples, ns, i, ret;
 
     if (s->input_state[0] & INPUT_ON) {
         /* first input live: use the corresponding frame size */
@@ -330,22 +332,31 @@ static int output_frame(AVFilterLink *outlink)
     if (nb_samples == 0)
         return 0;
 
+    if (nb_samples > s->mix_samples) {
+        if (s->mix_data)
+            av_freep(&s->mix_data[0]);
+        av_freep(&s->mix_data);
+        /* the default alignment pads the planes to a multiple of 32 samples,
+         * which covers the aligned length used by the dsp functions */
+        ret = av_samples_alloc_array_and_samples(&s->mix_data, NULL,
+                                                 s->nb_channels, nb_samples,
+                                                 outlink->format, 0);
+        if (ret < 0) {
+            s->mix_samples = 0;
+            return ret;
+        }
+        s->mix_samples = nb_samples;
+    }
+
     out_buf = ff_get_audio_buffer(outlink, nb_samples);
     if (!out_buf)
         return AVERROR(ENOMEM);
 
-    in_buf = ff_get_audio_buffer(outlink, nb_samples);
-    if (!in_buf) {
-        av_frame_free(&out_buf);
-        return AVERROR(ENOMEM);
-    }
-
     for (i = 0; i < s->nb_inputs; i++) {
         if (s->input_state[i] & INPUT_ON) {
             int planes, plane_size, p;
 
-            av_audio_fifo_read(s->fifos[i], (void **)in_buf->extended_data,
-                               nb_samples);
+            av_audio_fifo_read(s->fifos[i], (void **)s->mix_data, nb_samples);
 
             planes     = s->planar ? s->nb_channels : 1;
             plane_size = nb_samples * (s->planar ? 1 : s->nb_channels);
@@ -355,19 +366,18 @@ static int output_frame(AVFilterLink *outlink)
                 out_buf->format == AV_SAMPLE_FMT_FLTP) {
                 for (p = 0; p < planes; p++) {
                     s->fdsp->vector_fmac_scalar((float *)out_buf->extended_data[p],
-                                                (float *) in_buf->extended_data[p],
+                                                (float *)s->mix_data[p],
                                                 s->input_scale[i], plane_size);
                 }
             } else {
                 for (p = 0; p < planes; p++) {
                     s->fdsp->vector_dmac_scalar((double *)out_buf->extended_data[p],
-                                                (double *) in_buf->extended_data[p],
+                                                (double *)s->mix_data[p],
                                                 s->input_scale[i], plane_size);
                 }
             }
         }
     }
-    av_frame_free(&in_buf);
 
     out_buf->pts = s->next_pts;
     if (s->next_pts != AV_NOPTS_VALUE)
@@ -376,6 +386,25 @@ static int output_frame(AVFilterLink *outlink)
     return ff_filter_frame(outlink, out_buf);
 }
 
+/**
+ * Send a frame of the only active input, whose scale is 1, to the output
+ * link without mixing it, with the timestamp output_frame() would give it.
+ */
+static int forward_frame(AVFilterLink *outlink, AVFrame *buf)
+{
+    AVFilterContext *ctx = outlink->src;
+    MixContext      *s = ctx->priv;
+
+    s->next_pts = frame_list_next_pts(s->frame_list);
+    frame_list_remove_samples(s->frame_list, buf->nb_samples);
+
+    buf->pts = s->next_pts;
+    if (s->next_pts != AV_NOPTS_VALUE)
+        s->next_pts += buf->nb_samples;
+
+    return ff_filter_frame(outlink, buf);
+}
+
 /**
  * Requests a frame, if needed, from each input link other than the first.
  */
@@ -441,6 +470,14 @@ static int activate(AVFilterContext *ctx)
                 }
             }
 
+            if (s->active_inputs == 1 && s->input_state[i] == INPUT_ON &&
+                !av_audio_fifo_size(s->fifos[i]) && s->scale_norm[i] == 1.0f) {
+                ret = forward_frame(outlink, buf);
+                if (ret < 0)
+                    return ret;
+                continue;
+            }
+
             ret = av_audio_fifo_write(s->fifos[i], (void **)buf->extended_data,
                                       buf->nb_samples);
             if (ret < 0) {
@@ -568,6 +605,9 @@ static av_cold void uninit(AVFilterContext *ctx)
     av_freep(&s->scale_norm);
     av_freep(&s->weights);
     av_freep(&s->fdsp);
+    if (s->mix_data)
+        av_freep(&s->mix_data[0]);
+    av_freep(&s->mix_data);
 
     for (i = 0; i < ctx->nb_inputs; i++)
         av_freep(&ctx->input_pads[i].name);
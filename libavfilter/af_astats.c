@@ -55,6 +55,20 @@
 
 #define MEASURE_MINMAXPEAK              (MEASURE_MIN_LEVEL | MEASURE_MAX_LEVEL | MEASURE_PEAK_LEVEL)
 
+/* groups of entries sharing the same accumulators */
+#define MEASURE_MINMAX                  (MEASURE_MINMAXPEAK | MEASURE_CREST_FACTOR | MEASURE_DYNAMIC_RANGE)
+#define MEASURE_PEAKS                   (MEASURE_FLAT_FACTOR | MEASURE_PEAK_COUNT)
+#define MEASURE_SIGMA                   (MEASURE_DC_OFFSET | MEASURE_RMS_LEVEL | MEASURE_CREST_FACTOR | \
+                                         MEASURE_RMS_PEAK | MEASURE_RMS_TROUGH)
+#define MEASURE_RMS_WINDOW              (MEASURE_RMS_PEAK | MEASURE_RMS_TROUGH)
+#define MEASURE_DIFFERENCES             (MEASURE_MIN_DIFFERENCE | MEASURE_MAX_DIFFERENCE | \
+                                         MEASURE_MEAN_DIFFERENCE | MEASURE_RMS_DIFFERENCE)
+#define MEASURE_CROSSINGS               (MEASURE_ZERO_CROSSINGS | MEASURE_ZERO_CROSSINGS_RATE)
+#define MEASURE_FP_CLASSES              (MEASURE_NUMBER_OF_NANS | MEASURE_NUMBER_OF_INFS | \
+                                         MEASURE_NUMBER_OF_DENORMALS)
+#define MEASURE_ALL_BLOCK               (MEASURE_MINMAX | MEASURE_PEAKS | MEASURE_SIGMA | \
+                                         MEASURE_RMS_WINDOW | MEASURE_DIFFERENCES | MEASURE_CROSSINGS)
+
 typedef struct ChannelStats {
     double last;
     double last_non_zero;
@@ -92,6 +106,8 @@ typedef struct AudioStatsContext {
     int measure_overall;
     int is_float;
     int is_double;
+    double *buf;                ///< samples of the channel being measured
+    unsigned int buf_size;
 } AudioStatsContext;
 
 #define OFFSET(x) offsetof(AudioStatsContext, x)
@@ -239,68 +255,143 @@ static void bit_depth(AudioStatsContext *s, uint64_t mask, uint64_t imask, AVRat
             depth->num++;
 }
 
-static inline void update_minmax(AudioStatsContext *s, ChannelStats *p, double d)
+/**
+ * Update the accumulators of the selected entries with a block of samples
+ * of one channel, keeping them in local variables. Every accumulator is
+ * updated in the same order as sample by sample, so the results do not
+ * depend on the block size.
+ */
+static av_always_inline void update_block(AudioStatsContext *s, ChannelStats *p,
+                                          const double *d, double norm,
+                                          int nb_samples, const int measure)
 {
-    if (d < p->min)
-        p->min = d;
-    if (d > p->max)
-        p->max = d;
-}
+    double last = p->last, min = p->min, max = p->max;
+    double min_run = p->min_run, max_run = p->max_run;
+    double min_runs = p->min_runs, max_runs = p->max_runs;
+    double min_non_zero = p->min_non_zero, last_non_zero = p->last_non_zero;
+    double sigma_x = p->sigma_x, sigma_x2 = p->sigma_x2;
+    double avg_sigma_x2 = p->avg_sigma_x2;
+    double min_sigma_x2 = p->min_sigma_x2, max_sigma_x2 = p->max_sigma_x2;
+    double min_diff = p->min_diff, max_diff = p->max_diff;
+    double diff1_sum = p->diff1_sum, diff1_sum_x2 = p->diff1_sum_x2;
+    uint64_t min_count = p->min_count, max_count = p->max_count;
+    uint64_t zero_runs = p->zero_runs;
+    int n;
+
+    for (n = 0; n < nb_samples; n++) {
+        const double x = d[n];
+
+        if (measure & MEASURE_PEAKS) {
+            if (x < min) {
+                min = x;
+                min_run = 1;
+                min_runs = 0;
+                min_count = 1;
+            } else if (x == min) {
+                min_count++;
+                min_run = x == last ? min_run + 1 : 1;
+            } else if (last == min) {
+                min_runs += min_run * min_run;
+            }
+
+            if (x > max) {
+                max = x;
+                max_run = 1;
+                max_runs = 0;
+                max_count = 1;
+            } else if (x == max) {
+                max_count++;
+                max_run = x == last ? max_run + 1 : 1;
+            } else if (last == max) {
+                max_runs += max_run * max_run;
+            }
+        } else if (measure & MEASURE_MINMAX) {
+            if (x < min)
+                min = x;
+            if (x > max)
+                max = x;
+        }
 
-static inline void update_stat(AudioStatsContext *s, ChannelStats *p, double d, double nd, int64_t i)
-{
-    if (d < p->min) {
-        p->min = d;
-        p->nmin = nd;
-        p->min_run = 1;
-        p->min_runs = 0;
-        p->min_count = 1;
-    } else if (d == p->min) {
-        p->min_count++;
-        p->min_run = d == p->last ? p->min_run + 1 : 1;
-    } else if (p->last == p->min) {
-        p->min_runs += p->min_run * p->min_run;
-    }
+        if (measure & MEASURE_DYNAMIC_RANGE) {
+            if (x != 0 && FFABS(x) < min_non_zero)
+                min_non_zero = FFABS(x);
+        }
 
-    if (d != 0 && FFABS(d) < p->min_non_zero)
-        p->min_non_zero = FFABS(d);
+        if (measure & MEASURE_CROSSINGS) {
+            if (x != 0) {
+                zero_runs += FFSIGN(x) != FFSIGN(last_non_zero);
+                last_non_zero = x;
+            }
+        }
 
-    if (d > p->max) {
-        p->max = d;
-        p->nmax = nd;
-        p->max_run = 1;
-        p->max_runs = 0;
-        p->max_count = 1;
-    } else if (d == p->max) {
-        p->max_count++;
-        p->max_run = d == p->last ? p->max_run + 1 : 1;
-    } else if (p->last == p->max) {
-        p->max_runs += p->max_run * p->max_run;
-    }
+        if (measure & (MEASURE_SIGMA | MEASURE_RMS_WINDOW)) {
+            const double nd = x / norm;
+
+            sigma_x += nd;
+            sigma_x2 += nd * nd;
+            if (measure & MEASURE_RMS_WINDOW) {
+                avg_sigma_x2 = avg_sigma_x2 * s->mult + (1.0 - s->mult) * nd * nd;
+                if (p->nb_samples + n >= s->tc_samples) {
+                    max_sigma_x2 = FFMAX(max_sigma_x2, avg_sigma_x2);
+                    min_sigma_x2 = FFMIN(min_sigma_x2, avg_sigma_x2);
+                }
+            }
+        }
 
-    if (d != 0) {
-        p->zero_runs += FFSIGN(d) != FFSIGN(p->last_non_zero);
-        p->last_non_zero = d;
-    }
+        if (measure & MEASURE_DIFFERENCES) {
+            if (!isnan(last)) {
+                min_diff = FFMIN(min_diff, fabs(x - last));
+                max_diff = FFMAX(max_diff, fabs(x - last));
+                diff1_sum += fabs(x - last);
+                diff1_sum_x2 += (x - last) * (x - last);
+            }
+        }
 
-    p->sigma_x += nd;
-    p->sigma_x2 += nd * nd;
-    p->avg_sigma_x2 = p->avg_sigma_x2 * s->mult + (1.0 - s->mult) * nd * nd;
-    if (!isnan(p->last)) {
-        p->min_diff = FFMIN(p->min_diff, fabs(d - p->last));
-        p->max_diff = FFMAX(p->max_diff, fabs(d - p->last));
-        p->diff1_sum += fabs(d - p->last);
-        p->diff1_sum_x2 += (d - p->last) * (d - p->last);
+        last = x;
     }
-    p->last = d;
-    p->mask |= i;
-    p->imask &= i;
 
-    if (p->nb_samples >= s->tc_samples) {
-        p->max_sigma_x2 = FFMAX(p->max_sigma_x2, p->avg_sigma_x2);
-        p->min_sigma_x2 = FFMIN(p->min_sigma_x2, p->avg_sigma_x2);
+    if (min < p->min) {
+        p->min  = min;
+        p->nmin = min / norm;
+    }
+    if (max > p->max) {
+        p->max  = max;
+        p->nmax = max / norm;
     }
-    p->nb_samples++;
+    p->min_run       = min_run;
+    p->max_run       = max_run;
+    p->min_runs      = min_runs;
+    p->max_runs      = max_runs;
+    p->min_count     = min_count;
+    p->max_count     = max_count;
+    p->min_non_zero  = min_non_zero;
+    p->last_non_zero = last_non_zero;
+    p->zero_runs     = zero_runs;
+    p->sigma_x       = sigma_x;
+    p->sigma_x2      = sigma_x2;
+    p->avg_sigma_x2  = avg_sigma_x2;
+    p->min_sigma_x2  = min_sigma_x2;
+    p->max_sigma_x2  = max_sigma_x2;
+    p->min_diff      = min_diff;
+    p->max_diff      = max_diff;
+    p->diff1_sum     = diff1_sum;
+    p->diff1_sum_x2  = diff1_sum_x2;
+    p->last          = last;
+    p->nb_samples   += nb_samples;
+}
+
+static void update_stats(AudioStatsContext *s, ChannelStats *p,
+                         const double *d, double norm, int nb_samples)
+{
+    const int measure = s->measure_overall | s->measure_perchannel;
+
+    /* specialize the common cases: everything, and levels only */
+    if ((measure & MEASURE_ALL_BLOCK) == MEASURE_ALL_BLOCK)
+        update_block(s, p, d, norm, nb_samples, MEASURE_ALL_BLOCK);
+    else if (!(measure & MEASURE_ALL_BLOCK & ~MEASURE_MINMAX))
+        update_block(s, p, d, norm, nb_samples, measure & MEASURE_MINMAX);
+    else
+        update_block(s, p, d, norm, nb_samples, measure);
 }
 
 static inline void update_float_stat(AudioStatsContext *s, ChannelStats *p, float d)
@@ -473,35 +564,31 @@ static void set_metadata(AudioStatsContext *s, AVDictionary **metadata)
         set_meta(metadata, 0, "Number of denormals", "%f", nb_denormals / (float)s->nb_channels);
 }
 
-#define UPDATE_STATS_P(type, update_func, update_float, channel_func)           \
+#define UPDATE_STATS(planar, type, normalizer, int_sample, update_float)        \
     for (int c = 0; c < channels; c++) {                                        \
         ChannelStats *p = &s->chstats[c];                                       \
-        const type *src = (const type *)data[c];                                \
-        const type * const srcend = src + samples;                              \
-        for (; src < srcend; src++) {                                           \
-            update_func;                                                        \
-            update_float;                                                       \
+        const int stride = planar ? 1 : channels;                               \
+        const type * const start  = (const type *)data[planar ? c : 0] + (planar ? 0 : c); \
+        const type * const srcend = start + samples * stride;                   \
+        const type *src;                                                        \
+        double *d = s->buf;                                                     \
+        uint64_t mask = p->mask, imask = p->imask;                              \
+                                                                                \
+        for (src = start; src < srcend; src += stride) {                        \
+            if (measure & MEASURE_BIT_DEPTH) {                                  \
+                const int64_t i = int_sample;                                   \
+                mask  |= i;                                                     \
+                imask &= i;                                                     \
+            }                                                                   \
+            if (measure & MEASURE_FP_CLASSES) {                                 \
+                update_float;                                                   \
+            }                                                                   \
+            *d++ = *src;                                                        \
         }                                                                       \
-        channel_func;                                                           \
-    }
-
-#define UPDATE_STATS_I(type, update_func, update_float, channel_func)           \
-    for (int c = 0; c < channels; c++) {                                        \
-        ChannelStats *p = &s->chstats[c];                                       \
-        const type *src = (const type *)data[0];                                \
-        const type * const srcend = src + samples * channels;                   \
-        for (src += c; src < srcend; src += channels) {                         \
-            update_func;                                                        \
-            update_float;                                                       \
-        }                                                                       \
-        channel_func;                                                           \
-    }
-
-#define UPDATE_STATS(planar, type, sample, normalizer_suffix, int_sample) \
-    if ((s->measure_overall | s->measure_perchannel) & ~MEASURE_MINMAXPEAK) {                          \
-        UPDATE_STATS_##planar(type, update_stat(s, p, sample, sample normalizer_suffix, int_sample), s->is_float ? update_float_stat(s, p, sample) : s->is_double ? update_double_stat(s, p, sample) : (void)NULL, ); \
-    } else {                                                                                           \
-        UPDATE_STATS_##planar(type, update_minmax(s, p, sample), , p->nmin = p->min normalizer_suffix; p->nmax = p->max normalizer_suffix;); \
+        p->mask  = mask;                                                        \
+        p->imask = imask;                                                       \
+                                                                                \
+        update_stats(s, p, s->buf, normalizer, samples);                        \
     }
 
 static int filter_frame(AVFilterLink *inlink, AVFrame *buf)
@@ -511,6 +598,7 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *buf)
     const int channels = s->nb_channels;
     const int samples = buf->nb_samples;
     const uint8_t * const * const data = (const uint8_t * const *)buf->extended_data;
+    const int measure = s->measure_overall | s->measure_perchannel;
 
     if (s->reset_count > 0) {
         if (s->nb_frames >= s->reset_count) {
@@ -520,36 +608,42 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *buf)
         s->nb_frames++;
     }
 
+    av_fast_malloc(&s->buf, &s->buf_size, samples * sizeof(*s->buf));
+    if (!s->buf) {
+        av_frame_free(&buf);
+        return AVERROR(ENOMEM);
+    }
+
     switch (inlink->format) {
     case AV_SAMPLE_FMT_DBLP:
-        UPDATE_STATS(P, double, *src, , llrint(*src * (UINT64_C(1) << 63)));
+        UPDATE_STATS(1, double, 1.0, llrint(*src * (UINT64_C(1) << 63)), update_double_stat(s, p, *src));
         break;
     case AV_SAMPLE_FMT_DBL:
-        UPDATE_STATS(I, double, *src, , llrint(*src * (UINT64_C(1) << 63)));
+        UPDATE_STATS(0, double, 1.0, llrint(*src * (UINT64_C(1) << 63)), update_double_stat(s, p, *src));
         break;
     case AV_SAMPLE_FMT_FLTP:
-        UPDATE_STATS(P, float, *src, , llrint(*src * (UINT64_C(1) << 31)));
+        UPDATE_STATS(1, float, 1.0, llrint(*src * (UINT64_C(1) << 31)), update_float_stat(s, p, *src));
         break;
     case AV_SAMPLE_FMT_FLT:
-        UPDATE_STATS(I, float, *src, , llrint(*src * (UINT64_C(1) << 31)));
+        UPDATE_STATS(0, float, 1.0, llrint(*src * (UINT64_C(1) << 31)), update_float_stat(s, p, *src));
         break;
     case AV_SAMPLE_FMT_S64P:
-        UPDATE_STATS(P, int64_t, *src, / (double)INT64_MAX, *src);
+        UPDATE_STATS(1, int64_t, (double)INT64_MAX, *src, );
         break;
     case AV_SAMPLE_FMT_S64:
-        UPDATE_STATS(I, int64_t, *src, / (double)INT64_MAX, *src);
+        UPDATE_STATS(0, int64_t, (double)INT64_MAX, *src, );
         break;
     case AV_SAMPLE_FMT_S32P:
-        UPDATE_STATS(P, int32_t, *src, / (double)INT32_MAX, *src);
+        UPDATE_STATS(1, int32_t, (double)INT32_MAX, *src, );
         break;
     case AV_SAMPLE_FMT_S32:
-        UPDATE_STATS(I, int32_t, *src, / (double)INT32_MAX, *src);
+        UPDATE_STATS(0, int32_t, (double)INT32_MAX, *src, );
         break;
     case AV_SAMPLE_FMT_S16P:
-        UPDATE_STATS(P, int16_t, *src, / (double)INT16_MAX, *src);
+        UPDATE_STATS(1, int16_t, (double)INT16_MAX, *src, );
         break;
     case AV_SAMPLE_FMT_S16:
-        UPDATE_STATS(I, int16_t, *src, / (double)INT16_MAX, *src);
+        UPDATE_STATS(0, int16_t, (double)INT16_MAX, *src, );
         break;
     }
 
@@ -705,6 +799,7 @@ static av_cold void uninit(AVFilterContext *ctx)
     if (s->nb_channels)
         print_stats(ctx);
     av_freep(&s->chstats);
+    av_freep(&s->buf);
 }
 
 static const AVFilterPad astats_inputs[] = {
@@ -63,6 +63,7 @@
  */
 
 #include "libavutil/avassert.h"
+#include "libavutil/avstring.h"
 #include "libavutil/ffmath.h"
 #include "libavutil/opt.h"
 #include "audio.h"
@@ -99,6 +100,14 @@ typedef struct ChanCache {
     int clippings;
 } ChanCache;
 
+typedef struct CascadeStage {
+    double b0, b1, b2;
+    double a1, a2;              ///< negated feedback coefficients
+    double wet, dry;
+    double i1, i2;
+    double o1, o2;
+} CascadeStage;
+
 typedef struct BiquadsContext {
     const AVClass *class;
 
@@ -123,6 +132,16 @@ typedef struct BiquadsContext {
                    double *i1, double *i2, double *o1, double *o2,
                    double b0, double b1, double b2, double a1, double a2, int *clippings,
                    int disabled);
+
+    char *sections_str;
+    struct BiquadsContext *sections;
+    int nb_sections;
+    CascadeStage *stages;       ///< nb_sections stages per channel
+    int *nb_stages;             ///< number of stages used by each channel
+
+    void (*cascade)(const void *ibuf, void *obuf, int len,
+                    CascadeStage *stages, int nb_stages, int *clippings,
+                    int disabled);
 } BiquadsContext;
 
 static av_cold int init(AVFilterContext *ctx)
@@ -256,19 +275,123 @@ BIQUAD_FILTER(s32, int32_t, INT32_MIN, INT32_MAX, 1)
 BIQUAD_FILTER(flt, float,   -1., 1., 0)
 BIQUAD_FILTER(dbl, double,  -1., 1., 0)
 
-static int config_filter(AVFilterLink *outlink, int reset)
+#if CONFIG_BIQUADCHAIN_FILTER
+/* The sums are done in the same order as in biquad_*(), where the last
+ * sample of an odd-sized buffer is handled apart, so that a chain gives
+ * the same output as the filters it replaces. Stages are run in pairs,
+ * sample by sample with their state kept in registers, so that the
+ * recursions of both stages overlap. */
+#define BIQUAD_CASCADE(name, type, min, max, need_clipping)                   \
+static av_always_inline type cascade_stage_## name(const CascadeStage *st,   \
+                                                   double *i1, double *i2,   \
+                                                   double *o1, double *o2,   \
+                                                   type x, int *clippings,   \
+                                                   int disabled, int last)   \
+{                                                                             \
+    double in = x;                                                            \
+    double o0, out;                                                           \
+                                                                              \
+    if (last)                                                                 \
+        o0 = in * st->b0 + *i1 * st->b1 + *i2 * st->b2 + *o1 * st->a1 + *o2 * st->a2; \
+    else                                                                      \
+        o0 = *i2 * st->b2 + *i1 * st->b1 + in * st->b0 + *o2 * st->a2 + *o1 * st->a1; \
+    *i2 = *i1;                                                                \
+    *i1 = in;                                                                 \
+    *o2 = *o1;                                                                \
+    *o1 = o0;                                                                 \
+    out = o0 * st->wet + in * st->dry;                                        \
+                                                                              \
+    if (disabled) {                                                           \
+        return x;                                                             \
+    } else if (need_clipping && out < min) {                                  \
+        (*clippings)++;                                                       \
+        return min;                                                           \
+    } else if (need_clipping && out > max) {                                  \
+        (*clippings)++;                                                       \
+        return max;                                                           \
+    }                                                                         \
+    return out;                                                               \
+}                                                                             \
+                                                                              \
+static av_always_inline void cascade_group_## name(CascadeStage *st, int nb, \
+                                                   const type *ibuf,         \
+                                                   type *obuf, int len,      \
+                                                   int *clippings,           \
+                                                   int disabled)             \
+{                                                                             \
+    double i1[2], i2[2], o1[2], o2[2];                                        \
+    int i, n, clip = 0;                                                       \
+                                                                              \
+    for (n = 0; n < nb; n++) {                                                \
+        i1[n] = st[n].i1;                                                     \
+        i2[n] = st[n].i2;                                                     \
+        o1[n] = st[n].o1;                                                     \
+        o2[n] = st[n].o2;                                                     \
+    }                                                                         \
+                                                                              \
+    for (i = 0; i < (len & ~1); i++) {                                        \
+        type x = ibuf[i];                                                     \
+                                                                              \
+        for (n = 0; n < nb; n++)                                              \
+            x = cascade_stage_## name(&st[n], &i1[n], &i2[n], &o1[n], &o2[n], \
+                                      x, &clip, disabled, 0);                 \
+        obuf[i] = x;                                                          \
+    }                                                                         \
+    if (i < len) {                                                            \
+        type x = ibuf[i];                                                     \
+                                                                              \
+        for (n = 0; n < nb; n++)                                              \
+            x = cascade_stage_## name(&st[n], &i1[n], &i2[n], &o1[n], &o2[n], \
+                                      x, &clip, disabled, 1);                 \
+        obuf[i] = x;                                                          \
+    }                                                                         \
+                                                                              \
+    for (n = 0; n < nb; n++) {                                                \
+        st[n].i1 = i1[n];                                                     \
+        st[n].i2 = i2[n];                                                     \
+        st[n].o1 = o1[n];                                                     \
+        st[n].o2 = o2[n];                                                     \
+    }                                                                         \
+    *clippings += clip;                                                       \
+}                                                                             \
+                                                                              \
+static void cascade_## name(const void *input, void *output, int len,        \
+                            CascadeStage *stages, int nb_stages,             \
+                            int *clippings, int disabled)                    \
+{                                                                             \
+    const type *ibuf = input;                                                 \
+    type *obuf = output;                                                      \
+    int n;                                                                    \
+                                                                              \
+    if (!nb_stages && ibuf != obuf)                                           \
+        memcpy(obuf, ibuf, len * sizeof(*obuf));                              \
+                                                                              \
+    for (n = 0; n < nb_stages; n += 2) {                                      \
+        if (n + 1 < nb_stages)                                                \
+            cascade_group_## name(stages + n, 2, ibuf, obuf, len, clippings, disabled); \
+        else                                                                  \
+            cascade_group_## name(stages + n, 1, ibuf, obuf, len, clippings, disabled); \
+        ibuf = obuf;                                                          \
+    }                                                                         \
+}
+
+BIQUAD_CASCADE(s16, int16_t, INT16_MIN, INT16_MAX, 1)
+BIQUAD_CASCADE(s32, int32_t, INT32_MIN, INT32_MAX, 1)
+BIQUAD_CASCADE(flt, float,   -1., 1., 0)
+BIQUAD_CASCADE(dbl, double,  -1., 1., 0)
+#endif
+
+static int compute_coefficients(AVFilterContext *ctx, BiquadsContext *s,
+                                int sample_rate)
 {
-    AVFilterContext *ctx    = outlink->src;
-    BiquadsContext *s       = ctx->priv;
-    AVFilterLink *inlink    = ctx->inputs[0];
     double A = ff_exp10(s->gain / 40);
-    double w0 = 2 * M_PI * s->frequency / inlink->sample_rate;
+    double w0 = 2 * M_PI * s->frequency / sample_rate;
     double alpha, beta;
 
     if (w0 > M_PI) {
         av_log(ctx, AV_LOG_ERROR,
                "Invalid frequency %f. Frequency must be less than half the sample-rate %d.\n",
-               s->frequency, inlink->sample_rate);
+               s->frequency, sample_rate);
         return AVERROR(EINVAL);
     }
 
@@ -408,6 +531,20 @@ static int config_filter(AVFilterLink *outlink, int reset)
     s->b2 /= s->a0;
     s->a0 /= s->a0;
 
+    return 0;
+}
+
+static int config_filter(AVFilterLink *outlink, int reset)
+{
+    AVFilterContext *ctx    = outlink->src;
+    BiquadsContext *s       = ctx->priv;
+    AVFilterLink *inlink    = ctx->inputs[0];
+    int ret;
+
+    ret = compute_coefficients(ctx, s, inlink->sample_rate);
+    if (ret < 0)
+        return ret;
+
     s->cache = av_realloc_f(s->cache, sizeof(ChanCache), inlink->channels);
     if (!s->cache)
         return AVERROR(ENOMEM);
@@ -448,6 +585,13 @@ static int filter_channel(AVFilterContext *ctx, void *arg, int jobnr, int nb_job
     int ch;
 
     for (ch = start; ch < end; ch++) {
+        if (s->stages) {
+            s->cascade(buf->extended_data[ch], out_buf->extended_data[ch], buf->nb_samples,
+                       s->stages + ch * s->nb_sections, s->nb_stages[ch],
+                       &s->cache[ch].clippings, ctx->is_disabled);
+            continue;
+        }
+
         if (!((av_channel_layout_extract_channel(inlink->channel_layout, ch) & s->channels))) {
             if (buf != out_buf)
                 memcpy(out_buf->extended_data[ch], buf->extended_data[ch],
@@ -932,3 +1076,215 @@ static const AVOption biquad_options[] = {
 
 DEFINE_BIQUAD_FILTER(biquad, "Apply a biquad IIR filter with the given coefficients.");
 #endif  /* CONFIG_BIQUAD_FILTER */
+#if CONFIG_BIQUADCHAIN_FILTER
+static const struct {
+    const char *name;
+    enum FilterType type;
+    const AVClass *class;
+} section_types[] = {
+#if CONFIG_EQUALIZER_FILTER
+    { "equalizer",  equalizer,  &equalizer_class  },
+#endif
+#if CONFIG_BASS_FILTER
+    { "bass",       bass,       &bass_class       },
+#endif
+#if CONFIG_TREBLE_FILTER
+    { "treble",     treble,     &treble_class     },
+#endif
+#if CONFIG_BANDPASS_FILTER
+    { "bandpass",   bandpass,   &bandpass_class   },
+#endif
+#if CONFIG_BANDREJECT_FILTER
+    { "bandreject", bandreject, &bandreject_class },
+#endif
+#if CONFIG_LOWPASS_FILTER
+    { "lowpass",    lowpass,    &lowpass_class    },
+#endif
+#if CONFIG_HIGHPASS_FILTER
+    { "highpass",   highpass,   &highpass_class   },
+#endif
+#if CONFIG_ALLPASS_FILTER
+    { "allpass",    allpass,    &allpass_class    },
+#endif
+#if CONFIG_LOWSHELF_FILTER
+    { "lowshelf",   lowshelf,   &lowshelf_class   },
+#endif
+#if CONFIG_HIGHSHELF_FILTER
+    { "highshelf",  highshelf,  &highshelf_class  },
+#endif
+#if CONFIG_BIQUAD_FILTER
+    { "biquad",     biquad,     &biquad_class     },
+#endif
+};
+
+static int parse_section(AVFilterContext *ctx, BiquadsContext *sec, const char *str)
+{
+    size_t len = strcspn(str, " \n\t");
+    int i, ret;
+
+    for (i = 0; i < FF_ARRAY_ELEMS(section_types); i++) {
+        if (strlen(section_types[i].name) == len &&
+            !strncmp(section_types[i].name, str, len))
+            break;
+    }
+    if (i == FF_ARRAY_ELEMS(section_types)) {
+        av_log(ctx, AV_LOG_ERROR, "Unknown section type '%.*s'\n", (int)len, str);
+        return AVERROR(EINVAL);
+    }
+
+    sec->class       = section_types[i].class;
+    sec->filter_type = section_types[i].type;
+    av_opt_set_defaults(sec);
+    str += len + strspn(str + len, " \n\t");
+    if (*str) {
+        ret = av_set_options_string(sec, str, "=", " \n\t");
+        if (ret < 0) {
+            av_log(ctx, AV_LOG_ERROR, "Error parsing section options '%s'\n", str);
+            return ret;
+        }
+    }
+
+    if (sec->filter_type != biquad && (sec->frequency <= 0 || sec->width <= 0)) {
+        av_log(ctx, AV_LOG_ERROR, "Invalid frequency %f and/or width %f <= 0\n",
+               sec->frequency, sec->width);
+        return AVERROR(EINVAL);
+    }
+
+    return 0;
+}
+
+static av_cold int chain_init(AVFilterContext *ctx)
+{
+    BiquadsContext *s = ctx->priv;
+    char *args, *arg, *saveptr = NULL;
+    int ret = 0;
+
+    s->channels = -1;
+
+    if (!s->sections_str || !*s->sections_str) {
+        av_log(ctx, AV_LOG_ERROR, "No sections given\n");
+        return AVERROR(EINVAL);
+    }
+
+    args = av_strdup(s->sections_str);
+    if (!args)
+        return AVERROR(ENOMEM);
+
+    for (arg = av_strtok(args, "|", &saveptr); arg; arg = av_strtok(NULL, "|", &saveptr)) {
+        BiquadsContext *sec;
+
+        arg += strspn(arg, " \n\t");
+        if (!*arg)
+            continue;
+        ret = av_reallocp_array(&s->sections, s->nb_sections + 1, sizeof(*s->sections));
+        if (ret < 0) {
+            s->nb_sections = 0;
+            break;
+        }
+        sec = &s->sections[s->nb_sections++];
+        memset(sec, 0, sizeof(*sec));
+        ret = parse_section(ctx, sec, arg);
+        if (ret < 0)
+            break;
+    }
+    av_free(args);
+
+    return ret;
+}
+
+static int chain_config_output(AVFilterLink *outlink)
+{
+    AVFilterContext *ctx = outlink->src;
+    BiquadsContext *s    = ctx->priv;
+    AVFilterLink *inlink = ctx->inputs[0];
+    int ch, i, ret;
+
+    av_freep(&s->stages);
+    av_freep(&s->nb_stages);
+    av_freep(&s->cache);
+    s->stages    = av_calloc(inlink->channels * s->nb_sections, sizeof(*s->stages));
+    s->nb_stages = av_calloc(inlink->channels, sizeof(*s->nb_stages));
+    s->cache     = av_calloc(inlink->channels, sizeof(*s->cache));
+    if (!s->stages || !s->nb_stages || !s->cache)
+        return AVERROR(ENOMEM);
+
+    for (i = 0; i < s->nb_sections; i++) {
+        BiquadsContext *sec = &s->sections[i];
+
+        ret = compute_coefficients(ctx, sec, inlink->sample_rate);
+        if (ret < 0)
+            return ret;
+
+        for (ch = 0; ch < inlink->channels; ch++) {
+            CascadeStage *st = &s->stages[ch * s->nb_sections + s->nb_stages[ch]];
+
+            if (!(av_channel_layout_extract_channel(inlink->channel_layout, ch) & sec->channels))
+                continue;
+
+            st->b0  =  sec->b0;
+            st->b1  =  sec->b1;
+            st->b2  =  sec->b2;
+            st->a1  = -sec->a1;
+            st->a2  = -sec->a2;
+            st->wet =  sec->mix;
+            st->dry =  1. - sec->mix;
+            s->nb_stages[ch]++;
+        }
+    }
+
+    switch (inlink->format) {
+    case AV_SAMPLE_FMT_S16P: s->cascade = cascade_s16; break;
+    case AV_SAMPLE_FMT_S32P: s->cascade = cascade_s32; break;
+    case AV_SAMPLE_FMT_FLTP: s->cascade = cascade_flt; break;
+    case AV_SAMPLE_FMT_DBLP: s->cascade = cascade_dbl; break;
+    default: av_assert0(0);
+    }
+
+    s->block_align = av_get_bytes_per_sample(inlink->format);
+
+    return 0;
+}
+
+static av_cold void chain_uninit(AVFilterContext *ctx)
+{
+    BiquadsContext *s = ctx->priv;
+    int i;
+
+    for (i = 0; i < s->nb_sections; i++)
+        av_opt_free(&s->sections[i]);
+    av_freep(&s->sections);
+    av_freep(&s->stages);
+    av_freep(&s->nb_stages);
+    av_freep(&s->cache);
+}
+
+static const AVFilterPad chain_outputs[] = {
+    {
+        .name         = "default",
+        .type         = AVMEDIA_TYPE_AUDIO,
+        .config_props = chain_config_output,
+    },
+    { NULL }
+};
+
+static const AVOption biquadchain_options[] = {
+    {"sections", "set the list of sections", OFFSET(sections_str), AV_OPT_TYPE_STRING, {.str=NULL}, 0, 0, FLAGS},
+    {"s",        "set the list of sections", OFFSET(sections_str), AV_OPT_TYPE_STRING, {.str=NULL}, 0, 0, FLAGS},
+    {NULL}
+};
+
+AVFILTER_DEFINE_CLASS(biquadchain);
+
+AVFilter ff_af_biquadchain = {
+    .name          = "biquadchain",
+    .description   = NULL_IF_CONFIG_SMALL("Apply a chain of biquad filters."),
+    .priv_size     = sizeof(BiquadsContext),
+    .priv_class    = &biquadchain_class,
+    .init          = chain_init,
+    .uninit        = chain_uninit,
+    .query_formats = query_formats,
+    .inputs        = inputs,
+    .outputs       = chain_outputs,
+    .flags         = AVFILTER_FLAG_SLICE_THREADS | AVFILTER_FLAG_SUPPORT_TIMELINE_INTERNAL,
+};
+#endif  /* CONFIG_BIQUADCHAIN_FILTER */
@@ -72,10 +72,11 @@ typedef struct HeadphoneContext {
     int *delay[2];
     float *data_ir[2];
     float *temp_src[2];
-    FFTComplex *temp_fft[2];
+    FFTComplex *temp_fft;
     FFTComplex *temp_afft[2];
 
-    FFTContext *fft[2], *ifft[2];
+    int nb_fft_jobs;
+    FFTContext **fft, *ifft[2];
     FFTComplex *data_hrtf[2];
 
     AVFloatDSPContext *fdsp;
@@ -158,7 +159,6 @@ typedef struct ThreadData {
     int *n_clippings;
     float **ringbuffer;
     float **temp_src;
-    FFTComplex **temp_fft;
     FFTComplex **temp_afft;
 } ThreadData;
 
@@ -236,6 +236,38 @@ static int headphone_convolute(AVFilterContext *ctx, void *arg, int jobnr, int n
     return 0;
 }
 
+static int headphone_fft_input(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    HeadphoneContext *s = ctx->priv;
+    ThreadData *td = arg;
+    AVFrame *in = td->in;
+    const float *src = (const float *)in->data[0];
+    const int in_channels = in->channels;
+    const int start = (in_channels * jobnr) / nb_jobs;
+    const int end = (in_channels * (jobnr+1)) / nb_jobs;
+    FFTContext *fft = s->fft[jobnr];
+    const int n_fft = s->n_fft;
+    int i, j;
+
+    for (i = start; i < end; i++) {
+        FFTComplex *fft_in = s->temp_fft + i * n_fft;
+
+        if (i == s->lfe_channel)
+            continue;
+
+        memset(fft_in, 0, sizeof(FFTComplex) * n_fft);
+
+        for (j = 0; j < in->nb_samples; j++) {
+            fft_in[j].re = src[j * in_channels + i];
+        }
+
+        av_fft_permute(fft, fft_in);
+        av_fft_calc(fft, fft_in);
+    }
+
+    return 0;
+}
+
 static int headphone_fast_convolute(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
 {
     HeadphoneContext *s = ctx->priv;
@@ -252,10 +284,8 @@ static int headphone_fast_convolute(AVFilterContext *ctx, void *arg, int jobnr,
     const int in_channels = in->channels;
     const int buffer_length = s->buffer_length;
     const uint32_t modulo = (uint32_t)buffer_length - 1;
-    FFTComplex *fft_in = s->temp_fft[jobnr];
     FFTComplex *fft_acc = s->temp_afft[jobnr];
     FFTContext *ifft = s->ifft[jobnr];
-    FFTContext *fft = s->fft[jobnr];
     const int n_fft = s->n_fft;
     const float fft_scale = 1.0f / s->n_fft;
     FFTComplex *hrtf_offset;
@@ -279,6 +309,8 @@ static int headphone_fast_convolute(AVFilterContext *ctx, void *arg, int jobnr,
     memset(fft_acc, 0, sizeof(FFTComplex) * n_fft);
 
     for (i = 0; i < in_channels; i++) {
+        const FFTComplex *fft_in = s->temp_fft + i * n_fft;
+
         if (i == s->lfe_channel) {
             for (j = 0; j < in->nb_samples; j++) {
                 dst[2 * j] += src[i + j * in_channels] * s->gain_lfe;
@@ -289,14 +321,6 @@ static int headphone_fast_convolute(AVFilterContext *ctx, void *arg, int jobnr,
         offset = i * n_fft;
         hrtf_offset = hrtf + offset;
 
-        memset(fft_in, 0, sizeof(FFTComplex) * n_fft);
-
-        for (j = 0; j < in->nb_samples; j++) {
-            fft_in[j].re = src[j * in_channels + i];
-        }
-
-        av_fft_permute(fft, fft_in);
-        av_fft_calc(fft, fft_in);
         for (j = 0; j < n_fft; j++) {
             const FFTComplex *hcomplex = hrtf_offset + j;
             const float re = fft_in[j].re;
@@ -368,12 +392,13 @@ static int headphone_frame(HeadphoneContext *s, AVFrame *in, AVFilterLink *outli
     td.in = in; td.out = out; td.write = s->write;
     td.delay = s->delay; td.ir = s->data_ir; td.n_clippings = n_clippings;
     td.ringbuffer = s->ringbuffer; td.temp_src = s->temp_src;
-    td.temp_fft = s->temp_fft;
     td.temp_afft = s->temp_afft;
 
     if (s->type == TIME_DOMAIN) {
         ctx->internal->execute(ctx, headphone_convolute, &td, NULL, 2);
     } else {
+        /* Every input channel is transformed once and shared by both ears. */
+        ctx->internal->execute(ctx, headphone_fft_input, &td, NULL, s->nb_fft_jobs);
         ctx->internal->execute(ctx, headphone_fast_convolute, &td, NULL, 2);
     }
     emms_c();
@@ -416,16 +441,27 @@ static int convert_coeffs(AVFilterContext *ctx, AVFilterLink *inlink)
             goto fail;
         }
 
-        av_fft_end(s->fft[0]);
-        av_fft_end(s->fft[1]);
-        s->fft[0] = av_fft_init(av_log2(s->n_fft), 0);
-        s->fft[1] = av_fft_init(av_log2(s->n_fft), 0);
+        for (i = 0; i < s->nb_fft_jobs; i++)
+            av_fft_end(s->fft[i]);
+        av_freep(&s->fft);
+        s->nb_fft_jobs = FFMIN(nb_input_channels, ff_filter_get_nb_threads(ctx));
+        s->fft = av_calloc(s->nb_fft_jobs, sizeof(*s->fft));
+        if (!s->fft) {
+            s->nb_fft_jobs = 0;
+            ret = AVERROR(ENOMEM);
+            goto fail;
+        }
+        for (i = 0; i < s->nb_fft_jobs; i++) {
+            s->fft[i] = av_fft_init(av_log2(s->n_fft), 0);
+            if (!s->fft[i])
+                break;
+        }
         av_fft_end(s->ifft[0]);
         av_fft_end(s->ifft[1]);
         s->ifft[0] = av_fft_init(av_log2(s->n_fft), 1);
         s->ifft[1] = av_fft_init(av_log2(s->n_fft), 1);
 
-        if (!s->fft[0] || !s->fft[1] || !s->ifft[0] || !s->ifft[1]) {
+        if (i < s->nb_fft_jobs || !s->ifft[0] || !s->ifft[1]) {
             av_log(ctx, AV_LOG_ERROR, "Unable to create FFT contexts of size %d.\n", s->n_fft);
             ret = AVERROR(ENOMEM);
             goto fail;
@@ -443,11 +479,10 @@ static int convert_coeffs(AVFilterContext *ctx, AVFilterLink *inlink)
     } else {
         s->ringbuffer[0] = av_calloc(s->buffer_length, sizeof(float));
         s->ringbuffer[1] = av_calloc(s->buffer_length, sizeof(float));
-        s->temp_fft[0] = av_calloc(s->n_fft, sizeof(FFTComplex));
-        s->temp_fft[1] = av_calloc(s->n_fft, sizeof(FFTComplex));
+        s->temp_fft = av_calloc(s->n_fft, sizeof(FFTComplex) * nb_input_channels);
         s->temp_afft[0] = av_calloc(s->n_fft, sizeof(FFTComplex));
         s->temp_afft[1] = av_calloc(s->n_fft, sizeof(FFTComplex));
-        if (!s->temp_fft[0] || !s->temp_fft[1] ||
+        if (!s->temp_fft ||
             !s->temp_afft[0] || !s->temp_afft[1]) {
             ret = AVERROR(ENOMEM);
             goto fail;
@@ -816,8 +851,9 @@ static av_cold void uninit(AVFilterContext *ctx)
 
     av_fft_end(s->ifft[0]);
     av_fft_end(s->ifft[1]);
-    av_fft_end(s->fft[0]);
-    av_fft_end(s->fft[1]);
+    for (i = 0; i < s->nb_fft_jobs; i++)
+        av_fft_end(s->fft[i]);
+    av_freep(&s->fft);
     av_freep(&s->delay[0]);
     av_freep(&s->delay[1]);
     av_freep(&s->data_ir[0]);
@@ -826,8 +862,7 @@ static av_cold void uninit(AVFilterContext *ctx)
     av_freep(&s->ringbuffer[1]);
     av_freep(&s->temp_src[0]);
     av_freep(&s->temp_src[1]);
-    av_freep(&s->temp_fft[0]);
-    av_freep(&s->temp_fft[1]);
+    av_freep(&s->temp_fft);
     av_freep(&s->temp_afft[0]);
     av_freep(&s->temp_afft[1]);
     av_freep(&s->data_hrtf[0]);
@@ -34,6 +34,7 @@
 #include "libavutil/float_dsp.h"
 #include "libavutil/intmath.h"
 #include "libavutil/opt.h"
+#include "libavutil/thread.h"
 #include "avfilter.h"
 #include "filters.h"
 #include "internal.h"
@@ -42,7 +43,58 @@
 #define TIME_DOMAIN      0
 #define FREQUENCY_DOMAIN 1
 
+/* IRs of the virtual loudspeakers ready for the convolution, and their
+ * delays, shared by all filter instances using the same SOFA data with
+ * the same speaker positions, gain, sample rate and processing */
+typedef struct SOFAFilters {
+    struct SOFAFilters *next;
+    int refcount;
+    AVMutex lock;                /* held while the filters are computed */
+    int computed;
+    int ret;                     /* result of the computation */
+
+    int type;
+    int sample_rate;
+    int framesize;               /* only used in the frequency domain */
+    int n_conv;
+    float gain_lin;
+    float radius;
+    int *pos;                    /* azimuth and elevation of each channel */
+
+    int max_delay;
+    int buffer_length;
+    int n_fft;
+    int *delay[2];
+    float *data_ir[2];           /* time domain */
+    FFTComplex *data_hrtf[2];    /* frequency domain */
+} SOFAFilters;
+
+/* preprocessed SOFA data, shared by all filter instances
+ * loading the same file with the same options */
+typedef struct SOFACacheEntry {
+    struct SOFACacheEntry *next;
+    char *filename;
+    int normalize;
+    int minphase;
+    int interpolate;
+    float anglestep;
+    float radstep;
+    int refcount;
+    AVMutex lock;               /* held while the file is loaded */
+    int loaded;
+    int ret;                    /* result of the loading */
+    struct MYSOFA_HRTF *hrtf;
+    struct MYSOFA_LOOKUP *lookup;
+    struct MYSOFA_NEIGHBORHOOD *neighborhood;
+    SOFAFilters *filters;
+} SOFACacheEntry;
+
+static AVMutex sofa_cache_lock = AV_MUTEX_INITIALIZER;
+static SOFACacheEntry *sofa_cache;
+
 typedef struct MySofa {  /* contains data of one SOFA file */
+    SOFACacheEntry *entry;
+    SOFAFilters *filters;
     struct MYSOFA_HRTF *hrtf;
     struct MYSOFA_LOOKUP *lookup;
     struct MYSOFA_NEIGHBORHOOD *neighborhood;
@@ -50,7 +102,6 @@ typedef struct MySofa {  /* contains data of one SOFA file */
     int n_samples;       /* ir_samples to next power of 2 */
     float *lir, *rir;    /* IRs (time-domain) */
     float *fir;
-    int max_delay;
 } MySofa;
 
 typedef struct VirtualSpeaker {
@@ -84,13 +135,13 @@ typedef struct SOFAlizerContext {
     int n_fft;                  /* number of samples in one FFT block */
     int nb_samples;
 
-                                /* netCDF variables */
-    int *delay[2];              /* broadband delay for each channel/IR to be convolved */
+                                /* netCDF variables, shared through sofa.filters */
+    const int *delay[2];        /* broadband delay for each channel/IR to be convolved */
 
-    float *data_ir[2];          /* IRs for all channels to be convolved */
+    const float *data_ir[2];    /* IRs for all channels to be convolved */
                                 /* (this excludes the LFE) */
     float *temp_src[2];
-    FFTComplex *temp_fft[2];    /* Array to hold FFT values */
+    FFTComplex *temp_fft;       /* Array to hold FFT values of all input channels */
     FFTComplex *temp_afft[2];   /* Array to accumulate FFT values prior to IFFT */
 
                          /* control variables */
@@ -108,39 +159,88 @@ typedef struct SOFAlizerContext {
 
     VirtualSpeaker vspkrpos[64];
 
-    FFTContext *fft[2], *ifft[2];
-    FFTComplex *data_hrtf[2];
+    int nb_fft_jobs;
+    FFTContext **fft, *ifft[2];
+    const FFTComplex *data_hrtf[2];
 
     AVFloatDSPContext *fdsp;
 } SOFAlizerContext;
 
+static void free_sofa_filters(SOFAFilters *f)
+{
+    av_freep(&f->pos);
+    av_freep(&f->delay[0]);
+    av_freep(&f->delay[1]);
+    av_freep(&f->data_ir[0]);
+    av_freep(&f->data_ir[1]);
+    av_freep(&f->data_hrtf[0]);
+    av_freep(&f->data_hrtf[1]);
+    ff_mutex_destroy(&f->lock);
+    av_free(f);
+}
+
+static void free_sofa_entry(SOFACacheEntry *entry)
+{
+    if (entry->neighborhood)
+        mysofa_neighborhood_free(entry->neighborhood);
+    if (entry->lookup)
+        mysofa_lookup_free(entry->lookup);
+    if (entry->hrtf)
+        mysofa_free(entry->hrtf);
+    av_freep(&entry->filename);
+    ff_mutex_destroy(&entry->lock);
+    av_free(entry);
+}
+
+/* must be called with sofa_cache_lock held */
+static void release_sofa_filters(SOFACacheEntry *entry, SOFAFilters *f)
+{
+    if (f && !--f->refcount) {
+        SOFAFilters **p = &entry->filters;
+
+        while (*p != f)
+            p = &(*p)->next;
+        *p = f->next;
+        free_sofa_filters(f);
+    }
+}
+
 static int close_sofa(struct MySofa *sofa)
 {
-    if (sofa->neighborhood)
-        mysofa_neighborhood_free(sofa->neighborhood);
+    SOFACacheEntry *entry = sofa->entry;
+
+    if (entry) {
+        ff_mutex_lock(&sofa_cache_lock);
+        release_sofa_filters(entry, sofa->filters);
+        if (!--entry->refcount) {
+            SOFACacheEntry **p = &sofa_cache;
+
+            while (*p != entry)
+                p = &(*p)->next;
+            *p = entry->next;
+            free_sofa_entry(entry);
+        }
+        ff_mutex_unlock(&sofa_cache_lock);
+    }
+    sofa->entry = NULL;
+    sofa->filters = NULL;
     sofa->neighborhood = NULL;
-    if (sofa->lookup)
-        mysofa_lookup_free(sofa->lookup);
     sofa->lookup = NULL;
-    if (sofa->hrtf)
-        mysofa_free(sofa->hrtf);
     sofa->hrtf = NULL;
     av_freep(&sofa->fir);
 
     return 0;
 }
 
-static int preload_sofa(AVFilterContext *ctx, char *filename, int *samplingrate)
+static int load_sofa(AVFilterContext *ctx, SOFACacheEntry *entry)
 {
-    struct SOFAlizerContext *s = ctx->priv;
     struct MYSOFA_HRTF *mysofa;
-    char *license;
     int ret;
 
-    mysofa = mysofa_load(filename, &ret);
-    s->sofa.hrtf = mysofa;
+    mysofa = mysofa_load(entry->filename, &ret);
+    entry->hrtf = mysofa;
     if (ret || !mysofa) {
-        av_log(ctx, AV_LOG_ERROR, "Can't find SOFA-file '%s'\n", filename);
+        av_log(ctx, AV_LOG_ERROR, "Can't find SOFA-file '%s'\n", entry->filename);
         return AVERROR(EINVAL);
     }
 
@@ -150,23 +250,96 @@ static int preload_sofa(AVFilterContext *ctx, char *filename, int *samplingrate)
         return ret;
     }
 
-    if (s->normalize)
-        mysofa_loudness(s->sofa.hrtf);
+    if (entry->normalize)
+        mysofa_loudness(mysofa);
 
-    if (s->minphase)
-        mysofa_minphase(s->sofa.hrtf, 0.01f);
+    if (entry->minphase)
+        mysofa_minphase(mysofa, 0.01f);
 
-    mysofa_tocartesian(s->sofa.hrtf);
+    mysofa_tocartesian(mysofa);
 
-    s->sofa.lookup = mysofa_lookup_init(s->sofa.hrtf);
-    if (s->sofa.lookup == NULL)
+    entry->lookup = mysofa_lookup_init(mysofa);
+    if (entry->lookup == NULL)
         return AVERROR(EINVAL);
 
-    if (s->interpolate)
-        s->sofa.neighborhood = mysofa_neighborhood_init_withstepdefine(s->sofa.hrtf,
-                                                                       s->sofa.lookup,
-                                                                       s->anglestep,
-                                                                       s->radstep);
+    if (entry->interpolate)
+        entry->neighborhood = mysofa_neighborhood_init_withstepdefine(mysofa,
+                                                                      entry->lookup,
+                                                                      entry->anglestep,
+                                                                      entry->radstep);
+
+    return 0;
+}
+
+static int preload_sofa(AVFilterContext *ctx, char *filename, int *samplingrate)
+{
+    struct SOFAlizerContext *s = ctx->priv;
+    struct MYSOFA_HRTF *mysofa;
+    SOFACacheEntry *entry;
+    char *license;
+    int ret = 0;
+
+    /* loading and preprocessing a SOFA file is expensive, so it is done
+     * only once for all instances using the same file and options;
+     * the cache lock is only held to find or add the entry */
+    ff_mutex_lock(&sofa_cache_lock);
+    for (entry = sofa_cache; entry; entry = entry->next) {
+        if (!strcmp(entry->filename, filename) &&
+            entry->normalize   == s->normalize &&
+            entry->minphase    == s->minphase &&
+            entry->interpolate == s->interpolate &&
+            (!s->interpolate || (entry->anglestep == s->anglestep &&
+                                 entry->radstep   == s->radstep)))
+            break;
+    }
+
+    if (!entry) {
+        entry = av_mallocz(sizeof(*entry));
+        if (entry)
+            entry->filename = av_strdup(filename);
+        if (!entry || !entry->filename) {
+            av_freep(&entry);
+            ret = AVERROR(ENOMEM);
+        } else {
+            ff_mutex_init(&entry->lock, NULL);
+            entry->normalize   = s->normalize;
+            entry->minphase    = s->minphase;
+            entry->interpolate = s->interpolate;
+            entry->anglestep   = s->anglestep;
+            entry->radstep     = s->radstep;
+
+            entry->next = sofa_cache;
+            sofa_cache  = entry;
+        }
+    } else {
+        av_log(ctx, AV_LOG_DEBUG, "Reusing already loaded SOFA file '%s'.\n", filename);
+    }
+
+    if (entry)
+        entry->refcount++;
+    ff_mutex_unlock(&sofa_cache_lock);
+
+    if (ret)
+        return ret;
+
+    /* released by close_sofa(), also if loading fails */
+    s->sofa.entry = entry;
+
+    /* the first instance loads the file, the others using it wait here */
+    ff_mutex_lock(&entry->lock);
+    if (!entry->loaded) {
+        entry->ret    = load_sofa(ctx, entry);
+        entry->loaded = 1;
+    }
+    ret = entry->ret;
+    ff_mutex_unlock(&entry->lock);
+
+    if (ret)
+        return ret;
+
+    s->sofa.hrtf         = mysofa = entry->hrtf;
+    s->sofa.lookup       = entry->lookup;
+    s->sofa.neighborhood = entry->neighborhood;
 
     s->sofa.fir = av_calloc(s->sofa.hrtf->N * s->sofa.hrtf->R, sizeof(*s->sofa.fir));
     if (!s->sofa.fir)
@@ -319,12 +492,11 @@ static int get_speaker_pos(AVFilterContext *ctx,
 typedef struct ThreadData {
     AVFrame *in, *out;
     int *write;
-    int **delay;
-    float **ir;
+    const int **delay;
+    const float **ir;
     int *n_clippings;
     float **ringbuffer;
     float **temp_src;
-    FFTComplex **temp_fft;
     FFTComplex **temp_afft;
 } ThreadData;
 
@@ -428,6 +600,51 @@ static int sofalizer_convolute(AVFilterContext *ctx, void *arg, int jobnr, int n
     return 0;
 }
 
+static int sofalizer_fft_input(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    SOFAlizerContext *s = ctx->priv;
+    ThreadData *td = arg;
+    AVFrame *in = td->in;
+    const int planar = in->format == AV_SAMPLE_FMT_FLTP;
+    const int in_channels = s->n_conv; /* number of input channels */
+    const int start = (in_channels * jobnr) / nb_jobs;
+    const int end = (in_channels * (jobnr+1)) / nb_jobs;
+    FFTContext *fft = s->fft[jobnr];
+    const int n_fft = s->n_fft;
+    int i, j;
+
+    for (i = start; i < end; i++) {
+        const float *src = (const float *)in->extended_data[i * planar]; /* get pointer to audio input buffer */
+        FFTComplex *fft_in = s->temp_fft + i * n_fft; /* FFT input/output data of current channel */
+
+        if (i == s->lfe_channel) /* LFE is not convolved */
+            continue;
+
+        /* fill FFT input with 0 (we want to zero-pad) */
+        memset(fft_in, 0, sizeof(FFTComplex) * n_fft);
+
+        if (in->format == AV_SAMPLE_FMT_FLT) {
+            for (j = 0; j < in->nb_samples; j++) {
+                /* prepare input for FFT */
+                /* write all samples of current input channel to FFT input array */
+                fft_in[j].re = src[j * in_channels + i];
+            }
+        } else {
+            for (j = 0; j < in->nb_samples; j++) {
+                /* prepare input for FFT */
+                /* write all samples of current input channel to FFT input array */
+                fft_in[j].re = src[j];
+            }
+        }
+
+        /* transform input signal of current channel to frequency domain */
+        av_fft_permute(fft, fft_in);
+        av_fft_calc(fft, fft_in);
+    }
+
+    return 0;
+}
+
 static int sofalizer_fast_convolute(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
 {
     SOFAlizerContext *s = ctx->priv;
@@ -435,7 +652,7 @@ static int sofalizer_fast_convolute(AVFilterContext *ctx, void *arg, int jobnr,
     AVFrame *in = td->in, *out = td->out;
     int offset = jobnr;
     int *write = &td->write[jobnr];
-    FFTComplex *hrtf = s->data_hrtf[jobnr]; /* get pointers to current HRTF data */
+    const FFTComplex *hrtf = s->data_hrtf[jobnr]; /* get pointers to current HRTF data */
     int *n_clippings = &td->n_clippings[jobnr];
     float *ringbuffer = td->ringbuffer[jobnr];
     const int ir_samples = s->sofa.ir_samples; /* length of one IR */
@@ -447,14 +664,12 @@ static int sofalizer_fast_convolute(AVFilterContext *ctx, void *arg, int jobnr,
     const int buffer_length = s->buffer_length;
     /* -1 for AND instead of MODULO (applied to powers of 2): */
     const uint32_t modulo = (uint32_t)buffer_length - 1;
-    FFTComplex *fft_in = s->temp_fft[jobnr]; /* temporary array for FFT input/output data */
     FFTComplex *fft_acc = s->temp_afft[jobnr];
     FFTContext *ifft = s->ifft[jobnr];
-    FFTContext *fft = s->fft[jobnr];
     const int n_conv = s->n_conv;
     const int n_fft = s->n_fft;
     const float fft_scale = 1.0f / s->n_fft;
-    FFTComplex *hrtf_offset;
+    const FFTComplex *hrtf_offset;
     int wr = *write;
     int n_read;
     int i, j;
@@ -483,6 +698,7 @@ static int sofalizer_fast_convolute(AVFilterContext *ctx, void *arg, int jobnr,
 
     for (i = 0; i < n_conv; i++) {
         const float *src = (const float *)in->extended_data[i * planar]; /* get pointer to audio input buffer */
+        const FFTComplex *fft_in = s->temp_fft + i * n_fft; /* spectrum of current input channel */
 
         if (i == s->lfe_channel) { /* LFE */
             if (in->format == AV_SAMPLE_FMT_FLT) {
@@ -503,26 +719,6 @@ static int sofalizer_fast_convolute(AVFilterContext *ctx, void *arg, int jobnr,
         offset = i * n_fft; /* no. samples already processed */
         hrtf_offset = hrtf + offset;
 
-        /* fill FFT input with 0 (we want to zero-pad) */
-        memset(fft_in, 0, sizeof(FFTComplex) * n_fft);
-
-        if (in->format == AV_SAMPLE_FMT_FLT) {
-            for (j = 0; j < in->nb_samples; j++) {
-                /* prepare input for FFT */
-                /* write all samples of current input channel to FFT input array */
-                fft_in[j].re = src[j * in_channels + i];
-            }
-        } else {
-            for (j = 0; j < in->nb_samples; j++) {
-                /* prepare input for FFT */
-                /* write all samples of current input channel to FFT input array */
-                fft_in[j].re = src[j];
-            }
-        }
-
-        /* transform input signal of current channel to frequency domain */
-        av_fft_permute(fft, fft_in);
-        av_fft_calc(fft, fft_in);
         for (j = 0; j < n_fft; j++) {
             const FFTComplex *hcomplex = hrtf_offset + j;
             const float re = fft_in[j].re;
@@ -585,12 +781,13 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *in)
     td.in = in; td.out = out; td.write = s->write;
     td.delay = s->delay; td.ir = s->data_ir; td.n_clippings = n_clippings;
     td.ringbuffer = s->ringbuffer; td.temp_src = s->temp_src;
-    td.temp_fft = s->temp_fft;
     td.temp_afft = s->temp_afft;
 
     if (s->type == TIME_DOMAIN) {
         ctx->internal->execute(ctx, sofalizer_convolute, &td, NULL, 2);
     } else if (s->type == FREQUENCY_DOMAIN) {
+        /* transform every input channel once, shared by both ears */
+        ctx->internal->execute(ctx, sofalizer_fft_input, &td, NULL, s->nb_fft_jobs);
         ctx->internal->execute(ctx, sofalizer_fast_convolute, &td, NULL, 2);
     }
     emms_c();
@@ -716,94 +913,39 @@ static int getfilter_float(AVFilterContext *ctx, float x, float y, float z,
     return 0;
 }
 
-static int load_data(AVFilterContext *ctx, int azim, int elev, float radius, int sample_rate)
+static int compute_filters(AVFilterContext *ctx, SOFAFilters *f)
 {
     struct SOFAlizerContext *s = ctx->priv;
-    int n_samples;
-    int ir_samples;
-    int n_conv = s->n_conv; /* no. channels to convolve */
-    int n_fft;
-    float delay_l; /* broadband delay for each IR */
-    float delay_r;
-    int nb_input_channels = ctx->inputs[0]->channels; /* no. input channels */
-    float gain_lin = expf((s->gain - 3 * nb_input_channels) / 20 * M_LN10); /* gain - 3dB/channel */
-    FFTComplex *data_hrtf_l = NULL;
-    FFTComplex *data_hrtf_r = NULL;
+    const int n_samples = s->sofa.n_samples;
+    const int ir_samples = s->sofa.ir_samples;
+    const int n_conv = f->n_conv;
     FFTComplex *fft_in_l = NULL;
     FFTComplex *fft_in_r = NULL;
+    FFTContext *fft = NULL;
     float *data_ir_l = NULL;
     float *data_ir_r = NULL;
+    float delay_l; /* broadband delay for each IR */
+    float delay_r;
     int offset = 0; /* used for faster pointer arithmetics in for-loop */
-    int i, j, azim_orig = azim, elev_orig = elev;
-    int ret = 0;
-    int n_current;
-    int n_max = 0;
-
-    av_log(ctx, AV_LOG_DEBUG, "IR length: %d.\n", s->sofa.hrtf->N);
-    s->sofa.ir_samples = s->sofa.hrtf->N;
-    s->sofa.n_samples = 1 << (32 - ff_clz(s->sofa.ir_samples));
-
-    n_samples = s->sofa.n_samples;
-    ir_samples = s->sofa.ir_samples;
-
-    if (s->type == TIME_DOMAIN) {
-        s->data_ir[0] = av_calloc(n_samples, sizeof(float) * s->n_conv);
-        s->data_ir[1] = av_calloc(n_samples, sizeof(float) * s->n_conv);
+    int i, j, n_max, n_fft, ret = 0;
 
-        if (!s->data_ir[0] || !s->data_ir[1]) {
-            ret = AVERROR(ENOMEM);
-            goto fail;
-        }
-    }
-
-    s->delay[0] = av_calloc(s->n_conv, sizeof(int));
-    s->delay[1] = av_calloc(s->n_conv, sizeof(int));
-
-    if (!s->delay[0] || !s->delay[1]) {
-        ret = AVERROR(ENOMEM);
-        goto fail;
-    }
+    f->delay[0] = av_calloc(n_conv, sizeof(int));
+    f->delay[1] = av_calloc(n_conv, sizeof(int));
 
     /* get temporary IR for L and R channel */
     data_ir_l = av_calloc(n_conv * n_samples, sizeof(*data_ir_l));
     data_ir_r = av_calloc(n_conv * n_samples, sizeof(*data_ir_r));
-    if (!data_ir_r || !data_ir_l) {
-        ret = AVERROR(ENOMEM);
-        goto fail;
-    }
-
-    if (s->type == TIME_DOMAIN) {
-        s->temp_src[0] = av_calloc(n_samples, sizeof(float));
-        s->temp_src[1] = av_calloc(n_samples, sizeof(float));
-        if (!s->temp_src[0] || !s->temp_src[1]) {
-            ret = AVERROR(ENOMEM);
-            goto fail;
-        }
-    }
-
-    s->speaker_azim = av_calloc(s->n_conv, sizeof(*s->speaker_azim));
-    s->speaker_elev = av_calloc(s->n_conv, sizeof(*s->speaker_elev));
-    if (!s->speaker_azim || !s->speaker_elev) {
+    if (!f->delay[0] || !f->delay[1] || !data_ir_r || !data_ir_l) {
         ret = AVERROR(ENOMEM);
         goto fail;
     }
 
-    /* get speaker positions */
-    if ((ret = get_speaker_pos(ctx, s->speaker_azim, s->speaker_elev)) < 0) {
-        av_log(ctx, AV_LOG_ERROR, "Couldn't get speaker positions. Input channel configuration not supported.\n");
-        goto fail;
-    }
-
-    for (i = 0; i < s->n_conv; i++) {
+    for (i = 0; i < n_conv; i++) {
         float coordinates[3];
 
-        /* load and store IRs and corresponding delays */
-        azim = (int)(s->speaker_azim[i] + azim_orig) % 360;
-        elev = (int)(s->speaker_elev[i] + elev_orig) % 90;
-
-        coordinates[0] = azim;
-        coordinates[1] = elev;
-        coordinates[2] = radius;
+        coordinates[0] = f->pos[2 * i];
+        coordinates[1] = f->pos[2 * i + 1];
+        coordinates[2] = f->radius;
 
         mysofa_s2c(coordinates);
 
@@ -815,80 +957,43 @@ static int load_data(AVFilterContext *ctx, int azim, int elev, float radius, int
         if (ret < 0)
             goto fail;
 
-        s->delay[0][i] = delay_l * sample_rate;
-        s->delay[1][i] = delay_r * sample_rate;
+        f->delay[0][i] = delay_l * f->sample_rate;
+        f->delay[1][i] = delay_r * f->sample_rate;
 
-        s->sofa.max_delay = FFMAX3(s->sofa.max_delay, s->delay[0][i], s->delay[1][i]);
+        f->max_delay = FFMAX3(f->max_delay, f->delay[0][i], f->delay[1][i]);
     }
 
-    /* get size of ringbuffer (longest IR plus max. delay) */
-    /* then choose next power of 2 for performance optimization */
-    n_current = n_samples + s->sofa.max_delay;
-    /* length of longest IR plus max. delay */
-    n_max = FFMAX(n_max, n_current);
-
     /* buffer length is longest IR plus max. delay -> next power of 2
        (32 - count leading zeros gives required exponent)  */
-    s->buffer_length = 1 << (32 - ff_clz(n_max));
-    s->n_fft = n_fft = 1 << (32 - ff_clz(n_max + s->framesize));
-
-    if (s->type == FREQUENCY_DOMAIN) {
-        av_fft_end(s->fft[0]);
-        av_fft_end(s->fft[1]);
-        s->fft[0] = av_fft_init(av_log2(s->n_fft), 0);
-        s->fft[1] = av_fft_init(av_log2(s->n_fft), 0);
-        av_fft_end(s->ifft[0]);
-        av_fft_end(s->ifft[1]);
-        s->ifft[0] = av_fft_init(av_log2(s->n_fft), 1);
-        s->ifft[1] = av_fft_init(av_log2(s->n_fft), 1);
-
-        if (!s->fft[0] || !s->fft[1] || !s->ifft[0] || !s->ifft[1]) {
-            av_log(ctx, AV_LOG_ERROR, "Unable to create FFT contexts of size %d.\n", s->n_fft);
+    n_max = n_samples + f->max_delay;
+    f->buffer_length = 1 << (32 - ff_clz(n_max));
+    f->n_fft = n_fft = 1 << (32 - ff_clz(n_max + f->framesize));
+
+    if (f->type == TIME_DOMAIN) {
+        f->data_ir[0] = av_calloc(n_samples, sizeof(float) * n_conv);
+        f->data_ir[1] = av_calloc(n_samples, sizeof(float) * n_conv);
+        if (!f->data_ir[0] || !f->data_ir[1]) {
             ret = AVERROR(ENOMEM);
             goto fail;
         }
-    }
-
-    if (s->type == TIME_DOMAIN) {
-        s->ringbuffer[0] = av_calloc(s->buffer_length, sizeof(float) * nb_input_channels);
-        s->ringbuffer[1] = av_calloc(s->buffer_length, sizeof(float) * nb_input_channels);
-    } else if (s->type == FREQUENCY_DOMAIN) {
-        /* get temporary HRTF memory for L and R channel */
-        data_hrtf_l = av_malloc_array(n_fft, sizeof(*data_hrtf_l) * n_conv);
-        data_hrtf_r = av_malloc_array(n_fft, sizeof(*data_hrtf_r) * n_conv);
-        if (!data_hrtf_r || !data_hrtf_l) {
-            ret = AVERROR(ENOMEM);
-            goto fail;
-        }
-
-        s->ringbuffer[0] = av_calloc(s->buffer_length, sizeof(float));
-        s->ringbuffer[1] = av_calloc(s->buffer_length, sizeof(float));
-        s->temp_fft[0] = av_malloc_array(s->n_fft, sizeof(FFTComplex));
-        s->temp_fft[1] = av_malloc_array(s->n_fft, sizeof(FFTComplex));
-        s->temp_afft[0] = av_malloc_array(s->n_fft, sizeof(FFTComplex));
-        s->temp_afft[1] = av_malloc_array(s->n_fft, sizeof(FFTComplex));
-        if (!s->temp_fft[0] || !s->temp_fft[1] ||
-            !s->temp_afft[0] || !s->temp_afft[1]) {
+    } else {
+        f->data_hrtf[0] = av_malloc_array(n_fft, sizeof(FFTComplex) * n_conv);
+        f->data_hrtf[1] = av_malloc_array(n_fft, sizeof(FFTComplex) * n_conv);
+        fft_in_l = av_calloc(n_fft, sizeof(*fft_in_l));
+        fft_in_r = av_calloc(n_fft, sizeof(*fft_in_r));
+        if (!f->data_hrtf[0] || !f->data_hrtf[1] || !fft_in_l || !fft_in_r) {
             ret = AVERROR(ENOMEM);
             goto fail;
         }
-    }
-
-    if (!s->ringbuffer[0] || !s->ringbuffer[1]) {
-        ret = AVERROR(ENOMEM);
-        goto fail;
-    }
-
-    if (s->type == FREQUENCY_DOMAIN) {
-        fft_in_l = av_calloc(n_fft, sizeof(*fft_in_l));
-        fft_in_r = av_calloc(n_fft, sizeof(*fft_in_r));
-        if (!fft_in_l || !fft_in_r) {
+        fft = av_fft_init(av_log2(n_fft), 0);
+        if (!fft) {
+            av_log(ctx, AV_LOG_ERROR, "Unable to create FFT contexts of size %d.\n", n_fft);
             ret = AVERROR(ENOMEM);
             goto fail;
         }
     }
 
-    for (i = 0; i < s->n_conv; i++) {
+    for (i = 0; i < n_conv; i++) {
         float *lir, *rir;
 
         offset = i * n_samples; /* no. samples already written */
@@ -896,14 +1001,14 @@ static int load_data(AVFilterContext *ctx, int azim, int elev, float radius, int
         lir = data_ir_l + offset;
         rir = data_ir_r + offset;
 
-        if (s->type == TIME_DOMAIN) {
+        if (f->type == TIME_DOMAIN) {
             for (j = 0; j < ir_samples; j++) {
                 /* load reversed IRs of the specified source position
                  * sample-by-sample for left and right ear; and apply gain */
-                s->data_ir[0][offset + j] = lir[ir_samples - 1 - j] * gain_lin;
-                s->data_ir[1][offset + j] = rir[ir_samples - 1 - j] * gain_lin;
+                f->data_ir[0][offset + j] = lir[ir_samples - 1 - j] * f->gain_lin;
+                f->data_ir[1][offset + j] = rir[ir_samples - 1 - j] * f->gain_lin;
             }
-        } else if (s->type == FREQUENCY_DOMAIN) {
+        } else {
             memset(fft_in_l, 0, n_fft * sizeof(*fft_in_l));
             memset(fft_in_r, 0, n_fft * sizeof(*fft_in_r));
 
@@ -913,37 +1018,22 @@ static int load_data(AVFilterContext *ctx, int azim, int elev, float radius, int
                  * sample-by-sample and apply gain,
                  * L channel is loaded to real part, R channel to imag part,
                  * IRs are shifted by L and R delay */
-                fft_in_l[s->delay[0][i] + j].re = lir[j] * gain_lin;
-                fft_in_r[s->delay[1][i] + j].re = rir[j] * gain_lin;
+                fft_in_l[f->delay[0][i] + j].re = lir[j] * f->gain_lin;
+                fft_in_r[f->delay[1][i] + j].re = rir[j] * f->gain_lin;
             }
 
             /* actually transform to frequency domain (IRs -> HRTFs) */
-            av_fft_permute(s->fft[0], fft_in_l);
-            av_fft_calc(s->fft[0], fft_in_l);
-            memcpy(data_hrtf_l + offset, fft_in_l, n_fft * sizeof(*fft_in_l));
-            av_fft_permute(s->fft[0], fft_in_r);
-            av_fft_calc(s->fft[0], fft_in_r);
-            memcpy(data_hrtf_r + offset, fft_in_r, n_fft * sizeof(*fft_in_r));
-        }
-    }
-
-    if (s->type == FREQUENCY_DOMAIN) {
-        s->data_hrtf[0] = av_malloc_array(n_fft * s->n_conv, sizeof(FFTComplex));
-        s->data_hrtf[1] = av_malloc_array(n_fft * s->n_conv, sizeof(FFTComplex));
-        if (!s->data_hrtf[0] || !s->data_hrtf[1]) {
-            ret = AVERROR(ENOMEM);
-            goto fail;
+            av_fft_permute(fft, fft_in_l);
+            av_fft_calc(fft, fft_in_l);
+            memcpy(f->data_hrtf[0] + offset, fft_in_l, n_fft * sizeof(*fft_in_l));
+            av_fft_permute(fft, fft_in_r);
+            av_fft_calc(fft, fft_in_r);
+            memcpy(f->data_hrtf[1] + offset, fft_in_r, n_fft * sizeof(*fft_in_r));
         }
-
-        memcpy(s->data_hrtf[0], data_hrtf_l, /* copy HRTF data to */
-            sizeof(FFTComplex) * n_conv * n_fft); /* filter struct */
-        memcpy(s->data_hrtf[1], data_hrtf_r,
-            sizeof(FFTComplex) * n_conv * n_fft);
     }
 
 fail:
-    av_freep(&data_hrtf_l); /* free temporary HRTF memory */
-    av_freep(&data_hrtf_r);
+    av_fft_end(fft);
 
     av_freep(&data_ir_l); /* free temprary IR memory */
     av_freep(&data_ir_r);
@@ -954,6 +1044,198 @@ fail:
     return ret;
 }
 
+/**
+ * Get the filters for the current speaker positions and options, computing
+ * them only if no other instance using the same SOFA data did already.
+ */
+static int get_filters(AVFilterContext *ctx, const int *pos, float radius,
+                       float gain_lin, int sample_rate)
+{
+    struct SOFAlizerContext *s = ctx->priv;
+    SOFACacheEntry *entry = s->sofa.entry;
+    const int framesize = s->type == FREQUENCY_DOMAIN ? s->framesize : 0;
+    SOFAFilters *f;
+    int ret = 0;
+
+    /* the cache lock is only held to find or add the filters */
+    ff_mutex_lock(&sofa_cache_lock);
+    /* drop the filters of a previous configuration */
+    release_sofa_filters(entry, s->sofa.filters);
+    s->sofa.filters = NULL;
+
+    for (f = entry->filters; f; f = f->next) {
+        if (f->type        == s->type &&
+            f->sample_rate == sample_rate &&
+            f->framesize   == framesize &&
+            f->n_conv      == s->n_conv &&
+            f->gain_lin    == gain_lin &&
+            f->radius      == radius &&
+            !memcmp(f->pos, pos, 2 * s->n_conv * sizeof(*pos)))
+            break;
+    }
+
+    if (!f) {
+        f = av_mallocz(sizeof(*f));
+        if (f) {
+            ff_mutex_init(&f->lock, NULL);
+            f->pos = av_memdup(pos, 2 * s->n_conv * sizeof(*pos));
+        }
+        if (!f || !f->pos) {
+            if (f)
+                free_sofa_filters(f);
+            f = NULL;
+            ret = AVERROR(ENOMEM);
+        } else {
+            f->type        = s->type;
+            f->sample_rate = sample_rate;
+            f->framesize   = framesize;
+            f->n_conv      = s->n_conv;
+            f->gain_lin    = gain_lin;
+            f->radius      = radius;
+
+            f->next        = entry->filters;
+            entry->filters = f;
+        }
+    } else {
+        av_log(ctx, AV_LOG_DEBUG, "Reusing already computed filters.\n");
+    }
+
+    if (f)
+        f->refcount++;
+    ff_mutex_unlock(&sofa_cache_lock);
+
+    if (ret < 0)
+        return ret;
+
+    /* released by close_sofa() or the next call, also on failure */
+    s->sofa.filters = f;
+
+    /* the first instance computes the filters, the others using them
+     * wait here */
+    ff_mutex_lock(&f->lock);
+    if (!f->computed) {
+        f->ret      = compute_filters(ctx, f);
+        f->computed = 1;
+    }
+    ret = f->ret;
+    ff_mutex_unlock(&f->lock);
+
+    if (ret < 0)
+        return ret;
+
+    s->delay[0]      = f->delay[0];
+    s->delay[1]      = f->delay[1];
+    s->data_ir[0]    = f->data_ir[0];
+    s->data_ir[1]    = f->data_ir[1];
+    s->data_hrtf[0]  = f->data_hrtf[0];
+    s->data_hrtf[1]  = f->data_hrtf[1];
+    s->buffer_length = f->buffer_length;
+    s->n_fft         = f->n_fft;
+
+    return 0;
+}
+
+static int load_data(AVFilterContext *ctx, int azim, int elev, float radius, int sample_rate)
+{
+    struct SOFAlizerContext *s = ctx->priv;
+    int n_samples;
+    int n_conv = s->n_conv; /* no. channels to convolve */
+    int nb_input_channels = ctx->inputs[0]->channels; /* no. input channels */
+    float gain_lin = expf((s->gain - 3 * nb_input_channels) / 20 * M_LN10); /* gain - 3dB/channel */
+    int *pos = NULL;
+    int i;
+    int ret = 0;
+
+    av_log(ctx, AV_LOG_DEBUG, "IR length: %d.\n", s->sofa.hrtf->N);
+    s->sofa.ir_samples = s->sofa.hrtf->N;
+    s->sofa.n_samples = 1 << (32 - ff_clz(s->sofa.ir_samples));
+
+    n_samples = s->sofa.n_samples;
+
+    s->speaker_azim = av_calloc(s->n_conv, sizeof(*s->speaker_azim));
+    s->speaker_elev = av_calloc(s->n_conv, sizeof(*s->speaker_elev));
+    pos = av_calloc(s->n_conv, 2 * sizeof(*pos));
+    if (!s->speaker_azim || !s->speaker_elev || !pos) {
+        ret = AVERROR(ENOMEM);
+        goto fail;
+    }
+
+    /* get speaker positions */
+    if ((ret = get_speaker_pos(ctx, s->speaker_azim, s->speaker_elev)) < 0) {
+        av_log(ctx, AV_LOG_ERROR, "Couldn't get speaker positions. Input channel configuration not supported.\n");
+        goto fail;
+    }
+
+    for (i = 0; i < s->n_conv; i++) {
+        /* directions of the IRs to load */
+        pos[2 * i]     = (int)(s->speaker_azim[i] + azim) % 360;
+        pos[2 * i + 1] = (int)(s->speaker_elev[i] + elev) % 90;
+    }
+
+    /* load and store IRs and corresponding delays */
+    if ((ret = get_filters(ctx, pos, radius, gain_lin, sample_rate)) < 0)
+        goto fail;
+
+    if (s->type == TIME_DOMAIN) {
+        s->temp_src[0] = av_calloc(n_samples, sizeof(float));
+        s->temp_src[1] = av_calloc(n_samples, sizeof(float));
+        s->ringbuffer[0] = av_calloc(s->buffer_length, sizeof(float) * nb_input_channels);
+        s->ringbuffer[1] = av_calloc(s->buffer_length, sizeof(float) * nb_input_channels);
+        if (!s->temp_src[0] || !s->temp_src[1]) {
+            ret = AVERROR(ENOMEM);
+            goto fail;
+        }
+    } else if (s->type == FREQUENCY_DOMAIN) {
+        for (i = 0; i < s->nb_fft_jobs; i++)
+            av_fft_end(s->fft[i]);
+        av_freep(&s->fft);
+        /* one forward FFT context per job transforming input channels */
+        s->nb_fft_jobs = FFMIN(n_conv, ff_filter_get_nb_threads(ctx));
+        s->fft = av_calloc(s->nb_fft_jobs, sizeof(*s->fft));
+        if (!s->fft) {
+            s->nb_fft_jobs = 0;
+            ret = AVERROR(ENOMEM);
+            goto fail;
+        }
+        for (i = 0; i < s->nb_fft_jobs; i++) {
+            s->fft[i] = av_fft_init(av_log2(s->n_fft), 0);
+            if (!s->fft[i])
+                break;
+        }
+        av_fft_end(s->ifft[0]);
+        av_fft_end(s->ifft[1]);
+        s->ifft[0] = av_fft_init(av_log2(s->n_fft), 1);
+        s->ifft[1] = av_fft_init(av_log2(s->n_fft), 1);
+
+        if (i < s->nb_fft_jobs || !s->ifft[0] || !s->ifft[1]) {
+            av_log(ctx, AV_LOG_ERROR, "Unable to create FFT contexts of size %d.\n", s->n_fft);
+            ret = AVERROR(ENOMEM);
+            goto fail;
+        }
+
+        s->ringbuffer[0] = av_calloc(s->buffer_length, sizeof(float));
+        s->ringbuffer[1] = av_calloc(s->buffer_length, sizeof(float));
+        s->temp_fft = av_malloc_array(s->n_fft, sizeof(FFTComplex) * n_conv);
+        s->temp_afft[0] = av_malloc_array(s->n_fft, sizeof(FFTComplex));
+        s->temp_afft[1] = av_malloc_array(s->n_fft, sizeof(FFTComplex));
+        if (!s->temp_fft ||
+            !s->temp_afft[0] || !s->temp_afft[1]) {
+            ret = AVERROR(ENOMEM);
+            goto fail;
+        }
+    }
+
+    if (!s->ringbuffer[0] || !s->ringbuffer[1]) {
+        ret = AVERROR(ENOMEM);
+        goto fail;
+    }
+
+fail:
+    av_freep(&pos);
+
+    return ret;
+}
+
 static av_cold int init(AVFilterContext *ctx)
 {
     SOFAlizerContext *s = ctx->priv;
@@ -1016,16 +1298,12 @@ static av_cold void uninit(AVFilterContext *ctx)
     close_sofa(&s->sofa);
     av_fft_end(s->ifft[0]);
     av_fft_end(s->ifft[1]);
-    av_fft_end(s->fft[0]);
-    av_fft_end(s->fft[1]);
+    for (int i = 0; i < s->nb_fft_jobs; i++)
+        av_fft_end(s->fft[i]);
+    av_freep(&s->fft);
+    s->nb_fft_jobs = 0;
     s->ifft[0] = NULL;
     s->ifft[1] = NULL;
-    s->fft[0] = NULL;
-    s->fft[1] = NULL;
-    av_freep(&s->delay[0]);
-    av_freep(&s->delay[1]);
-    av_freep(&s->data_ir[0]);
-    av_freep(&s->data_ir[1]);
     av_freep(&s->ringbuffer[0]);
     av_freep(&s->ringbuffer[1]);
     av_freep(&s->speaker_azim);
@@ -1034,10 +1312,7 @@ static av_cold void uninit(AVFilterContext *ctx)
     av_freep(&s->temp_src[1]);
     av_freep(&s->temp_afft[0]);
     av_freep(&s->temp_afft[1]);
-    av_freep(&s->temp_fft[0]);
-    av_freep(&s->temp_fft[1]);
-    av_freep(&s->data_hrtf[0]);
-    av_freep(&s->data_hrtf[1]);
+    av_freep(&s->temp_fft);
     av_freep(&s->fdsp);
 }
 
@@ -84,6 +84,7 @@ extern AVFilter ff_af_bandpass;
 extern AVFilter ff_af_bandreject;
 extern AVFilter ff_af_bass;
 extern AVFilter ff_af_biquad;
+extern AVFilter ff_af_biquadchain;
 extern AVFilter ff_af_bs2b;
 extern AVFilter ff_af_channelmap;
 extern AVFilter ff_af_channelsplit;
@@ -89,6 +89,16 @@ typedef struct ShowWavesContext {
     struct frame_node *last_frame;
     int64_t total_samples;
     int64_t *sum; /* abs sum of the samples per channel */
+
+    /* streaming peak summary, used instead of queueing the audio frames */
+    int peaks;
+    int16_t *bin_min, *bin_max; /* min/max of each bin, per channel */
+    int nb_bins;
+    int64_t bin_size;           /* number of samples summarized in one bin */
+    int64_t bin_samples;        /* number of samples in the last bin */
+    char *peaks_file_str;
+    FILE *peaks_file;
+    int peaks_written;
 } ShowWavesContext;
 
 #define OFFSET(x) offsetof(ShowWavesContext, x)
@@ -138,8 +148,14 @@ static av_cold void uninit(AVFilterContext *ctx)
             av_freep(&tmp);
         }
         av_freep(&showwaves->sum);
+        av_freep(&showwaves->bin_min);
+        av_freep(&showwaves->bin_max);
         showwaves->last_frame = NULL;
     }
+
+    if (showwaves->peaks_file && showwaves->peaks_file != stdout)
+        fclose(showwaves->peaks_file);
+    showwaves->peaks_file = NULL;
 }
 
 static int query_formats(AVFilterContext *ctx)
@@ -615,6 +631,124 @@ static int push_single_pic(AVFilterLink *outlink)
     return push_frame(outlink);
 }
 
+static void draw_peak(uint8_t *buf, int linesize, int pixstep, int full,
+                      int y0, int y1, const uint8_t color[4])
+{
+    int i, k;
+
+    for (k = y0; k <= y1; k++) {
+        uint8_t *dst = buf + k * linesize;
+
+        for (i = 0; i < pixstep; i++)
+            dst[i] = full ? color[i] : dst[i] + color[i];
+    }
+}
+
+/**
+ * Write the peak summary at every resolution, from the bins of the summary
+ * down to a single bin, each level merging pairs of bins of the previous
+ * one.
+ */
+static int write_peaks_file(AVFilterContext *ctx)
+{
+    AVFilterLink *inlink = ctx->inputs[0];
+    ShowWavesContext *showwaves = ctx->priv;
+    FILE *f = showwaves->peaks_file;
+    const int nb_channels = inlink->channels;
+    int nb_bins = showwaves->nb_bins;
+    int64_t bin_size = showwaves->bin_size;
+    int16_t *bin_min, *bin_max;
+    int level, i, ch;
+
+    bin_min = av_memdup(showwaves->bin_min, nb_bins * nb_channels * sizeof(*bin_min));
+    bin_max = av_memdup(showwaves->bin_max, nb_bins * nb_channels * sizeof(*bin_max));
+    if (nb_bins && (!bin_min || !bin_max)) {
+        av_free(bin_min);
+        av_free(bin_max);
+        return AVERROR(ENOMEM);
+    }
+
+    fprintf(f, "peaks_version:1 sample_rate:%d channels:%d samples:%"PRId64"\n",
+            inlink->sample_rate, nb_channels, showwaves->total_samples);
+    for (level = 0; nb_bins > 0; level++) {
+        fprintf(f, "level:%d bins:%d bin_size:%"PRId64"\n", level, nb_bins, bin_size);
+        for (i = 0; i < nb_bins; i++) {
+            fprintf(f, "bin:%d", i);
+            for (ch = 0; ch < nb_channels; ch++)
+                fprintf(f, " min_%d:%d max_%d:%d",
+                        ch, bin_min[i * nb_channels + ch],
+                        ch, bin_max[i * nb_channels + ch]);
+            fprintf(f, "\n");
+        }
+        if (nb_bins == 1)
+            break;
+
+        /* merge pairs of bins, an odd last bin is kept alone */
+        for (i = 0; i < nb_bins; i += 2) {
+            for (ch = 0; ch < nb_channels; ch++) {
+                const int a = i * nb_channels + ch;
+                const int b = FFMIN(i + 1, nb_bins - 1) * nb_channels + ch;
+
+                bin_min[i / 2 * nb_channels + ch] = FFMIN(bin_min[a], bin_min[b]);
+                bin_max[i / 2 * nb_channels + ch] = FFMAX(bin_max[a], bin_max[b]);
+            }
+        }
+        nb_bins   = (nb_bins + 1) / 2;
+        bin_size *= 2;
+    }
+    fflush(f);
+
+    av_free(bin_min);
+    av_free(bin_max);
+    return 0;
+}
+
+static int push_peaks_pic(AVFilterLink *outlink)
+{
+    AVFilterContext *ctx = outlink->src;
+    AVFilterLink *inlink = ctx->inputs[0];
+    ShowWavesContext *showwaves = ctx->priv;
+    AVFrame *out = showwaves->outpicref;
+    const int nb_channels = inlink->channels;
+    const int ch_height = showwaves->split_channels ? outlink->h / nb_channels : outlink->h;
+    const int linesize = out->linesize[0];
+    const int pixstep = showwaves->pixstep;
+    const int full = showwaves->draw_mode == DRAW_FULL;
+    const int nb_bins = showwaves->nb_bins;
+    int col, ch, b;
+
+    if (nb_bins < outlink->w) {
+        av_log(ctx, AV_LOG_ERROR, "Too few samples\n");
+        return AVERROR(EINVAL);
+    }
+
+    av_log(ctx, AV_LOG_DEBUG, "Create frame from %d bins of %"PRId64" samples\n",
+           nb_bins, showwaves->bin_size);
+
+    for (col = 0; col < outlink->w; col++) {
+        const int start = (int64_t)col * nb_bins / outlink->w;
+        const int end = (int64_t)(col + 1) * nb_bins / outlink->w;
+
+        for (ch = 0; ch < nb_channels; ch++) {
+            uint8_t *buf = out->data[0] + col * pixstep;
+            int min = INT16_MAX, max = INT16_MIN;
+            int y0, y1;
+
+            for (b = start; b < end; b++) {
+                min = FFMIN(min, showwaves->bin_min[b * nb_channels + ch]);
+                max = FFMAX(max, showwaves->bin_max[b * nb_channels + ch]);
+            }
+
+            if (showwaves->split_channels)
+                buf += ch*ch_height*linesize;
+            y0 = av_clip(showwaves->get_h(max, ch_height), 0, ch_height - 1);
+            y1 = av_clip(showwaves->get_h(min, ch_height), 0, ch_height - 1);
+            draw_peak(buf, linesize, pixstep, full, y0, y1, &showwaves->fg[ch * 4]);
+        }
+    }
+
+    return push_frame(outlink);
+}
 
 static int request_frame(AVFilterLink *outlink)
 {
@@ -623,8 +757,17 @@ static int request_frame(AVFilterLink *outlink)
     int ret;
 
     ret = ff_request_frame(inlink);
+    if (ret == AVERROR_EOF && showwaves->peaks_file && !showwaves->peaks_written) {
+        int err = write_peaks_file(outlink->src);
+
+        showwaves->peaks_written = 1;
+        if (err < 0)
+            return err;
+    }
     if (ret == AVERROR_EOF && showwaves->outpicref) {
-        if (showwaves->single_pic)
+        if (showwaves->peaks)
+            push_peaks_pic(outlink);
+        else if (showwaves->single_pic)
             push_single_pic(outlink);
         else
             push_frame(outlink);
@@ -660,7 +803,25 @@ static av_cold int init(AVFilterContext *ctx)
 
     if (!strcmp(ctx->filter->name, "showwavespic")) {
         showwaves->single_pic = 1;
-        showwaves->mode = MODE_CENTERED_LINE;
+        if (showwaves->peaks_file_str) {
+            /* the file is written from the peak summary */
+            showwaves->peaks = 1;
+            if (!strcmp(showwaves->peaks_file_str, "-")) {
+                showwaves->peaks_file = stdout;
+            } else {
+                showwaves->peaks_file = fopen(showwaves->peaks_file_str, "w");
+                if (!showwaves->peaks_file) {
+                    int err = AVERROR(errno);
+                    char buf[128];
+                    av_strerror(err, buf, sizeof(buf));
+                    av_log(ctx, AV_LOG_ERROR, "Could not open peaks file %s: %s\n",
+                           showwaves->peaks_file_str, buf);
+                    return err;
+                }
+            }
+        }
+        /* peaks are drawn around the center, so they need signed heights */
+        showwaves->mode = showwaves->peaks ? MODE_LINE : MODE_CENTERED_LINE;
     }
 
     return 0;
@@ -792,6 +953,8 @@ static const AVOption showwavespic_options[] = {
     { "draw", "set draw mode", OFFSET(draw_mode), AV_OPT_TYPE_INT, {.i64 = DRAW_SCALE}, 0, DRAW_NB-1, FLAGS, .unit="draw" },
         { "scale", "scale pixel values for each drawn sample", 0, AV_OPT_TYPE_CONST, {.i64=DRAW_SCALE}, .flags=FLAGS, .unit="draw"},
         { "full",  "draw every pixel for sample directly",     0, AV_OPT_TYPE_CONST, {.i64=DRAW_FULL},  .flags=FLAGS, .unit="draw"},
+    { "peaks", "draw peaks from a constant memory summary", OFFSET(peaks), AV_OPT_TYPE_BOOL, {.i64 = 0}, 0, 1, FLAGS },
+    { "peaks_file", "write the peak summary to a file", OFFSET(peaks_file_str), AV_OPT_TYPE_STRING, {.str = NULL}, 0, 0, FLAGS },
     { NULL }
 };
 
@@ -808,9 +971,81 @@ static int showwavespic_config_input(AVFilterLink *inlink)
             return AVERROR(ENOMEM);
     }
 
+    if (showwaves->peaks) {
+        showwaves->bin_min = av_malloc_array(2 * showwaves->w, inlink->channels * sizeof(*showwaves->bin_min));
+        showwaves->bin_max = av_malloc_array(2 * showwaves->w, inlink->channels * sizeof(*showwaves->bin_max));
+        if (!showwaves->bin_min || !showwaves->bin_max)
+            return AVERROR(ENOMEM);
+        showwaves->nb_bins  = 0;
+        showwaves->bin_size = 1;
+    }
+
     return 0;
 }
 
+/**
+ * Add samples to the peak summary. The summary holds at most twice as
+ * many bins as there are columns; once it is full, pairs of adjacent
+ * bins are merged and the number of samples per bin doubles.
+ */
+static void update_peaks(ShowWavesContext *showwaves, const int16_t *p,
+                         int nb_samples, int nb_channels)
+{
+    const int max_bins = 2 * showwaves->w;
+    int16_t *bin_min = showwaves->bin_min;
+    int16_t *bin_max = showwaves->bin_max;
+
+    while (nb_samples > 0) {
+        int16_t *cur_min, *cur_max;
+        int i, n, ch;
+
+        if (!showwaves->nb_bins || showwaves->bin_samples == showwaves->bin_size) {
+            if (showwaves->nb_bins == max_bins) {
+                for (i = 0; i < max_bins / 2; i++) {
+                    for (ch = 0; ch < nb_channels; ch++) {
+                        const int a = 2 * i * nb_channels + ch;
+                        const int b = a + nb_channels;
+
+                        bin_min[i * nb_channels + ch] = FFMIN(bin_min[a], bin_min[b]);
+                        bin_max[i * nb_channels + ch] = FFMAX(bin_max[a], bin_max[b]);
+                    }
+                }
+                showwaves->nb_bins   = max_bins / 2;
+                showwaves->bin_size *= 2;
+            }
+
+            for (ch = 0; ch < nb_channels; ch++) {
+                bin_min[showwaves->nb_bins * nb_channels + ch] = INT16_MAX;
+                bin_max[showwaves->nb_bins * nb_channels + ch] = INT16_MIN;
+            }
+            showwaves->nb_bins++;
+            showwaves->bin_samples = 0;
+        }
+
+        cur_min = bin_min + (showwaves->nb_bins - 1) * nb_channels;
+        cur_max = bin_max + (showwaves->nb_bins - 1) * nb_channels;
+        n = FFMIN(nb_samples, showwaves->bin_size - showwaves->bin_samples);
+
+        for (ch = 0; ch < nb_channels; ch++) {
+            const int16_t *src = p + ch;
+            int min = cur_min[ch], max = cur_max[ch];
+
+            for (i = 0; i < n; i++) {
+                const int v = src[i * nb_channels];
+
+                min = FFMIN(min, v);
+                max = FFMAX(max, v);
+            }
+            cur_min[ch] = min;
+            cur_max[ch] = max;
+        }
+
+        p                      += n * nb_channels;
+        nb_samples             -= n;
+        showwaves->bin_samples += n;
+    }
+}
+
 static int showwavespic_filter_frame(AVFilterLink *inlink, AVFrame *insamples)
 {
     AVFilterContext *ctx = inlink->dst;
@@ -819,7 +1054,14 @@ static int showwavespic_filter_frame(AVFilterLink *inlink, AVFrame *insamples)
     int16_t *p = (int16_t *)insamples->data[0];
     int ret = 0;
 
-    if (showwaves->single_pic) {
+    if (showwaves->peaks) {
+        ret = alloc_out_frame(showwaves, p, inlink, outlink, insamples);
+        if (ret < 0)
+            goto end;
+
+        update_peaks(showwaves, p, insamples->nb_samples, inlink->channels);
+        showwaves->total_samples += insamples->nb_samples;
+    } else if (showwaves->single_pic) {
         struct frame_node *f;
 
         ret = alloc_out_frame(showwaves, p, inlink, outlink, insamples);
@@ -19,11 +19,16 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
  */
 
+#include "config.h"
+
+#include <time.h>
+
 #include "libavutil/avassert.h"
 #include "libavutil/avstring.h"
 #include "libavutil/buffer.h"
 #include "libavutil/channel_layout.h"
 #include "libavutil/common.h"
+#include "libavutil/cpu.h"
 #include "libavutil/eval.h"
 #include "libavutil/hwcontext.h"
 #include "libavutil/imgutils.h"
@@ -33,6 +38,7 @@
 #include "libavutil/rational.h"
 #include "libavutil/samplefmt.h"
 #include "libavutil/thread.h"
+#include "libavutil/time.h"
 
 #define FF_INTERNAL_FIELDS 1
 #include "framequeue.h"
@@ -166,6 +172,7 @@ int avfilter_link(AVFilterContext *src, unsigned srcpad,
     link->type    = src->output_pads[srcpad].type;
     av_assert0(AV_PIX_FMT_NONE == -1 && AV_SAMPLE_FMT_NONE == -1);
     link->format  = -1;
+    link->format_hint = -1;
     ff_framequeue_init(&link->fifo, &src->graph->internal->frame_queues);
 
     return 0;
@@ -192,7 +199,11 @@ int avfilter_link_get_channels(AVFilterLink *link)
 
 void ff_filter_set_ready(AVFilterContext *filter, unsigned priority)
 {
-    filter->ready = FFMAX(filter->ready, priority);
+    if (priority <= filter->ready)
+        return;
+    filter->ready = priority;
+    if (filter->graph)
+        ff_filter_graph_update_ready(filter->graph, filter);
 }
 
 /**
@@ -660,6 +671,84 @@ static int default_execute(AVFilterContext *ctx, avfilter_action_func *func, voi
     return 0;
 }
 
+static int64_t profile_time(void)
+{
+#if HAVE_CLOCK_GETTIME && defined(CLOCK_MONOTONIC)
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * INT64_C(1000000000) + ts.tv_nsec;
+#else
+    return av_gettime_relative() * 1000;
+#endif
+}
+
+static int64_t profile_cpu_time(void)
+{
+#if HAVE_CLOCK_GETTIME && defined(CLOCK_THREAD_CPUTIME_ID)
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * INT64_C(1000000000) + ts.tv_nsec;
+#else
+    return 0;
+#endif
+}
+
+typedef struct ProfileJobs {
+    avfilter_action_func *func;
+    void *arg;
+    int64_t *job_time;
+} ProfileJobs;
+
+static int profile_job(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    ProfileJobs *pj = arg;
+    int64_t t0 = profile_time();
+    int ret = pj->func(ctx, pj->arg, jobnr, nb_jobs);
+
+    pj->job_time[jobnr] = profile_time() - t0;
+    return ret;
+}
+
+static int profile_execute(AVFilterContext *ctx, avfilter_action_func *func,
+                           void *arg, int *ret, int nb_jobs)
+{
+    FilterProfile *p = ctx->internal->profile;
+    ProfileJobs pj = { func, arg };
+    int64_t t0, elapsed;
+    int i, threads, r;
+
+    av_fast_malloc(&p->job_time, &p->job_time_size,
+                   nb_jobs * sizeof(*p->job_time));
+    if (!p->job_time)
+        return p->execute(ctx, func, arg, ret, nb_jobs);
+    pj.job_time = p->job_time;
+
+    t0 = profile_time();
+    r = p->execute(ctx, profile_job, &pj, ret, nb_jobs);
+    elapsed = profile_time() - t0;
+
+    threads = ctx->thread_type & AVFILTER_THREAD_SLICE ?
+              FFMIN(nb_jobs, ff_filter_get_nb_threads(ctx)) : 1;
+    p->stats.nb_slice_executions++;
+    p->stats.nb_slice_jobs     += nb_jobs;
+    p->stats.slice_time        += elapsed;
+    p->stats.slice_thread_time += elapsed * threads;
+    for (i = 0; i < nb_jobs; i++)
+        p->stats.slice_busy_time += p->job_time[i];
+    return r;
+}
+
+int ff_filter_profile_init(AVFilterContext *ctx)
+{
+    if (ctx->internal->profile)
+        return 0;
+    if (!(ctx->internal->profile = av_mallocz(sizeof(*ctx->internal->profile))))
+        return AVERROR(ENOMEM);
+    ctx->internal->profile->execute = ctx->internal->execute;
+    ctx->internal->execute = profile_execute;
+    return 0;
+}
+
 AVFilterContext *ff_filter_alloc(const AVFilter *filter, const char *inst_name)
 {
     AVFilterContext *ret;
@@ -696,6 +785,7 @@ AVFilterContext *ff_filter_alloc(const AVFilter *filter, const char *inst_name)
     if (!ret->internal)
         goto err;
     ret->internal->execute = default_execute;
+    ret->internal->ready_index = -1;
 
     ret->nb_inputs = avfilter_pad_count(filter->inputs);
     if (ret->nb_inputs ) {
@@ -795,6 +885,10 @@ void avfilter_free(AVFilterContext *filter)
     av_expr_free(filter->enable);
     filter->enable = NULL;
     av_freep(&filter->var_values);
+    if (filter->internal->profile)
+        av_freep(&filter->internal->profile->job_time);
+    av_freep(&filter->internal->profile);
+    ff_filter_options_free(&filter->internal->init_options);
     av_freep(&filter->internal);
     av_free(filter);
 }
@@ -884,14 +978,135 @@ static int process_options(AVFilterContext *ctx, AVDictionary **options,
     return count;
 }
 
-int avfilter_init_dict(AVFilterContext *ctx, AVDictionary **options)
+static int options_alloc(FilterOptions **popts, const AVFilter *filter,
+                         const void *priv, const AVDictionary *dict,
+                         unsigned thread_type)
 {
-    int ret = 0;
+    FilterOptions *opts;
+    int ret;
 
-    ret = av_opt_set_dict(ctx, options);
-    if (ret < 0) {
-        av_log(ctx, AV_LOG_ERROR, "Error applying generic filter options.\n");
+    opts = av_mallocz(sizeof(*opts));
+    if (!opts)
+        return AVERROR(ENOMEM);
+    *popts = opts;
+    opts->thread_type = thread_type;
+
+    if (filter->priv_class) {
+        opts->priv = av_mallocz(filter->priv_size);
+        if (!opts->priv)
+            return AVERROR(ENOMEM);
+        *(const AVClass **)opts->priv = filter->priv_class;
+        if ((ret = av_opt_copy(opts->priv, priv)) < 0)
+            return ret;
+    }
+    return av_dict_copy(&opts->dict, dict, 0);
+}
+
+static int add_child_options(FilterOptions *opts, AVDictionary *child_opts)
+{
+    AVDictionary **tmp = av_realloc_array(opts->child_opts, opts->nb_child_opts + 1,
+                                          sizeof(*opts->child_opts));
+    if (!tmp) {
+        av_dict_free(&child_opts);
+        return AVERROR(ENOMEM);
+    }
+    opts->child_opts = tmp;
+    opts->child_opts[opts->nb_child_opts++] = child_opts;
+    return 0;
+}
+
+/* Child objects (such as the framesync of the filters with several inputs)
+ * are not part of the private context options copied by av_opt_copy(), so
+ * their options are kept as strings. */
+static int get_child_options(AVDictionary **child_opts, void *child)
+{
+    const AVOption *o = NULL;
+    int ret;
+
+    while ((o = av_opt_next(child, o))) {
+        uint8_t *val;
+
+        if (o->type == AV_OPT_TYPE_CONST ||
+            o->flags & (AV_OPT_FLAG_READONLY | AV_OPT_FLAG_DEPRECATED))
+            continue;
+        if ((ret = av_opt_get(child, o->name, 0, &val)) < 0)
+            return ret;
+        if ((ret = av_dict_set(child_opts, o->name, val, AV_DICT_DONT_STRDUP_VAL)) < 0)
+            return ret;
+    }
+    return 0;
+}
+
+int ff_filter_options_alloc(FilterOptions **popts, const AVFilter *filter,
+                            void *priv, const AVDictionary *dict,
+                            unsigned thread_type)
+{
+    void *child = NULL;
+    int ret;
+
+    if ((ret = options_alloc(popts, filter, priv, dict, thread_type)) < 0)
+        return ret;
+
+    while (filter->priv_class && (child = av_opt_child_next(priv, child))) {
+        AVDictionary *child_opts = NULL;
+
+        if ((ret = get_child_options(&child_opts, child)) < 0) {
+            av_dict_free(&child_opts);
+            return ret;
+        }
+        if ((ret = add_child_options(*popts, child_opts)) < 0)
+            return ret;
+    }
+    return 0;
+}
+
+int ff_filter_options_copy(FilterOptions **dst, const AVFilter *filter,
+                           const FilterOptions *src)
+{
+    int i, ret;
+
+    if ((ret = options_alloc(dst, filter, src->priv, src->dict, src->thread_type)) < 0)
         return ret;
+
+    for (i = 0; i < src->nb_child_opts; i++) {
+        AVDictionary *child_opts = NULL;
+
+        if ((ret = av_dict_copy(&child_opts, src->child_opts[i], 0)) < 0) {
+            av_dict_free(&child_opts);
+            return ret;
+        }
+        if ((ret = add_child_options(*dst, child_opts)) < 0)
+            return ret;
+    }
+    return 0;
+}
+
+void ff_filter_options_free(FilterOptions **opts)
+{
+    int i;
+
+    if (!*opts)
+        return;
+    if ((*opts)->priv)
+        av_opt_free((*opts)->priv);
+    av_freep(&(*opts)->priv);
+    for (i = 0; i < (*opts)->nb_child_opts; i++)
+        av_dict_free(&(*opts)->child_opts[i]);
+    av_freep(&(*opts)->child_opts);
+    av_dict_free(&(*opts)->dict);
+    av_freep(opts);
+}
+
+static int init_filter(AVFilterContext *ctx, AVDictionary **options)
+{
+    int ret;
+
+    if (ctx->graph->keep_options) {
+        ff_filter_options_free(&ctx->internal->init_options);
+        ret = ff_filter_options_alloc(&ctx->internal->init_options, ctx->filter,
+                                      ctx->priv, *options, ctx->thread_type);
+        if (ret < 0)
+            return ret;
     }
 
     if (ctx->filter->flags & AVFILTER_FLAG_SLICE_THREADS &&
@@ -903,24 +1118,70 @@ int avfilter_init_dict(AVFilterContext *ctx, AVDictionary **options)
         ctx->thread_type = 0;
     }
 
-    if (ctx->filter->priv_class) {
-        ret = av_opt_set_dict2(ctx->priv, options, AV_OPT_SEARCH_CHILDREN);
-        if (ret < 0) {
-            av_log(ctx, AV_LOG_ERROR, "Error applying options to the filter.\n");
-            return ret;
-        }
-    }
-
     if (ctx->filter->init_opaque)
         ret = ctx->filter->init_opaque(ctx, NULL);
     else if (ctx->filter->init)
         ret = ctx->filter->init(ctx);
     else if (ctx->filter->init_dict)
         ret = ctx->filter->init_dict(ctx, options);
+    else
+        ret = 0;
 
     return ret;
 }
 
+int ff_filter_init_options(AVFilterContext *ctx, const FilterOptions *opts)
+{
+    AVDictionary *options = NULL;
+    int ret;
+
+    if (ctx->filter->priv_class) {
+        void *child = NULL;
+        int i = 0;
+
+        if ((ret = av_opt_copy(ctx->priv, opts->priv)) < 0)
+            return ret;
+        while (i < opts->nb_child_opts && (child = av_opt_child_next(ctx->priv, child))) {
+            if ((ret = av_dict_copy(&options, opts->child_opts[i++], 0)) < 0 ||
+                (ret = av_opt_set_dict(child, &options)) < 0) {
+                av_dict_free(&options);
+                return ret;
+            }
+            av_dict_free(&options);
+        }
+    }
+    if (ctx->enable_str && (ret = set_enable_expr(ctx, ctx->enable_str)) < 0)
+        return ret;
+    if ((ret = av_dict_copy(&options, opts->dict, 0)) < 0)
+        return ret;
+    ctx->thread_type = opts->thread_type;
+
+    ret = init_filter(ctx, &options);
+    av_dict_free(&options);
+    return ret;
+}
+
+int avfilter_init_dict(AVFilterContext *ctx, AVDictionary **options)
+{
+    int ret = 0;
+
+    ret = av_opt_set_dict(ctx, options);
+    if (ret < 0) {
+        av_log(ctx, AV_LOG_ERROR, "Error applying generic filter options.\n");
+        return ret;
+    }
+
+    if (ctx->filter->priv_class) {
+        ret = av_opt_set_dict2(ctx->priv, options, AV_OPT_SEARCH_CHILDREN);
+        if (ret < 0) {
+            av_log(ctx, AV_LOG_ERROR, "Error applying options to the filter.\n");
+            return ret;
+        }
+    }
+
+    return init_filter(ctx, options);
+}
+
 int avfilter_init_str(AVFilterContext *filter, const char *args)
 {
     AVDictionary *options = NULL;
@@ -1120,6 +1381,12 @@ int ff_filter_frame(AVFilterLink *link, AVFrame *frame)
         av_frame_free(&frame);
         return ret;
     }
+    if (link->dst->internal->profile) {
+        FilterProfile *profile = link->dst->internal->profile;
+        profile->stats.max_queued_frames =
+            FFMAX(profile->stats.max_queued_frames,
+                  ff_framequeue_queued_frames(&link->fifo));
+    }
     ff_filter_set_ready(link->dst, 300);
     return 0;
 
@@ -1135,6 +1402,30 @@ static int samples_ready(AVFilterLink *link, unsigned min)
             link->status_in);
 }
 
+/**
+ * Tell if the samples of a frame are aligned like the ones of the buffers
+ * allocated by ff_get_audio_buffer(), so that they can be given as they are
+ * to filters with SIMD code even after some samples were skipped.
+ */
+static int samples_aligned(const AVFrame *frame, int channels)
+{
+    uintptr_t addr = 0;
+    int i, planes = av_sample_fmt_is_planar(frame->format) ? channels : 1;
+
+    for (i = 0; i < planes; i++)
+        addr |= (uintptr_t)frame->extended_data[i];
+    return !(addr & (av_cpu_max_align() - 1));
+}
+
+/**
+ * Take min to max samples from the link FIFO.
+ *
+ * Samples are only copied when they span several queued frames or would
+ * be misaligned. Otherwise the returned frame is the first queued frame
+ * itself or, when only a part of it is taken, a new reference to its
+ * buffers with the data pointers at the current position: such frames are
+ * not writable as long as the rest of the frame is queued.
+ */
 static int take_samples(AVFilterLink *link, unsigned min, unsigned max,
                         AVFrame **rframe)
 {
@@ -1146,7 +1437,8 @@ static int take_samples(AVFilterLink *link, unsigned min, unsigned max,
        called with enough samples. */
     av_assert1(samples_ready(link, link->min_samples));
     frame0 = frame = ff_framequeue_peek(&link->fifo, 0);
-    if (!link->fifo.samples_skipped && frame->nb_samples >= min && frame->nb_samples <= max) {
+    if (frame->nb_samples >= min && frame->nb_samples <= max &&
+        (!link->fifo.samples_skipped || samples_aligned(frame, link->channels))) {
         *rframe = ff_framequeue_take(&link->fifo);
         return 0;
     }
@@ -1165,6 +1457,16 @@ static int take_samples(AVFilterLink *link, unsigned min, unsigned max,
         frame = ff_framequeue_peek(&link->fifo, nb_frames);
     }
 
+    if (!nb_frames && samples_aligned(frame0, link->channels)) {
+        /* the samples are the beginning of the first frame */
+        if (!(buf = av_frame_clone(frame0)))
+            return AVERROR(ENOMEM);
+        buf->nb_samples = nb_samples;
+        ff_framequeue_skip_samples(&link->fifo, nb_samples, link->time_base);
+        *rframe = buf;
+        return 0;
+    }
+
     buf = ff_get_audio_buffer(link, nb_samples);
     if (!buf)
         return AVERROR(ENOMEM);
@@ -1353,7 +1655,8 @@ static int ff_filter_activate_default(AVFilterContext *filter)
      ff_avfilter_link_set_out_status().
 
    Filters are activated according to the ready field, set using the
-   ff_filter_set_ready(). Eventually, a priority queue will be used.
+   ff_filter_set_ready(), which keeps the filters with a non-0 ready field in
+   a priority queue owned by the graph.
    ff_filter_set_ready() is called whenever anything could cause progress to
    be possible. Marking a filter ready when it is not is not a problem,
    except for the small overhead it causes.
@@ -1420,14 +1723,27 @@ static int ff_filter_activate_default(AVFilterContext *filter)
 
 int ff_filter_activate(AVFilterContext *filter)
 {
+    FilterProfile *profile = filter->internal->profile;
+    int64_t t0 = 0, cpu0 = 0;
     int ret;
 
     /* Generic timeline support is not yet implemented but should be easy */
     av_assert1(!(filter->filter->flags & AVFILTER_FLAG_SUPPORT_TIMELINE_GENERIC &&
                  filter->filter->activate));
     filter->ready = 0;
+    if (filter->graph)
+        ff_filter_graph_update_ready(filter->graph, filter);
+    if (profile) {
+        t0   = profile_time();
+        cpu0 = profile_cpu_time();
+    }
     ret = filter->filter->activate ? filter->filter->activate(filter) :
           ff_filter_activate_default(filter);
+    if (profile) {
+        profile->stats.nb_activations++;
+        profile->stats.activate_time     += profile_time()     - t0;
+        profile->stats.activate_cpu_time += profile_cpu_time() - cpu0;
+    }
     if (ret == FFERROR_NOT_READY)
         ret = 0;
     return ret;
@@ -642,6 +642,15 @@ struct AVFilterLink {
      */
     int status_out;
 
+    /**
+     * Format, sample rate and channel layout negotiated on the link of a
+     * filter graph template this link was instantiated from; format_hint
+     * is -1 if there is none.
+     */
+    int format_hint;
+    int sample_rate_hint;
+    uint64_t channel_layout_hint;
+
 #endif /* FF_INTERNAL_FIELDS */
 
 };
@@ -907,6 +916,12 @@ typedef struct AVFilterGraph {
     int sink_links_count;
 
     unsigned disable_auto_convert;
+
+    int format_negotiation; ///< format negotiation mode, Access ONLY through AVOptions
+
+    int profile; ///< gather profiling statistics, Access ONLY through AVOptions
+
+    int keep_options; ///< keep the filters options for templates, Access ONLY through AVOptions
 } AVFilterGraph;
 
 /**
@@ -1141,6 +1156,119 @@ int avfilter_graph_queue_command(AVFilterGraph *graph, const char *target, const
  */
 char *avfilter_graph_dump(AVFilterGraph *graph, const char *options);
 
+/**
+ * Profiling statistics of a filter.
+ *
+ * New fields can be added to the end with minor version bumps.
+ */
+typedef struct AVFilterStats {
+    /**
+     * Number of times the filter was activated.
+     */
+    int64_t nb_activations;
+
+    /**
+     * Wall clock time spent in the activations of the filter, including its
+     * slice threaded executions, in nanoseconds.
+     */
+    int64_t activate_time;
+
+    /**
+     * CPU time of the calling thread spent in the activations of the
+     * filter, in nanoseconds; 0 if not supported on the platform.
+     */
+    int64_t activate_cpu_time;
+
+    int64_t frames_in;          ///< frames consumed on all the inputs
+    int64_t frames_out;         ///< frames sent on all the outputs
+    int64_t queued_frames;      ///< frames currently queued on the inputs
+    int64_t max_queued_frames;  ///< most frames ever queued on a single input
+
+    int64_t nb_slice_executions; ///< number of slice threaded executions
+    int64_t nb_slice_jobs;      ///< number of jobs run by these executions
+
+    /**
+     * Wall clock time spent in the slice threaded executions, in
+     * nanoseconds.
+     */
+    int64_t slice_time;
+
+    /**
+     * Sum of the wall clock time of every execution multiplied by the number
+     * of threads available to it, in nanoseconds.
+     */
+    int64_t slice_thread_time;
+
+    /**
+     * Time spent running the jobs, summed over all jobs, in nanoseconds.
+     * slice_busy_time / slice_thread_time measures how well the threads were
+     * used by the filter.
+     */
+    int64_t slice_busy_time;
+} AVFilterStats;
+
+/**
+ * Get the profiling statistics of a filter of a graph.
+ *
+ * The statistics are only gathered for graphs with the "profile" option
+ * set before avfilter_graph_config() is called.
+ *
+ * @param graph  the filter graph
+ * @param idx    index of the filter in graph->filters
+ * @return  the statistics of the filter, valid until the graph is freed and
+ *          updated by every call for the same filter; NULL if the filter is
+ *          not profiled or idx is invalid
+ */
+const AVFilterStats *avfilter_graph_get_stats(AVFilterGraph *graph, unsigned idx);
+
+/**
+ * Immutable snapshot of the filters and links of a filter graph, from which
+ * identical graphs can be created without parsing their description or
+ * options again.
+ */
+typedef struct AVFilterGraphTemplate AVFilterGraphTemplate;
+
+/**
+ * Create a template from a filter graph.
+ *
+ * The graph must have had the "keep_options" option set before its filters
+ * were initialized, so that their options are known as they were before
+ * initialization; options changed after that are not part of the template.
+ * If the graph is configured, the formats negotiated on its links, and the
+ * conversion filters inserted automatically, are part of the template too.
+ *
+ * @param tmpl   set to the newly allocated template on success
+ * @param graph  the filter graph, which is not modified
+ * @return >= 0 in case of success, a negative AVERROR code otherwise
+ */
+int avfilter_graph_template_create(AVFilterGraphTemplate **tmpl,
+                                   const AVFilterGraph *graph);
+
+/**
+ * Add the filters and links of a template to a filter graph.
+ *
+ * The filters are initialized from the options stored in the template and
+ * keep their names, so that the sources and sinks can be retrieved with
+ * avfilter_graph_get_filter(). The graph must then be configured with
+ * avfilter_graph_config(), after the buffer sources were given other
+ * parameters with av_buffersrc_parameters_set() if needed. The formats
+ * negotiated in the template are reused as long as all the filters still
+ * support them, otherwise the formats are negotiated again.
+ *
+ * The options of the graph itself, such as the number of threads, are not
+ * part of the template.
+ *
+ * @return >= 0 in case of success, a negative AVERROR code otherwise; the
+ *         filters already added to the graph are left in it on failure
+ */
+int avfilter_graph_template_instantiate(const AVFilterGraphTemplate *tmpl,
+                                        AVFilterGraph *graph);
+
+/**
+ * Free a filter graph template and set *tmpl to NULL.
+ */
+void avfilter_graph_template_free(AVFilterGraphTemplate **tmpl);
+
 /**
  * Request a frame on the oldest sink link.
  *
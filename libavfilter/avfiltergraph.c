@@ -32,6 +32,7 @@
 #include "libavutil/internal.h"
 #include "libavutil/opt.h"
 #include "libavutil/pixdesc.h"
+#include "libavutil/time.h"
 
 #define FF_INTERNAL_FIELDS 1
 #include "framequeue.h"
@@ -42,6 +43,11 @@
 #include "internal.h"
 #include "thread.h"
 
+enum FormatNegotiation {
+    FORMAT_NEGOTIATION_GREEDY,
+    FORMAT_NEGOTIATION_GLOBAL,
+};
+
 #define OFFSET(x) offsetof(AVFilterGraph, x)
 #define F AV_OPT_FLAG_FILTERING_PARAM
 #define V AV_OPT_FLAG_VIDEO_PARAM
@@ -56,6 +62,16 @@ static const AVOption filtergraph_options[] = {
         AV_OPT_TYPE_STRING, {.str = NULL}, 0, 0, F|V },
     {"aresample_swr_opts"   , "default aresample filter options"    , OFFSET(aresample_swr_opts)    ,
         AV_OPT_TYPE_STRING, {.str = NULL}, 0, 0, F|A },
+    { "format_negotiation", "Format negotiation mode", OFFSET(format_negotiation),
+        AV_OPT_TYPE_INT, { .i64 = FORMAT_NEGOTIATION_GREEDY }, 0, 1, F|V|A, "format_negotiation" },
+        { "greedy", "merge the formats lists link by link", 0, AV_OPT_TYPE_CONST,
+            { .i64 = FORMAT_NEGOTIATION_GREEDY }, .flags = F|V|A, .unit = "format_negotiation" },
+        { "global", "minimize the cost of the conversions over the whole graph", 0, AV_OPT_TYPE_CONST,
+            { .i64 = FORMAT_NEGOTIATION_GLOBAL }, .flags = F|V|A, .unit = "format_negotiation" },
+    { "profile", "Gather per-filter profiling statistics", OFFSET(profile),
+        AV_OPT_TYPE_BOOL, { .i64 = 0 }, 0, 1, F|V|A },
+    { "keep_options", "Keep the filters options to create templates", OFFSET(keep_options),
+        AV_OPT_TYPE_BOOL, { .i64 = 0 }, 0, 1, F|V|A },
     { NULL },
 };
 
@@ -99,14 +115,93 @@ AVFilterGraph *avfilter_graph_alloc(void)
     return ret;
 }
 
+static int ready_before(const AVFilterContext *a, const AVFilterContext *b)
+{
+    if (a->ready != b->ready)
+        return a->ready > b->ready;
+    return a->internal->graph_index < b->internal->graph_index;
+}
+
+static void ready_heap_set(AVFilterGraphInternal *gi, unsigned idx,
+                           AVFilterContext *filter)
+{
+    gi->ready_heap[idx] = filter;
+    filter->internal->ready_index = idx;
+}
+
+/**
+ * Move the heap entry at idx to its place according to ready_before().
+ */
+static void ready_heap_fix(AVFilterGraphInternal *gi, unsigned idx)
+{
+    AVFilterContext *filter = gi->ready_heap[idx];
+
+    while (idx) {
+        unsigned parent = (idx - 1) / 2;
+        if (!ready_before(filter, gi->ready_heap[parent]))
+            break;
+        ready_heap_set(gi, idx, gi->ready_heap[parent]);
+        idx = parent;
+    }
+    for (;;) {
+        unsigned child = 2 * idx + 1;
+        if (child >= gi->nb_ready)
+            break;
+        if (child + 1 < gi->nb_ready &&
+            ready_before(gi->ready_heap[child + 1], gi->ready_heap[child]))
+            child++;
+        if (!ready_before(gi->ready_heap[child], filter))
+            break;
+        ready_heap_set(gi, idx, gi->ready_heap[child]);
+        idx = child;
+    }
+    ready_heap_set(gi, idx, filter);
+}
+
+void ff_filter_graph_update_ready(AVFilterGraph *graph, AVFilterContext *filter)
+{
+    AVFilterGraphInternal *gi = graph->internal;
+    int idx = filter->internal->ready_index;
+
+    if (!filter->ready) {
+        AVFilterContext *last;
+
+        if (idx < 0)
+            return;
+        filter->internal->ready_index = -1;
+        last = gi->ready_heap[--gi->nb_ready];
+        if (last != filter) {
+            ready_heap_set(gi, idx, last);
+            ready_heap_fix(gi, idx);
+        }
+        return;
+    }
+
+    if (idx < 0) {
+        av_assert0(gi->nb_ready < graph->nb_filters);
+        idx = gi->nb_ready++;
+        ready_heap_set(gi, idx, filter);
+    }
+    ready_heap_fix(gi, idx);
+}
+
 void ff_filter_graph_remove_filter(AVFilterGraph *graph, AVFilterContext *filter)
 {
     int i, j;
     for (i = 0; i < graph->nb_filters; i++) {
         if (graph->filters[i] == filter) {
+            AVFilterContext *moved = graph->filters[graph->nb_filters - 1];
+
+            if (filter->ready) {
+                filter->ready = 0;
+                ff_filter_graph_update_ready(graph, filter);
+            }
             FFSWAP(AVFilterContext*, graph->filters[i],
                    graph->filters[graph->nb_filters - 1]);
             graph->nb_filters--;
+            moved->internal->graph_index = i;
+            if (moved->internal->ready_index >= 0)
+                ready_heap_fix(graph->internal, moved->internal->ready_index);
             filter->graph = NULL;
             for (j = 0; j<filter->nb_outputs; j++)
                 if (filter->outputs[j])
@@ -135,6 +230,7 @@ void avfilter_graph_free(AVFilterGraph **graph)
     av_freep(&(*graph)->resample_lavr_opts);
 #endif
     av_freep(&(*graph)->filters);
+    av_freep(&(*graph)->internal->ready_heap);
     av_freep(&(*graph)->internal);
     av_freep(graph);
 }
@@ -171,7 +267,7 @@ AVFilterContext *avfilter_graph_alloc_filter(AVFilterGraph *graph,
                                              const AVFilter *filter,
                                              const char *name)
 {
-    AVFilterContext **filters, *s;
+    AVFilterContext **filters, **ready_heap, *s;
 
     if (graph->thread_type && !graph->internal->thread_execute) {
         if (graph->execute) {
@@ -196,6 +292,16 @@ AVFilterContext *avfilter_graph_alloc_filter(AVFilterGraph *graph,
     }
 
     graph->filters = filters;
+
+    ready_heap = av_realloc_array(graph->internal->ready_heap,
+                                  graph->nb_filters + 1, sizeof(*ready_heap));
+    if (!ready_heap) {
+        avfilter_free(s);
+        return NULL;
+    }
+    graph->internal->ready_heap = ready_heap;
+
+    s->internal->graph_index = graph->nb_filters;
     graph->filters[graph->nb_filters++] = s;
 
     s->graph = graph;
@@ -372,64 +478,699 @@ static int formats_declared(AVFilterContext *f)
     return 1;
 }
 
-static AVFilterFormats *clone_filter_formats(AVFilterFormats *arg)
+/**
+ * Filters and links which still need work during the query_formats() rounds,
+ * in graph order.
+ */
+typedef struct FormatsWorklist {
+    AVFilterContext **filters;  ///< filters which did not declare their formats
+    int nb_filters;
+    AVFilterLink **links;       ///< links with formats lists not merged yet
+    int nb_links;
+} FormatsWorklist;
+
+static int worklist_init(FormatsWorklist *wl, AVFilterGraph *graph)
 {
-    AVFilterFormats *a = av_memdup(arg, sizeof(*arg));
-    if (a) {
-        a->refcount = 0;
-        a->refs     = NULL;
-        a->formats  = av_memdup(a->formats, sizeof(*a->formats) * a->nb_formats);
-        if (!a->formats && arg->formats)
-            av_freep(&a);
+    int i, j, nb_links = 0;
+
+    for (i = 0; i < graph->nb_filters; i++)
+        nb_links += graph->filters[i]->nb_inputs;
+
+    wl->filters = av_malloc_array(graph->nb_filters, sizeof(*wl->filters));
+    wl->links   = av_malloc_array(nb_links,          sizeof(*wl->links));
+    if (!wl->filters || !wl->links)
+        return AVERROR(ENOMEM);
+
+    wl->nb_filters = wl->nb_links = 0;
+    for (i = 0; i < graph->nb_filters; i++) {
+        AVFilterContext *f = graph->filters[i];
+
+        wl->filters[wl->nb_filters++] = f;
+        for (j = 0; j < f->nb_inputs; j++)
+            if (f->inputs[j])
+                wl->links[wl->nb_links++] = f->inputs[j];
     }
-    return a;
+    return 0;
 }
 
-static int can_merge_formats(AVFilterFormats *a_arg,
-                             AVFilterFormats *b_arg,
-                             enum AVMediaType type,
-                             int is_sample_rate)
+static void worklist_uninit(FormatsWorklist *wl)
 {
-    AVFilterFormats *a, *b, *ret;
-    if (a_arg == b_arg)
-        return 1;
-    a = clone_filter_formats(a_arg);
-    b = clone_filter_formats(b_arg);
+    av_freep(&wl->filters);
+    av_freep(&wl->links);
+}
+
+/*
+ * Global format negotiation
+ *
+ * With the "global" negotiation mode, once all the filters have declared
+ * their formats and before any list is merged, every formats list is reduced
+ * to the single format which minimizes the total cost of the conversions
+ * the graph will need. The lists are the nodes of a graph whose edges are
+ * the links; a conversion is needed on a link when the formats chosen for
+ * both of its ends differ. The normal merging then inserts the conversion
+ * filters exactly where the plan wants them.
+ *
+ * The optimum is exact on forests, which covers most filter graphs: it is
+ * found by dynamic programming on a spanning tree of each connected
+ * component. The few remaining links, closing cycles, are then handled by
+ * iterated local improvements.
+ */
 
-    if (!a || !b) {
-        if (a)
-            av_freep(&a->formats);
-        if (b)
-            av_freep(&b->formats);
+/* Cost of a conversion, in arbitrary units. The base cost dominates so that
+ * the number of conversions is minimized first; the bandwidth and the
+ * precision loss only choose between plans with as many conversions. */
+#define CONV_COST_BASE       10000
+#define CONV_COST_IMPOSSIBLE (1 << 24)
 
-        av_freep(&a);
-        av_freep(&b);
+static int pix_fmt_conv_cost(enum AVPixelFormat src, enum AVPixelFormat dst)
+{
+    const AVPixFmtDescriptor *sd = av_pix_fmt_desc_get(src);
+    const AVPixFmtDescriptor *dd = av_pix_fmt_desc_get(dst);
+    int loss, cost;
+
+    if (!sd || !dd || ((sd->flags | dd->flags) & AV_PIX_FMT_FLAG_HWACCEL))
+        return CONV_COST_IMPOSSIBLE;
+
+    /* memory bandwidth: bits read and written per pixel */
+    cost = CONV_COST_BASE + av_get_padded_bits_per_pixel(sd) +
+                            av_get_padded_bits_per_pixel(dd);
+
+    loss = av_get_pix_fmt_loss(dst, src, !!(sd->flags & AV_PIX_FMT_FLAG_ALPHA));
+    if (loss & FF_LOSS_RESOLUTION) cost += 200;
+    if (loss & FF_LOSS_DEPTH)      cost += 300;
+    if (loss & FF_LOSS_COLORSPACE) cost += 100;
+    if (loss & FF_LOSS_ALPHA)      cost += 300;
+    if (loss & FF_LOSS_COLORQUANT) cost += 300;
+    if (loss & FF_LOSS_CHROMA)     cost += 500;
+    return cost;
+}
+
+static int sample_fmt_conv_cost(enum AVSampleFormat src, enum AVSampleFormat dst)
+{
+    enum AVSampleFormat ps = av_get_packed_sample_fmt(src);
+    enum AVSampleFormat pd = av_get_packed_sample_fmt(dst);
+    int bs = av_get_bytes_per_sample(src);
+    int bd = av_get_bytes_per_sample(dst);
+    int cost = CONV_COST_BASE + 8 * (bs + bd);
+
+    if (bd < bs)
+        cost += 300 * (bs - bd);
+    /* clipping of float samples */
+    if ((ps == AV_SAMPLE_FMT_FLT || ps == AV_SAMPLE_FMT_DBL) &&
+        pd != AV_SAMPLE_FMT_FLT && pd != AV_SAMPLE_FMT_DBL)
+        cost += 100;
+    return cost;
+}
 
+typedef struct PlanNode {
+    AVFilterFormats *formats;
+    enum AVMediaType type;
+    int choice;         ///< index of the chosen format in formats
+    int parent;         ///< parent in the spanning tree, -1 for a root
+    int parent_edge;
+    int64_t *acc;       ///< cost of the subtree for each candidate format
+    int *best;          ///< best candidate for each candidate of the parent
+} PlanNode;
+
+typedef struct PlanEdge {
+    AVFilterLink *link;
+    int src, dst;       ///< nodes of link->in_formats and link->out_formats
+} PlanEdge;
+
+typedef struct FormatsPlan {
+    PlanNode *nodes;
+    int nb_nodes;
+    PlanEdge *edges;
+    int nb_edges;
+    int *adj;           ///< edges incident to each node
+    int *adj_start;     ///< index of the first edge of each node in adj
+    int32_t *pix_cost;  ///< pixel format conversion costs, computed lazily
+} FormatsPlan;
+
+typedef struct PlanListRef {
+    const AVFilterFormats *formats;
+    int node;
+} PlanListRef;
+
+static int cmp_list_ref(const void *a, const void *b)
+{
+    uintptr_t la = (uintptr_t)((const PlanListRef *)a)->formats;
+    uintptr_t lb = (uintptr_t)((const PlanListRef *)b)->formats;
+
+    return (la > lb) - (la < lb);
+}
+
+static int plan_cost(FormatsPlan *p, enum AVMediaType type, int src, int dst)
+{
+    if (src == dst)
         return 0;
+    if (type == AVMEDIA_TYPE_AUDIO) {
+        if ((unsigned)src >= AV_SAMPLE_FMT_NB || (unsigned)dst >= AV_SAMPLE_FMT_NB)
+            return CONV_COST_IMPOSSIBLE;
+        return sample_fmt_conv_cost(src, dst);
     }
+    if ((unsigned)src >= AV_PIX_FMT_NB || (unsigned)dst >= AV_PIX_FMT_NB)
+        return CONV_COST_IMPOSSIBLE;
+    if (p->pix_cost[src * AV_PIX_FMT_NB + dst] < 0)
+        p->pix_cost[src * AV_PIX_FMT_NB + dst] = pix_fmt_conv_cost(src, dst);
+    return p->pix_cost[src * AV_PIX_FMT_NB + dst];
+}
 
-    if (is_sample_rate) {
-        ret = ff_merge_samplerates(a, b);
-    } else {
-        ret = ff_merge_formats(a, b, type);
+/* Cost of edge e when node u uses the format fu and the other end uses fv. */
+static int plan_edge_cost(FormatsPlan *p, const PlanEdge *e, int u, int fu, int fv)
+{
+    return e->src == u ? plan_cost(p, e->link->type, fu, fv)
+                       : plan_cost(p, e->link->type, fv, fu);
+}
+
+static void plan_uninit(FormatsPlan *p)
+{
+    int i;
+
+    for (i = 0; i < p->nb_nodes; i++) {
+        av_freep(&p->nodes[i].acc);
+        av_freep(&p->nodes[i].best);
     }
-    if (ret) {
-        av_freep(&ret->formats);
-        av_freep(&ret->refs);
-        av_freep(&ret);
+    av_freep(&p->nodes);
+    av_freep(&p->edges);
+    av_freep(&p->adj);
+    av_freep(&p->adj_start);
+    av_freep(&p->pix_cost);
+}
+
+/**
+ * Build the nodes and edges of the plan from the links of the worklist.
+ *
+ * @return 1 if the graph can be planned, 0 if not, a negative error code
+ */
+static int plan_build(FormatsPlan *p, FormatsWorklist *wl, void *log_ctx)
+{
+    PlanListRef *refs;
+    int i, j, nb_refs = 0;
+
+    p->edges = av_malloc_array(wl->nb_links, sizeof(*p->edges));
+    refs     = av_malloc_array(wl->nb_links, 2 * sizeof(*refs));
+    if (!p->edges || !refs) {
+        av_free(refs);
+        return AVERROR(ENOMEM);
+    }
+    for (i = 0; i < wl->nb_links; i++) {
+        AVFilterLink *link = wl->links[i];
+
+        if (link->type != AVMEDIA_TYPE_VIDEO && link->type != AVMEDIA_TYPE_AUDIO)
+            continue;
+        if (!link->in_formats || !link->out_formats) {
+            av_log(log_ctx, AV_LOG_VERBOSE, "Formats of link %s -> %s unknown "
+                   "before merging\n", link->src->name, link->dst->name);
+            av_free(refs);
+            return 0;
+        }
+        /* the link by link merging reports the missing formats */
+        if (!link->in_formats->nb_formats || !link->out_formats->nb_formats) {
+            av_log(log_ctx, AV_LOG_VERBOSE, "No formats for link %s -> %s\n",
+                   link->src->name, link->dst->name);
+            av_free(refs);
+            return 0;
+        }
+        if (link->in_formats == link->out_formats)
+            continue;
+        p->edges[p->nb_edges++].link = link;
+        refs[nb_refs++].formats = link->in_formats;
+        refs[nb_refs++].formats = link->out_formats;
+    }
+
+    /* number the lists in graph order */
+    for (i = 0; i < nb_refs; i++)
+        refs[i].node = -1;
+    qsort(refs, nb_refs, sizeof(*refs), cmp_list_ref);
+    for (i = j = 0; i < nb_refs; i++)
+        if (!j || refs[i].formats != refs[j - 1].formats)
+            refs[j++] = refs[i];
+    nb_refs = j;
+
+    p->nodes = av_calloc(nb_refs, sizeof(*p->nodes));
+    if (!p->nodes) {
+        av_free(refs);
+        return AVERROR(ENOMEM);
+    }
+    for (i = 0; i < p->nb_edges; i++) {
+        PlanEdge *e = &p->edges[i];
+
+        for (j = 0; j < 2; j++) {
+            PlanListRef key = { j ? e->link->out_formats : e->link->in_formats };
+            PlanListRef *ref = bsearch(&key, refs, nb_refs, sizeof(*refs),
+                                       cmp_list_ref);
+
+            if (ref->node < 0) {
+                PlanNode *n = &p->nodes[p->nb_nodes];
+
+                n->formats = (AVFilterFormats *)ref->formats;
+                n->type    = e->link->type;
+                ref->node  = p->nb_nodes++;
+            } else if (p->nodes[ref->node].type != e->link->type) {
+                av_free(refs);
+                return 0;
+            }
+            *(j ? &e->dst : &e->src) = ref->node;
+        }
+    }
+    av_free(refs);
+
+    p->adj_start = av_calloc(p->nb_nodes + 1, sizeof(*p->adj_start));
+    p->adj       = av_malloc_array(p->nb_edges, 2 * sizeof(*p->adj));
+    p->pix_cost  = av_malloc_array(AV_PIX_FMT_NB * AV_PIX_FMT_NB,
+                                   sizeof(*p->pix_cost));
+    if (!p->adj_start || !p->adj || !p->pix_cost)
+        return AVERROR(ENOMEM);
+    memset(p->pix_cost, 0xff, AV_PIX_FMT_NB * AV_PIX_FMT_NB * sizeof(*p->pix_cost));
+
+    for (i = 0; i < p->nb_edges; i++) {
+        p->adj_start[p->edges[i].src + 1]++;
+        p->adj_start[p->edges[i].dst + 1]++;
+    }
+    for (i = 0; i < p->nb_nodes; i++)
+        p->adj_start[i + 1] += p->adj_start[i];
+    for (i = 0; i < p->nb_edges; i++) {
+        p->adj[p->adj_start[p->edges[i].src]++] = i;
+        p->adj[p->adj_start[p->edges[i].dst]++] = i;
+    }
+    for (i = p->nb_nodes; i > 0; i--)
+        p->adj_start[i] = p->adj_start[i - 1];
+    p->adj_start[0] = 0;
+
+    return 1;
+}
+
+/**
+ * Compute the cost of the subtree of node u for each format of its parent
+ * and add it to the subtree cost of the parent.
+ */
+static int plan_reduce_node(FormatsPlan *p, int u, int *index)
+{
+    PlanNode *n = &p->nodes[u], *parent = &p->nodes[n->parent];
+    const PlanEdge *e = &p->edges[n->parent_edge];
+    int nu = n->formats->nb_formats, np = parent->formats->nb_formats;
+    int64_t min_acc = INT64_MAX;
+    int j, k;
+
+    if (!(n->best = av_malloc_array(np, sizeof(*n->best))))
+        return AVERROR(ENOMEM);
+    for (j = 0; j < nu; j++) {
+        min_acc = FFMIN(min_acc, n->acc[j]);
+        index[n->formats->formats[j]] = j;
+    }
+
+    for (k = 0; k < np; k++) {
+        int fp = parent->formats->formats[k];
+        int64_t best_cost = INT64_MAX;
+        int best = 0;
+
+        /* keeping the format of the parent is optimal when the subtree does
+           not save more than the cost of any conversion */
+        j = index[fp];
+        if (j >= 0 && n->acc[j] <= min_acc + CONV_COST_BASE) {
+            best      = j;
+            best_cost = n->acc[j];
+        } else {
+            for (j = 0; j < nu; j++) {
+                int64_t cost = n->acc[j] +
+                    plan_edge_cost(p, e, u, n->formats->formats[j], fp);
+                if (cost < best_cost) {
+                    best_cost = cost;
+                    best      = j;
+                }
+            }
+        }
+        n->best[k]      = best;
+        parent->acc[k] += best_cost;
+    }
+
+    for (j = 0; j < nu; j++)
+        index[n->formats->formats[j]] = -1;
+    return 0;
+}
+
+/**
+ * Choose the formats of all the nodes of the plan.
+ *
+ * @return the number of links closing cycles, or a negative error code
+ */
+static int plan_solve(FormatsPlan *p)
+{
+    int index[FFMAX((int)AV_PIX_FMT_NB, (int)AV_SAMPLE_FMT_NB)];
+    uint8_t *edge_used;
+    int *order, i, j, k, nb_order = 0, nb_cycles = 0, ret = 0;
+
+    order     = av_malloc_array(p->nb_nodes, sizeof(*order));
+    edge_used = av_mallocz(p->nb_edges);
+    if (!order || !edge_used) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+    memset(index, 0xff, sizeof(index));
+
+    /* breadth-first spanning forest, roots in graph order */
+    for (i = 0; i < p->nb_nodes; i++) {
+        p->nodes[i].parent = -2;
+        if (!(p->nodes[i].acc = av_calloc(p->nodes[i].formats->nb_formats,
+                                          sizeof(*p->nodes[i].acc)))) {
+            ret = AVERROR(ENOMEM);
+            goto end;
+        }
+    }
+    for (i = 0; i < p->nb_nodes; i++) {
+        int head = nb_order;
+
+        if (p->nodes[i].parent != -2)
+            continue;
+        p->nodes[i].parent = -1;
+        order[nb_order++]  = i;
+        for (; head < nb_order; head++) {
+            int u = order[head];
+
+            for (j = p->adj_start[u]; j < p->adj_start[u + 1]; j++) {
+                const PlanEdge *e = &p->edges[p->adj[j]];
+                int v = e->src == u ? e->dst : e->src;
+
+                if (p->nodes[v].parent != -2)
+                    continue;
+                p->nodes[v].parent      = u;
+                p->nodes[v].parent_edge = p->adj[j];
+                edge_used[p->adj[j]]    = 1;
+                order[nb_order++] = v;
+            }
+        }
+    }
+
+    /* exact minimization on the forest, leaves first */
+    for (i = nb_order - 1; i >= 0; i--)
+        if (p->nodes[order[i]].parent >= 0 &&
+            (ret = plan_reduce_node(p, order[i], index)) < 0)
+            goto end;
+    for (i = 0; i < nb_order; i++) {
+        PlanNode *n = &p->nodes[order[i]];
+
+        if (n->parent >= 0) {
+            n->choice = n->best[p->nodes[n->parent].choice];
+            continue;
+        }
+        n->choice = 0;
+        for (k = 1; k < n->formats->nb_formats; k++)
+            if (n->acc[k] < n->acc[n->choice])
+                n->choice = k;
+    }
+
+    /* the links closing cycles were ignored; improve the assignment
+       locally until it does not change anymore */
+    for (i = 0; i < p->nb_edges; i++)
+        nb_cycles += !edge_used[i];
+    for (k = 0; nb_cycles && k < 16; k++) {
+        int changed = 0;
+
+        for (i = 0; i < nb_order; i++) {
+            int u = order[i], best = p->nodes[u].choice;
+            int64_t best_cost = INT64_MAX;
+
+            for (j = 0; j < p->nodes[u].formats->nb_formats; j++) {
+                int fu = p->nodes[u].formats->formats[j];
+                int64_t cost = 0;
+                int l;
+
+                for (l = p->adj_start[u]; l < p->adj_start[u + 1]; l++) {
+                    const PlanEdge *e = &p->edges[p->adj[l]];
+                    const PlanNode *v = &p->nodes[e->src == u ? e->dst : e->src];
+
+                    cost += plan_edge_cost(p, e, u, fu,
+                                           v->formats->formats[v->choice]);
+                }
+                if (cost < best_cost ||
+                    (cost == best_cost && j == p->nodes[u].choice)) {
+                    best_cost = cost;
+                    best      = j;
+                }
+            }
+            changed |= best != p->nodes[u].choice;
+            p->nodes[u].choice = best;
+        }
+        if (!changed)
+            break;
+    }
+    ret = nb_cycles;
+
+end:
+    av_free(order);
+    av_free(edge_used);
+    return ret;
+}
+
+static int uf_find(int *parent, int i)
+{
+    while (parent[i] != i)
+        i = parent[i] = parent[parent[i]];
+    return i;
+}
+
+/**
+ * Count the conversions the link by link merging would insert, for
+ * comparison with the plan.
+ */
+static int plan_count_greedy(FormatsPlan *p)
+{
+    int *parent, *nb, **formats, i, j, k, count = 0;
+
+    parent  = av_malloc_array(p->nb_nodes, sizeof(*parent));
+    nb      = av_malloc_array(p->nb_nodes, sizeof(*nb));
+    formats = av_calloc(p->nb_nodes, sizeof(*formats));
+    if (!parent || !nb || !formats) {
+        count = AVERROR(ENOMEM);
+        goto end;
+    }
+    for (i = 0; i < p->nb_nodes; i++) {
+        const AVFilterFormats *f = p->nodes[i].formats;
+
+        parent[i] = i;
+        nb[i]     = f->nb_formats;
+        if (!(formats[i] = av_memdup(f->formats, nb[i] * sizeof(*f->formats)))) {
+            count = AVERROR(ENOMEM);
+            goto end;
+        }
+    }
+
+    for (i = 0; i < p->nb_edges; i++) {
+        const PlanEdge *e = &p->edges[i];
+        int a = uf_find(parent, e->src), b = uf_find(parent, e->dst);
+        AVFilterFormats fa = { 0 }, fb = { 0 };
+
+        if (a == b)
+            continue;
+        fa.formats = formats[a]; fa.nb_formats = nb[a];
+        fb.formats = formats[b]; fb.nb_formats = nb[b];
+        if (!ff_can_merge_formats(&fa, &fb, e->link->type)) {
+            count++;
+            continue;
+        }
+        for (j = k = 0; j < nb[a]; j++) {
+            int l;
+            for (l = 0; l < nb[b] && formats[b][l] != formats[a][j]; l++);
+            if (l < nb[b])
+                formats[a][k++] = formats[a][j];
+        }
+        nb[a]     = k;
+        parent[b] = a;
+    }
+
+end:
+    if (formats)
+        for (i = 0; i < p->nb_nodes; i++)
+            av_free(formats[i]);
+    av_free(formats);
+    av_free(parent);
+    av_free(nb);
+    return count;
+}
+
+static const char *plan_format_name(enum AVMediaType type, int format)
+{
+    const char *name = type == AVMEDIA_TYPE_VIDEO ?
+                       av_get_pix_fmt_name(format) : av_get_sample_fmt_name(format);
+    return name ? name : "?";
+}
+
+/**
+ * Reduce all the formats lists of the worklist links to the formats
+ * minimizing the cost of the conversions over the whole graph.
+ */
+static int plan_formats(AVFilterGraph *graph, FormatsWorklist *wl)
+{
+    FormatsPlan p = { 0 };
+    int64_t total = 0;
+    int i, nb_conv = 0, nb_greedy, nb_cycles, ret;
+
+    if ((ret = plan_build(&p, wl, graph)) <= 0) {
+        if (!ret)
+            av_log(graph, AV_LOG_VERBOSE, "Global format negotiation not "
+                   "possible, merging formats link by link\n");
+        goto end;
+    }
+    if ((nb_cycles = ret = plan_solve(&p)) < 0)
+        goto end;
+    if ((nb_greedy = ret = plan_count_greedy(&p)) < 0)
+        goto end;
+
+    for (i = 0; i < p.nb_edges; i++) {
+        const PlanEdge *e = &p.edges[i];
+        const PlanNode *src = &p.nodes[e->src], *dst = &p.nodes[e->dst];
+        int fs = src->formats->formats[src->choice];
+        int fd = dst->formats->formats[dst->choice];
+        int cost = plan_cost(&p, e->link->type, fs, fd);
+
+        if (!cost)
+            continue;
+        nb_conv++;
+        total += cost;
+        av_log(graph, AV_LOG_VERBOSE, "Conversion planned on link "
+               "'%s' -> '%s': %s -> %s, cost %d\n",
+               e->link->src->name, e->link->dst->name,
+               plan_format_name(e->link->type, fs),
+               plan_format_name(e->link->type, fd), cost);
+    }
+    av_log(graph, AV_LOG_VERBOSE, "Format plan for %d lists and %d links "
+           "(%d closing cycles): %d conversions with a cost of %"PRId64", "
+           "%d with link by link merging\n", p.nb_nodes, p.nb_edges,
+           nb_cycles, nb_conv, total, nb_greedy);
+
+    for (i = 0; i < p.nb_nodes; i++) {
+        AVFilterFormats *f = p.nodes[i].formats;
+
+        f->formats[0]  = f->formats[p.nodes[i].choice];
+        f->nb_formats  = 1;
+    }
+    ret = 0;
+
+end:
+    plan_uninit(&p);
+    return ret;
+}
+
+/*
+ * Format hints
+ *
+ * The links of a graph instantiated from a template carry the formats
+ * negotiated on the template. If all of them are still supported at both
+ * ends of their links, the formats lists are reduced to them before any
+ * merging and the negotiation reaches the same result directly; otherwise,
+ * for example when a source was given another pixel format, they are all
+ * ignored.
+ */
+
+static int hint_in_formats(const AVFilterFormats *f, int fmt)
+{
+    int i;
+
+    for (i = 0; i < f->nb_formats; i++)
+        if (f->formats[i] == fmt)
+            return 1;
+    return 0;
+}
+
+static int hint_in_layouts(const AVFilterChannelLayouts *l, uint64_t layout)
+{
+    int i;
+
+    if (l->all_layouts || l->all_counts)
         return 1;
-    } else {
-        av_freep(&a->formats);
-        av_freep(&b->formats);
-        av_freep(&a);
-        av_freep(&b);
+    for (i = 0; i < l->nb_channel_layouts; i++)
+        if (l->channel_layouts[i] == layout)
+            return 1;
+    return 0;
+}
+
+static int link_hints_supported(AVFilterLink *link)
+{
+    if (!hint_in_formats(link->in_formats,  link->format_hint) ||
+        !hint_in_formats(link->out_formats, link->format_hint))
         return 0;
+    if (link->type != AVMEDIA_TYPE_AUDIO)
+        return 1;
+    /* empty samplerates lists stand for all samplerates */
+    return (!link->in_samplerates->nb_formats ||
+            hint_in_formats(link->in_samplerates,  link->sample_rate_hint)) &&
+           (!link->out_samplerates->nb_formats ||
+            hint_in_formats(link->out_samplerates, link->sample_rate_hint)) &&
+           hint_in_layouts(link->in_channel_layouts,  link->channel_layout_hint) &&
+           hint_in_layouts(link->out_channel_layouts, link->channel_layout_hint);
+}
+
+static void reduce_to_hint(AVFilterFormats *f, int fmt)
+{
+    if (f->nb_formats) {
+        f->formats[0] = fmt;
+        f->nb_formats = 1;
+    }
+}
+
+static void reduce_layouts_to_hint(AVFilterChannelLayouts *l, uint64_t layout)
+{
+    if (!l->all_layouts && !l->all_counts) {
+        l->channel_layouts[0]  = layout;
+        l->nb_channel_layouts = 1;
     }
 }
 
+/**
+ * Reduce the formats lists of the links to their hints if possible.
+ *
+ * @return 1 if the hints were applied, 0 otherwise
+ */
+static int apply_format_hints(AVFilterGraph *graph, FormatsWorklist *wl)
+{
+    int i, nb_hints = 0;
+
+    for (i = 0; i < wl->nb_links; i++) {
+        AVFilterLink *link = wl->links[i];
+
+        if (link->format_hint < 0)
+            continue;
+        if (!link_hints_supported(link)) {
+            av_log(graph, AV_LOG_VERBOSE, "Formats of the template not "
+                   "supported on link '%s' -> '%s', negotiating formats\n",
+                   link->src->name, link->dst->name);
+            return 0;
+        }
+        nb_hints++;
+    }
+    if (!nb_hints)
+        return 0;
+
+    for (i = 0; i < wl->nb_links; i++) {
+        AVFilterLink *link = wl->links[i];
+
+        if (link->format_hint < 0)
+            continue;
+        reduce_to_hint(link->in_formats,  link->format_hint);
+        reduce_to_hint(link->out_formats, link->format_hint);
+        if (link->type == AVMEDIA_TYPE_AUDIO) {
+            reduce_to_hint(link->in_samplerates,  link->sample_rate_hint);
+            reduce_to_hint(link->out_samplerates, link->sample_rate_hint);
+            reduce_layouts_to_hint(link->in_channel_layouts,  link->channel_layout_hint);
+            reduce_layouts_to_hint(link->out_channel_layouts, link->channel_layout_hint);
+        }
+    }
+    av_log(graph, AV_LOG_VERBOSE, "Reusing the formats of the template on "
+           "%d links\n", nb_hints);
+    return 1;
+}
+
 /**
  * Perform one round of query_formats() and merging formats lists on the
  * filter graph.
+ *
+ * Only the filters and links of the worklist are visited; the worklist is
+ * then reduced to the ones which still need to be visited in the next round.
+ * If all the filters declared their formats, the lists are reduced before
+ * any merging: to the format hints of the links if hints is set and they
+ * are supported, else to the formats chosen by plan_formats() if plan is set.
+ *
  * @return  >=0 if all links formats lists could be queried and merged;
  *          AVERROR(EAGAIN) some progress was made in the queries or merging
  *          and a later call may succeed;
@@ -437,17 +1178,18 @@ static int can_merge_formats(AVFilterFormats *a_arg,
  *          was made and the negotiation is stuck;
  *          a negative error code if some other error happened
  */
-static int query_formats(AVFilterGraph *graph, AVClass *log_ctx)
+static int query_formats(AVFilterGraph *graph, AVClass *log_ctx,
+                         FormatsWorklist *wl, int hints, int plan)
 {
-    int i, j, ret;
+    int i, k, ret;
     int scaler_count = 0, resampler_count = 0;
     int count_queried = 0;        /* successful calls to query_formats() */
     int count_merged = 0;         /* successful merge of formats lists */
     int count_already_merged = 0; /* lists already merged */
     int count_delayed = 0;        /* lists that need to be merged later */
 
-    for (i = 0; i < graph->nb_filters; i++) {
-        AVFilterContext *f = graph->filters[i];
+    for (i = k = 0; i < wl->nb_filters; i++) {
+        AVFilterContext *f = wl->filters[i];
         if (formats_declared(f))
             continue;
         if (f->filter->query_formats)
@@ -458,158 +1200,167 @@ static int query_formats(AVFilterGraph *graph, AVClass *log_ctx)
             return ret;
         /* note: EAGAIN could indicate a partial success, not counted yet */
         count_queried += ret >= 0;
+        if (!formats_declared(f))
+            wl->filters[k++] = f;
+    }
+    wl->nb_filters = k;
+
+    if (hints && !wl->nb_filters && apply_format_hints(graph, wl))
+        plan = 0;
+    if (plan) {
+        if (wl->nb_filters)
+            av_log(graph, AV_LOG_VERBOSE, "Some filters did not declare their "
+                   "formats, merging formats link by link\n");
+        else if ((ret = plan_formats(graph, wl)) < 0)
+            return ret;
     }
 
     /* go through and merge as many format lists as possible */
-    for (i = 0; i < graph->nb_filters; i++) {
-        AVFilterContext *filter = graph->filters[i];
-
-        for (j = 0; j < filter->nb_inputs; j++) {
-            AVFilterLink *link = filter->inputs[j];
-            int convert_needed = 0;
-
-            if (!link)
-                continue;
-
-            if (link->in_formats != link->out_formats
-                && link->in_formats && link->out_formats)
-                if (!can_merge_formats(link->in_formats, link->out_formats,
-                                      link->type, 0))
+    for (i = k = 0; i < wl->nb_links; i++) {
+        AVFilterLink *link = wl->links[i];
+        int delayed = count_delayed;
+        int convert_needed = 0;
+
+        if (link->in_formats != link->out_formats
+            && link->in_formats && link->out_formats)
+            if (!ff_can_merge_formats(link->in_formats, link->out_formats,
+                                      link->type))
+                convert_needed = 1;
+        if (link->type == AVMEDIA_TYPE_AUDIO) {
+            if (link->in_samplerates != link->out_samplerates
+                && link->in_samplerates && link->out_samplerates)
+                if (!ff_can_merge_samplerates(link->in_samplerates,
+                                              link->out_samplerates))
                     convert_needed = 1;
-            if (link->type == AVMEDIA_TYPE_AUDIO) {
-                if (link->in_samplerates != link->out_samplerates
-                    && link->in_samplerates && link->out_samplerates)
-                    if (!can_merge_formats(link->in_samplerates,
-                                           link->out_samplerates,
-                                           0, 1))
-                        convert_needed = 1;
-            }
+        }
 
 #define MERGE_DISPATCH(field, statement)                                     \
-            if (!(link->in_ ## field && link->out_ ## field)) {              \
-                count_delayed++;                                             \
-            } else if (link->in_ ## field == link->out_ ## field) {          \
-                count_already_merged++;                                      \
-            } else if (!convert_needed) {                                    \
-                count_merged++;                                              \
-                statement                                                    \
-            }
+        if (!(link->in_ ## field && link->out_ ## field)) {                  \
+            count_delayed++;                                                 \
+        } else if (link->in_ ## field == link->out_ ## field) {              \
+            count_already_merged++;                                          \
+        } else if (!convert_needed) {                                        \
+            count_merged++;                                                  \
+            statement                                                        \
+        }
 
-            if (link->type == AVMEDIA_TYPE_AUDIO) {
-                MERGE_DISPATCH(channel_layouts,
-                    if (!ff_merge_channel_layouts(link->in_channel_layouts,
-                                                  link->out_channel_layouts))
-                        convert_needed = 1;
-                )
-                MERGE_DISPATCH(samplerates,
-                    if (!ff_merge_samplerates(link->in_samplerates,
-                                              link->out_samplerates))
-                        convert_needed = 1;
-                )
-            }
-            MERGE_DISPATCH(formats,
-                if (!ff_merge_formats(link->in_formats, link->out_formats,
-                                      link->type))
+        if (link->type == AVMEDIA_TYPE_AUDIO) {
+            MERGE_DISPATCH(channel_layouts,
+                if (!ff_merge_channel_layouts(link->in_channel_layouts,
+                                              link->out_channel_layouts))
+                    convert_needed = 1;
+            )
+            MERGE_DISPATCH(samplerates,
+                if (!ff_merge_samplerates(link->in_samplerates,
+                                          link->out_samplerates))
                     convert_needed = 1;
             )
+        }
+        MERGE_DISPATCH(formats,
+            if (!ff_merge_formats(link->in_formats, link->out_formats,
+                                  link->type))
+                convert_needed = 1;
+        )
 #undef MERGE_DISPATCH
 
-            if (convert_needed) {
-                AVFilterContext *convert;
-                const AVFilter *filter;
-                AVFilterLink *inlink, *outlink;
-                char inst_name[30];
-
-                if (graph->disable_auto_convert) {
-                    av_log(log_ctx, AV_LOG_ERROR,
-                           "The filters '%s' and '%s' do not have a common format "
-                           "and automatic conversion is disabled.\n",
-                           link->src->name, link->dst->name);
-                    return AVERROR(EINVAL);
-                }
+        if (convert_needed) {
+            AVFilterContext *convert;
+            const AVFilter *filter;
+            AVFilterLink *inlink, *outlink;
+            char inst_name[30];
 
-                /* couldn't merge format lists. auto-insert conversion filter */
-                switch (link->type) {
-                case AVMEDIA_TYPE_VIDEO:
-                    if (!(filter = avfilter_get_by_name("scale"))) {
-                        av_log(log_ctx, AV_LOG_ERROR, "'scale' filter "
-                               "not present, cannot convert pixel formats.\n");
-                        return AVERROR(EINVAL);
-                    }
+            if (graph->disable_auto_convert) {
+                av_log(log_ctx, AV_LOG_ERROR,
+                       "The filters '%s' and '%s' do not have a common format "
+                       "and automatic conversion is disabled.\n",
+                       link->src->name, link->dst->name);
+                return AVERROR(EINVAL);
+            }
 
-                    snprintf(inst_name, sizeof(inst_name), "auto_scaler_%d",
-                             scaler_count++);
+            /* couldn't merge format lists. auto-insert conversion filter */
+            switch (link->type) {
+            case AVMEDIA_TYPE_VIDEO:
+                if (!(filter = avfilter_get_by_name("scale"))) {
+                    av_log(log_ctx, AV_LOG_ERROR, "'scale' filter "
+                           "not present, cannot convert pixel formats.\n");
+                    return AVERROR(EINVAL);
+                }
 
-                    if ((ret = avfilter_graph_create_filter(&convert, filter,
-                                                            inst_name, graph->scale_sws_opts, NULL,
-                                                            graph)) < 0)
-                        return ret;
-                    break;
-                case AVMEDIA_TYPE_AUDIO:
-                    if (!(filter = avfilter_get_by_name("aresample"))) {
-                        av_log(log_ctx, AV_LOG_ERROR, "'aresample' filter "
-                               "not present, cannot convert audio formats.\n");
-                        return AVERROR(EINVAL);
-                    }
+                snprintf(inst_name, sizeof(inst_name), "auto_scaler_%d",
+                         scaler_count++);
 
-                    snprintf(inst_name, sizeof(inst_name), "auto_resampler_%d",
-                             resampler_count++);
-                    if ((ret = avfilter_graph_create_filter(&convert, filter,
-                                                            inst_name, graph->aresample_swr_opts,
-                                                            NULL, graph)) < 0)
-                        return ret;
-                    break;
-                default:
+                if ((ret = avfilter_graph_create_filter(&convert, filter,
+                                                        inst_name, graph->scale_sws_opts, NULL,
+                                                        graph)) < 0)
+                    return ret;
+                break;
+            case AVMEDIA_TYPE_AUDIO:
+                if (!(filter = avfilter_get_by_name("aresample"))) {
+                    av_log(log_ctx, AV_LOG_ERROR, "'aresample' filter "
+                           "not present, cannot convert audio formats.\n");
                     return AVERROR(EINVAL);
                 }
 
-                if ((ret = avfilter_insert_filter(link, convert, 0, 0)) < 0)
+                snprintf(inst_name, sizeof(inst_name), "auto_resampler_%d",
+                         resampler_count++);
+                if ((ret = avfilter_graph_create_filter(&convert, filter,
+                                                        inst_name, graph->aresample_swr_opts,
+                                                        NULL, graph)) < 0)
                     return ret;
+                break;
+            default:
+                return AVERROR(EINVAL);
+            }
 
-                if ((ret = filter_query_formats(convert)) < 0)
-                    return ret;
+            if ((ret = avfilter_insert_filter(link, convert, 0, 0)) < 0)
+                return ret;
 
-                inlink  = convert->inputs[0];
-                outlink = convert->outputs[0];
-                av_assert0( inlink-> in_formats->refcount > 0);
-                av_assert0( inlink->out_formats->refcount > 0);
-                av_assert0(outlink-> in_formats->refcount > 0);
-                av_assert0(outlink->out_formats->refcount > 0);
-                if (outlink->type == AVMEDIA_TYPE_AUDIO) {
-                    av_assert0( inlink-> in_samplerates->refcount > 0);
-                    av_assert0( inlink->out_samplerates->refcount > 0);
-                    av_assert0(outlink-> in_samplerates->refcount > 0);
-                    av_assert0(outlink->out_samplerates->refcount > 0);
-                    av_assert0( inlink-> in_channel_layouts->refcount > 0);
-                    av_assert0( inlink->out_channel_layouts->refcount > 0);
-                    av_assert0(outlink-> in_channel_layouts->refcount > 0);
-                    av_assert0(outlink->out_channel_layouts->refcount > 0);
-                }
-                if (!ff_merge_formats( inlink->in_formats,  inlink->out_formats,  inlink->type) ||
-                    !ff_merge_formats(outlink->in_formats, outlink->out_formats, outlink->type))
-                    ret = AVERROR(ENOSYS);
-                if (inlink->type == AVMEDIA_TYPE_AUDIO &&
-                    (!ff_merge_samplerates(inlink->in_samplerates,
-                                           inlink->out_samplerates) ||
-                     !ff_merge_channel_layouts(inlink->in_channel_layouts,
-                                               inlink->out_channel_layouts)))
-                    ret = AVERROR(ENOSYS);
-                if (outlink->type == AVMEDIA_TYPE_AUDIO &&
-                    (!ff_merge_samplerates(outlink->in_samplerates,
-                                           outlink->out_samplerates) ||
-                     !ff_merge_channel_layouts(outlink->in_channel_layouts,
-                                               outlink->out_channel_layouts)))
-                    ret = AVERROR(ENOSYS);
-
-                if (ret < 0) {
-                    av_log(log_ctx, AV_LOG_ERROR,
-                           "Impossible to convert between the formats supported by the filter "
-                           "'%s' and the filter '%s'\n", link->src->name, link->dst->name);
-                    return ret;
-                }
+            if ((ret = filter_query_formats(convert)) < 0)
+                return ret;
+
+            inlink  = convert->inputs[0];
+            outlink = convert->outputs[0];
+            av_assert0( inlink-> in_formats->refcount > 0);
+            av_assert0( inlink->out_formats->refcount > 0);
+            av_assert0(outlink-> in_formats->refcount > 0);
+            av_assert0(outlink->out_formats->refcount > 0);
+            if (outlink->type == AVMEDIA_TYPE_AUDIO) {
+                av_assert0( inlink-> in_samplerates->refcount > 0);
+                av_assert0( inlink->out_samplerates->refcount > 0);
+                av_assert0(outlink-> in_samplerates->refcount > 0);
+                av_assert0(outlink->out_samplerates->refcount > 0);
+                av_assert0( inlink-> in_channel_layouts->refcount > 0);
+                av_assert0( inlink->out_channel_layouts->refcount > 0);
+                av_assert0(outlink-> in_channel_layouts->refcount > 0);
+                av_assert0(outlink->out_channel_layouts->refcount > 0);
             }
+            if (!ff_merge_formats( inlink->in_formats,  inlink->out_formats,  inlink->type) ||
+                !ff_merge_formats(outlink->in_formats, outlink->out_formats, outlink->type))
+                ret = AVERROR(ENOSYS);
+            if (inlink->type == AVMEDIA_TYPE_AUDIO &&
+                (!ff_merge_samplerates(inlink->in_samplerates,
+                                       inlink->out_samplerates) ||
+                 !ff_merge_channel_layouts(inlink->in_channel_layouts,
+                                           inlink->out_channel_layouts)))
+                ret = AVERROR(ENOSYS);
+            if (outlink->type == AVMEDIA_TYPE_AUDIO &&
+                (!ff_merge_samplerates(outlink->in_samplerates,
+                                       outlink->out_samplerates) ||
+                 !ff_merge_channel_layouts(outlink->in_channel_layouts,
+                                           outlink->out_channel_layouts)))
+                ret = AVERROR(ENOSYS);
+
+            if (ret < 0) {
+                av_log(log_ctx, AV_LOG_ERROR,
+                       "Impossible to convert between the formats supported by the filter "
+                       "'%s' and the filter '%s'\n", link->src->name, link->dst->name);
+                return ret;
+            }
+        } else if (count_delayed > delayed) {
+            wl->links[k++] = link;
         }
     }
+    wl->nb_links = k;
 
     av_log(graph, AV_LOG_DEBUG, "query_formats: "
            "%d queried, %d merged, %d already done, %d delayed\n",
@@ -748,6 +1499,91 @@ static int pick_format(AVFilterLink *link, AVFilterLink *ref)
     return 0;
 }
 
+typedef struct ListLinkRef {
+    const void *list;
+    AVFilterLink *link;
+} ListLinkRef;
+
+/**
+ * Index of the links by the formats, sample rates and channel layouts lists
+ * they use, sorted by list.
+ */
+typedef struct ListLinkIndex {
+    ListLinkRef *refs;
+    int nb_refs;
+} ListLinkIndex;
+
+static int cmp_list_link_ref(const void *a, const void *b)
+{
+    uintptr_t la = (uintptr_t)((const ListLinkRef *)a)->list;
+    uintptr_t lb = (uintptr_t)((const ListLinkRef *)b)->list;
+
+    return (la > lb) - (la < lb);
+}
+
+/**
+ * Build the index of the lists of all the links of the graph. The lists
+ * are only modified in place afterwards, so the index stays valid.
+ */
+static int list_link_index_init(ListLinkIndex *idx, AVFilterGraph *graph)
+{
+    int i, j, k, nb_links = 0;
+
+    for (i = 0; i < graph->nb_filters; i++)
+        nb_links += graph->filters[i]->nb_inputs;
+    if (!(idx->refs = av_malloc_array(nb_links, 6 * sizeof(*idx->refs))))
+        return AVERROR(ENOMEM);
+
+    idx->nb_refs = 0;
+    for (i = 0; i < graph->nb_filters; i++) {
+        AVFilterContext *f = graph->filters[i];
+
+        for (j = 0; j < f->nb_inputs; j++) {
+            AVFilterLink *l = f->inputs[j];
+            const void *lists[6];
+
+            if (!l)
+                continue;
+            lists[0] = l->in_formats;
+            lists[1] = l->out_formats;
+            lists[2] = l->in_samplerates;
+            lists[3] = l->out_samplerates;
+            lists[4] = l->in_channel_layouts;
+            lists[5] = l->out_channel_layouts;
+            for (k = 0; k < 6; k++) {
+                if (!lists[k])
+                    continue;
+                idx->refs[idx->nb_refs].list   = lists[k];
+                idx->refs[idx->nb_refs++].link = l;
+            }
+        }
+    }
+    qsort(idx->refs, idx->nb_refs, sizeof(*idx->refs), cmp_list_link_ref);
+    return 0;
+}
+
+/**
+ * Flag the filters on both ends of every link using the given list as
+ * needing to be visited again by reduce_formats().
+ */
+static void mark_list_changed(const ListLinkIndex *idx, uint8_t *dirty,
+                              const void *list)
+{
+    ListLinkRef key = { list };
+    const ListLinkRef *ref = bsearch(&key, idx->refs, idx->nb_refs,
+                                     sizeof(*idx->refs), cmp_list_link_ref);
+    const ListLinkRef *end = idx->refs + idx->nb_refs;
+
+    if (!ref)
+        return;
+    while (ref > idx->refs && ref[-1].list == list)
+        ref--;
+    for (; ref < end && ref->list == list; ref++) {
+        dirty[ref->link->src->internal->graph_index] = 1;
+        dirty[ref->link->dst->internal->graph_index] = 1;
+    }
+}
+
 #define REDUCE_FORMATS(fmt_type, list_type, list, var, nb, add_format, unref_format) \
 do {                                                                   \
     for (i = 0; i < filter->nb_inputs; i++) {                          \
@@ -770,6 +1606,8 @@ do {                                                                   \
             if (!out_link->in_ ## list->nb) {                          \
                 if ((ret = add_format(&out_link->in_ ##list, fmt)) < 0)\
                     return ret;                                        \
+                mark_list_changed(idx, dirty,                          \
+                                  out_link->in_ ## list);              \
                 ret = 1;                                               \
                 break;                                                 \
             }                                                          \
@@ -778,6 +1616,7 @@ do {                                                                   \
                 if (fmts->var[k] == fmt) {                             \
                     fmts->var[0]  = fmt;                               \
                     fmts->nb = 1;                                      \
+                    mark_list_changed(idx, dirty, fmts);               \
                     ret = 1;                                           \
                     break;                                             \
                 }                                                      \
@@ -785,7 +1624,8 @@ do {                                                                   \
     }                                                                  \
 } while (0)
 
-static int reduce_formats_on_filter(AVFilterContext *filter)
+static int reduce_formats_on_filter(AVFilterContext *filter,
+                                    const ListLinkIndex *idx, uint8_t *dirty)
 {
     int i, j, k, ret = 0;
 
@@ -818,6 +1658,7 @@ static int reduce_formats_on_filter(AVFilterContext *filter)
                 fmts->all_layouts = fmts->all_counts  = 0;
                 if (ff_add_channel_layout(&outlink->in_channel_layouts, fmt) < 0)
                     ret = 1;
+                mark_list_changed(idx, dirty, outlink->in_channel_layouts);
                 break;
             }
 
@@ -825,6 +1666,7 @@ static int reduce_formats_on_filter(AVFilterContext *filter)
                 if (fmts->channel_layouts[k] == fmt) {
                     fmts->channel_layouts[0]  = fmt;
                     fmts->nb_channel_layouts = 1;
+                    mark_list_changed(idx, dirty, fmts);
                     ret = 1;
                     break;
                 }
@@ -835,21 +1677,44 @@ static int reduce_formats_on_filter(AVFilterContext *filter)
     return ret;
 }
 
+/**
+ * Reduce formats until no filter makes progress anymore.
+ *
+ * Filters are visited in graph order, as long as any of them made progress
+ * during the previous pass. A filter is only visited again once one of the
+ * lists it reads has changed, as otherwise it would do the same as during
+ * its previous visit.
+ */
 static int reduce_formats(AVFilterGraph *graph)
 {
-    int i, reduced, ret;
+    ListLinkIndex idx = { 0 };
+    uint8_t *dirty;
+    int i, reduced, ret = 0;
+
+    if (!(dirty = av_malloc(graph->nb_filters)))
+        return AVERROR(ENOMEM);
+    memset(dirty, 1, graph->nb_filters);
+    if ((ret = list_link_index_init(&idx, graph)) < 0)
+        goto end;
 
     do {
         reduced = 0;
 
         for (i = 0; i < graph->nb_filters; i++) {
-            if ((ret = reduce_formats_on_filter(graph->filters[i])) < 0)
-                return ret;
+            if (!dirty[i])
+                continue;
+            dirty[i] = 0;
+            if ((ret = reduce_formats_on_filter(graph->filters[i], &idx, dirty)) < 0)
+                goto end;
             reduced |= ret;
         }
     } while (reduced);
+    ret = 0;
 
-    return 0;
+end:
+    av_free(idx.refs);
+    av_free(dirty);
+    return ret;
 }
 
 static void swap_samplerates_on_filter(AVFilterContext *filter)
@@ -1158,28 +2023,51 @@ static int pick_formats(AVFilterGraph *graph)
  */
 static int graph_config_formats(AVFilterGraph *graph, AVClass *log_ctx)
 {
-    int ret;
+    int64_t t0 = av_gettime_relative(), t1, t2, t3, t4;
+    FormatsWorklist wl = { 0 };
+    int plan = graph->format_negotiation == FORMAT_NEGOTIATION_GLOBAL &&
+               !graph->disable_auto_convert;
+    int hints = 1, rounds = 1, ret;
 
     /* find supported formats from sub-filters, and merge along links */
-    while ((ret = query_formats(graph, log_ctx)) == AVERROR(EAGAIN))
-        av_log(graph, AV_LOG_DEBUG, "query_formats not finished\n");
+    if ((ret = worklist_init(&wl, graph)) < 0) {
+        worklist_uninit(&wl);
+        return ret;
+    }
+    while ((ret = query_formats(graph, log_ctx, &wl, hints, plan)) == AVERROR(EAGAIN)) {
+        av_log(graph, AV_LOG_DEBUG, "query_formats not finished after round %d, "
+               "%"PRId64"us elapsed, %d filters and %d links left\n", rounds,
+               av_gettime_relative() - t0, wl.nb_filters, wl.nb_links);
+        hints = plan = 0;
+        rounds++;
+    }
+    worklist_uninit(&wl);
     if (ret < 0)
         return ret;
+    t1 = av_gettime_relative();
 
     /* Once everything is merged, it's possible that we'll still have
      * multiple valid media format choices. We try to minimize the amount
      * of format conversion inside filters */
     if ((ret = reduce_formats(graph)) < 0)
         return ret;
+    t2 = av_gettime_relative();
 
     /* for audio filters, ensure the best format, sample rate and channel layout
      * is selected */
     swap_sample_fmts(graph);
     swap_samplerates(graph);
     swap_channel_layouts(graph);
+    t3 = av_gettime_relative();
 
     if ((ret = pick_formats(graph)) < 0)
         return ret;
+    t4 = av_gettime_relative();
+
+    av_log(graph, AV_LOG_VERBOSE, "Formats negotiated for %u filters in %"PRId64"us: "
+           "query %"PRId64"us (%d rounds), reduce %"PRId64"us, "
+           "swap %"PRId64"us, pick %"PRId64"us\n", graph->nb_filters, t4 - t0,
+           t1 - t0, rounds, t2 - t1, t3 - t2, t4 - t3);
 
     return 0;
 }
@@ -1280,10 +2168,38 @@ int avfilter_graph_config(AVFilterGraph *graphctx, void *log_ctx)
         return ret;
     if ((ret = graph_config_pointers(graphctx, log_ctx)))
         return ret;
+    if (graphctx->profile) {
+        unsigned i;
+
+        for (i = 0; i < graphctx->nb_filters; i++)
+            if ((ret = ff_filter_profile_init(graphctx->filters[i])) < 0)
+                return ret;
+    }
 
     return 0;
 }
 
+const AVFilterStats *avfilter_graph_get_stats(AVFilterGraph *graph, unsigned idx)
+{
+    AVFilterContext *filter;
+    AVFilterStats *stats;
+    unsigned i;
+
+    if (idx >= graph->nb_filters || !graph->filters[idx]->internal->profile)
+        return NULL;
+    filter = graph->filters[idx];
+    stats  = &filter->internal->profile->stats;
+
+    stats->frames_in = stats->frames_out = stats->queued_frames = 0;
+    for (i = 0; i < filter->nb_inputs; i++) {
+        stats->frames_in     += filter->inputs[i]->frame_count_out;
+        stats->queued_frames += ff_framequeue_queued_frames(&filter->inputs[i]->fifo);
+    }
+    for (i = 0; i < filter->nb_outputs; i++)
+        stats->frames_out += filter->outputs[i]->frame_count_in;
+    return stats;
+}
+
 int avfilter_graph_send_command(AVFilterGraph *graph, const char *target, const char *cmd, const char *arg, char *res, int res_len, int flags)
 {
     int i, r = AVERROR(ENOSYS);
@@ -1441,15 +2357,8 @@ int avfilter_graph_request_oldest(AVFilterGraph *graph)
 
 int ff_filter_graph_run_once(AVFilterGraph *graph)
 {
-    AVFilterContext *filter;
-    unsigned i;
-
     av_assert0(graph->nb_filters);
-    filter = graph->filters[0];
-    for (i = 1; i < graph->nb_filters; i++)
-        if (graph->filters[i]->ready > filter->ready)
-            filter = graph->filters[i];
-    if (!filter->ready)
+    if (!graph->internal->nb_ready)
         return AVERROR(EAGAIN);
-    return ff_filter_activate(filter);
+    return ff_filter_activate(graph->internal->ready_heap[0]);
 }
@@ -31,6 +31,7 @@
 enum SearchMethod {
     EXHAUSTIVE,        ///< Search all possible positions
     SMART_EXHAUSTIVE,  ///< Search most possible positions (faster)
+    PREDICTIVE,        ///< Descend from the previous frame's vectors (fastest)
     SEARCH_COUNT
 };
 
@@ -57,6 +58,9 @@ typedef struct DeshakeContext {
     int counts[2*MAX_R+1][2*MAX_R+1]; /// < Scratch buffer for motion search
     double *angles;            ///< Scratch buffer for block angles
     unsigned angles_size;
+    IntMotionVector *mvs;      ///< Motion vector of every block of the current frame
+    IntMotionVector *prev_mvs; ///< Motion vectors of the previous frame, search predictors
+    int nb_mvs;                ///< Number of blocks in the search grid
     AVFrame *ref;              ///< Previous frame
     int rx;                    ///< Maximum horizontal shift
     int ry;                    ///< Maximum vertical shift
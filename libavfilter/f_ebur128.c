@@ -37,7 +37,6 @@
 #include "libavutil/xga_font_data.h"
 #include "libavutil/opt.h"
 #include "libavutil/timestamp.h"
-#include "libswresample/swresample.h"
 #include "audio.h"
 #include "avfilter.h"
 #include "formats.h"
@@ -59,6 +58,25 @@
 #define RLB_A1 -1.99004745483398
 #define RLB_A2  0.99007225036621
 
+/* true-peak 4x over-sampling filter, polyphase form of the 48 taps
+ * interpolation filter from ITU-R BS.1770-4 Annex 2 */
+#define TP_PHASES 4
+#define TP_TAPS  12
+static const double tp_coeffs[TP_PHASES][TP_TAPS] = {
+    {  0.0017089843750,  0.0109863281250, -0.0196533203125,  0.0332031250000,
+      -0.0594482421875,  0.1373291015625,  0.9721679687500, -0.1022949218750,
+       0.0476074218750, -0.0266113281250,  0.0148925781250, -0.0083007812500 },
+    { -0.0291748046875,  0.0292968750000, -0.0517578125000,  0.0891113281250,
+      -0.1665039062500,  0.4650878906250,  0.7797851562500, -0.2003173828125,
+       0.1015625000000, -0.0582275390625,  0.0330810546875, -0.0189208984375 },
+    { -0.0189208984375,  0.0330810546875, -0.0582275390625,  0.1015625000000,
+      -0.2003173828125,  0.7797851562500,  0.4650878906250, -0.1665039062500,
+       0.0891113281250, -0.0517578125000,  0.0292968750000, -0.0291748046875 },
+    { -0.0083007812500,  0.0148925781250, -0.0266113281250,  0.0476074218750,
+      -0.1022949218750,  0.9721679687500,  0.1373291015625, -0.0594482421875,
+       0.0332031250000, -0.0196533203125,  0.0109863281250,  0.0017089843750 },
+};
+
 #define ABS_THRES    -70            ///< silence gate: we discard anything below this absolute (LUFS) threshold
 #define ABS_UP_THRES  10            ///< upper loud limit to consider (ABS_THRES being the minimum)
 #define HIST_GRAIN   100            ///< defines histogram precision
@@ -98,11 +116,9 @@ typedef struct EBUR128Context {
     double *true_peaks;             ///< true peaks per channel
     double *sample_peaks;           ///< sample peaks per channel
     double *true_peaks_per_frame;   ///< true peaks in a frame per channel
-#if CONFIG_SWRESAMPLE
-    SwrContext *swr_ctx;            ///< over-sampling context for true peak metering
-    double *swr_buf;                ///< resampled audio data for true peak metering
-    int swr_linesize;
-#endif
+    double *tp_hist;                ///< last TP_TAPS-1 input samples per channel for true peak metering
+    double *tp_buf;                 ///< one channel of input samples with its history for true peak metering
+    unsigned int tp_buf_size;
 
     /* video  */
     int do_video;                   ///< 1 if video output enabled, 0 otherwise
@@ -174,6 +190,7 @@ static const AVOption ebur128_options[] = {
     { "size",  "set video size",   OFFSET(w), AV_OPT_TYPE_IMAGE_SIZE, {.str = "640x480"}, 0, 0, V|F },
     { "meter", "set scale meter (+9 to +18)",  OFFSET(meter), AV_OPT_TYPE_INT, {.i64 = 9}, 9, 18, V|F },
     { "framelog", "force frame logging level", OFFSET(loglevel), AV_OPT_TYPE_INT, {.i64 = -1},   INT_MIN, INT_MAX, A|V|F, "level" },
+        { "quiet",   "disable frame logging",     0, AV_OPT_TYPE_CONST, {.i64 = AV_LOG_QUIET},   INT_MIN, INT_MAX, A|V|F, "level" },
         { "info",    "information logging level", 0, AV_OPT_TYPE_CONST, {.i64 = AV_LOG_INFO},    INT_MIN, INT_MAX, A|V|F, "level" },
         { "verbose", "verbose logging level",     0, AV_OPT_TYPE_CONST, {.i64 = AV_LOG_VERBOSE}, INT_MIN, INT_MAX, A|V|F, "level" },
     { "metadata", "inject metadata in the filtergraph", OFFSET(metadata), AV_OPT_TYPE_BOOL, {.i64 = 0}, 0, 1, A|V|F },
@@ -439,31 +456,14 @@ static int config_audio_output(AVFilterLink *outlink)
             return AVERROR(ENOMEM);
     }
 
-#if CONFIG_SWRESAMPLE
     if (ebur128->peak_mode & PEAK_MODE_TRUE_PEAKS) {
-        int ret;
-
-        ebur128->swr_buf    = av_malloc_array(nb_channels, 19200 * sizeof(double));
+        ebur128->tp_hist    = av_calloc(nb_channels, (TP_TAPS - 1) * sizeof(*ebur128->tp_hist));
         ebur128->true_peaks = av_calloc(nb_channels, sizeof(*ebur128->true_peaks));
         ebur128->true_peaks_per_frame = av_calloc(nb_channels, sizeof(*ebur128->true_peaks_per_frame));
-        ebur128->swr_ctx    = swr_alloc();
-        if (!ebur128->swr_buf || !ebur128->true_peaks ||
-            !ebur128->true_peaks_per_frame || !ebur128->swr_ctx)
+        if (!ebur128->tp_hist || !ebur128->true_peaks ||
+            !ebur128->true_peaks_per_frame)
             return AVERROR(ENOMEM);
-
-        av_opt_set_int(ebur128->swr_ctx, "in_channel_layout",    outlink->channel_layout, 0);
-        av_opt_set_int(ebur128->swr_ctx, "in_sample_rate",       outlink->sample_rate, 0);
-        av_opt_set_sample_fmt(ebur128->swr_ctx, "in_sample_fmt", outlink->format, 0);
-
-        av_opt_set_int(ebur128->swr_ctx, "out_channel_layout",    outlink->channel_layout, 0);
-        av_opt_set_int(ebur128->swr_ctx, "out_sample_rate",       192000, 0);
-        av_opt_set_sample_fmt(ebur128->swr_ctx, "out_sample_fmt", outlink->format, 0);
-
-        ret = swr_init(ebur128->swr_ctx);
-        if (ret < 0)
-            return ret;
     }
-#endif
 
     if (ebur128->peak_mode & PEAK_MODE_SAMPLES_PEAKS) {
         ebur128->sample_peaks = av_calloc(nb_channels, sizeof(*ebur128->sample_peaks));
@@ -498,7 +498,8 @@ static av_cold int init(AVFilterContext *ctx)
     AVFilterPad pad;
     int ret;
 
-    if (ebur128->loglevel != AV_LOG_INFO &&
+    if (ebur128->loglevel != AV_LOG_QUIET &&
+        ebur128->loglevel != AV_LOG_INFO &&
         ebur128->loglevel != AV_LOG_VERBOSE) {
         if (ebur128->do_video || ebur128->metadata)
             ebur128->loglevel = AV_LOG_VERBOSE;
@@ -506,12 +507,6 @@ static av_cold int init(AVFilterContext *ctx)
             ebur128->loglevel = AV_LOG_INFO;
     }
 
-    if (!CONFIG_SWRESAMPLE && (ebur128->peak_mode & PEAK_MODE_TRUE_PEAKS)) {
-        av_log(ctx, AV_LOG_ERROR,
-               "True-peak mode requires libswresample to be performed\n");
-        return AVERROR(EINVAL);
-    }
-
     // if meter is  +9 scale, scale range is from -18 LU to  +9 LU (or 3*9)
     // if meter is +18 scale, scale range is from -36 LU to +18 LU (or 3*18)
     ebur128->scale_range = 3 * ebur128->meter;
@@ -585,99 +580,198 @@ static int gate_update(struct integrator *integ, double power,
     return gate_hist_pos;
 }
 
-static int filter_frame(AVFilterLink *inlink, AVFrame *insamples)
+/**
+ * Update the true peaks with a frame of interleaved samples, over-sampled 4
+ * times with a polyphase FIR.
+ */
+static int true_peak_frame(EBUR128Context *ebur128, const double *samples,
+                           int nb_samples)
 {
-    int i, ch, idx_insample;
-    AVFilterContext *ctx = inlink->dst;
-    EBUR128Context *ebur128 = ctx->priv;
     const int nb_channels = ebur128->nb_channels;
-    const int nb_samples  = insamples->nb_samples;
-    const double *samples = (double *)insamples->data[0];
-    AVFrame *pic = ebur128->outpicref;
+    double *buf;
+    int ch, n, k;
 
-#if CONFIG_SWRESAMPLE
-    if (ebur128->peak_mode & PEAK_MODE_TRUE_PEAKS) {
-        const double *swr_samples = ebur128->swr_buf;
-        int ret = swr_convert(ebur128->swr_ctx, (uint8_t**)&ebur128->swr_buf, 19200,
-                              (const uint8_t **)insamples->data, nb_samples);
-        if (ret < 0)
-            return ret;
-        for (ch = 0; ch < nb_channels; ch++)
-            ebur128->true_peaks_per_frame[ch] = 0.0;
-        for (idx_insample = 0; idx_insample < ret; idx_insample++) {
-            for (ch = 0; ch < nb_channels; ch++) {
-                ebur128->true_peaks[ch] = FFMAX(ebur128->true_peaks[ch], fabs(*swr_samples));
-                ebur128->true_peaks_per_frame[ch] = FFMAX(ebur128->true_peaks_per_frame[ch],
-                                                          fabs(*swr_samples));
-                swr_samples++;
+    av_fast_malloc(&ebur128->tp_buf, &ebur128->tp_buf_size,
+                   (TP_TAPS - 1 + nb_samples) * sizeof(*ebur128->tp_buf));
+    if (!ebur128->tp_buf)
+        return AVERROR(ENOMEM);
+    buf = ebur128->tp_buf;
+
+    for (ch = 0; ch < nb_channels; ch++) {
+        double *hist = ebur128->tp_hist + ch * (TP_TAPS - 1);
+        double peak = 0.0;
+
+        memcpy(buf, hist, (TP_TAPS - 1) * sizeof(*buf));
+        for (n = 0; n < nb_samples; n++)
+            buf[TP_TAPS - 1 + n] = samples[n * nb_channels + ch];
+
+        for (n = 0; n < nb_samples; n++) {
+            const double *src = buf + n + TP_TAPS - 1;
+            double p0 = 0.0, p1 = 0.0, p2 = 0.0, p3 = 0.0;
+
+            for (k = 0; k < TP_TAPS; k++) {
+                p0 += tp_coeffs[0][k] * src[-k];
+                p1 += tp_coeffs[1][k] * src[-k];
+                p2 += tp_coeffs[2][k] * src[-k];
+                p3 += tp_coeffs[3][k] * src[-k];
             }
+            peak = FFMAX(peak, FFMAX(FFMAX(fabs(p0), fabs(p1)),
+                                     FFMAX(fabs(p2), fabs(p3))));
         }
-    }
-#endif
-
-    for (idx_insample = 0; idx_insample < nb_samples; idx_insample++) {
-        const int bin_id_400  = ebur128->i400.cache_pos;
-        const int bin_id_3000 = ebur128->i3000.cache_pos;
-
-#define MOVE_TO_NEXT_CACHED_ENTRY(time) do {                \
-    ebur128->i##time.cache_pos++;                           \
-    if (ebur128->i##time.cache_pos == I##time##_BINS) {     \
-        ebur128->i##time.filled    = 1;                     \
-        ebur128->i##time.cache_pos = 0;                     \
-    }                                                       \
-} while (0)
 
-        MOVE_TO_NEXT_CACHED_ENTRY(400);
-        MOVE_TO_NEXT_CACHED_ENTRY(3000);
-
-        for (ch = 0; ch < nb_channels; ch++) {
-            double bin;
+        memcpy(hist, buf + nb_samples, (TP_TAPS - 1) * sizeof(*buf));
+        ebur128->true_peaks_per_frame[ch] = peak;
+        ebur128->true_peaks[ch] = FFMAX(ebur128->true_peaks[ch], peak);
+    }
 
-            if (ebur128->peak_mode & PEAK_MODE_SAMPLES_PEAKS)
-                ebur128->sample_peaks[ch] = FFMAX(ebur128->sample_peaks[ch], fabs(*samples));
+    return 0;
+}
 
-            ebur128->x[ch * 3] = *samples++; // set X[i]
+/**
+ * Run nb_samples interleaved samples of nb_ch channels through the
+ * K-weighting filters and the 400ms and 3s integrators. The filters are
+ * recursive, so running two channels side by side is what keeps the FPU
+ * busy, the state being kept in local variables.
+ */
+static av_always_inline void filter_channels(EBUR128Context *ebur128,
+                                             const double *samples,
+                                             int nb_samples,
+                                             const int *chs, const int nb_ch)
+{
+    const int nb_channels = ebur128->nb_channels;
+    const int pos_400  = ebur128->i400.cache_pos;
+    const int pos_3000 = ebur128->i3000.cache_pos;
+    double x1[2], x2[2], y1[2], y2[2], z1[2], z2[2], sum_400[2], sum_3000[2];
+    double *cache_400[2], *cache_3000[2];
+    int i, n, p400 = pos_400, p3000 = pos_3000;
+
+    for (i = 0; i < nb_ch; i++) {
+        const int ch = chs[i];
+
+        x1[i] = ebur128->x[ch * 3 + 1];
+        x2[i] = ebur128->x[ch * 3 + 2];
+        y1[i] = ebur128->y[ch * 3    ];
+        y2[i] = ebur128->y[ch * 3 + 1];
+        z1[i] = ebur128->z[ch * 3    ];
+        z2[i] = ebur128->z[ch * 3 + 1];
+        sum_400[i]    = ebur128->i400.sum [ch];
+        sum_3000[i]   = ebur128->i3000.sum[ch];
+        cache_400[i]  = ebur128->i400.cache [ch];
+        cache_3000[i] = ebur128->i3000.cache[ch];
+    }
 
-            if (!ebur128->ch_weighting[ch])
-                continue;
+    for (n = 0; n < nb_samples; n++) {
+        for (i = 0; i < nb_ch; i++) {
+            const double x0 = samples[n * nb_channels + chs[i]];
+            double y0, z0, bin;
 
             /* Y[i] = X[i]*b0 + X[i-1]*b1 + X[i-2]*b2 - Y[i-1]*a1 - Y[i-2]*a2 */
-#define FILTER(Y, X, name) do {                                                 \
-            double *dst = ebur128->Y + ch*3;                                    \
-            double *src = ebur128->X + ch*3;                                    \
-            dst[2] = dst[1];                                                    \
-            dst[1] = dst[0];                                                    \
-            dst[0] = src[0]*name##_B0 + src[1]*name##_B1 + src[2]*name##_B2     \
-                                      - dst[1]*name##_A1 - dst[2]*name##_A2;    \
-} while (0)
-
-            // TODO: merge both filters in one?
-            FILTER(y, x, PRE);  // apply pre-filter
-            ebur128->x[ch * 3 + 2] = ebur128->x[ch * 3 + 1];
-            ebur128->x[ch * 3 + 1] = ebur128->x[ch * 3    ];
-            FILTER(z, y, RLB);  // apply RLB-filter
+            y0 = x0*PRE_B0 + x1[i]*PRE_B1 + x2[i]*PRE_B2 - y1[i]*PRE_A1 - y2[i]*PRE_A2;
+            z0 = y0*RLB_B0 + y1[i]*RLB_B1 + y2[i]*RLB_B2 - z1[i]*RLB_A1 - z2[i]*RLB_A2;
+            x2[i] = x1[i]; x1[i] = x0;
+            y2[i] = y1[i]; y1[i] = y0;
+            z2[i] = z1[i]; z1[i] = z0;
 
-            bin = ebur128->z[ch * 3] * ebur128->z[ch * 3];
+            bin = z0 * z0;
 
             /* add the new value, and limit the sum to the cache size (400ms or 3s)
              * by removing the oldest one */
-            ebur128->i400.sum [ch] = ebur128->i400.sum [ch] + bin - ebur128->i400.cache [ch][bin_id_400];
-            ebur128->i3000.sum[ch] = ebur128->i3000.sum[ch] + bin - ebur128->i3000.cache[ch][bin_id_3000];
+            sum_400[i]  = sum_400[i]  + bin - cache_400 [i][p400 ];
+            sum_3000[i] = sum_3000[i] + bin - cache_3000[i][p3000];
 
             /* override old cache entry with the new value */
-            ebur128->i400.cache [ch][bin_id_400 ] = bin;
-            ebur128->i3000.cache[ch][bin_id_3000] = bin;
+            cache_400 [i][p400 ] = bin;
+            cache_3000[i][p3000] = bin;
         }
+        if (++p400 == I400_BINS)
+            p400 = 0;
+        if (++p3000 == I3000_BINS)
+            p3000 = 0;
+    }
+
+    for (i = 0; i < nb_ch; i++) {
+        const int ch = chs[i];
+
+        ebur128->x[ch * 3 + 1] = x1[i];
+        ebur128->x[ch * 3 + 2] = x2[i];
+        ebur128->y[ch * 3    ] = y1[i];
+        ebur128->y[ch * 3 + 1] = y2[i];
+        ebur128->z[ch * 3    ] = z1[i];
+        ebur128->z[ch * 3 + 1] = z2[i];
+        ebur128->i400.sum [ch] = sum_400[i];
+        ebur128->i3000.sum[ch] = sum_3000[i];
+    }
+}
+
+static void filter_samples(EBUR128Context *ebur128, const double *samples,
+                           int nb_samples)
+{
+    const int nb_channels = ebur128->nb_channels;
+    int chs[2], nb_ch = 0;
+    int ch, n;
+
+    for (ch = 0; ch < nb_channels; ch++) {
+        if (ebur128->peak_mode & PEAK_MODE_SAMPLES_PEAKS) {
+            double peak = ebur128->sample_peaks[ch];
+
+            for (n = 0; n < nb_samples; n++)
+                peak = FFMAX(peak, fabs(samples[n * nb_channels + ch]));
+            ebur128->sample_peaks[ch] = peak;
+        }
+
+        if (!ebur128->ch_weighting[ch])
+            continue;
+
+        chs[nb_ch++] = ch;
+        if (nb_ch == 2) {
+            filter_channels(ebur128, samples, nb_samples, chs, 2);
+            nb_ch = 0;
+        }
+    }
+    if (nb_ch)
+        filter_channels(ebur128, samples, nb_samples, chs, 1);
+
+#define MOVE_CACHED_ENTRY(time) do {                            \
+    ebur128->i##time.cache_pos += nb_samples;                   \
+    if (ebur128->i##time.cache_pos >= I##time##_BINS) {         \
+        ebur128->i##time.filled     = 1;                        \
+        ebur128->i##time.cache_pos -= I##time##_BINS;           \
+    }                                                           \
+} while (0)
+
+    MOVE_CACHED_ENTRY(400);
+    MOVE_CACHED_ENTRY(3000);
+}
+
+static int filter_frame(AVFilterLink *inlink, AVFrame *insamples)
+{
+    int i, ch, idx_insample, nb;
+    AVFilterContext *ctx = inlink->dst;
+    EBUR128Context *ebur128 = ctx->priv;
+    const int nb_channels = ebur128->nb_channels;
+    const int nb_samples  = insamples->nb_samples;
+    const double *samples = (double *)insamples->data[0];
+    AVFrame *pic = ebur128->outpicref;
+
+    if (ebur128->peak_mode & PEAK_MODE_TRUE_PEAKS) {
+        int ret = true_peak_frame(ebur128, samples, nb_samples);
+        if (ret < 0)
+            return ret;
+    }
+
+    for (idx_insample = 0; idx_insample < nb_samples; idx_insample += nb) {
+        nb = FFMIN(nb_samples - idx_insample, 4800 - ebur128->sample_count);
+        filter_samples(ebur128, samples + idx_insample * nb_channels, nb);
 
         /* For integrated loudness, gating blocks are 400ms long with 75%
          * overlap (see BS.1770-2 p5), so a re-computation is needed each 100ms
          * (4800 samples at 48kHz). */
-        if (++ebur128->sample_count == 4800) {
+        if ((ebur128->sample_count += nb) == 4800) {
             double loudness_400, loudness_3000;
             double power_400 = 1e-12, power_3000 = 1e-12;
             AVFilterLink *outlink = ctx->outputs[0];
             const int64_t pts = insamples->pts +
-                av_rescale_q(idx_insample, (AVRational){ 1, inlink->sample_rate },
+                av_rescale_q(idx_insample + nb - 1, (AVRational){ 1, inlink->sample_rate },
                              outlink->time_base);
 
             ebur128->sample_count = 0;
@@ -859,6 +953,9 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *insamples)
                 SET_META_PEAK(true,   TRUE);
             }
 
+            if (ebur128->loglevel == AV_LOG_QUIET)
+                continue;
+
             if (ebur128->scale == SCALE_TYPE_ABSOLUTE) {
                 av_log(ctx, ebur128->loglevel, "t: %-10s " LOG_FMT,
                        av_ts2timestr(pts, &outlink->time_base),
@@ -989,10 +1086,8 @@ static av_cold void uninit(AVFilterContext *ctx)
     for (i = 0; i < ctx->nb_outputs; i++)
         av_freep(&ctx->output_pads[i].name);
     av_frame_free(&ebur128->outpicref);
-#if CONFIG_SWRESAMPLE
-    av_freep(&ebur128->swr_buf);
-    swr_free(&ebur128->swr_ctx);
-#endif
+    av_freep(&ebur128->tp_hist);
+    av_freep(&ebur128->tp_buf);
 }
 
 static const AVFilterPad ebur128_inputs[] = {
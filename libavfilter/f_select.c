@@ -145,7 +145,9 @@ typedef struct SelectContext {
     AVExpr *expr;
     double var_values[VAR_VARS_NB];
     int do_scene_detect;            ///< 1 if the expression requires scene detection variables, 0 otherwise
-    ff_scene_sad_fn sad;            ///< Sum of the absolute difference function (scene detect only)
+    FFSceneContext scene;           ///< scene analysis context                  (scene detect only)
+    int scene_method;               ///< scene scoring method                    (scene detect only)
+    int scene_step;                 ///< analyse one line out of scene_step      (scene detect only)
     double prev_mafd;               ///< previous MAFD                           (scene detect only)
     AVFrame *prev_picref;           ///< previous frame                          (scene detect only)
     double select;
@@ -154,13 +156,16 @@ typedef struct SelectContext {
 } SelectContext;
 
 #define OFFSET(x) offsetof(SelectContext, x)
-#define DEFINE_OPTIONS(filt_name, FLAGS)                            \
-static const AVOption filt_name##_options[] = {                     \
+#define COMMON_OPTIONS(FLAGS)                                       \
     { "expr", "set an expression to use for selecting frames", OFFSET(expr_str), AV_OPT_TYPE_STRING, { .str = "1" }, .flags=FLAGS }, \
     { "e",    "set an expression to use for selecting frames", OFFSET(expr_str), AV_OPT_TYPE_STRING, { .str = "1" }, .flags=FLAGS }, \
     { "outputs", "set the number of outputs", OFFSET(nb_outputs), AV_OPT_TYPE_INT, {.i64 = 1}, 1, INT_MAX, .flags=FLAGS }, \
-    { "n",       "set the number of outputs", OFFSET(nb_outputs), AV_OPT_TYPE_INT, {.i64 = 1}, 1, INT_MAX, .flags=FLAGS }, \
-    { NULL }                                                            \
+    { "n",       "set the number of outputs", OFFSET(nb_outputs), AV_OPT_TYPE_INT, {.i64 = 1}, 1, INT_MAX, .flags=FLAGS },
+
+#define DEFINE_OPTIONS(filt_name, FLAGS)                            \
+static const AVOption filt_name##_options[] = {                     \
+    COMMON_OPTIONS(FLAGS)                                           \
+    { NULL }                                                        \
 }
 
 static int request_frame(AVFilterLink *outlink);
@@ -242,9 +247,10 @@ static int config_input(AVFilterLink *inlink)
         inlink->type == AVMEDIA_TYPE_AUDIO ? inlink->sample_rate : NAN;
 
     if (CONFIG_SELECT_FILTER && select->do_scene_detect) {
-        select->sad = ff_scene_sad_get_fn(8);
-        if (!select->sad)
-            return AVERROR(EINVAL);
+        int ret = ff_scene_init(&select->scene, inlink->dst, select->scene_method,
+                                8, 3, select->scene_step);
+        if (ret < 0)
+            return ret;
     }
     return 0;
 }
@@ -255,15 +261,20 @@ static double get_scene_score(AVFilterContext *ctx, AVFrame *frame)
     SelectContext *select = ctx->priv;
     AVFrame *prev_picref = select->prev_picref;
 
+    if (select->scene_method == FF_SCENE_HIST)
+        return av_clipf(ff_scene_hist(&select->scene, frame->data[0], frame->linesize[0],
+                                      frame->width * 3, frame->height), 0, 1);
+
     if (prev_picref &&
         frame->height == prev_picref->height &&
         frame->width  == prev_picref->width) {
         uint64_t sad;
+        int64_t count;
         double mafd, diff;
 
-        select->sad(prev_picref->data[0], prev_picref->linesize[0], frame->data[0], frame->linesize[0], frame->width * 3, frame->height, &sad);
-        emms_c();
-        mafd = (double)sad / (frame->width * 3 * frame->height);
+        count = ff_scene_sad(&select->scene, prev_picref->data[0], prev_picref->linesize[0],
+                             frame->data[0], frame->linesize[0], frame->width * 3, frame->height, &sad);
+        mafd = (double)sad / count;
         diff = fabs(mafd - select->prev_mafd);
         ret  = av_clipf(FFMIN(mafd, diff) / 100., 0, 1);
         select->prev_mafd = mafd;
@@ -415,6 +426,7 @@ static av_cold void uninit(AVFilterContext *ctx)
 
     if (select->do_scene_detect) {
         av_frame_free(&select->prev_picref);
+        ff_scene_uninit(&select->scene);
     }
 }
 
@@ -486,7 +498,15 @@ static int query_formats(AVFilterContext *ctx)
     return 0;
 }
 
-DEFINE_OPTIONS(select, AV_OPT_FLAG_VIDEO_PARAM|AV_OPT_FLAG_FILTERING_PARAM);
+#define VFLAGS AV_OPT_FLAG_VIDEO_PARAM|AV_OPT_FLAG_FILTERING_PARAM
+static const AVOption select_options[] = {
+    COMMON_OPTIONS(VFLAGS)
+    { "scene_method", "set the scene change scoring method", OFFSET(scene_method), AV_OPT_TYPE_INT, {.i64 = FF_SCENE_SAD}, 0, FF_SCENE_NB - 1, VFLAGS, "scene_method" },
+        { "sad",  "difference between consecutive frames", 0, AV_OPT_TYPE_CONST, {.i64 = FF_SCENE_SAD},  0, 0, VFLAGS, "scene_method" },
+        { "hist", "difference between color histograms",   0, AV_OPT_TYPE_CONST, {.i64 = FF_SCENE_HIST}, 0, 0, VFLAGS, "scene_method" },
+    { "scene_step", "set the line decimation of scene detection", OFFSET(scene_step), AV_OPT_TYPE_INT, {.i64 = 1}, 1, 64, VFLAGS },
+    { NULL }
+};
 AVFILTER_DEFINE_CLASS(select);
 
 static av_cold int select_init(AVFilterContext *ctx)
@@ -518,6 +538,6 @@ AVFilter ff_vf_select = {
     .priv_size     = sizeof(SelectContext),
     .priv_class    = &select_class,
     .inputs        = avfilter_vf_select_inputs,
-    .flags         = AVFILTER_FLAG_DYNAMIC_OUTPUTS,
+    .flags         = AVFILTER_FLAG_DYNAMIC_OUTPUTS | AVFILTER_FLAG_SLICE_THREADS,
 };
 #endif /* CONFIG_SELECT_FILTER */
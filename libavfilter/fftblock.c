@@ -0,0 +1,176 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <string.h>
+
+#include "libavutil/common.h"
+#include "libavutil/error.h"
+#include "fftblock.h"
+
+static void import_row8(float *dst, ptrdiff_t step, const uint8_t *src, int w)
+{
+    int j;
+
+    for (j = 0; j < w; j++)
+        dst[j * step] = src[j];
+}
+
+static void export_row8(uint8_t *dst, const float *src, ptrdiff_t step,
+                        int w, float scale, int depth)
+{
+    int j;
+
+    for (j = 0; j < w; j++)
+        dst[j] = av_clip_uint8(src[j * step] * scale);
+}
+
+static void import_row16(float *dst, ptrdiff_t step, const uint8_t *srcp, int w)
+{
+    const uint16_t *src = (const uint16_t *)srcp;
+    int j;
+
+    for (j = 0; j < w; j++)
+        dst[j * step] = src[j];
+}
+
+static void export_row16(uint8_t *dstp, const float *src, ptrdiff_t step,
+                         int w, float scale, int depth)
+{
+    uint16_t *dst = (uint16_t *)dstp;
+    int j;
+
+    for (j = 0; j < w; j++)
+        dst[j] = av_clip_uintp2_c(src[j * step] * scale, depth);
+}
+
+void ff_fftblock_init_rows(FFTBlockContext *s, int depth)
+{
+    s->depth = depth;
+    if (depth <= 8) {
+        s->import_row = import_row8;
+        s->export_row = export_row8;
+    } else {
+        s->import_row = import_row16;
+        s->export_row = export_row16;
+    }
+}
+
+int ff_fftblock_init(FFTBlockContext *s, int depth, int width, int height,
+                     int block, int overlap)
+{
+    if (width <= 0 || height <= 0 || block <= 0 ||
+        overlap < 0 || overlap >= block)
+        return AVERROR(EINVAL);
+
+    ff_fftblock_init_rows(s, depth);
+
+    s->width   = width;
+    s->height  = height;
+    s->block   = block;
+    s->overlap = overlap;
+    s->size    = block - overlap;
+    s->nox     = (width  + (s->size - 1)) / s->size;
+    s->noy     = (height + (s->size - 1)) / s->size;
+
+    return 0;
+}
+
+/* Index to read from when extending n valid entries to a full block */
+static av_always_inline int mirror(int j, int n, int block)
+{
+    const int m = block - j - 1;
+
+    return m < n ? m : FFMAX(2 * n - j - 1, 0);
+}
+
+void ff_fftblock_import(const FFTBlockContext *s, AVTXContext *tx, av_tx_fn tx_fn,
+                        AVComplexFloat *tmp, AVComplexFloat *hdata,
+                        AVComplexFloat *dst, ptrdiff_t dst_linesize,
+                        const uint8_t *src, ptrdiff_t src_linesize,
+                        int bx, int by)
+{
+    const int block = s->block;
+    const int size = s->size;
+    const int bpp = (s->depth + 7) / 8;
+    const int rh = FFMIN(block, s->height - by * size);
+    const int rw = FFMIN(block, s->width  - bx * size);
+    AVComplexFloat *row = tmp, *col = tmp + block;
+    int i, j;
+
+    src += src_linesize * by * size + bx * size * bpp;
+    for (i = 0; i < rh; i++) {
+        s->import_row(&row[0].re, 2, src, rw);
+        for (j = rw; j < block; j++)
+            row[j].re = row[mirror(j, rw, block)].re;
+        tx_fn(tx, hdata + i * block, row, sizeof(*row));
+
+        src += src_linesize;
+    }
+
+    for (; i < block; i++)
+        memcpy(hdata + i * block, hdata + mirror(i, rh, block) * block,
+               block * sizeof(*hdata));
+
+    for (i = 0; i < block; i++) {
+        for (j = 0; j < block; j++)
+            col[j] = hdata[j * block + i];
+        tx_fn(tx, dst, col, sizeof(*col));
+
+        dst = (AVComplexFloat *)((uint8_t *)dst + dst_linesize);
+    }
+}
+
+void ff_fftblock_export(const FFTBlockContext *s, AVTXContext *itx, av_tx_fn itx_fn,
+                        AVComplexFloat *tmp, AVComplexFloat *hdata,
+                        uint8_t *dst, ptrdiff_t dst_linesize,
+                        const AVComplexFloat *src, ptrdiff_t src_linesize,
+                        int bx, int by)
+{
+    const int block = s->block;
+    const int size = s->size;
+    const int hoverlap = s->overlap / 2;
+    const int bpp = (s->depth + 7) / 8;
+    const int x0 = bx ? bx * size + hoverlap : 0;
+    const int y0 = by ? by * size + hoverlap : 0;
+    const int rw = FFMIN((bx + 1) * size + hoverlap, s->width)  - x0;
+    const int rh = FFMIN((by + 1) * size + hoverlap, s->height) - y0;
+    const int woff = x0 - bx * size;
+    const int hoff = y0 - by * size;
+    const float scale = 1.f / (block * block);
+    AVComplexFloat *col = tmp + block;
+    int i, j;
+
+    if (rw <= 0 || rh <= 0)
+        return;
+
+    for (i = 0; i < block; i++) {
+        itx_fn(itx, col, (void *)src, sizeof(*col));
+        for (j = hoff; j < hoff + rh; j++)
+            hdata[j * block + i] = col[j];
+
+        src = (const AVComplexFloat *)((const uint8_t *)src + src_linesize);
+    }
+
+    dst += dst_linesize * y0 + x0 * bpp;
+    for (i = 0; i < rh; i++) {
+        itx_fn(itx, col, hdata + (hoff + i) * block, sizeof(*col));
+        s->export_row(dst, &col[woff].re, 2, rw, scale, s->depth);
+
+        dst += dst_linesize;
+    }
+}
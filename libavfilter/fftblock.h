@@ -0,0 +1,99 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * Helpers for filters working on planar pictures in the frequency domain:
+ * sample import/export and tiling of a plane into overlapping blocks.
+ */
+
+#ifndef AVFILTER_FFTBLOCK_H
+#define AVFILTER_FFTBLOCK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "libavutil/tx.h"
+
+typedef struct FFTBlockContext {
+    int depth;
+    int width, height;  ///< plane dimensions
+    int block;          ///< block size, 0 when only the row helpers are used
+    int overlap;        ///< overlap between neighbouring blocks
+    int size;           ///< distance between block origins, block - overlap
+    int nox, noy;       ///< number of blocks horizontally and vertically
+
+    /**
+     * Convert w samples from src into dst[0], dst[step], ... dst[(w-1)*step].
+     */
+    void (*import_row)(float *dst, ptrdiff_t step, const uint8_t *src, int w);
+
+    /**
+     * Convert w values from src[0], src[step], ... multiplied by scale back
+     * to clipped samples in dst.
+     */
+    void (*export_row)(uint8_t *dst, const float *src, ptrdiff_t step,
+                       int w, float scale, int depth);
+} FFTBlockContext;
+
+/**
+ * Set up the row converters for the given bit depth.
+ */
+void ff_fftblock_init_rows(FFTBlockContext *s, int depth);
+
+/**
+ * Set up the row converters and the block tiling of a width x height plane.
+ *
+ * @return 0 on success, a negative AVERROR on invalid parameters
+ */
+int ff_fftblock_init(FFTBlockContext *s, int depth, int width, int height,
+                     int block, int overlap);
+
+/**
+ * Import block (bx, by) of a plane and apply the forward 2D transform.
+ *
+ * Rows and columns reaching past the plane edges are mirrored. The
+ * transformed block is stored column-major in dst, one transformed column
+ * of block complex values per dst_linesize bytes.
+ *
+ * @param tx     forward complex transform of length block
+ * @param tmp    scratch of 2 * block complex values, the first block of
+ *               which must have zeroed imaginary parts
+ * @param hdata  scratch of block * block complex values
+ */
+void ff_fftblock_import(const FFTBlockContext *s, AVTXContext *tx, av_tx_fn tx_fn,
+                        AVComplexFloat *tmp, AVComplexFloat *hdata,
+                        AVComplexFloat *dst, ptrdiff_t dst_linesize,
+                        const uint8_t *src, ptrdiff_t src_linesize,
+                        int bx, int by);
+
+/**
+ * Apply the inverse 2D transform to a block laid out by ff_fftblock_import()
+ * and write its part of the plane back to dst.
+ *
+ * Only the non-overlapping center of the block is written, so that every
+ * output sample is produced by exactly one block and block rows can be
+ * exported in parallel.
+ */
+void ff_fftblock_export(const FFTBlockContext *s, AVTXContext *itx, av_tx_fn itx_fn,
+                        AVComplexFloat *tmp, AVComplexFloat *hdata,
+                        uint8_t *dst, ptrdiff_t dst_linesize,
+                        const AVComplexFloat *src, ptrdiff_t src_linesize,
+                        int bx, int by);
+
+#endif /* AVFILTER_FFTBLOCK_H */
@@ -55,50 +55,61 @@ do {                                                                       \
 } while (0)
 
 /**
- * Add all formats common for a and b to ret, copy the refs and destroy
- * a and b.
+ * Find the formats common to a and b, in the order of a.
+ *
+ * For video, the merge is also refused if chroma or alpha could be lost.
+ *
+ * @param common if not NULL, filled with the common formats; it must have
+ *               room for FFMIN(a->nb_formats, b->nb_formats) entries
+ * @return the number of common formats, 0 if the lists cannot be merged
  */
-#define MERGE_FORMATS(ret, a, b, fmts, nb, type, fail)                          \
-do {                                                                            \
-    int i, j, k = 0, count = FFMIN(a->nb, b->nb);                               \
-                                                                                \
-    if (!(ret = av_mallocz(sizeof(*ret))))                                      \
-        goto fail;                                                              \
-                                                                                \
-    if (count) {                                                                \
-        if (!(ret->fmts = av_malloc_array(count, sizeof(*ret->fmts))))          \
-            goto fail;                                                          \
-        for (i = 0; i < a->nb; i++)                                             \
-            for (j = 0; j < b->nb; j++)                                         \
-                if (a->fmts[i] == b->fmts[j]) {                                 \
-                    if(k >= FFMIN(a->nb, b->nb)){                               \
-                        av_log(NULL, AV_LOG_ERROR, "Duplicate formats in %s detected\n", __FUNCTION__); \
-                        av_free(ret->fmts);                                     \
-                        av_free(ret);                                           \
-                        return NULL;                                            \
-                    }                                                           \
-                    ret->fmts[k++] = a->fmts[i];                                \
-                }                                                               \
-    }                                                                           \
-    ret->nb = k;                                                                \
-    /* check that there was at least one common format */                       \
-    if (!ret->nb)                                                               \
-        goto fail;                                                              \
-                                                                                \
-    MERGE_REF(ret, a, fmts, type, fail);                                        \
-    MERGE_REF(ret, b, fmts, type, fail);                                        \
-} while (0)
-
-AVFilterFormats *ff_merge_formats(AVFilterFormats *a, AVFilterFormats *b,
-                                  enum AVMediaType type)
+static int intersect_formats(const AVFilterFormats *a, const AVFilterFormats *b,
+                             enum AVMediaType type, int *common)
 {
-    AVFilterFormats *ret = NULL;
-    int i, j;
-    int alpha1=0, alpha2=0;
-    int chroma1=0, chroma2=0;
+    unsigned count[FFMAX((int)AV_PIX_FMT_NB, (int)AV_SAMPLE_FMT_NB)];
+    const int max = FFMIN(a->nb_formats, b->nb_formats);
+    int alpha_a = 0, alpha_b = 0, alpha_common = 0;
+    int chroma_a = 0, chroma_b = 0, chroma_common = 0;
+    int use_count = type == AVMEDIA_TYPE_VIDEO || type == AVMEDIA_TYPE_AUDIO;
+    int i, j, n, k = 0;
+
+    if (use_count) {
+        memset(count, 0, sizeof(count));
+        for (j = 0; j < b->nb_formats; j++) {
+            if ((unsigned)b->formats[j] >= FF_ARRAY_ELEMS(count)) {
+                use_count = 0;
+                break;
+            }
+            count[b->formats[j]]++;
+        }
+    }
 
-    if (a == b)
-        return a;
+    for (i = 0; i < a->nb_formats; i++) {
+        const int fmt = a->formats[i];
+
+        if (use_count) {
+            n = (unsigned)fmt < FF_ARRAY_ELEMS(count) ? count[fmt] : 0;
+        } else {
+            for (j = n = 0; j < b->nb_formats; j++)
+                n += b->formats[j] == fmt;
+        }
+        if (!n)
+            continue;
+        if (k + n > max) {
+            av_log(NULL, AV_LOG_ERROR, "Duplicate formats in %s detected\n", __FUNCTION__);
+            return 0;
+        }
+        if (type == AVMEDIA_TYPE_VIDEO) {
+            const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(fmt);
+            alpha_common  |= desc->flags & AV_PIX_FMT_FLAG_ALPHA;
+            chroma_common |= desc->nb_components > 1;
+        }
+        while (n--) {
+            if (common)
+                common[k] = fmt;
+            k++;
+        }
+    }
 
     /* Do not lose chroma or alpha in merging.
        It happens if both lists have formats with chroma (resp. alpha), but
@@ -107,35 +118,71 @@ AVFilterFormats *ff_merge_formats(AVFilterFormats *a, AVFilterFormats *b,
        possibly causing a lossy conversion elsewhere in the graph.
        To avoid that, pretend that there are no common formats to force the
        insertion of a conversion filter. */
-    if (type == AVMEDIA_TYPE_VIDEO)
-        for (i = 0; i < a->nb_formats; i++)
-            for (j = 0; j < b->nb_formats; j++) {
-                const AVPixFmtDescriptor *adesc = av_pix_fmt_desc_get(a->formats[i]);
-                const AVPixFmtDescriptor *bdesc = av_pix_fmt_desc_get(b->formats[j]);
-                alpha2 |= adesc->flags & bdesc->flags & AV_PIX_FMT_FLAG_ALPHA;
-                chroma2|= adesc->nb_components > 1 && bdesc->nb_components > 1;
-                if (a->formats[i] == b->formats[j]) {
-                    alpha1 |= adesc->flags & AV_PIX_FMT_FLAG_ALPHA;
-                    chroma1|= adesc->nb_components > 1;
-                }
-            }
+    if (k && type == AVMEDIA_TYPE_VIDEO) {
+        for (i = 0; i < a->nb_formats; i++) {
+            const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(a->formats[i]);
+            alpha_a  |= desc->flags & AV_PIX_FMT_FLAG_ALPHA;
+            chroma_a |= desc->nb_components > 1;
+        }
+        for (j = 0; j < b->nb_formats; j++) {
+            const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(b->formats[j]);
+            alpha_b  |= desc->flags & AV_PIX_FMT_FLAG_ALPHA;
+            chroma_b |= desc->nb_components > 1;
+        }
+        if ((alpha_a & alpha_b) > alpha_common ||
+            (chroma_a & chroma_b) > chroma_common)
+            return 0;
+    }
 
-    // If chroma or alpha can be lost through merging then do not merge
-    if (alpha2 > alpha1 || chroma2 > chroma1)
+    return k;
+}
+
+/**
+ * Merge two lists of formats known to have common elements. The list with
+ * the most references is kept, so that the references are moved as little
+ * as possible when a list is merged many times.
+ */
+static AVFilterFormats *merge_formats(AVFilterFormats *a, AVFilterFormats *b,
+                                      enum AVMediaType type)
+{
+    AVFilterFormats *ret, *other;
+    int *common, nb;
+
+    if (!(common = av_malloc_array(FFMIN(a->nb_formats, b->nb_formats),
+                                   sizeof(*common))))
         return NULL;
+    if (!(nb = intersect_formats(a, b, type, common)))
+        goto fail;
 
-    MERGE_FORMATS(ret, a, b, formats, nb_formats, AVFilterFormats, fail);
+    ret   = a->refcount >= b->refcount ? a : b;
+    other = ret == a ? b : a;
+    MERGE_REF(ret, other, formats, AVFilterFormats, fail);
+
+    av_free(ret->formats);
+    ret->formats    = common;
+    ret->nb_formats = nb;
 
     return ret;
 fail:
-    if (ret) {
-        av_freep(&ret->refs);
-        av_freep(&ret->formats);
-    }
-    av_freep(&ret);
+    av_free(common);
     return NULL;
 }
 
+AVFilterFormats *ff_merge_formats(AVFilterFormats *a, AVFilterFormats *b,
+                                  enum AVMediaType type)
+{
+    if (a == b)
+        return a;
+
+    return merge_formats(a, b, type);
+}
+
+int ff_can_merge_formats(const AVFilterFormats *a, const AVFilterFormats *b,
+                         enum AVMediaType type)
+{
+    return a == b || intersect_formats(a, b, type, NULL) > 0;
+}
+
 AVFilterFormats *ff_merge_samplerates(AVFilterFormats *a,
                                       AVFilterFormats *b)
 {
@@ -143,9 +190,10 @@ AVFilterFormats *ff_merge_samplerates(AVFilterFormats *a,
 
     if (a == b) return a;
 
-    if (a->nb_formats && b->nb_formats) {
-        MERGE_FORMATS(ret, a, b, formats, nb_formats, AVFilterFormats, fail);
-    } else if (a->nb_formats) {
+    if (a->nb_formats && b->nb_formats)
+        return merge_formats(a, b, AVMEDIA_TYPE_UNKNOWN);
+
+    if (a->nb_formats) {
         MERGE_REF(a, b, formats, AVFilterFormats, fail);
         ret = a;
     } else {
@@ -155,14 +203,15 @@ AVFilterFormats *ff_merge_samplerates(AVFilterFormats *a,
 
     return ret;
 fail:
-    if (ret) {
-        av_freep(&ret->refs);
-        av_freep(&ret->formats);
-    }
-    av_freep(&ret);
     return NULL;
 }
 
+int ff_can_merge_samplerates(const AVFilterFormats *a, const AVFilterFormats *b)
+{
+    return a == b || !a->nb_formats || !b->nb_formats ||
+           intersect_formats(a, b, AVMEDIA_TYPE_UNKNOWN, NULL) > 0;
+}
+
 AVFilterChannelLayouts *ff_merge_channel_layouts(AVFilterChannelLayouts *a,
                                                  AVFilterChannelLayouts *b)
 {
@@ -353,10 +402,17 @@ AVFilterFormats *ff_all_formats(enum AVMediaType type)
 
     if (type == AVMEDIA_TYPE_VIDEO) {
         const AVPixFmtDescriptor *desc = NULL;
-        while ((desc = av_pix_fmt_desc_next(desc))) {
-            if (ff_add_format(&ret, av_pix_fmt_desc_get_id(desc)) < 0)
-                return NULL;
+        int nb = 0;
+
+        while ((desc = av_pix_fmt_desc_next(desc)))
+            nb++;
+        if (!(ret = av_mallocz(sizeof(*ret))) ||
+            !(ret->formats = av_malloc_array(nb, sizeof(*ret->formats)))) {
+            av_freep(&ret);
+            return NULL;
         }
+        while ((desc = av_pix_fmt_desc_next(desc)))
+            ret->formats[ret->nb_formats++] = av_pix_fmt_desc_get_id(desc);
     } else if (type == AVMEDIA_TYPE_AUDIO) {
         enum AVSampleFormat fmt = 0;
         while (av_get_sample_fmt_name(fmt)) {
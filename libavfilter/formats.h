@@ -111,7 +111,8 @@ typedef struct AVFilterChannelLayouts {
 /**
  * Return a channel layouts/samplerates list which contains the intersection of
  * the layouts/samplerates of a and b. Also, all the references of a, all the
- * references of b, and a and b themselves will be deallocated.
+ * references of b, and a and b themselves will be deallocated, except for the
+ * one which may be reused for the result.
  *
  * If a and b do not share any common elements, neither is modified, and NULL
  * is returned.
@@ -121,6 +122,11 @@ AVFilterChannelLayouts *ff_merge_channel_layouts(AVFilterChannelLayouts *a,
 AVFilterFormats *ff_merge_samplerates(AVFilterFormats *a,
                                       AVFilterFormats *b);
 
+/**
+ * Check if ff_merge_samplerates() would succeed, without modifying a or b.
+ */
+int ff_can_merge_samplerates(const AVFilterFormats *a, const AVFilterFormats *b);
+
 /**
  * Construct an empty AVFilterChannelLayouts/AVFilterFormats struct --
  * representing any channel layout (with known disposition)/sample rate.
@@ -230,7 +236,8 @@ AVFilterFormats *ff_planar_sample_fmts(void);
 /**
  * Return a format list which contains the intersection of the formats of
  * a and b. Also, all the references of a, all the references of b, and
- * a and b themselves will be deallocated.
+ * a and b themselves will be deallocated, except for the one which may be
+ * reused for the result.
  *
  * If a and b do not share any common formats, neither is modified, and NULL
  * is returned.
@@ -238,6 +245,12 @@ AVFilterFormats *ff_planar_sample_fmts(void);
 AVFilterFormats *ff_merge_formats(AVFilterFormats *a, AVFilterFormats *b,
                                   enum AVMediaType type);
 
+/**
+ * Check if ff_merge_formats() would succeed, without modifying a or b.
+ */
+int ff_can_merge_formats(const AVFilterFormats *a, const AVFilterFormats *b,
+                         enum AVMediaType type);
+
 /**
  * Add *ref as a new reference to formats.
  * That is the pointers will point like in the ascii art below:
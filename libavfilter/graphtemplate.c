@@ -0,0 +1,188 @@
+/*
+ * Filter graph templates
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "libavutil/avassert.h"
+#include "libavutil/mem.h"
+
+#define FF_INTERNAL_FIELDS 1
+#include "framequeue.h"
+
+#include "avfilter.h"
+#include "internal.h"
+
+typedef struct TemplateFilter {
+    const AVFilter *filter;
+    char *name;
+    char *enable_str;
+    int nb_threads;
+    int extra_hw_frames;
+    FilterOptions *opts;
+} TemplateFilter;
+
+typedef struct TemplateLink {
+    unsigned src, srcpad;
+    unsigned dst, dstpad;
+    int format;                 ///< negotiated format, -1 if not configured
+    int sample_rate;
+    uint64_t channel_layout;
+} TemplateLink;
+
+struct AVFilterGraphTemplate {
+    TemplateFilter *filters;
+    unsigned nb_filters;
+    TemplateLink *links;
+    unsigned nb_links;
+};
+
+static int copy_filter(TemplateFilter *tf, AVFilterContext *ctx)
+{
+    const FilterOptions *opts = ctx->internal->init_options;
+
+    if (!opts) {
+        av_log(ctx, AV_LOG_ERROR, "The options of the filter were not kept, "
+               "the graph cannot be used as a template.\n");
+        return AVERROR(EINVAL);
+    }
+
+    tf->filter          = ctx->filter;
+    tf->nb_threads      = ctx->nb_threads;
+    tf->extra_hw_frames = ctx->extra_hw_frames;
+    if (ctx->name && !(tf->name = av_strdup(ctx->name)))
+        return AVERROR(ENOMEM);
+    if (ctx->enable_str && !(tf->enable_str = av_strdup(ctx->enable_str)))
+        return AVERROR(ENOMEM);
+
+    return ff_filter_options_copy(&tf->opts, ctx->filter, opts);
+}
+
+int avfilter_graph_template_create(AVFilterGraphTemplate **ptmpl,
+                                   const AVFilterGraph *graph)
+{
+    AVFilterGraphTemplate *tmpl;
+    unsigned i, j, nb_links = 0;
+    int ret;
+
+    *ptmpl = NULL;
+
+    tmpl = av_mallocz(sizeof(*tmpl));
+    if (!tmpl)
+        return AVERROR(ENOMEM);
+
+    for (i = 0; i < graph->nb_filters; i++)
+        nb_links += graph->filters[i]->nb_inputs;
+    tmpl->filters = av_mallocz_array(graph->nb_filters, sizeof(*tmpl->filters));
+    tmpl->links   = av_malloc_array(nb_links, sizeof(*tmpl->links));
+    if (!tmpl->filters || (nb_links && !tmpl->links)) {
+        ret = AVERROR(ENOMEM);
+        goto fail;
+    }
+
+    for (i = 0; i < graph->nb_filters; i++) {
+        AVFilterContext *f = graph->filters[i];
+
+        tmpl->nb_filters++;
+        if ((ret = copy_filter(&tmpl->filters[i], f)) < 0)
+            goto fail;
+
+        for (j = 0; j < f->nb_inputs; j++) {
+            const AVFilterLink *link = f->inputs[j];
+            TemplateLink *tl = &tmpl->links[tmpl->nb_links];
+
+            if (!link)
+                continue;
+            av_assert0(link->src->graph == graph);
+            tl->src            = link->src->internal->graph_index;
+            tl->srcpad         = FF_OUTLINK_IDX(link);
+            tl->dst            = i;
+            tl->dstpad         = j;
+            tl->format         = link->format;
+            tl->sample_rate    = link->sample_rate;
+            tl->channel_layout = link->channel_layout;
+            tmpl->nb_links++;
+        }
+    }
+
+    *ptmpl = tmpl;
+    return 0;
+
+fail:
+    avfilter_graph_template_free(&tmpl);
+    return ret;
+}
+
+int avfilter_graph_template_instantiate(const AVFilterGraphTemplate *tmpl,
+                                        AVFilterGraph *graph)
+{
+    unsigned i, base = graph->nb_filters;
+    int ret;
+
+    for (i = 0; i < tmpl->nb_filters; i++) {
+        const TemplateFilter *tf = &tmpl->filters[i];
+        AVFilterContext *ctx;
+
+        ctx = avfilter_graph_alloc_filter(graph, tf->filter, tf->name);
+        if (!ctx)
+            return AVERROR(ENOMEM);
+        ctx->nb_threads      = tf->nb_threads;
+        ctx->extra_hw_frames = tf->extra_hw_frames;
+        if (tf->enable_str && !(ctx->enable_str = av_strdup(tf->enable_str)))
+            return AVERROR(ENOMEM);
+
+        if ((ret = ff_filter_init_options(ctx, tf->opts)) < 0) {
+            av_log(ctx, AV_LOG_ERROR, "Error initializing filter '%s' "
+                   "from the template\n", tf->filter->name);
+            return ret;
+        }
+    }
+
+    for (i = 0; i < tmpl->nb_links; i++) {
+        const TemplateLink *tl = &tmpl->links[i];
+        AVFilterContext *src = graph->filters[base + tl->src];
+        AVFilterContext *dst = graph->filters[base + tl->dst];
+        AVFilterLink *link;
+
+        if ((ret = avfilter_link(src, tl->srcpad, dst, tl->dstpad)) < 0)
+            return ret;
+        link = dst->inputs[tl->dstpad];
+        link->format_hint         = tl->format;
+        link->sample_rate_hint    = tl->sample_rate;
+        link->channel_layout_hint = tl->channel_layout;
+    }
+
+    return 0;
+}
+
+void avfilter_graph_template_free(AVFilterGraphTemplate **ptmpl)
+{
+    AVFilterGraphTemplate *tmpl = *ptmpl;
+    unsigned i;
+
+    if (!tmpl)
+        return;
+
+    for (i = 0; i < tmpl->nb_filters; i++) {
+        av_freep(&tmpl->filters[i].name);
+        av_freep(&tmpl->filters[i].enable_str);
+        ff_filter_options_free(&tmpl->filters[i].opts);
+    }
+    av_freep(&tmpl->filters);
+    av_freep(&tmpl->links);
+    av_freep(ptmpl);
+}
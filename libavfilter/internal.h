@@ -149,12 +149,88 @@ struct AVFilterGraphInternal {
     void *thread;
     avfilter_execute_func *thread_execute;
     FFFrameQueueGlobal frame_queues;
+
+    /**
+     * Binary heap of the filters with a non-0 ready status, the most urgent
+     * first; ties are broken by the position of the filters in the graph.
+     * Allocated for graph->nb_filters entries.
+     */
+    AVFilterContext **ready_heap;
+    unsigned nb_ready;
 };
 
+/**
+ * Profiling state of a filter.
+ */
+typedef struct FilterProfile {
+    AVFilterStats stats;
+
+    /**
+     * Execute function wrapped by the profiling one.
+     */
+    avfilter_execute_func *execute;
+
+    /**
+     * Time spent in each job of the current slice threaded execution.
+     */
+    int64_t *job_time;
+    unsigned job_time_size;
+} FilterProfile;
+
+/**
+ * Options of a filter as they were just before its initialization, kept for
+ * filter graph templates.
+ */
+typedef struct FilterOptions {
+    void *priv;             ///< copy of the private options, NULL without priv_class
+    AVDictionary **child_opts; ///< options of the child objects of priv, as strings
+    int nb_child_opts;
+    AVDictionary *dict;     ///< options left unused, passed to init_dict()
+    unsigned thread_type;   ///< thread type requested for the filter
+} FilterOptions;
+
 struct AVFilterInternal {
     avfilter_execute_func *execute;
+
+    unsigned graph_index;   ///< index of the filter in graph->filters
+    int ready_index;        ///< index in the graph ready heap, -1 if absent
+
+    FilterProfile *profile; ///< NULL unless the graph is profiled
+
+    FilterOptions *init_options; ///< NULL unless the graph keeps the options
 };
 
+/**
+ * Start gathering the profiling statistics of a filter.
+ */
+int ff_filter_profile_init(AVFilterContext *ctx);
+
+/**
+ * Allocate a copy of the options of a filter.
+ *
+ * @param priv  private context of an allocated filter of the same type,
+ *              whose options and those of its child objects are copied;
+ *              ignored if the filter has no priv_class
+ */
+int ff_filter_options_alloc(FilterOptions **opts, const AVFilter *filter,
+                            void *priv, const AVDictionary *dict,
+                            unsigned thread_type);
+
+/**
+ * Allocate a copy of options kept by ff_filter_options_alloc().
+ */
+int ff_filter_options_copy(FilterOptions **dst, const AVFilter *filter,
+                           const FilterOptions *src);
+
+void ff_filter_options_free(FilterOptions **opts);
+
+/**
+ * Initialize a filter from options kept by ff_filter_options_alloc(),
+ * instead of parsing them as avfilter_init_str() and avfilter_init_dict() do.
+ * The generic options other than the thread type must already be set.
+ */
+int ff_filter_init_options(AVFilterContext *ctx, const FilterOptions *opts);
+
 /**
  * Tell if an integer is contained in the provided -1-terminated list of integers.
  * This is useful for determining (for instance) if an AVPixelFormat is in an
@@ -384,6 +460,12 @@ void ff_filter_graph_remove_filter(AVFilterGraph *graph, AVFilterContext *filter
  */
 #define FF_FILTER_FLAG_HWFRAME_AWARE (1 << 0)
 
+/**
+ * Update the position of a filter in the graph ready heap after its ready
+ * status changed.
+ */
+void ff_filter_graph_update_ready(AVFilterGraph *graph, AVFilterContext *filter);
+
 /**
  * Run one round of processing on a filter graph.
  */
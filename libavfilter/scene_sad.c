@@ -21,6 +21,8 @@
  * Scene SAD functions
  */
 
+#include "libavutil/mem.h"
+#include "internal.h"
 #include "scene_sad.h"
 
 void ff_scene_sad16_c(SCENE_SAD_PARAMS)
@@ -70,3 +72,154 @@ ff_scene_sad_fn ff_scene_sad_get_fn(int depth)
     return sad;
 }
 
+
+typedef struct SceneThreadData {
+    FFSceneContext *s;
+    const uint8_t *src[2];
+    ptrdiff_t stride[2];
+    int width, rows;
+} SceneThreadData;
+
+av_cold int ff_scene_init(FFSceneContext *s, AVFilterContext *ctx,
+                          enum FFSceneMethod method, int depth, int nb_comp, int step)
+{
+    s->ctx        = ctx;
+    s->method     = method;
+    s->nb_comp    = nb_comp;
+    s->step       = FFMAX(step, 1);
+    s->nb_threads = ff_filter_get_nb_threads(ctx);
+
+    if (method == FF_SCENE_HIST) {
+        if (depth != 8)
+            return AVERROR(EINVAL);
+        s->job_hist = av_malloc_array(s->nb_threads, nb_comp * 256 * sizeof(*s->job_hist));
+        s->hist[0]  = av_calloc(nb_comp * 256, sizeof(*s->hist[0]));
+        s->hist[1]  = av_calloc(nb_comp * 256, sizeof(*s->hist[1]));
+        if (!s->job_hist || !s->hist[0] || !s->hist[1])
+            return AVERROR(ENOMEM);
+    } else {
+        s->sad = ff_scene_sad_get_fn(depth);
+        if (!s->sad)
+            return AVERROR(EINVAL);
+        s->job_sad = av_calloc(s->nb_threads, sizeof(*s->job_sad));
+        if (!s->job_sad)
+            return AVERROR(ENOMEM);
+    }
+
+    return 0;
+}
+
+static int sad_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    SceneThreadData *td = arg;
+    FFSceneContext *s = td->s;
+    const int start = (td->rows *  jobnr     ) / nb_jobs;
+    const int end   = (td->rows * (jobnr + 1)) / nb_jobs;
+    const ptrdiff_t stride1 = td->stride[0] * s->step;
+    const ptrdiff_t stride2 = td->stride[1] * s->step;
+
+    s->sad(td->src[0] + start * stride1, stride1,
+           td->src[1] + start * stride2, stride2,
+           td->width, end - start, &s->job_sad[jobnr]);
+
+    return 0;
+}
+
+int64_t ff_scene_sad(FFSceneContext *s,
+                     const uint8_t *src1, ptrdiff_t stride1,
+                     const uint8_t *src2, ptrdiff_t stride2,
+                     int width, int height, uint64_t *sum)
+{
+    SceneThreadData td = { s, { src1, src2 }, { stride1, stride2 }, width };
+    int i, nb_jobs;
+
+    td.rows = (height + s->step - 1) / s->step;
+    nb_jobs = FFMAX(FFMIN(s->nb_threads, td.rows), 1);
+
+    s->ctx->internal->execute(s->ctx, sad_slice, &td, NULL, nb_jobs);
+    emms_c();
+
+    *sum = 0;
+    for (i = 0; i < nb_jobs; i++)
+        *sum += s->job_sad[i];
+
+    return (int64_t)width * td.rows;
+}
+
+static int hist_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    SceneThreadData *td = arg;
+    FFSceneContext *s = td->s;
+    const int nb_comp = s->nb_comp;
+    const int xstep = nb_comp * s->step;
+    const int start = (td->rows *  jobnr     ) / nb_jobs;
+    const int end   = (td->rows * (jobnr + 1)) / nb_jobs;
+    uint32_t *hist = s->job_hist + jobnr * nb_comp * 256;
+    int x, y, c;
+
+    memset(hist, 0, nb_comp * 256 * sizeof(*hist));
+    for (y = start; y < end; y++) {
+        const uint8_t *src = td->src[0] + y * s->step * td->stride[0];
+
+        for (x = 0; x + nb_comp <= td->width; x += xstep)
+            for (c = 0; c < nb_comp; c++)
+                hist[c * 256 + src[x + c]]++;
+    }
+
+    return 0;
+}
+
+void ff_scene_histogram(FFSceneContext *s, const uint8_t *src, ptrdiff_t stride,
+                        int width, int height, uint32_t *hist)
+{
+    SceneThreadData td = { s, { src }, { stride }, width };
+    const int size = s->nb_comp * 256;
+    int i, j, nb_jobs;
+
+    td.rows = (height + s->step - 1) / s->step;
+    nb_jobs = FFMAX(FFMIN(s->nb_threads, td.rows), 1);
+
+    s->ctx->internal->execute(s->ctx, hist_slice, &td, NULL, nb_jobs);
+
+    memcpy(hist, s->job_hist, size * sizeof(*hist));
+    for (j = 1; j < nb_jobs; j++)
+        for (i = 0; i < size; i++)
+            hist[i] += s->job_hist[j * size + i];
+}
+
+double ff_scene_hist(FFSceneContext *s, const uint8_t *src, ptrdiff_t stride,
+                     int width, int height)
+{
+    const int size = s->nb_comp * 256;
+    uint32_t *cur = s->hist[1], *prev = s->hist[0];
+    uint64_t cur_count = 0, prev_count = 0;
+    double ret = 0;
+    int i;
+
+    ff_scene_histogram(s, src, stride, width, height, cur);
+
+    if (s->has_prev_hist) {
+        for (i = 0; i < 256; i++) {
+            cur_count  += cur[i];
+            prev_count += prev[i];
+        }
+        if (cur_count && prev_count) {
+            for (i = 0; i < size; i++)
+                ret += fabs(cur[i] / (double)cur_count - prev[i] / (double)prev_count);
+            ret /= 2 * s->nb_comp;
+        }
+    }
+
+    FFSWAP(uint32_t *, s->hist[0], s->hist[1]);
+    s->has_prev_hist = 1;
+
+    return ret;
+}
+
+av_cold void ff_scene_uninit(FFSceneContext *s)
+{
+    av_freep(&s->job_sad);
+    av_freep(&s->job_hist);
+    av_freep(&s->hist[0]);
+    av_freep(&s->hist[1]);
+}
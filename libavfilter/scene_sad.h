@@ -41,4 +41,73 @@ ff_scene_sad_fn ff_scene_sad_get_fn_x86(int depth);
 
 ff_scene_sad_fn ff_scene_sad_get_fn(int depth);
 
+enum FFSceneMethod {
+    FF_SCENE_SAD,               ///< sum of absolute differences
+    FF_SCENE_HIST,              ///< difference of the per component histograms
+    FF_SCENE_NB
+};
+
+/**
+ * Scene analysis shared by the scene change detecting filters.
+ *
+ * Planes are analysed on one line out of step, with the lines split into
+ * slices run on the slice threads of the owning filter.
+ */
+typedef struct FFSceneContext {
+    AVFilterContext *ctx;
+    ff_scene_sad_fn sad;
+    enum FFSceneMethod method;
+    int step;                   ///< analyse one line (and pixel for histograms) out of step
+    int nb_comp;                ///< number of interleaved components per pixel
+    int nb_threads;
+
+    uint64_t *job_sad;          ///< per slice SAD,       nb_threads entries
+    uint32_t *job_hist;         ///< per slice histogram, nb_threads * nb_comp * 256 entries
+    uint32_t *hist[2];          ///< histograms of the previous and current frame
+    int has_prev_hist;
+} FFSceneContext;
+
+/**
+ * Initialize the scene analysis context.
+ *
+ * @param ctx     filter whose slice threads are used
+ * @param depth   bit depth of the planes, histograms require 8
+ * @param nb_comp number of interleaved components per pixel
+ * @param step    line decimation factor, 1 analyses every line
+ * @return 0 on success, a negative AVERROR code on failure
+ */
+int ff_scene_init(FFSceneContext *s, AVFilterContext *ctx,
+                  enum FFSceneMethod method, int depth, int nb_comp, int step);
+
+/**
+ * Compute the SAD of two planes of width bytes per line.
+ *
+ * @return the number of compared samples
+ */
+int64_t ff_scene_sad(FFSceneContext *s,
+                     const uint8_t *src1, ptrdiff_t stride1,
+                     const uint8_t *src2, ptrdiff_t stride2,
+                     int width, int height, uint64_t *sum);
+
+/**
+ * Compute the per component histograms of a plane of width bytes per line.
+ *
+ * @param hist nb_comp * 256 entries, the histogram of component c is
+ *             written at hist + c * 256
+ */
+void ff_scene_histogram(FFSceneContext *s, const uint8_t *src, ptrdiff_t stride,
+                        int width, int height, uint32_t *hist);
+
+/**
+ * Compute the histogram of a plane of width bytes per line and compare it
+ * to the histogram of the previous call.
+ *
+ * @return the histogram distance, between 0 (identical) and 1 (disjoint);
+ *         0 on the first call
+ */
+double ff_scene_hist(FFSceneContext *s, const uint8_t *src, ptrdiff_t stride,
+                     int width, int height);
+
+void ff_scene_uninit(FFSceneContext *s);
+
 #endif /* AVFILTER_SCENE_SAD_H */
@@ -0,0 +1,231 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "libavutil/channel_layout.h"
+#include "libavutil/mem.h"
+#include "libavutil/opt.h"
+#include "libavutil/pixdesc.h"
+#include "libavutil/samplefmt.h"
+#include "libavfilter/avfilter.h"
+#include "libavfilter/buffersrc.h"
+
+static const struct {
+    const char *filter;
+    const char *graph;
+} tests[] = {
+    { "overlay", "color=s=16x16[a];color=s=8x8[b];"
+                 "[a][b]overlay=x=3:eof_action=pass:shortest=1,nullsink" },
+    { "blend",   "color=s=16x16[a];color=s=16x16[b];"
+                 "[a][b]blend=all_mode=multiply:eof_action=endall:shortest=1:repeatlast=0,nullsink" },
+};
+
+static const char *const keys[] = {
+    "x", "all_mode", "eof_action", "shortest", "repeatlast", NULL
+};
+
+static const struct {
+    const char *name;
+    const char *graph;
+    int pix_fmt;                ///< pixel format given to the copy, or -1
+    int sample_rate;            ///< sample rate given to the copy, or 0
+    int width;                  ///< width given to the copy, or 0
+} hint_tests[] = {
+    { "video", "buffer=video_size=16x16:pix_fmt=yuv420p:time_base=1/25,"
+               "hflip,format=pix_fmts=yuv444p|rgb24,nullsink",
+      -1, 0, 0 },
+    { "video-size", "buffer=video_size=16x16:pix_fmt=yuv420p:time_base=1/25,"
+                    "hflip,format=pix_fmts=yuv444p|rgb24,nullsink",
+      -1, 0, 32 },
+    { "video-pix_fmt", "buffer=video_size=16x16:pix_fmt=yuv420p:time_base=1/25,"
+                       "hflip,format=pix_fmts=yuv444p|rgb24,nullsink",
+      AV_PIX_FMT_RGB24, 0, 0 },
+    { "audio", "abuffer=sample_rate=44100:sample_fmt=s16:channel_layout=stereo:time_base=1/44100,"
+               "aformat=sample_fmts=fltp|s16p:sample_rates=48000|44100,anullsink",
+      -1, 0, 0 },
+    { "audio-sample_rate", "abuffer=sample_rate=44100:sample_fmt=s16:channel_layout=stereo:time_base=1/44100,"
+                           "aformat=sample_fmts=fltp|s16p:sample_rates=48000|44100,anullsink",
+      -1, 48000, 0 },
+};
+
+static const char *hints_state;
+
+static void log_callback(void *avcl, int level, const char *fmt, va_list vl)
+{
+    if (!strncmp(fmt, "Reusing the formats of the template", 35))
+        hints_state = "hints applied";
+    else if (!strncmp(fmt, "Formats of the template not supported", 37))
+        hints_state = "hints ignored";
+    else if (level <= AV_LOG_WARNING)
+        av_log_default_callback(avcl, level, fmt, vl);
+}
+
+static void print_formats(const AVFilterGraph *graph, const char *name,
+                          const char *state)
+{
+    unsigned i, j;
+
+    printf("%s:%s%s\n", name, state ? " " : "", state ? state : "");
+    for (i = 0; i < graph->nb_filters; i++) {
+        const AVFilterContext *ctx = graph->filters[i];
+
+        for (j = 0; j < ctx->nb_inputs; j++) {
+            const AVFilterLink *link = ctx->inputs[j];
+
+            printf("  %s -> %s:", link->src->filter->name, ctx->filter->name);
+            if (link->type == AVMEDIA_TYPE_AUDIO) {
+                char layout[64];
+
+                av_get_channel_layout_string(layout, sizeof(layout), 0,
+                                             link->channel_layout);
+                printf(" %s %d %s\n", av_get_sample_fmt_name(link->format),
+                       link->sample_rate, layout);
+            } else {
+                printf(" %s %dx%d\n", av_get_pix_fmt_name(link->format),
+                       link->w, link->h);
+            }
+        }
+    }
+}
+
+static int test_hints(unsigned n)
+{
+    AVFilterGraph *graph = avfilter_graph_alloc();
+    AVFilterGraph *copy  = avfilter_graph_alloc();
+    AVFilterGraphTemplate *tmpl = NULL;
+    unsigned i;
+    int ret;
+
+    if (!graph || !copy)
+        return AVERROR(ENOMEM);
+    av_opt_set_int(graph, "keep_options", 1, 0);
+
+    /* the template is created from a configured graph, with the formats
+       negotiated on it and the conversion filters inserted for them */
+    if ((ret = avfilter_graph_parse_ptr(graph, hint_tests[n].graph, NULL, NULL, NULL)) < 0 ||
+        (ret = avfilter_graph_config(graph, NULL)) < 0 ||
+        (ret = avfilter_graph_template_create(&tmpl, graph)) < 0 ||
+        (ret = avfilter_graph_template_instantiate(tmpl, copy)) < 0)
+        goto end;
+    print_formats(graph, "template", NULL);
+
+    for (i = 0; i < copy->nb_filters; i++) {
+        AVFilterContext *ctx = copy->filters[i];
+        AVBufferSrcParameters *par;
+
+        if (strcmp(ctx->filter->name, "buffer") && strcmp(ctx->filter->name, "abuffer"))
+            continue;
+        if (!(par = av_buffersrc_parameters_alloc())) {
+            ret = AVERROR(ENOMEM);
+            goto end;
+        }
+        if (hint_tests[n].pix_fmt >= 0)
+            par->format = hint_tests[n].pix_fmt;
+        par->sample_rate = hint_tests[n].sample_rate;
+        par->width       = hint_tests[n].width;
+        ret = av_buffersrc_parameters_set(ctx, par);
+        av_free(par);
+        if (ret < 0)
+            goto end;
+    }
+
+    hints_state = "no hints";
+    if ((ret = avfilter_graph_config(copy, NULL)) < 0)
+        goto end;
+    print_formats(copy, hint_tests[n].name, hints_state);
+
+end:
+    avfilter_graph_template_free(&tmpl);
+    avfilter_graph_free(&graph);
+    avfilter_graph_free(&copy);
+    return ret;
+}
+
+static void print_options(const AVFilterGraph *graph, const char *name)
+{
+    unsigned i;
+    int k;
+
+    for (i = 0; i < graph->nb_filters; i++) {
+        AVFilterContext *ctx = graph->filters[i];
+
+        if (strcmp(ctx->filter->name, name))
+            continue;
+        printf("%s:", name);
+        for (k = 0; keys[k]; k++) {
+            uint8_t *val;
+
+            if (av_opt_get(ctx->priv, keys[k], AV_OPT_SEARCH_CHILDREN, &val) < 0)
+                continue;
+            printf(" %s=%s", keys[k], val);
+            av_free(val);
+        }
+        printf("\n");
+    }
+}
+
+int main(void)
+{
+    unsigned i;
+
+    for (i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {
+        AVFilterGraph *graph = avfilter_graph_alloc();
+        AVFilterGraph *copy  = avfilter_graph_alloc();
+        AVFilterGraphTemplate *tmpl = NULL;
+        int ret;
+
+        if (!graph || !copy)
+            return 1;
+        av_opt_set_int(graph, "keep_options", 1, 0);
+
+        if ((ret = avfilter_graph_parse_ptr(graph, tests[i].graph, NULL, NULL, NULL)) < 0 ||
+            (ret = avfilter_graph_template_create(&tmpl, graph)) < 0 ||
+            (ret = avfilter_graph_template_instantiate(tmpl, copy)) < 0) {
+            printf("%s: error %d\n", tests[i].filter, ret);
+            return 1;
+        }
+
+        /* before configuration, which may adjust the framesync options */
+        print_options(graph, tests[i].filter);
+        print_options(copy,  tests[i].filter);
+
+        if ((ret = avfilter_graph_config(graph, NULL)) < 0 ||
+            (ret = avfilter_graph_config(copy, NULL)) < 0) {
+            printf("%s: error %d\n", tests[i].filter, ret);
+            return 1;
+        }
+
+        avfilter_graph_template_free(&tmpl);
+        avfilter_graph_free(&graph);
+        avfilter_graph_free(&copy);
+    }
+
+    av_log_set_callback(log_callback);
+    for (i = 0; i < sizeof(hint_tests) / sizeof(hint_tests[0]); i++) {
+        int ret = test_hints(i);
+
+        if (ret < 0) {
+            printf("%s: error %d\n", hint_tests[i].name, ret);
+            return 1;
+        }
+    }
+
+    return 0;
+}
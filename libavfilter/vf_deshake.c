@@ -81,6 +81,7 @@ static const AVOption deshake_options[] = {
     { "search",  "set search strategy", OFFSET(search), AV_OPT_TYPE_INT, {.i64=EXHAUSTIVE}, EXHAUSTIVE, SEARCH_COUNT-1, FLAGS, "smode" },
         { "exhaustive", "exhaustive search",      0, AV_OPT_TYPE_CONST, {.i64=EXHAUSTIVE},       INT_MIN, INT_MAX, FLAGS, "smode" },
         { "less",       "less exhaustive search", 0, AV_OPT_TYPE_CONST, {.i64=SMART_EXHAUSTIVE}, INT_MIN, INT_MAX, FLAGS, "smode" },
+        { "predictive", "predictive search",      0, AV_OPT_TYPE_CONST, {.i64=PREDICTIVE},       INT_MIN, INT_MAX, FLAGS, "smode" },
     { "filename", "set motion search detailed log file name", OFFSET(filename), AV_OPT_TYPE_STRING, {.str=NULL}, .flags = FLAGS },
     { "opencl", "ignored",                              OFFSET(opencl), AV_OPT_TYPE_BOOL, {.i64=0}, 0, 1, .flags = FLAGS },
     { NULL }
@@ -117,9 +118,9 @@ static double clean_mean(double *values, int count)
  * and ry attributes. Searches using a simple matrix of those shifts and
  * chooses the most likely shift by the smallest difference in blocks.
  */
-static void find_block_motion(DeshakeContext *deshake, uint8_t *src1,
-                              uint8_t *src2, int cx, int cy, int stride,
-                              IntMotionVector *mv)
+static int find_block_motion_search(DeshakeContext *deshake, uint8_t *src1,
+                                    uint8_t *src2, int cx, int cy, int stride,
+                                    IntMotionVector *mv, int search)
 {
     int x, y;
     int diff;
@@ -129,7 +130,7 @@ static void find_block_motion(DeshakeContext *deshake, uint8_t *src1,
     #define CMP(i, j) deshake->sad(src1 + cy  * stride + cx,  stride,\
                                    src2 + (j) * stride + (i), stride)
 
-    if (deshake->search == EXHAUSTIVE) {
+    if (search == EXHAUSTIVE) {
         // Compare every possible position - this is sloooow!
         for (y = -deshake->ry; y <= deshake->ry; y++) {
             for (x = -deshake->rx; x <= deshake->rx; x++) {
@@ -141,7 +142,7 @@ static void find_block_motion(DeshakeContext *deshake, uint8_t *src1,
                 }
             }
         }
-    } else if (deshake->search == SMART_EXHAUSTIVE) {
+    } else if (search == SMART_EXHAUSTIVE) {
         // Compare every other possible position and find the best match
         for (y = -deshake->ry + 1; y < deshake->ry; y += 2) {
             for (x = -deshake->rx + 1; x < deshake->rx; x += 2) {
@@ -173,13 +174,83 @@ static void find_block_motion(DeshakeContext *deshake, uint8_t *src1,
         }
     }
 
+    return smallest;
+}
+
+/**
+ * Start from the zero vector and the vector found for the same block in
+ * the previous frame, then walk downhill over the SAD surface in single
+ * pixel steps. Camera motion is mostly smooth, so this usually lands on
+ * the same vector as the full search at a fraction of its cost.
+ */
+static int find_block_motion_predictive(DeshakeContext *deshake, uint8_t *src1,
+                                        uint8_t *src2, int cx, int cy, int stride,
+                                        const IntMotionVector *pred,
+                                        IntMotionVector *mv)
+{
+    static const int dirs[4][2] = { { -1, 0 }, { 1, 0 }, { 0, -1 }, { 0, 1 } };
+    int smallest, diff, i, iter;
+
+    mv->x = mv->y = 0;
+    smallest = CMP(cx, cy);
+
+    if (pred && (pred->x != -1 || pred->y != -1) && (pred->x || pred->y)) {
+        diff = CMP(cx - pred->x, cy - pred->y);
+        if (diff < smallest) {
+            smallest = diff;
+            *mv = *pred;
+        }
+    }
+
+    for (iter = 0; iter < deshake->rx + deshake->ry; iter++) {
+        IntMotionVector best = *mv;
+
+        for (i = 0; i < 4; i++) {
+            const int x = mv->x + dirs[i][0];
+            const int y = mv->y + dirs[i][1];
+
+            if (FFABS(x) > deshake->rx || FFABS(y) > deshake->ry)
+                continue;
+
+            diff = CMP(cx - x, cy - y);
+            if (diff < smallest) {
+                smallest = diff;
+                best.x = x;
+                best.y = y;
+            }
+        }
+
+        if (best.x == mv->x && best.y == mv->y)
+            break;
+        *mv = best;
+    }
+
+    // Stuck in a local minimum which would be rejected anyway, search wider
+    if (smallest > 512)
+        smallest = find_block_motion_search(deshake, src1, src2, cx, cy,
+                                            stride, mv, SMART_EXHAUSTIVE);
+
+    return smallest;
+}
+
+static void find_block_motion(DeshakeContext *deshake, uint8_t *src1,
+                              uint8_t *src2, int cx, int cy, int stride,
+                              const IntMotionVector *pred, IntMotionVector *mv)
+{
+    int smallest;
+
+    if (deshake->search == PREDICTIVE)
+        smallest = find_block_motion_predictive(deshake, src1, src2, cx, cy,
+                                                stride, pred, mv);
+    else
+        smallest = find_block_motion_search(deshake, src1, src2, cx, cy,
+                                            stride, mv, deshake->search);
+
     if (smallest > 512) {
         mv->x = -1;
         mv->y = -1;
     }
     emms_c();
-    //av_log(NULL, AV_LOG_ERROR, "%d\n", smallest);
-    //av_log(NULL, AV_LOG_ERROR, "Final: (%d, %d) = %d x %d\n", cx, cy, mv->x, mv->y);
 }
 
 /**
@@ -189,29 +260,36 @@ static void find_block_motion(DeshakeContext *deshake, uint8_t *src1,
  */
 static int block_contrast(uint8_t *src, int x, int y, int stride, int blocksize)
 {
-    int highest = 0;
-    int lowest = 255;
-    int i, j, pos;
+    uint8_t highest[16] = { 0 };
+    uint8_t lowest[16];
+    int i, j;
 
+    memset(lowest, 255, sizeof(lowest));
+
+    // Keep one running minimum and maximum per column so the inner loop
+    // has no dependency between neighbouring pixels
+    src += y * stride + x;
     for (i = 0; i <= blocksize * 2; i++) {
         // We use a width of 16 here to match the sad function
-        for (j = 0; j <= 15; j++) {
-            pos = (y + i) * stride + (x + j);
-            if (src[pos] < lowest)
-                lowest = src[pos];
-            else if (src[pos] > highest) {
-                highest = src[pos];
-            }
+        for (j = 0; j < 16; j++) {
+            lowest[j]  = FFMIN(lowest[j],  src[j]);
+            highest[j] = FFMAX(highest[j], src[j]);
         }
+        src += stride;
+    }
+
+    for (j = 1; j < 16; j++) {
+        lowest[0]  = FFMIN(lowest[0],  lowest[j]);
+        highest[0] = FFMAX(highest[0], highest[j]);
     }
 
-    return highest - lowest;
+    return highest[0] - lowest[0];
 }
 
 /**
  * Find the rotation for a given block.
  */
-static double block_angle(int x, int y, int cx, int cy, IntMotionVector *shift)
+static double block_angle(int x, int y, int cx, int cy, const IntMotionVector *shift)
 {
     double a1, a2, diff;
 
@@ -225,6 +303,43 @@ static double block_angle(int x, int y, int cx, int cy, IntMotionVector *shift)
            diff;
 }
 
+typedef struct ThreadData {
+    uint8_t *src1, *src2;
+    int stride;
+    int nb_blocks_x, nb_blocks_y;
+} ThreadData;
+
+static int find_motion_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    DeshakeContext *deshake = ctx->priv;
+    ThreadData *td = arg;
+    const int slice_start = (td->nb_blocks_y *  jobnr   ) / nb_jobs;
+    const int slice_end   = (td->nb_blocks_y * (jobnr+1)) / nb_jobs;
+    int bx, by;
+
+    for (by = slice_start; by < slice_end; by++) {
+        const int y = deshake->ry + by * deshake->blocksize * 2;
+
+        for (bx = 0; bx < td->nb_blocks_x; bx++) {
+            const int x = deshake->rx + bx * 16;
+            const int idx = by * td->nb_blocks_x + bx;
+            IntMotionVector *mv = &deshake->mvs[idx];
+
+            // If the contrast is too low, just skip this block as it probably
+            // won't be very useful to us.
+            if (block_contrast(td->src2, x, y, td->stride, deshake->blocksize) > deshake->contrast) {
+                mv->x = mv->y = 0;
+                find_block_motion(deshake, td->src1, td->src2, x, y, td->stride,
+                                  &deshake->prev_mvs[idx], mv);
+            } else {
+                mv->x = mv->y = -1;
+            }
+        }
+    }
+
+    return 0;
+}
+
 /**
  * Find the estimated global motion for a scene given the most likely shift
  * for each block in the frame. The global motion is estimated to be the
@@ -232,19 +347,21 @@ static double block_angle(int x, int y, int cx, int cy, IntMotionVector *shift)
  * move one pixel to the right and two pixels down, this would yield a
  * motion vector (1, -2).
  */
-static void find_motion(DeshakeContext *deshake, uint8_t *src1, uint8_t *src2,
-                        int width, int height, int stride, Transform *t)
+static int find_motion(AVFilterContext *ctx, uint8_t *src1, uint8_t *src2,
+                       int width, int height, int stride, Transform *t)
 {
-    int x, y;
-    IntMotionVector mv = {0, 0};
+    DeshakeContext *deshake = ctx->priv;
+    int x, y, bx, by;
     int count_max_value = 0;
-    int contrast;
+    ThreadData td;
 
     int pos;
     int center_x = 0, center_y = 0;
     double p_x, p_y;
 
     av_fast_malloc(&deshake->angles, &deshake->angles_size, width * height / (16 * deshake->blocksize) * sizeof(*deshake->angles));
+    if (!deshake->angles)
+        return AVERROR(ENOMEM);
 
     // Reset counts to zero
     for (x = 0; x < deshake->rx * 2 + 1; x++) {
@@ -253,28 +370,51 @@ static void find_motion(DeshakeContext *deshake, uint8_t *src1, uint8_t *src2,
         }
     }
 
+    td.src1 = src1;
+    td.src2 = src2;
+    td.stride = stride;
+    td.nb_blocks_x = FFMAX(0, (width  - 2 * deshake->rx - 16 + 15) / 16);
+    td.nb_blocks_y = FFMAX(0, (height - 2 * deshake->ry - deshake->blocksize * 2 +
+                               deshake->blocksize * 2 - 1) / (deshake->blocksize * 2));
+
+    if (td.nb_blocks_x * td.nb_blocks_y != deshake->nb_mvs) {
+        deshake->nb_mvs = td.nb_blocks_x * td.nb_blocks_y;
+        av_freep(&deshake->mvs);
+        av_freep(&deshake->prev_mvs);
+        deshake->mvs      = av_malloc_array(deshake->nb_mvs + 1, sizeof(*deshake->mvs));
+        deshake->prev_mvs = av_malloc_array(deshake->nb_mvs + 1, sizeof(*deshake->prev_mvs));
+        if (!deshake->mvs || !deshake->prev_mvs) {
+            deshake->nb_mvs = 0;
+            return AVERROR(ENOMEM);
+        }
+        for (pos = 0; pos < deshake->nb_mvs; pos++)
+            deshake->prev_mvs[pos].x = deshake->prev_mvs[pos].y = -1;
+    }
+
+    // Find motion for every block, rows of blocks are searched in parallel
+    if (deshake->nb_mvs)
+        ctx->internal->execute(ctx, find_motion_slice, &td, NULL,
+                               FFMIN(td.nb_blocks_y, ff_filter_get_nb_threads(ctx)));
+
+    // Store the motion vectors in the counts, in raster order
     pos = 0;
-    // Find motion for every block and store the motion vector in the counts
-    for (y = deshake->ry; y < height - deshake->ry - (deshake->blocksize * 2); y += deshake->blocksize * 2) {
-        // We use a width of 16 here to match the sad function
-        for (x = deshake->rx; x < width - deshake->rx - 16; x += 16) {
-            // If the contrast is too low, just skip this block as it probably
-            // won't be very useful to us.
-            contrast = block_contrast(src2, x, y, stride, deshake->blocksize);
-            if (contrast > deshake->contrast) {
-                //av_log(NULL, AV_LOG_ERROR, "%d\n", contrast);
-                find_block_motion(deshake, src1, src2, x, y, stride, &mv);
-                if (mv.x != -1 && mv.y != -1) {
-                    deshake->counts[mv.x + deshake->rx][mv.y + deshake->ry] += 1;
-                    if (x > deshake->rx && y > deshake->ry)
-                        deshake->angles[pos++] = block_angle(x, y, 0, 0, &mv);
-
-                    center_x += mv.x;
-                    center_y += mv.y;
-                }
+    for (by = 0; by < td.nb_blocks_y; by++) {
+        y = deshake->ry + by * deshake->blocksize * 2;
+        for (bx = 0; bx < td.nb_blocks_x; bx++) {
+            const IntMotionVector *mv = &deshake->mvs[by * td.nb_blocks_x + bx];
+
+            x = deshake->rx + bx * 16;
+            if (mv->x != -1 && mv->y != -1) {
+                deshake->counts[mv->x + deshake->rx][mv->y + deshake->ry] += 1;
+                if (x > deshake->rx && y > deshake->ry)
+                    deshake->angles[pos++] = block_angle(x, y, 0, 0, mv);
+
+                center_x += mv->x;
+                center_y += mv->y;
             }
         }
     }
+    FFSWAP(IntMotionVector *, deshake->mvs, deshake->prev_mvs);
 
     if (pos) {
          center_x /= pos;
@@ -310,6 +450,8 @@ static void find_motion(DeshakeContext *deshake, uint8_t *src1, uint8_t *src2,
     t->angle = av_clipf(t->angle, -0.1, 0.1);
 
     //av_log(NULL, AV_LOG_ERROR, "%d x %d\n", avg->x, avg->y);
+
+    return 0;
 }
 
 static int deshake_transform_c(AVFilterContext *ctx,
@@ -403,6 +545,9 @@ static av_cold void uninit(AVFilterContext *ctx)
     av_frame_free(&deshake->ref);
     av_freep(&deshake->angles);
     deshake->angles_size = 0;
+    av_freep(&deshake->mvs);
+    av_freep(&deshake->prev_mvs);
+    deshake->nb_mvs = 0;
     if (deshake->fp)
         fclose(deshake->fp);
 }
@@ -436,7 +581,7 @@ static int filter_frame(AVFilterLink *link, AVFrame *in)
 
     if (deshake->cx < 0 || deshake->cy < 0 || deshake->cw < 0 || deshake->ch < 0) {
         // Find the most likely global motion for the current frame
-        find_motion(deshake, (deshake->ref == NULL) ? in->data[0] : deshake->ref->data[0], in->data[0], link->w, link->h, in->linesize[0], &t);
+        ret = find_motion(link->dst, (deshake->ref == NULL) ? in->data[0] : deshake->ref->data[0], in->data[0], link->w, link->h, in->linesize[0], &t);
     } else {
         uint8_t *src1 = (deshake->ref == NULL) ? in->data[0] : deshake->ref->data[0];
         uint8_t *src2 = in->data[0];
@@ -453,7 +598,11 @@ static int filter_frame(AVFilterLink *link, AVFrame *in)
         src1 += deshake->cy * in->linesize[0] + deshake->cx;
         src2 += deshake->cy * in->linesize[0] + deshake->cx;
 
-        find_motion(deshake, src1, src2, deshake->cw, deshake->ch, in->linesize[0], &t);
+        ret = find_motion(link->dst, src1, src2, deshake->cw, deshake->ch, in->linesize[0], &t);
+    }
+    if (ret < 0) {
+        av_frame_free(&in);
+        goto fail;
     }
 
 
@@ -557,4 +706,5 @@ AVFilter ff_vf_deshake = {
     .inputs        = deshake_inputs,
     .outputs       = deshake_outputs,
     .priv_class    = &deshake_class,
+    .flags         = AVFILTER_FLAG_SLICE_THREADS,
 };
@@ -23,8 +23,9 @@
 #include "libavutil/imgutils.h"
 #include "libavutil/opt.h"
 #include "libavutil/pixdesc.h"
+#include "libavutil/tx.h"
 #include "internal.h"
-#include "libavcodec/avfft.h"
+#include "fftblock.h"
 
 enum BufferTypes {
     CURRENT,
@@ -41,13 +42,18 @@ typedef struct PlaneContext {
     float n;
 
     float *buffer[BSIZE];
-    FFTComplex *hdata, *vdata;
-    int data_linesize;
     int buffer_linesize;
 
-    FFTContext *fft, *ifft;
+    FFTBlockContext fb;
 } PlaneContext;
 
+typedef struct SliceContext {
+    AVTXContext *fft, *ifft;
+    av_tx_fn tx_fn, itx_fn;
+    AVComplexFloat *hdata;
+    AVComplexFloat *tmp;
+} SliceContext;
+
 typedef struct FFTdnoizContext {
     const AVClass *class;
 
@@ -65,8 +71,8 @@ typedef struct FFTdnoizContext {
     int nb_planes;
     PlaneContext planes[4];
 
-    void (*import_row)(FFTComplex *dst, uint8_t *src, int rw);
-    void (*export_row)(FFTComplex *src, uint8_t *dst, int rw, float scale, int depth);
+    int nb_threads;
+    SliceContext *slices;
 } FFTdnoizContext;
 
 #define OFFSET(x) offsetof(FFTdnoizContext, x)
@@ -91,23 +97,6 @@ static const AVOption fftdnoiz_options[] = {
 
 AVFILTER_DEFINE_CLASS(fftdnoiz);
 
-static av_cold int init(AVFilterContext *ctx)
-{
-    FFTdnoizContext *s = ctx->priv;
-    int i;
-
-    for (i = 0; i < 4; i++) {
-        PlaneContext *p = &s->planes[i];
-
-        p->fft  = av_fft_init(s->block_bits, 0);
-        p->ifft = av_fft_init(s->block_bits, 1);
-        if (!p->fft || !p->ifft)
-            return AVERROR(ENOMEM);
-    }
-
-    return 0;
-}
-
 static int query_formats(AVFilterContext *ctx)
 {
     static const enum AVPixelFormat pix_fmts[] = {
@@ -138,65 +127,24 @@ static int query_formats(AVFilterContext *ctx)
 }
 
 typedef struct ThreadData {
-    float *src, *dst;
+    AVFrame *out;
+    int plane;
 } ThreadData;
 
-static void import_row8(FFTComplex *dst, uint8_t *src, int rw)
-{
-    int j;
-
-    for (j = 0; j < rw; j++) {
-        dst[j].re = src[j];
-        dst[j].im = 0;
-    }
-}
-
-static void export_row8(FFTComplex *src, uint8_t *dst, int rw, float scale, int depth)
-{
-    int j;
-
-    for (j = 0; j < rw; j++)
-        dst[j] = av_clip_uint8(src[j].re * scale);
-}
-
-static void import_row16(FFTComplex *dst, uint8_t *srcp, int rw)
-{
-    uint16_t *src = (uint16_t *)srcp;
-    int j;
-
-    for (j = 0; j < rw; j++) {
-        dst[j].re = src[j];
-        dst[j].im = 0;
-    }
-}
-
-static void export_row16(FFTComplex *src, uint8_t *dstp, int rw, float scale, int depth)
-{
-    uint16_t *dst = (uint16_t *)dstp;
-    int j;
-
-    for (j = 0; j < rw; j++)
-        dst[j] = av_clip_uintp2_c(src[j].re * scale, depth);
-}
-
 static int config_input(AVFilterLink *inlink)
 {
     AVFilterContext *ctx = inlink->dst;
     const AVPixFmtDescriptor *desc;
     FFTdnoizContext *s = ctx->priv;
-    int i;
+    const int block = 1 << s->block_bits;
+    const float scale = 1.f;
+    int i, ret;
 
     desc = av_pix_fmt_desc_get(inlink->format);
     s->depth = desc->comp[0].depth;
 
-    if (s->depth <= 8) {
-        s->import_row = import_row8;
-        s->export_row = export_row8;
-    } else {
-        s->import_row = import_row16;
-        s->export_row = export_row16;
+    if (s->depth > 8)
         s->sigma *= 1 << (s->depth - 8) * (1 + s->nb_prev + s->nb_next);
-    }
 
     s->planes[1].planewidth = s->planes[2].planewidth = AV_CEIL_RSHIFT(inlink->w, desc->log2_chroma_w);
     s->planes[0].planewidth = s->planes[3].planewidth = inlink->w;
@@ -209,16 +157,20 @@ static int config_input(AVFilterLink *inlink)
         PlaneContext *p = &s->planes[i];
         int size;
 
-        p->b = 1 << s->block_bits;
+        p->b = block;
         p->n = 1.f / (p->b * p->b);
         p->o = p->b * s->overlap;
-        size = p->b - p->o;
-        p->nox = (p->planewidth  + (size - 1)) / size;
-        p->noy = (p->planeheight + (size - 1)) / size;
+        ret = ff_fftblock_init(&p->fb, s->depth, p->planewidth, p->planeheight,
+                               p->b, p->o);
+        if (ret < 0)
+            return ret;
+        size = p->fb.size;
+        p->nox = p->fb.nox;
+        p->noy = p->fb.noy;
 
         av_log(ctx, AV_LOG_DEBUG, "nox:%d noy:%d size:%d\n", p->nox, p->noy, size);
 
-        p->buffer_linesize = p->b * p->nox * sizeof(FFTComplex);
+        p->buffer_linesize = p->b * p->nox * sizeof(AVComplexFloat);
         p->buffer[CURRENT] = av_calloc(p->b * p->noy, p->buffer_linesize);
         if (!p->buffer[CURRENT])
             return AVERROR(ENOMEM);
@@ -232,144 +184,80 @@ static int config_input(AVFilterLink *inlink)
             if (!p->buffer[NEXT])
                 return AVERROR(ENOMEM);
         }
-        p->data_linesize = 2 * p->b * sizeof(float);
-        p->hdata = av_calloc(p->b, p->data_linesize);
-        p->vdata = av_calloc(p->b, p->data_linesize);
-        if (!p->hdata || !p->vdata)
+    }
+
+    s->nb_threads = ff_filter_get_nb_threads(ctx);
+    s->slices = av_calloc(s->nb_threads, sizeof(*s->slices));
+    if (!s->slices)
+        return AVERROR(ENOMEM);
+
+    for (i = 0; i < s->nb_threads; i++) {
+        SliceContext *sc = &s->slices[i];
+
+        ret = av_tx_init(&sc->fft, &sc->tx_fn, AV_TX_FLOAT_FFT, 0, block, &scale, 0);
+        if (ret < 0)
+            return ret;
+        ret = av_tx_init(&sc->ifft, &sc->itx_fn, AV_TX_FLOAT_FFT, 1, block, &scale, 0);
+        if (ret < 0)
+            return ret;
+
+        sc->hdata = av_calloc(block * block, sizeof(*sc->hdata));
+        sc->tmp   = av_calloc(2 * block, sizeof(*sc->tmp));
+        if (!sc->hdata || !sc->tmp)
             return AVERROR(ENOMEM);
     }
 
     return 0;
 }
 
-static void import_plane(FFTdnoizContext *s,
+static void import_plane(FFTdnoizContext *s, SliceContext *sc,
                          uint8_t *srcp, int src_linesize,
-                         float *buffer, int buffer_linesize, int plane)
+                         float *buffer, int buffer_linesize, int plane,
+                         int slice_start, int slice_end)
 {
     PlaneContext *p = &s->planes[plane];
-    const int width = p->planewidth;
-    const int height = p->planeheight;
     const int block = p->b;
-    const int overlap = p->o;
-    const int size = block - overlap;
     const int nox = p->nox;
-    const int noy = p->noy;
-    const int bpp = (s->depth + 7) / 8;
-    const int data_linesize = p->data_linesize / sizeof(FFTComplex);
-    FFTComplex *hdata = p->hdata;
-    FFTComplex *vdata = p->vdata;
-    int x, y, i, j;
-
-    buffer_linesize /= sizeof(float);
-    for (y = 0; y < noy; y++) {
-        for (x = 0; x < nox; x++) {
-            const int rh = FFMIN(block, height - y * size);
-            const int rw = FFMIN(block, width  - x * size);
-            uint8_t *src = srcp + src_linesize * y * size + x * size * bpp;
-            float *bdst = buffer + buffer_linesize * y * block + x * block * 2;
-            FFTComplex *ssrc, *dst = hdata;
-
-            for (i = 0; i < rh; i++) {
-                s->import_row(dst, src, rw);
-                for (j = rw; j < block; j++) {
-                    dst[j].re = dst[block - j - 1].re;
-                    dst[j].im = 0;
-                }
-                av_fft_permute(p->fft, dst);
-                av_fft_calc(p->fft, dst);
-
-                src += src_linesize;
-                dst += data_linesize;
-            }
+    int x, y;
 
-            dst = hdata;
-            for (; i < block; i++) {
-                for (j = 0; j < block; j++) {
-                    dst[j].re = dst[(block - i - 1) * data_linesize + j].re;
-                    dst[j].im = dst[(block - i - 1) * data_linesize + j].im;
-                }
-            }
+    for (y = slice_start; y < slice_end; y++) {
+        for (x = 0; x < nox; x++) {
+            float *bdst = buffer + buffer_linesize / sizeof(float) * y * block + x * block * 2;
 
-            ssrc = hdata;
-            dst = vdata;
-            for (i = 0; i < block; i++) {
-                for (j = 0; j < block; j++)
-                    dst[j] = ssrc[j * data_linesize + i];
-                av_fft_permute(p->fft, dst);
-                av_fft_calc(p->fft, dst);
-                memcpy(bdst, dst, block * sizeof(FFTComplex));
-
-                dst += data_linesize;
-                bdst += buffer_linesize;
-            }
+            ff_fftblock_import(&p->fb, sc->fft, sc->tx_fn, sc->tmp, sc->hdata,
+                               (AVComplexFloat *)bdst, buffer_linesize,
+                               srcp, src_linesize, x, y);
         }
     }
 }
 
-static void export_plane(FFTdnoizContext *s,
+static void export_plane(FFTdnoizContext *s, SliceContext *sc,
                          uint8_t *dstp, int dst_linesize,
-                         float *buffer, int buffer_linesize, int plane)
+                         float *buffer, int buffer_linesize, int plane,
+                         int slice_start, int slice_end)
 {
     PlaneContext *p = &s->planes[plane];
-    const int depth = s->depth;
-    const int bpp = (depth + 7) / 8;
-    const int width = p->planewidth;
-    const int height = p->planeheight;
     const int block = p->b;
-    const int overlap = p->o;
-    const int hoverlap = overlap / 2;
-    const int size = block - overlap;
     const int nox = p->nox;
-    const int noy = p->noy;
-    const int data_linesize = p->data_linesize / sizeof(FFTComplex);
-    const float scale = 1.f / (block * block);
-    FFTComplex *hdata = p->hdata;
-    FFTComplex *vdata = p->vdata;
-    int x, y, i, j;
-
-    buffer_linesize /= sizeof(float);
-    for (y = 0; y < noy; y++) {
-        for (x = 0; x < nox; x++) {
-            const int woff = x == 0 ? 0 : hoverlap;
-            const int hoff = y == 0 ? 0 : hoverlap;
-            const int rw = x == 0 ? block : FFMIN(size, width  - x * size - woff);
-            const int rh = y == 0 ? block : FFMIN(size, height - y * size - hoff);
-            float *bsrc = buffer + buffer_linesize * y * block + x * block * 2;
-            uint8_t *dst = dstp + dst_linesize * (y * size + hoff) + (x * size + woff) * bpp;
-            FFTComplex *hdst, *ddst = vdata;
-
-            hdst = hdata;
-            for (i = 0; i < block; i++) {
-                memcpy(ddst, bsrc, block * sizeof(FFTComplex));
-                av_fft_permute(p->ifft, ddst);
-                av_fft_calc(p->ifft, ddst);
-                for (j = 0; j < block; j++) {
-                    hdst[j * data_linesize + i] = ddst[j];
-                }
+    int x, y;
 
-                ddst += data_linesize;
-                bsrc += buffer_linesize;
-            }
-
-            hdst = hdata + hoff * data_linesize;
-            for (i = 0; i < rh; i++) {
-                av_fft_permute(p->ifft, hdst);
-                av_fft_calc(p->ifft, hdst);
-                s->export_row(hdst + woff, dst, rw, scale, depth);
+    for (y = slice_start; y < slice_end; y++) {
+        for (x = 0; x < nox; x++) {
+            float *bsrc = buffer + buffer_linesize / sizeof(float) * y * block + x * block * 2;
 
-                hdst += data_linesize;
-                dst += dst_linesize;
-            }
+            ff_fftblock_export(&p->fb, sc->ifft, sc->itx_fn, sc->tmp, sc->hdata,
+                               dstp, dst_linesize,
+                               (AVComplexFloat *)bsrc, buffer_linesize, x, y);
         }
     }
 }
 
-static void filter_plane3d2(FFTdnoizContext *s, int plane, float *pbuffer, float *nbuffer)
+static void filter_plane3d2(FFTdnoizContext *s, int plane, float *pbuffer, float *nbuffer,
+                            int slice_start, int slice_end)
 {
     PlaneContext *p = &s->planes[plane];
     const int block = p->b;
     const int nox = p->nox;
-    const int noy = p->noy;
     const int buffer_linesize = p->buffer_linesize / sizeof(float);
     const float sigma = s->sigma * s->sigma * block * block;
     const float limit = 1.f - s->amount;
@@ -378,7 +266,7 @@ static void filter_plane3d2(FFTdnoizContext *s, int plane, float *pbuffer, float
     const float scale = 1.f / 3.f;
     int y, x, i, j;
 
-    for (y = 0; y < noy; y++) {
+    for (y = slice_start; y < slice_end; y++) {
         for (x = 0; x < nox; x++) {
             float *cbuff = cbuffer + buffer_linesize * y * block + x * block * 2;
             float *pbuff = pbuffer + buffer_linesize * y * block + x * block * 2;
@@ -424,19 +312,19 @@ static void filter_plane3d2(FFTdnoizContext *s, int plane, float *pbuffer, float
     }
 }
 
-static void filter_plane3d1(FFTdnoizContext *s, int plane, float *pbuffer)
+static void filter_plane3d1(FFTdnoizContext *s, int plane, float *pbuffer,
+                            int slice_start, int slice_end)
 {
     PlaneContext *p = &s->planes[plane];
     const int block = p->b;
     const int nox = p->nox;
-    const int noy = p->noy;
     const int buffer_linesize = p->buffer_linesize / sizeof(float);
     const float sigma = s->sigma * s->sigma * block * block;
     const float limit = 1.f - s->amount;
     float *cbuffer = p->buffer[CURRENT];
     int y, x, i, j;
 
-    for (y = 0; y < noy; y++) {
+    for (y = slice_start; y < slice_end; y++) {
         for (x = 0; x < nox; x++) {
             float *cbuff = cbuffer + buffer_linesize * y * block + x * block * 2;
             float *pbuff = pbuffer + buffer_linesize * y * block + x * block * 2;
@@ -476,19 +364,19 @@ static void filter_plane3d1(FFTdnoizContext *s, int plane, float *pbuffer)
     }
 }
 
-static void filter_plane2d(FFTdnoizContext *s, int plane)
+static void filter_plane2d(FFTdnoizContext *s, int plane,
+                           int slice_start, int slice_end)
 {
     PlaneContext *p = &s->planes[plane];
     const int block = p->b;
     const int nox = p->nox;
-    const int noy = p->noy;
     const int buffer_linesize = p->buffer_linesize / 4;
     const float sigma = s->sigma * s->sigma * block * block;
     const float limit = 1.f - s->amount;
     float *buffer = p->buffer[CURRENT];
     int y, x, i, j;
 
-    for (y = 0; y < noy; y++) {
+    for (y = slice_start; y < slice_end; y++) {
         for (x = 0; x < nox; x++) {
             float *buff = buffer + buffer_linesize * y * block + x * block * 2;
 
@@ -510,6 +398,64 @@ static void filter_plane2d(FFTdnoizContext *s, int plane)
     }
 }
 
+static int import_filter(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    FFTdnoizContext *s = ctx->priv;
+    ThreadData *td = arg;
+    const int plane = td->plane;
+    PlaneContext *p = &s->planes[plane];
+    SliceContext *sc = &s->slices[jobnr];
+    const int slice_start = (p->noy *  jobnr   ) / nb_jobs;
+    const int slice_end   = (p->noy * (jobnr+1)) / nb_jobs;
+
+    if (s->next) {
+        import_plane(s, sc, s->next->data[plane], s->next->linesize[plane],
+                     p->buffer[NEXT], p->buffer_linesize, plane,
+                     slice_start, slice_end);
+    }
+
+    if (s->prev) {
+        import_plane(s, sc, s->prev->data[plane], s->prev->linesize[plane],
+                     p->buffer[PREV], p->buffer_linesize, plane,
+                     slice_start, slice_end);
+    }
+
+    import_plane(s, sc, s->cur->data[plane], s->cur->linesize[plane],
+                 p->buffer[CURRENT], p->buffer_linesize, plane,
+                 slice_start, slice_end);
+
+    if (s->next && s->prev) {
+        filter_plane3d2(s, plane, p->buffer[PREV], p->buffer[NEXT],
+                        slice_start, slice_end);
+    } else if (s->next) {
+        filter_plane3d1(s, plane, p->buffer[NEXT], slice_start, slice_end);
+    } else  if (s->prev) {
+        filter_plane3d1(s, plane, p->buffer[PREV], slice_start, slice_end);
+    } else {
+        filter_plane2d(s, plane, slice_start, slice_end);
+    }
+
+    return 0;
+}
+
+static int export_blocks(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    FFTdnoizContext *s = ctx->priv;
+    ThreadData *td = arg;
+    AVFrame *out = td->out;
+    const int plane = td->plane;
+    PlaneContext *p = &s->planes[plane];
+    SliceContext *sc = &s->slices[jobnr];
+    const int slice_start = (p->noy *  jobnr   ) / nb_jobs;
+    const int slice_end   = (p->noy * (jobnr+1)) / nb_jobs;
+
+    export_plane(s, sc, out->data[plane], out->linesize[plane],
+                 p->buffer[CURRENT], p->buffer_linesize, plane,
+                 slice_start, slice_end);
+
+    return 0;
+}
+
 static int filter_frame(AVFilterLink *inlink, AVFrame *in)
 {
     AVFilterContext *ctx = inlink->dst;
@@ -564,6 +510,7 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *in)
 
     for (plane = 0; plane < s->nb_planes; plane++) {
         PlaneContext *p = &s->planes[plane];
+        ThreadData td;
 
         if (!((1 << plane) & s->planesf) || ctx->is_disabled) {
             if (!direct)
@@ -573,31 +520,14 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *in)
             continue;
         }
 
-        if (s->next) {
-            import_plane(s, s->next->data[plane], s->next->linesize[plane],
-                         p->buffer[NEXT], p->buffer_linesize, plane);
-        }
-
-        if (s->prev) {
-            import_plane(s, s->prev->data[plane], s->prev->linesize[plane],
-                         p->buffer[PREV], p->buffer_linesize, plane);
-        }
-
-        import_plane(s, s->cur->data[plane], s->cur->linesize[plane],
-                     p->buffer[CURRENT], p->buffer_linesize, plane);
-
-        if (s->next && s->prev) {
-            filter_plane3d2(s, plane, p->buffer[PREV], p->buffer[NEXT]);
-        } else if (s->next) {
-            filter_plane3d1(s, plane, p->buffer[NEXT]);
-        } else  if (s->prev) {
-            filter_plane3d1(s, plane, p->buffer[PREV]);
-        } else {
-            filter_plane2d(s, plane);
-        }
-
-        export_plane(s, out->data[plane], out->linesize[plane],
-                     p->buffer[CURRENT], p->buffer_linesize, plane);
+        td.out = out;
+        td.plane = plane;
+        /* Blocks overlap, so every block must be imported before any is
+         * written back when filtering in place. */
+        ctx->internal->execute(ctx, import_filter, &td, NULL,
+                               FFMIN(p->noy, s->nb_threads));
+        ctx->internal->execute(ctx, export_blocks, &td, NULL,
+                               FFMIN(p->noy, s->nb_threads));
     }
 
     if (s->nb_next == 0 && s->nb_prev == 0) {
@@ -647,15 +577,21 @@ static av_cold void uninit(AVFilterContext *ctx)
     for (i = 0; i < 4; i++) {
         PlaneContext *p = &s->planes[i];
 
-        av_freep(&p->hdata);
-        av_freep(&p->vdata);
         av_freep(&p->buffer[PREV]);
         av_freep(&p->buffer[CURRENT]);
         av_freep(&p->buffer[NEXT]);
-        av_fft_end(p->fft);
-        av_fft_end(p->ifft);
     }
 
+    for (i = 0; i < s->nb_threads && s->slices; i++) {
+        SliceContext *sc = &s->slices[i];
+
+        av_freep(&sc->hdata);
+        av_freep(&sc->tmp);
+        av_tx_uninit(&sc->fft);
+        av_tx_uninit(&sc->ifft);
+    }
+    av_freep(&s->slices);
+
     av_frame_free(&s->prev);
     av_frame_free(&s->cur);
     av_frame_free(&s->next);
@@ -684,11 +620,11 @@ AVFilter ff_vf_fftdnoiz = {
     .name          = "fftdnoiz",
     .description   = NULL_IF_CONFIG_SMALL("Denoise frames using 3D FFT."),
     .priv_size     = sizeof(FFTdnoizContext),
-    .init          = init,
     .uninit        = uninit,
     .query_formats = query_formats,
     .inputs        = fftdnoiz_inputs,
     .outputs       = fftdnoiz_outputs,
     .priv_class    = &fftdnoiz_class,
-    .flags         = AVFILTER_FLAG_SUPPORT_TIMELINE_INTERNAL,
+    .flags         = AVFILTER_FLAG_SUPPORT_TIMELINE_INTERNAL |
+                     AVFILTER_FLAG_SLICE_THREADS,
 };
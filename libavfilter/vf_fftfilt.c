@@ -31,6 +31,7 @@
 #include "libavutil/pixdesc.h"
 #include "libavcodec/avfft.h"
 #include "libavutil/eval.h"
+#include "fftblock.h"
 
 #define MAX_PLANES 4
 
@@ -65,8 +66,7 @@ typedef struct FFTFILTContext {
     AVExpr *weight_expr[MAX_PLANES];
     double *weight[MAX_PLANES];
 
-    void (*rdft_horizontal)(struct FFTFILTContext *s, AVFrame *in, int w, int h, int plane);
-    void (*irdft_horizontal)(struct FFTFILTContext *s, AVFrame *out, int w, int h, int plane);
+    FFTBlockContext fb;
 } FFTFILTContext;
 
 static const char *const var_names[] = {   "X",   "Y",   "W",   "H",   "N", NULL        };
@@ -114,30 +114,13 @@ static void copy_rev (FFTSample *dest, int w, int w2)
 }
 
 /*Horizontal pass - RDFT*/
-static void rdft_horizontal8(FFTFILTContext *s, AVFrame *in, int w, int h, int plane)
+static void rdft_horizontal(FFTFILTContext *s, AVFrame *in, int w, int h, int plane)
 {
-    int i, j;
-
-    for (i = 0; i < h; i++) {
-        for (j = 0; j < w; j++)
-            s->rdft_hdata[plane][i * s->rdft_hlen[plane] + j] = *(in->data[plane] + in->linesize[plane] * i + j);
-
-        copy_rev(s->rdft_hdata[plane] + i * s->rdft_hlen[plane], w, s->rdft_hlen[plane]);
-    }
-
-    for (i = 0; i < h; i++)
-        av_rdft_calc(s->hrdft[plane], s->rdft_hdata[plane] + i * s->rdft_hlen[plane]);
-}
-
-static void rdft_horizontal16(FFTFILTContext *s, AVFrame *in, int w, int h, int plane)
-{
-    const uint16_t *src = (const uint16_t *)in->data[plane];
-    int linesize = in->linesize[plane] / 2;
-    int i, j;
+    int i;
 
     for (i = 0; i < h; i++) {
-        for (j = 0; j < w; j++)
-            s->rdft_hdata[plane][i * s->rdft_hlen[plane] + j] = *(src + linesize * i + j);
+        s->fb.import_row(s->rdft_hdata[plane] + i * s->rdft_hlen[plane], 1,
+                         in->data[plane] + in->linesize[plane] * i, w);
 
         copy_rev(s->rdft_hdata[plane] + i * s->rdft_hlen[plane], w, s->rdft_hlen[plane]);
     }
@@ -176,37 +159,18 @@ static void irdft_vertical(FFTFILTContext *s, int h, int plane)
 }
 
 /*Horizontal pass - IRDFT*/
-static void irdft_horizontal8(FFTFILTContext *s, AVFrame *out, int w, int h, int plane)
+static void irdft_horizontal(FFTFILTContext *s, AVFrame *out, int w, int h, int plane)
 {
-    int i, j;
-
-    for (i = 0; i < h; i++)
-        av_rdft_calc(s->ihrdft[plane], s->rdft_hdata[plane] + i * s->rdft_hlen[plane]);
-
-    for (i = 0; i < h; i++)
-        for (j = 0; j < w; j++)
-            *(out->data[plane] + out->linesize[plane] * i + j) = av_clip(s->rdft_hdata[plane][i
-                                                                         *s->rdft_hlen[plane] + j] * 4 /
-                                                                         (s->rdft_hlen[plane] *
-                                                                          s->rdft_vlen[plane]), 0, 255);
-}
-
-static void irdft_horizontal16(FFTFILTContext *s, AVFrame *out, int w, int h, int plane)
-{
-    uint16_t *dst = (uint16_t *)out->data[plane];
-    int linesize = out->linesize[plane] / 2;
-    int max = (1 << s->depth) - 1;
-    int i, j;
+    const float scale = 4.f / (s->rdft_hlen[plane] * s->rdft_vlen[plane]);
+    int i;
 
     for (i = 0; i < h; i++)
         av_rdft_calc(s->ihrdft[plane], s->rdft_hdata[plane] + i * s->rdft_hlen[plane]);
 
     for (i = 0; i < h; i++)
-        for (j = 0; j < w; j++)
-            *(dst + linesize * i + j) = av_clip(s->rdft_hdata[plane][i
-                                                *s->rdft_hlen[plane] + j] * 4 /
-                                                (s->rdft_hlen[plane] *
-                                                s->rdft_vlen[plane]), 0, max);
+        s->fb.export_row(out->data[plane] + out->linesize[plane] * i,
+                         s->rdft_hdata[plane] + i * s->rdft_hlen[plane], 1,
+                         w, scale, s->depth);
 }
 
 static av_cold int initialize(AVFilterContext *ctx)
@@ -315,15 +279,8 @@ static int config_props(AVFilterLink *inlink)
             do_eval(s, inlink, plane);
     }
 
-    if (s->depth <= 8) {
-        s->rdft_horizontal = rdft_horizontal8;
-        s->irdft_horizontal = irdft_horizontal8;
-    } else if (s->depth > 8) {
-        s->rdft_horizontal = rdft_horizontal16;
-        s->irdft_horizontal = irdft_horizontal16;
-    } else {
-        return AVERROR_BUG;
-    }
+    ff_fftblock_init_rows(&s->fb, s->depth);
+
     return 0;
 }
 
@@ -350,7 +307,7 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *in)
         if (s->eval_mode == EVAL_MODE_FRAME)
             do_eval(s, inlink, plane);
 
-        s->rdft_horizontal(s, in, w, h, plane);
+        rdft_horizontal(s, in, w, h, plane);
         rdft_vertical(s, h, plane);
 
         /*Change user defined parameters*/
@@ -362,7 +319,7 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *in)
         s->rdft_vdata[plane][0] += s->rdft_hlen[plane] * s->rdft_vlen[plane] * s->dc[plane];
 
         irdft_vertical(s, h, plane);
-        s->irdft_horizontal(s, out, w, h, plane);
+        irdft_horizontal(s, out, w, h, plane);
     }
 
     av_frame_free(&in);
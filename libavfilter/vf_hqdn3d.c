@@ -81,7 +81,8 @@ static void denoise_spatial(HQDN3DContext *s,
                             uint8_t *src, uint8_t *dst,
                             uint16_t *line_ant, uint16_t *frame_ant,
                             int w, int h, int sstride, int dstride,
-                            int16_t *spatial, int16_t *temporal, int depth)
+                            int16_t *spatial, int16_t *temporal, int depth,
+                            const uint8_t *seam)
 {
     long x, y;
     uint32_t pixel_ant;
@@ -90,13 +91,29 @@ static void denoise_spatial(HQDN3DContext *s,
     spatial  += 256 << LUT_BITS;
     temporal += 256 << LUT_BITS;
 
-    /* First line has no top neighbor. Only left one for each tmp and
-     * last frame */
-    pixel_ant = LOAD(0);
-    for (x = 0; x < w; x++) {
-        line_ant[x] = tmp = pixel_ant = lowpass(pixel_ant, LOAD(x), spatial, depth);
-        frame_ant[x] = tmp = lowpass(frame_ant[x], tmp, temporal, depth);
-        STORE(x, tmp);
+    if (seam) {
+        /* seam is a copy of the line above the slice, taken before any
+         * slice was filtered. It only seeds the vertical state the same way
+         * the first line of the picture is. */
+        {
+            const uint8_t *src = seam;
+            pixel_ant = LOAD(0);
+            for (x = 0; x < w; x++)
+                line_ant[x] = pixel_ant = lowpass(pixel_ant, LOAD(x), spatial, depth);
+        }
+        src       -= sstride;
+        dst       -= dstride;
+        frame_ant -= w;
+        h++;
+    } else {
+        /* First line has no top neighbor. Only left one for each tmp and
+         * last frame */
+        pixel_ant = LOAD(0);
+        for (x = 0; x < w; x++) {
+            line_ant[x] = tmp = pixel_ant = lowpass(pixel_ant, LOAD(x), spatial, depth);
+            frame_ant[x] = tmp = lowpass(frame_ant[x], tmp, temporal, depth);
+            STORE(x, tmp);
+        }
     }
 
     for (y = 1; y < h; y++) {
@@ -121,55 +138,77 @@ static void denoise_spatial(HQDN3DContext *s,
 }
 
 av_always_inline
-static int denoise_depth(HQDN3DContext *s,
-                         uint8_t *src, uint8_t *dst,
-                         uint16_t *line_ant, uint16_t **frame_ant_ptr,
-                         int w, int h, int sstride, int dstride,
-                         int16_t *spatial, int16_t *temporal, int depth)
+static void denoise_depth(HQDN3DContext *s,
+                          uint8_t *src, uint8_t *dst,
+                          uint16_t *line_ant, uint16_t *frame_ant,
+                          int w, int h, int sstride, int dstride,
+                          int16_t *spatial, int16_t *temporal,
+                          const uint8_t *seam, int y0, int init, int depth)
 {
     // FIXME: For 16-bit depth, frame_ant could be a pointer to the previous
     // filtered frame rather than a separate buffer.
     long x, y;
-    uint16_t *frame_ant = *frame_ant_ptr;
-    if (!frame_ant) {
+
+    src       += y0 * sstride;
+    dst       += y0 * dstride;
+    frame_ant += y0 * w;
+
+    if (init) {
         uint8_t *frame_src = src;
-        *frame_ant_ptr = frame_ant = av_malloc_array(w, h*sizeof(uint16_t));
-        if (!frame_ant)
-            return AVERROR(ENOMEM);
+        uint16_t *frame_dst = frame_ant;
+
         for (y = 0; y < h; y++, src += sstride, frame_ant += w)
             for (x = 0; x < w; x++)
                 frame_ant[x] = LOAD(x);
         src = frame_src;
-        frame_ant = *frame_ant_ptr;
+        frame_ant = frame_dst;
     }
 
     if (spatial[0])
         denoise_spatial(s, src, dst, line_ant, frame_ant,
-                        w, h, sstride, dstride, spatial, temporal, depth);
+                        w, h, sstride, dstride, spatial, temporal, depth, seam);
     else
         denoise_temporal(src, dst, frame_ant,
                          w, h, sstride, dstride, temporal, depth);
+}
+
+typedef struct ThreadData {
+    AVFrame *in, *out;
+    int plane;
+    int init;
+} ThreadData;
+
+static int denoise_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    HQDN3DContext *s = ctx->priv;
+    ThreadData *td = arg;
+    AVFrame *in = td->in, *out = td->out;
+    const int c = td->plane;
+    const int w = AV_CEIL_RSHIFT(in->width,  (!!c * s->hsub));
+    const int h = AV_CEIL_RSHIFT(in->height, (!!c * s->vsub));
+    const int slice_start = (h *  jobnr   ) / nb_jobs;
+    const int slice_end   = (h * (jobnr+1)) / nb_jobs;
+    uint16_t *line_ant = s->line + jobnr * in->width;
+    const uint8_t *seam = jobnr ? s->seam + jobnr * in->width * 2 : NULL;
+    int16_t *spatial  = s->coefs[c ? CHROMA_SPATIAL : LUMA_SPATIAL];
+    int16_t *temporal = s->coefs[c ? CHROMA_TMP     : LUMA_TMP];
+
+#define DENOISE(depth)                                                        \
+    denoise_depth(s, in->data[c], out->data[c], line_ant, s->frame_prev[c],   \
+                  w, slice_end - slice_start, in->linesize[c], out->linesize[c], \
+                  spatial, temporal, seam, slice_start, td->init, depth)
+
+    switch (s->depth) {
+    case  8: DENOISE( 8); break;
+    case  9: DENOISE( 9); break;
+    case 10: DENOISE(10); break;
+    case 16: DENOISE(16); break;
+    }
     emms_c();
+
     return 0;
 }
 
-#define denoise(...)                                                          \
-    do {                                                                      \
-        int ret = AVERROR_BUG;                                                \
-        switch (s->depth) {                                                   \
-            case  8: ret = denoise_depth(__VA_ARGS__,  8); break;             \
-            case  9: ret = denoise_depth(__VA_ARGS__,  9); break;             \
-            case 10: ret = denoise_depth(__VA_ARGS__, 10); break;             \
-            case 16: ret = denoise_depth(__VA_ARGS__, 16); break;             \
-        }                                                                     \
-        if (ret < 0) {                                                        \
-            av_frame_free(&out);                                              \
-            if (!direct)                                                      \
-                av_frame_free(&in);                                           \
-            return ret;                                                       \
-        }                                                                     \
-    } while (0)
-
 static int16_t *precalc_coefs(double dist25, int depth)
 {
     int i;
@@ -224,6 +263,7 @@ static av_cold void uninit(AVFilterContext *ctx)
     av_freep(&s->coefs[2]);
     av_freep(&s->coefs[3]);
     av_freep(&s->line);
+    av_freep(&s->seam);
     av_freep(&s->frame_prev[0]);
     av_freep(&s->frame_prev[1]);
     av_freep(&s->frame_prev[2]);
@@ -271,10 +311,14 @@ static int config_input(AVFilterLink *inlink)
     s->vsub  = desc->log2_chroma_h;
     s->depth = desc->comp[0].depth;
 
-    s->line = av_malloc_array(inlink->w, sizeof(*s->line));
+    s->line = av_malloc_array(inlink->w, FFMAX(s->slices, 1) * sizeof(*s->line));
     if (!s->line)
         return AVERROR(ENOMEM);
 
+    s->seam = av_malloc_array(inlink->w * 2, FFMAX(s->slices, 1));
+    if (!s->seam)
+        return AVERROR(ENOMEM);
+
     for (i = 0; i < 4; i++) {
         s->coefs[i] = precalc_coefs(s->strength[i], s->depth);
         if (!s->coefs[i])
@@ -309,13 +353,34 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *in)
     }
 
     for (c = 0; c < 3; c++) {
-        denoise(s, in->data[c], out->data[c],
-                s->line, &s->frame_prev[c],
-                AV_CEIL_RSHIFT(in->width,  (!!c * s->hsub)),
-                AV_CEIL_RSHIFT(in->height, (!!c * s->vsub)),
-                in->linesize[c], out->linesize[c],
-                s->coefs[c ? CHROMA_SPATIAL : LUMA_SPATIAL],
-                s->coefs[c ? CHROMA_TMP     : LUMA_TMP]);
+        const int h = AV_CEIL_RSHIFT(in->height, (!!c * s->vsub));
+        const int w = AV_CEIL_RSHIFT(in->width,  (!!c * s->hsub));
+        const int nb_jobs = FFMIN(h, FFMAX(s->slices, 1));
+        ThreadData td;
+        int j;
+
+        td.init = !s->frame_prev[c];
+        if (td.init) {
+            s->frame_prev[c] = av_malloc_array(w, h * sizeof(uint16_t));
+            if (!s->frame_prev[c]) {
+                if (!direct)
+                    av_frame_free(&out);
+                av_frame_free(&in);
+                return AVERROR(ENOMEM);
+            }
+        }
+
+        /* Slices are seeded from the line above them, which the previous
+         * slice may overwrite when filtering in place. */
+        for (j = 1; j < nb_jobs; j++)
+            memcpy(s->seam + j * in->width * 2,
+                   in->data[c] + ((h * j) / nb_jobs - 1) * in->linesize[c],
+                   w * (s->depth > 8 ? 2 : 1));
+
+        td.in = in;
+        td.out = out;
+        td.plane = c;
+        ctx->internal->execute(ctx, denoise_slice, &td, NULL, nb_jobs);
     }
 
     if (ctx->is_disabled) {
@@ -336,6 +401,7 @@ static const AVOption hqdn3d_options[] = {
     { "chroma_spatial", "spatial chroma strength",  OFFSET(strength[CHROMA_SPATIAL]), AV_OPT_TYPE_DOUBLE, { .dbl = 0.0 }, 0, DBL_MAX, FLAGS },
     { "luma_tmp",       "temporal luma strength",   OFFSET(strength[LUMA_TMP]),       AV_OPT_TYPE_DOUBLE, { .dbl = 0.0 }, 0, DBL_MAX, FLAGS },
     { "chroma_tmp",     "temporal chroma strength", OFFSET(strength[CHROMA_TMP]),     AV_OPT_TYPE_DOUBLE, { .dbl = 0.0 }, 0, DBL_MAX, FLAGS },
+    { "slices",         "number of independently filtered horizontal slices", OFFSET(slices), AV_OPT_TYPE_INT, { .i64 = 0 }, 0, 256, FLAGS },
     { NULL }
 };
 
@@ -370,5 +436,5 @@ AVFilter ff_vf_hqdn3d = {
     .query_formats = query_formats,
     .inputs        = avfilter_vf_hqdn3d_inputs,
     .outputs       = avfilter_vf_hqdn3d_outputs,
-    .flags         = AVFILTER_FLAG_SUPPORT_TIMELINE_INTERNAL,
+    .flags         = AVFILTER_FLAG_SUPPORT_TIMELINE_INTERNAL | AVFILTER_FLAG_SLICE_THREADS,
 };
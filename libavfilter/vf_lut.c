@@ -218,7 +218,7 @@ static int config_props(AVFilterLink *inlink)
     const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(inlink->format);
     uint8_t rgba_map[4]; /* component index -> RGBA color index map */
     int min[4], max[4];
-    int val, color, ret;
+    int val, color, lut_size, ret;
 
     s->hsub = desc->log2_chroma_w;
     s->vsub = desc->log2_chroma_h;
@@ -226,6 +226,8 @@ static int config_props(AVFilterLink *inlink)
     s->var_values[VAR_W] = inlink->w;
     s->var_values[VAR_H] = inlink->h;
     s->is_16bit = desc->comp[0].depth > 8;
+    /* 8-bit samples only ever index the first 256 entries */
+    lut_size = s->is_16bit ? FF_ARRAY_ELEMS(s->lut[0]) : 256;
 
     switch (inlink->format) {
     case AV_PIX_FMT_YUV410P:
@@ -315,7 +317,7 @@ static int config_props(AVFilterLink *inlink)
         s->var_values[VAR_MAXVAL] = max[color];
         s->var_values[VAR_MINVAL] = min[color];
 
-        for (val = 0; val < FF_ARRAY_ELEMS(s->lut[comp]); val++) {
+        for (val = 0; val < lut_size; val++) {
             s->var_values[VAR_VAL] = val;
             s->var_values[VAR_CLIPVAL] = av_clip(val, min[color], max[color]);
             s->var_values[VAR_NEGVAL] =
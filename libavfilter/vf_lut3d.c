@@ -67,6 +67,8 @@ typedef struct LUT3DContext {
     struct rgbvec scale;
     struct rgbvec lut[MAX_LEVEL][MAX_LEVEL][MAX_LEVEL];
     int lutsize;
+    int bake;
+    uint8_t *baked;             ///< interpolated output of all the 8-bit colors
 #if CONFIG_HALDCLUT_FILTER
     uint8_t clut_rgba_map[4];
     int clut_step;
@@ -330,6 +332,115 @@ DEFINE_INTERP_FUNC(nearest,     16)
 DEFINE_INTERP_FUNC(trilinear,   16)
 DEFINE_INTERP_FUNC(tetrahedral, 16)
 
+#define BAKED_INDEX(r, g, b) ((((r) << 16) | ((g) << 8) | (b)) * 3)
+
+/* Interpolate the output of all the 8-bit colors exactly as the interp_8_*
+ * functions do, so that applying the baked table is bitexact with them. */
+#define DEFINE_BAKE_FUNC(name)                                                                      \
+static int bake_##name(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)                     \
+{                                                                                                   \
+    int r, g, b;                                                                                    \
+    const LUT3DContext *lut3d = ctx->priv;                                                          \
+    const int start = (256 *  jobnr   ) / nb_jobs;                                                  \
+    const int end   = (256 * (jobnr+1)) / nb_jobs;                                                  \
+    const float scale_r = (lut3d->scale.r / ((1<<8) - 1)) * (lut3d->lutsize - 1);                   \
+    const float scale_g = (lut3d->scale.g / ((1<<8) - 1)) * (lut3d->lutsize - 1);                   \
+    const float scale_b = (lut3d->scale.b / ((1<<8) - 1)) * (lut3d->lutsize - 1);                   \
+                                                                                                    \
+    for (r = start; r < end; r++) {                                                                 \
+        for (g = 0; g < 256; g++) {                                                                 \
+            uint8_t *dst = lut3d->baked + BAKED_INDEX(r, g, 0);                                     \
+            for (b = 0; b < 256; b++) {                                                             \
+                const struct rgbvec scaled_rgb = {r * scale_r, g * scale_g, b * scale_b};          \
+                struct rgbvec vec = interp_##name(lut3d, &scaled_rgb);                              \
+                dst[3*b + 0] = av_clip_uint8(vec.r * (float)((1<<8) - 1));                          \
+                dst[3*b + 1] = av_clip_uint8(vec.g * (float)((1<<8) - 1));                          \
+                dst[3*b + 2] = av_clip_uint8(vec.b * (float)((1<<8) - 1));                          \
+            }                                                                                       \
+        }                                                                                           \
+    }                                                                                               \
+    return 0;                                                                                       \
+}
+
+DEFINE_BAKE_FUNC(nearest)
+DEFINE_BAKE_FUNC(trilinear)
+DEFINE_BAKE_FUNC(tetrahedral)
+
+static int interp_8_baked(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    int x, y;
+    const LUT3DContext *lut3d = ctx->priv;
+    const ThreadData *td = arg;
+    const AVFrame *in  = td->in;
+    const AVFrame *out = td->out;
+    const int direct = out == in;
+    const int step = lut3d->step;
+    const uint8_t r = lut3d->rgba_map[R];
+    const uint8_t g = lut3d->rgba_map[G];
+    const uint8_t b = lut3d->rgba_map[B];
+    const uint8_t a = lut3d->rgba_map[A];
+    const int slice_start = (in->height *  jobnr   ) / nb_jobs;
+    const int slice_end   = (in->height * (jobnr+1)) / nb_jobs;
+    uint8_t       *dstrow = out->data[0] + slice_start * out->linesize[0];
+    const uint8_t *srcrow = in ->data[0] + slice_start * in ->linesize[0];
+
+    for (y = slice_start; y < slice_end; y++) {
+        uint8_t *dst = dstrow;
+        const uint8_t *src = srcrow;
+        for (x = 0; x < in->width * step; x += step) {
+            const uint8_t *c = lut3d->baked + BAKED_INDEX(src[x + r], src[x + g], src[x + b]);
+            dst[x + r] = c[0];
+            dst[x + g] = c[1];
+            dst[x + b] = c[2];
+            if (!direct && step == 4)
+                dst[x + a] = src[x + a];
+        }
+        dstrow += out->linesize[0];
+        srcrow += in ->linesize[0];
+    }
+    return 0;
+}
+
+static int interp_8_baked_p8(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    int x, y;
+    const LUT3DContext *lut3d = ctx->priv;
+    const ThreadData *td = arg;
+    const AVFrame *in  = td->in;
+    const AVFrame *out = td->out;
+    const int direct = out == in;
+    const int slice_start = (in->height *  jobnr   ) / nb_jobs;
+    const int slice_end   = (in->height * (jobnr+1)) / nb_jobs;
+    uint8_t *grow = out->data[0] + slice_start * out->linesize[0];
+    uint8_t *brow = out->data[1] + slice_start * out->linesize[1];
+    uint8_t *rrow = out->data[2] + slice_start * out->linesize[2];
+    uint8_t *arow = out->data[3] + slice_start * out->linesize[3];
+    const uint8_t *srcgrow = in->data[0] + slice_start * in->linesize[0];
+    const uint8_t *srcbrow = in->data[1] + slice_start * in->linesize[1];
+    const uint8_t *srcrrow = in->data[2] + slice_start * in->linesize[2];
+    const uint8_t *srcarow = in->data[3] + slice_start * in->linesize[3];
+
+    for (y = slice_start; y < slice_end; y++) {
+        for (x = 0; x < in->width; x++) {
+            const uint8_t *c = lut3d->baked + BAKED_INDEX(srcrrow[x], srcgrow[x], srcbrow[x]);
+            rrow[x] = c[0];
+            grow[x] = c[1];
+            brow[x] = c[2];
+            if (!direct && in->linesize[3])
+                arow[x] = srcarow[x];
+        }
+        grow += out->linesize[0];
+        brow += out->linesize[1];
+        rrow += out->linesize[2];
+        arow += out->linesize[3];
+        srcgrow += in->linesize[0];
+        srcbrow += in->linesize[1];
+        srcrrow += in->linesize[2];
+        srcarow += in->linesize[3];
+    }
+    return 0;
+}
+
 #define MAX_LINE_SIZE 512
 
 static int skip_line(const char *p)
@@ -666,9 +777,33 @@ static int query_formats(AVFilterContext *ctx)
     return ff_set_common_formats(ctx, fmts_list);
 }
 
+static int bake_lut(AVFilterContext *ctx)
+{
+    LUT3DContext *lut3d = ctx->priv;
+    avfilter_action_func *bake;
+
+    if (lut3d->baked)
+        return 0;
+
+    switch (lut3d->interpolation) {
+    case INTERPOLATE_NEAREST:     bake = bake_nearest;      break;
+    case INTERPOLATE_TRILINEAR:   bake = bake_trilinear;    break;
+    case INTERPOLATE_TETRAHEDRAL: bake = bake_tetrahedral;  break;
+    default:
+        av_assert0(0);
+    }
+
+    lut3d->baked = av_malloc(BAKED_INDEX(256, 0, 0));
+    if (!lut3d->baked)
+        return AVERROR(ENOMEM);
+    ctx->internal->execute(ctx, bake, NULL, NULL,
+                           FFMIN(256, ff_filter_get_nb_threads(ctx)));
+    return 0;
+}
+
 static int config_input(AVFilterLink *inlink)
 {
-    int depth, is16bit = 0, planar = 0;
+    int depth, is16bit = 0, planar = 0, ret;
     LUT3DContext *lut3d = inlink->dst->priv;
     const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(inlink->format);
 
@@ -721,6 +856,12 @@ static int config_input(AVFilterLink *inlink)
         av_assert0(0);
     }
 
+    if (lut3d->bake && depth == 8) {
+        if ((ret = bake_lut(inlink->dst)) < 0)
+            return ret;
+        lut3d->interp = planar ? interp_8_baked_p8 : interp_8_baked;
+    }
+
     return 0;
 }
 
@@ -765,6 +906,7 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *in)
 #if CONFIG_LUT3D_FILTER
 static const AVOption lut3d_options[] = {
     { "file", "set 3D LUT file name", OFFSET(file), AV_OPT_TYPE_STRING, {.str=NULL}, .flags = FLAGS },
+    { "bake", "precompute the output of all the 8-bit colors", OFFSET(bake), AV_OPT_TYPE_BOOL, {.i64=0}, 0, 1, FLAGS },
     COMMON_OPTIONS
 };
 
@@ -824,6 +966,12 @@ end:
     return ret;
 }
 
+static av_cold void lut3d_uninit(AVFilterContext *ctx)
+{
+    LUT3DContext *lut3d = ctx->priv;
+    av_freep(&lut3d->baked);
+}
+
 static const AVFilterPad lut3d_inputs[] = {
     {
         .name         = "default",
@@ -847,6 +995,7 @@ AVFilter ff_vf_lut3d = {
     .description   = NULL_IF_CONFIG_SMALL("Adjust colors using a 3D LUT."),
     .priv_size     = sizeof(LUT3DContext),
     .init          = lut3d_init,
+    .uninit        = lut3d_uninit,
     .query_formats = query_formats,
     .inputs        = lut3d_inputs,
     .outputs       = lut3d_outputs,
@@ -40,6 +40,7 @@
 
 #define SCD_METHOD_NONE 0
 #define SCD_METHOD_FDIFF 1
+#define SCD_METHOD_HIST 2
 
 #define NB_FRAMES 4
 #define NB_PIXEL_MVS 32
@@ -188,7 +189,7 @@ typedef struct MIContext {
 
     int scd_method;
     int scene_changed;
-    ff_scene_sad_fn sad;
+    FFSceneContext scene;
     double prev_mafd;
     double scd_threshold;
 
@@ -226,9 +227,10 @@ static const AVOption minterpolate_options[] = {
     { "mb_size", "macroblock size", OFFSET(mb_size), AV_OPT_TYPE_INT, {.i64 = 16}, 4, 16, FLAGS },
     { "search_param", "search parameter", OFFSET(search_param), AV_OPT_TYPE_INT, {.i64 = 32}, 4, INT_MAX, FLAGS },
     { "vsbmc", "variable-size block motion compensation", OFFSET(vsbmc), AV_OPT_TYPE_INT, {.i64 = 0}, 0, 1, FLAGS },
-    { "scd", "scene change detection method", OFFSET(scd_method), AV_OPT_TYPE_INT, {.i64 = SCD_METHOD_FDIFF}, SCD_METHOD_NONE, SCD_METHOD_FDIFF, FLAGS, "scene" },
+    { "scd", "scene change detection method", OFFSET(scd_method), AV_OPT_TYPE_INT, {.i64 = SCD_METHOD_FDIFF}, SCD_METHOD_NONE, SCD_METHOD_HIST, FLAGS, "scene" },
         CONST("none",   "disable detection",                    SCD_METHOD_NONE,        "scene"),
         CONST("fdiff",  "frame difference",                     SCD_METHOD_FDIFF,       "scene"),
+        CONST("hist",   "luma histogram difference",            SCD_METHOD_HIST,        "scene"),
     { "scd_threshold", "scene change threshold", OFFSET(scd_threshold), AV_OPT_TYPE_DOUBLE, {.dbl = 5.0}, 0, 100.0, FLAGS },
     { NULL }
 };
@@ -382,10 +384,12 @@ static int config_input(AVFilterLink *inlink)
         }
     }
 
-    if (mi_ctx->scd_method == SCD_METHOD_FDIFF) {
-        mi_ctx->sad = ff_scene_sad_get_fn(8);
-        if (!mi_ctx->sad)
-            return AVERROR(EINVAL);
+    if (mi_ctx->scd_method != SCD_METHOD_NONE) {
+        ret = ff_scene_init(&mi_ctx->scene, inlink->dst,
+                            mi_ctx->scd_method == SCD_METHOD_HIST ? FF_SCENE_HIST : FF_SCENE_SAD,
+                            8, 1, 1);
+        if (ret < 0)
+            return ret;
     }
 
     ff_me_init_context(me_ctx, mi_ctx->mb_size, mi_ctx->search_param, width, height, 0, (mi_ctx->b_width - 1) << mi_ctx->log2_mb_size, 0, (mi_ctx->b_height - 1) << mi_ctx->log2_mb_size);
@@ -834,14 +838,21 @@ static int detect_scene_change(MIContext *mi_ctx)
     if (mi_ctx->scd_method == SCD_METHOD_FDIFF) {
         double ret = 0, mafd, diff;
         uint64_t sad;
-        mi_ctx->sad(p1, linesize1, p2, linesize2, me_ctx->width, me_ctx->height, &sad);
-        emms_c();
-        mafd = (double) sad / (me_ctx->height * me_ctx->width * 3);
+        int64_t count;
+        count = ff_scene_sad(&mi_ctx->scene, p1, linesize1, p2, linesize2, me_ctx->width, me_ctx->height, &sad);
+        mafd = (double) sad / (count * 3);
         diff = fabs(mafd - mi_ctx->prev_mafd);
         ret  = av_clipf(FFMIN(mafd, diff), 0, 100.0);
         mi_ctx->prev_mafd = mafd;
 
         return ret >= mi_ctx->scd_threshold;
+    } else if (mi_ctx->scd_method == SCD_METHOD_HIST) {
+        double ret;
+        if (!mi_ctx->scene.has_prev_hist)
+            ff_scene_hist(&mi_ctx->scene, p1, linesize1, me_ctx->width, me_ctx->height);
+        ret = ff_scene_hist(&mi_ctx->scene, p2, linesize2, me_ctx->width, me_ctx->height);
+
+        return ret * 100.0 >= mi_ctx->scd_threshold;
     }
 
     return 0;
@@ -1235,6 +1246,8 @@ static av_cold void uninit(AVFilterContext *ctx)
 
     for (i = 0; i < 3; i++)
         av_freep(&mi_ctx->mv_table[i]);
+
+    ff_scene_uninit(&mi_ctx->scene);
 }
 
 static const AVFilterPad minterpolate_inputs[] = {
@@ -1265,4 +1278,5 @@ AVFilter ff_vf_minterpolate = {
     .query_formats = query_formats,
     .inputs        = minterpolate_inputs,
     .outputs       = minterpolate_outputs,
+    .flags         = AVFILTER_FLAG_SLICE_THREADS,
 };
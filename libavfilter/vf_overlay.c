@@ -32,6 +32,7 @@
 #include "libavutil/avstring.h"
 #include "libavutil/pixdesc.h"
 #include "libavutil/imgutils.h"
+#include "libavutil/intreadwrite.h"
 #include "libavutil/mathematics.h"
 #include "libavutil/opt.h"
 #include "libavutil/timestamp.h"
@@ -350,6 +351,43 @@ static int config_output(AVFilterLink *outlink)
 // ((((x) + (y)) << 8) - ((x) + (y)) - (y) * (x)) is a faster version of: 255 * (x + y)
 #define UNPREMULTIPLY_ALPHA(x, y) ((((x) << 16) - ((x) << 9) + (x)) / ((((x) + (y)) << 8) - ((x) + (y)) - (y) * (x)))
 
+/**
+ * Find the part of an overlay row which is not fully transparent.
+ *
+ * @param a     first alpha value of the row
+ * @param step  distance in bytes between two alpha values
+ * @param w     number of alpha values
+ * @param start set to the index of the first non-zero alpha value
+ * @return index past the last non-zero alpha value, equal to *start if the
+ *         whole row is transparent
+ */
+static av_always_inline int alpha_row_span(const uint8_t *a, int step, int w,
+                                           int *start)
+{
+    int i = 0, end = w;
+
+    if (step == 1) {
+        while (i + 8 <= w && !AV_RN64(a + i))
+            i += 8;
+    }
+    while (i < w && !a[i * step])
+        i++;
+    if (i == w) {
+        *start = w;
+        return w;
+    }
+
+    if (step == 1) {
+        while (end - 8 > i && !AV_RN64(a + end - 8))
+            end -= 8;
+    }
+    while (!a[(end - 1) * step])
+        end--;
+
+    *start = i;
+    return end;
+}
+
 /**
  * Blend image in src to destination buffer dst at position (x, y).
  */
@@ -389,11 +427,19 @@ static av_always_inline void blend_slice_packed_rgb(AVFilterContext *ctx,
     dp = dst->data[0] + (y + slice_start) * dst->linesize[0];
 
     for (i = slice_start; i < slice_end; i++) {
-        j = FFMAX(-x, 0);
+        int start;
+
+        // transparent pixels are left untouched, only blend the visible part
+        j    = FFMAX(-x, 0);
+        jmax = FFMIN(-x + dst_w, src_w);
+        if (j < jmax) {
+            jmax = j + alpha_row_span(sp + j * sstep + sa, sstep, jmax - j, &start);
+            j   += start;
+        }
         S = sp + j     * sstep;
         d = dp + (x+j) * dstep;
 
-        for (jmax = FFMIN(-x + dst_w, src_w); j < jmax; j++) {
+        for (; j < jmax; j++) {
             alpha = S[sa];
 
             // if the main channel has an alpha channel, alpha has to be calculated
@@ -482,13 +528,37 @@ static av_always_inline void blend_plane(AVFilterContext *ctx,
 
     for (j = slice_start; j < slice_end; j++) {
         k = FFMAX(-xp, 0);
+        kmax = FFMIN(-xp + dst_wp, src_wp);
+
+        // with straight alpha, fully transparent pixels leave the main
+        // picture untouched, so only blend the span covering visible ones
+        if (straight && k < kmax) {
+            const int lx = k << hsub;
+            const int lw = FFMIN(kmax << hsub, src_w) - lx;
+            int start, end, start2, end2;
+
+            end = alpha_row_span(ap + lx, 1, lw, &start);
+            if (vsub && (j << vsub) + 1 < src_h) {
+                end2 = alpha_row_span(ap + src->linesize[3] + lx, 1, lw, &start2);
+                if (start2 < end2) {
+                    start = start < end ? FFMIN(start, start2) : start2;
+                    end   = FFMAX(end, end2);
+                }
+            }
+            if (start < end) {
+                kmax = FFMIN(kmax, k + ((end + (1 << hsub) - 1) >> hsub));
+                k   += start >> hsub;
+            } else {
+                kmax = k;
+            }
+        }
+
         d = dp + (xp+k) * dst_step;
         s = sp + k;
         a = ap + (k<<hsub);
         da = dap + ((xp+k) << hsub);
-        kmax = FFMIN(-xp + dst_wp, src_wp);
 
-        if (((vsub && j+1 < src_hp) || !vsub) && octx->blend_row[i]) {
+        if (((vsub && j+1 < src_hp) || !vsub) && octx->blend_row[i] && k < kmax) {
             int c = octx->blend_row[i](d, da, s, a, kmax - k, src->linesize[3]);
 
             s += c;
@@ -570,11 +640,18 @@ static inline void alpha_composite(const AVFrame *src, const AVFrame *dst,
     da = dst->data[3] + (y + i + slice_start) * dst->linesize[3];
 
     for (i = i + slice_start; i < slice_end; i++) {
-        j = FFMAX(-x, 0);
+        int start;
+
+        j    = FFMAX(-x, 0);
+        jmax = FFMIN(-x + dst_w, src_w);
+        if (j < jmax) {
+            jmax = j + alpha_row_span(sa + j, 1, jmax - j, &start);
+            j   += start;
+        }
         s = sa + j;
         d = da + x+j;
 
-        for (jmax = FFMIN(-x + dst_w, src_w); j < jmax; j++) {
+        for (; j < jmax; j++) {
             alpha = *s;
             if (alpha != 0 && alpha != 255) {
                 uint8_t alpha_d = *d;
@@ -29,12 +29,25 @@
 #include "framesync.h"
 #include "video.h"
 
+#define MAX_CANVASES 4
+
 typedef struct StackItem {
     int x[4], y[4];
     int linesize[4];
     int height[4];
+    int64_t nb_views;   ///< number of buffers allocated in the output frames
+    int64_t last_view;  ///< index of the last of these buffers stacked
 } StackItem;
 
+/**
+ * Output frame whose regions are given to the inputs to render into.
+ */
+typedef struct StackCanvas {
+    AVFrame *frame;
+    int64_t *view;      ///< for each input, index of the buffer allocated
+                        ///< in its region, starting at 1; 0 if none
+} StackCanvas;
+
 typedef struct StackContext {
     const AVClass *class;
     const AVPixFmtDescriptor *desc;
@@ -48,6 +61,11 @@ typedef struct StackContext {
     StackItem *items;
     AVFrame **frames;
     FFFrameSync fs;
+
+    int direct;         ///< the input regions do not overlap
+    StackCanvas canvas[MAX_CANVASES]; ///< oldest first
+    int nb_canvases;
+    int64_t *views;
 } StackContext;
 
 static int query_formats(AVFilterContext *ctx)
@@ -67,6 +85,104 @@ static int query_formats(AVFilterContext *ctx)
     return ff_set_common_formats(ctx, pix_fmts);
 }
 
+/**
+ * Return the canvas in which frame was rendered in place for input in,
+ * or -1.
+ */
+static int find_view(StackContext *s, AVFrame *frame, int in)
+{
+    const StackItem *item = &s->items[in];
+    int c, p;
+
+    for (c = 0; c < s->nb_canvases; c++) {
+        const AVFrame *canvas = s->canvas[c].frame;
+
+        if (!s->canvas[c].view[in])
+            continue;
+        for (p = 0; p < s->nb_planes; p++)
+            if (frame->data[p] != canvas->data[p] + canvas->linesize[p] * item->y[p] + item->x[p] ||
+                frame->linesize[p] != canvas->linesize[p])
+                break;
+        if (p == s->nb_planes)
+            return c;
+    }
+    return -1;
+}
+
+/**
+ * Remove the canvases up to c included: the older ones are freed, the frame
+ * of canvas c is returned.
+ */
+static AVFrame *remove_canvases(StackContext *s, int c)
+{
+    AVFrame *frame = s->canvas[c].frame;
+    int i;
+
+    for (i = 0; i < c; i++)
+        av_frame_free(&s->canvas[i].frame);
+    for (i = 0; i < s->nb_canvases - c - 1; i++) {
+        FFSWAP(int64_t *, s->canvas[i].view, s->canvas[i + c + 1].view);
+        s->canvas[i].frame = s->canvas[i + c + 1].frame;
+    }
+    for (; i < s->nb_canvases; i++)
+        s->canvas[i].frame = NULL;
+    s->nb_canvases -= c + 1;
+    return frame;
+}
+
+/* Tell if all the frames rendered in canvas c were already stacked */
+static int canvas_done(StackContext *s, int c)
+{
+    int i;
+
+    for (i = 0; i < s->nb_inputs; i++)
+        if (s->canvas[c].view[i] > s->items[i].last_view)
+            return 0;
+    return 1;
+}
+
+/**
+ * Give upstream filters a view of the region of an output frame where
+ * their frame is stacked, so that it does not need to be copied.
+ */
+static AVFrame *get_video_buffer(AVFilterLink *inlink, int w, int h)
+{
+    AVFilterContext *ctx = inlink->dst;
+    AVFilterLink *outlink = ctx->outputs[0];
+    StackContext *s = ctx->priv;
+    int in = FF_INLINK_IDX(inlink), c;
+    const StackItem *item = &s->items[in];
+    StackCanvas *canvas;
+    AVFrame *frame;
+    int p;
+
+    if (!s->direct || w != inlink->w || h != inlink->h)
+        return ff_default_get_video_buffer(inlink, w, h);
+
+    for (c = 0; c < s->nb_canvases && s->canvas[c].view[in]; c++);
+    if (c == MAX_CANVASES)
+        return ff_default_get_video_buffer(inlink, w, h);
+    canvas = &s->canvas[c];
+    if (c == s->nb_canvases) {
+        canvas->frame = ff_get_video_buffer(outlink, outlink->w, outlink->h);
+        if (!canvas->frame)
+            return NULL;
+        memset(canvas->view, 0, s->nb_inputs * sizeof(*canvas->view));
+        s->nb_canvases++;
+    }
+
+    frame = av_frame_clone(canvas->frame);
+    if (!frame)
+        return NULL;
+    frame->width  = w;
+    frame->height = h;
+    for (p = 0; p < s->nb_planes; p++)
+        frame->data[p] += frame->linesize[p] * item->y[p] + item->x[p];
+    canvas->view[in] = ++s->items[in].nb_views;
+
+    return frame;
+}
+
 static av_cold int init(AVFilterContext *ctx)
 {
     StackContext *s = ctx->priv;
@@ -79,8 +195,12 @@ static av_cold int init(AVFilterContext *ctx)
         s->is_horizontal = 1;
 
     s->frames = av_calloc(s->nb_inputs, sizeof(*s->frames));
-    if (!s->frames)
+    s->items  = av_calloc(s->nb_inputs, sizeof(*s->items));
+    s->views  = av_calloc(s->nb_inputs, MAX_CANVASES * sizeof(*s->views));
+    if (!s->frames || !s->items || !s->views)
         return AVERROR(ENOMEM);
+    for (i = 0; i < MAX_CANVASES; i++)
+        s->canvas[i].view = s->views + i * s->nb_inputs;
 
     if (!strcmp(ctx->filter->name, "xstack")) {
         if (!s->layout) {
@@ -93,10 +213,6 @@ static av_cold int init(AVFilterContext *ctx)
                 return AVERROR(EINVAL);
             }
         }
-
-        s->items = av_calloc(s->nb_inputs, sizeof(*s->items));
-        if (!s->items)
-            return AVERROR(ENOMEM);
     }
 
     for (i = 0; i < s->nb_inputs; i++) {
@@ -104,6 +220,7 @@ static av_cold int init(AVFilterContext *ctx)
 
         pad.type = AVMEDIA_TYPE_VIDEO;
         pad.name = av_asprintf("input%d", i);
+        pad.get_video_buffer = get_video_buffer;
         if (!pad.name)
             return AVERROR(ENOMEM);
 
@@ -123,59 +240,60 @@ static int process_frame(FFFrameSync *fs)
     StackContext *s = fs->opaque;
     AVFrame **in = s->frames;
     AVFrame *out;
-    int i, p, ret, offset[4] = { 0 };
+    int i, p, ret, c = -1;
 
     for (i = 0; i < s->nb_inputs; i++) {
         if ((ret = ff_framesync_get_frame(&s->fs, i, &in[i], 0)) < 0)
             return ret;
     }
 
-    out = ff_get_video_buffer(outlink, outlink->w, outlink->h);
-    if (!out)
-        return AVERROR(ENOMEM);
-    out->pts = av_rescale_q(s->fs.pts, s->fs.time_base, outlink->time_base);
-    out->sample_aspect_ratio = outlink->sample_aspect_ratio;
-
+    /* Use the output frame some inputs were rendered in, if the regions of
+       the other inputs can be overwritten: they must not hold a frame
+       newer than the one to stack. */
     for (i = 0; i < s->nb_inputs; i++) {
-        AVFilterLink *inlink = ctx->inputs[i];
-        int linesize[4];
-        int height[4];
-
-        if (s->is_horizontal || s->is_vertical) {
-            if ((ret = av_image_fill_linesizes(linesize, inlink->format, inlink->w)) < 0) {
-                av_frame_free(&out);
-                return ret;
-            }
+        int c1 = find_view(s, in[i], i);
 
-            height[1] = height[2] = AV_CEIL_RSHIFT(inlink->h, s->desc->log2_chroma_h);
-            height[0] = height[3] = inlink->h;
+        if (c1 >= 0) {
+            s->items[i].last_view = s->canvas[c1].view[i];
+            if (c < 0)
+                c = c1;
         }
+    }
+    for (i = 0; i < s->nb_inputs && c >= 0; i++) {
+        int64_t view = s->canvas[c].view[i];
+        int c1 = find_view(s, in[i], i);
 
-        for (p = 0; p < s->nb_planes; p++) {
-            if (s->is_vertical) {
-                av_image_copy_plane(out->data[p] + offset[p] * out->linesize[p],
-                                    out->linesize[p],
-                                    in[i]->data[p],
-                                    in[i]->linesize[p],
-                                    linesize[p], height[p]);
-                offset[p] += height[p];
-            } else if (s->is_horizontal) {
-                av_image_copy_plane(out->data[p] + offset[p],
-                                    out->linesize[p],
-                                    in[i]->data[p],
-                                    in[i]->linesize[p],
-                                    linesize[p], height[p]);
-                offset[p] += linesize[p];
-            } else {
-                StackItem *item = &s->items[i];
+        if (c1 != c && view && (c1 < 0 || s->canvas[c1].view[i] < view))
+            c = -1;
+    }
 
-                av_image_copy_plane(out->data[p] + out->linesize[p] * item->y[p] + item->x[p],
-                                    out->linesize[p],
-                                    in[i]->data[p],
-                                    in[i]->linesize[p],
-                                    item->linesize[p], item->height[p]);
-            }
+    if (c >= 0) {
+        out = remove_canvases(s, c);
+    } else {
+        while (s->nb_canvases && canvas_done(s, 0)) {
+            out = remove_canvases(s, 0);
+            av_frame_free(&out);
         }
+        out = ff_get_video_buffer(outlink, outlink->w, outlink->h);
+        if (!out)
+            return AVERROR(ENOMEM);
+    }
+    out->pts = av_rescale_q(s->fs.pts, s->fs.time_base, outlink->time_base);
+    out->sample_aspect_ratio = outlink->sample_aspect_ratio;
+
+    for (i = 0; i < s->nb_inputs; i++) {
+        StackItem *item = &s->items[i];
+
+        /* rendered in place */
+        if (c >= 0 && in[i]->data[0] == out->data[0] + out->linesize[0] * item->y[0] + item->x[0])
+            continue;
+
+        for (p = 0; p < s->nb_planes; p++)
+            av_image_copy_plane(out->data[p] + out->linesize[p] * item->y[p] + item->x[p],
+                                out->linesize[p],
+                                in[i]->data[p],
+                                in[i]->linesize[p],
+                                item->linesize[p], item->height[p]);
     }
 
     return ff_filter_frame(outlink, out);
@@ -190,27 +308,46 @@ static int config_output(AVFilterLink *outlink)
     int height = ctx->inputs[0]->h;
     int width = ctx->inputs[0]->w;
     FFFrameSyncIn *in;
-    int i, ret;
+    int i, j, p, ret;
 
     s->desc = av_pix_fmt_desc_get(outlink->format);
     if (!s->desc)
         return AVERROR_BUG;
 
-    if (s->is_vertical) {
-        for (i = 1; i < s->nb_inputs; i++) {
-            if (ctx->inputs[i]->w != width) {
-                av_log(ctx, AV_LOG_ERROR, "Input %d width %d does not match input %d width %d.\n", i, ctx->inputs[i]->w, 0, width);
+    if (s->is_vertical || s->is_horizontal) {
+        int offset[4] = { 0 };
+
+        for (i = 0; i < s->nb_inputs; i++) {
+            AVFilterLink *inlink = ctx->inputs[i];
+            StackItem *item = &s->items[i];
+
+            if (s->is_vertical && inlink->w != width) {
+                av_log(ctx, AV_LOG_ERROR, "Input %d width %d does not match input %d width %d.\n", i, inlink->w, 0, width);
                 return AVERROR(EINVAL);
             }
-            height += ctx->inputs[i]->h;
-        }
-    } else if (s->is_horizontal) {
-        for (i = 1; i < s->nb_inputs; i++) {
-            if (ctx->inputs[i]->h != height) {
-                av_log(ctx, AV_LOG_ERROR, "Input %d height %d does not match input %d height %d.\n", i, ctx->inputs[i]->h, 0, height);
+            if (s->is_horizontal && inlink->h != height) {
+                av_log(ctx, AV_LOG_ERROR, "Input %d height %d does not match input %d height %d.\n", i, inlink->h, 0, height);
                 return AVERROR(EINVAL);
             }
-            width += ctx->inputs[i]->w;
+            if ((ret = av_image_fill_linesizes(item->linesize, inlink->format, inlink->w)) < 0)
+                return ret;
+
+            item->height[1] = item->height[2] = AV_CEIL_RSHIFT(inlink->h, s->desc->log2_chroma_h);
+            item->height[0] = item->height[3] = inlink->h;
+
+            for (p = 0; p < 4; p++) {
+                if (s->is_vertical) {
+                    item->y[p]  = offset[p];
+                    offset[p]  += item->height[p];
+                } else {
+                    item->x[p]  = offset[p];
+                    offset[p]  += item->linesize[p];
+                }
+            }
+            if (i && s->is_vertical)
+                height += inlink->h;
+            if (i && s->is_horizontal)
+                width  += inlink->w;
         }
     } else {
         char *arg, *p = s->layout, *saveptr = NULL;
@@ -289,6 +426,20 @@ static int config_output(AVFilterLink *outlink)
 
     s->nb_planes = av_pix_fmt_count_planes(outlink->format);
 
+    /* inputs can only render directly in the output if they do not
+       overwrite each other */
+    s->direct = 1;
+    for (i = 0; i < s->nb_inputs; i++) {
+        for (j = 0; j < i; j++) {
+            const StackItem *a = &s->items[i], *b = &s->items[j];
+
+            for (p = 0; p < s->nb_planes; p++)
+                if (a->x[p] < b->x[p] + b->linesize[p] && b->x[p] < a->x[p] + a->linesize[p] &&
+                    a->y[p] < b->y[p] + b->height[p]   && b->y[p] < a->y[p] + a->height[p])
+                    s->direct = 0;
+        }
+    }
+
     outlink->w          = width;
     outlink->h          = height;
     outlink->frame_rate = frame_rate;
@@ -324,6 +475,9 @@ static av_cold void uninit(AVFilterContext *ctx)
     ff_framesync_uninit(&s->fs);
     av_freep(&s->frames);
     av_freep(&s->items);
+    for (i = 0; i < s->nb_canvases; i++)
+        av_frame_free(&s->canvas[i].frame);
+    av_freep(&s->views);
 
     for (i = 0; i < ctx->nb_inputs; i++)
         av_freep(&ctx->input_pads[i].name);
@@ -30,12 +30,14 @@
 #include "libavutil/opt.h"
 #include "avfilter.h"
 #include "internal.h"
+#include "scene_sad.h"
+#include "video.h"
 
 #define HIST_SIZE (3*256)
 
 struct thumb_frame {
     AVFrame *buf;               ///< cached frame
-    int histogram[HIST_SIZE];   ///< RGB color distribution histogram of the frame
+    uint32_t histogram[HIST_SIZE]; ///< RGB color distribution histogram of the frame
 };
 
 typedef struct ThumbContext {
@@ -44,6 +46,12 @@ typedef struct ThumbContext {
     int n_frames;               ///< number of frames for analysis
     struct thumb_frame *frames; ///< the n_frames frames
     AVRational tb;              ///< copy of the input timebase to ease access
+
+    int max_w, max_h;           ///< maximum size of the stored candidates
+    int factor_w, factor_h;     ///< candidate downscaling factors, 1 keeps the input frames
+    int nb_threads;
+    FFSceneContext scene;       ///< computes the histograms on the slice threads
+    int *thread_sum;            ///< per slice line of block sums for downscaling
 } ThumbContext;
 
 #define OFFSET(x) offsetof(ThumbContext, x)
@@ -51,6 +59,7 @@ typedef struct ThumbContext {
 
 static const AVOption thumbnail_options[] = {
     { "n", "set the frames batch size", OFFSET(n_frames), AV_OPT_TYPE_INT, {.i64=100}, 2, INT_MAX, FLAGS },
+    { "max_size", "downscale the candidates to fit in this size", OFFSET(max_w), AV_OPT_TYPE_IMAGE_SIZE, {.str=NULL}, 0, 0, FLAGS },
     { NULL }
 };
 
@@ -76,7 +85,7 @@ static av_cold int init(AVFilterContext *ctx)
  * @param median average color distribution histogram
  * @return       sum of squared errors
  */
-static double frame_sum_square_err(const int *hist, const double *median)
+static double frame_sum_square_err(const uint32_t *hist, const double *median)
 {
     int i;
     double err, sum_sq_err = 0;
@@ -128,27 +137,81 @@ static AVFrame *get_best_frame(AVFilterContext *ctx)
     return picref;
 }
 
+typedef struct ThreadData {
+    AVFrame *in, *out;
+} ThreadData;
+
+static int downscale_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    ThumbContext *s = ctx->priv;
+    ThreadData *td = arg;
+    const AVFrame *in = td->in;
+    AVFrame *out = td->out;
+    const int fw = s->factor_w;
+    const int fh = s->factor_h;
+    const int area = fw * fh;
+    const int slice_start = (out->height *  jobnr     ) / nb_jobs;
+    const int slice_end   = (out->height * (jobnr + 1)) / nb_jobs;
+    int *sum = s->thread_sum + jobnr * out->width * 3;
+    int x, y, i, j;
+
+    for (y = slice_start; y < slice_end; y++) {
+        uint8_t *dst = out->data[0] + y * out->linesize[0];
+
+        // accumulate the fh source lines, then the fw pixels of each block
+        memset(sum, 0, out->width * 3 * sizeof(*sum));
+        for (j = 0; j < fh; j++) {
+            const uint8_t *p = in->data[0] + (y * fh + j) * in->linesize[0];
+
+            for (x = 0; x < out->width; x++) {
+                int s0 = 0, s1 = 0, s2 = 0;
+
+                for (i = 0; i < fw; i++) {
+                    s0 += p[0];
+                    s1 += p[1];
+                    s2 += p[2];
+                    p  += 3;
+                }
+                sum[x*3    ] += s0;
+                sum[x*3 + 1] += s1;
+                sum[x*3 + 2] += s2;
+            }
+        }
+
+        for (x = 0; x < out->width * 3; x++)
+            dst[x] = (sum[x] + area / 2) / area;
+    }
+
+    return 0;
+}
+
 static int filter_frame(AVFilterLink *inlink, AVFrame *frame)
 {
-    int i, j;
     AVFilterContext *ctx  = inlink->dst;
     ThumbContext *s   = ctx->priv;
     AVFilterLink *outlink = ctx->outputs[0];
-    int *hist = s->frames[s->n].histogram;
-    const uint8_t *p = frame->data[0];
-
-    // keep a reference of each frame
-    s->frames[s->n].buf = frame;
 
-    // update current frame RGB histogram
-    for (j = 0; j < inlink->h; j++) {
-        for (i = 0; i < inlink->w; i++) {
-            hist[0*256 + p[i*3    ]]++;
-            hist[1*256 + p[i*3 + 1]]++;
-            hist[2*256 + p[i*3 + 2]]++;
+    // compute current frame RGB histogram
+    ff_scene_histogram(&s->scene, frame->data[0], frame->linesize[0],
+                       frame->width * 3, frame->height, s->frames[s->n].histogram);
+
+    // keep a reference of each frame, or a downscaled copy of it
+    if (s->factor_w > 1 || s->factor_h > 1) {
+        ThreadData td;
+        AVFrame *out = ff_get_video_buffer(outlink, outlink->w, outlink->h);
+        if (!out) {
+            av_frame_free(&frame);
+            return AVERROR(ENOMEM);
         }
-        p += frame->linesize[0];
+        av_frame_copy_props(out, frame);
+        td.in  = frame;
+        td.out = out;
+        ctx->internal->execute(ctx, downscale_slice, &td, NULL,
+                               FFMIN(s->nb_threads, outlink->h));
+        av_frame_free(&frame);
+        frame = out;
     }
+    s->frames[s->n].buf = frame;
 
     // no selection until the buffer of N frames is filled up
     s->n++;
@@ -165,6 +228,8 @@ static av_cold void uninit(AVFilterContext *ctx)
     for (i = 0; i < s->n_frames && s->frames[i].buf; i++)
         av_frame_free(&s->frames[i].buf);
     av_freep(&s->frames);
+    ff_scene_uninit(&s->scene);
+    av_freep(&s->thread_sum);
 }
 
 static int request_frame(AVFilterLink *link)
@@ -188,8 +253,41 @@ static int config_props(AVFilterLink *inlink)
 {
     AVFilterContext *ctx = inlink->dst;
     ThumbContext *s = ctx->priv;
+    int factor, ret;
 
     s->tb = inlink->time_base;
+
+    s->nb_threads = ff_filter_get_nb_threads(ctx);
+    ff_scene_uninit(&s->scene);
+    ret = ff_scene_init(&s->scene, ctx, FF_SCENE_HIST, 8, 3, 1);
+    if (ret < 0)
+        return ret;
+
+    factor = 1;
+    if (s->max_w > 0 && s->max_h > 0)
+        factor = FFMAX3(1, (inlink->w + s->max_w - 1) / s->max_w,
+                           (inlink->h + s->max_h - 1) / s->max_h);
+    // keep the aspect ratio unless a dimension would drop below one pixel
+    s->factor_w = FFMIN(factor, inlink->w);
+    s->factor_h = FFMIN(factor, inlink->h);
+    return 0;
+}
+
+static int config_output(AVFilterLink *outlink)
+{
+    AVFilterContext *ctx = outlink->src;
+    AVFilterLink *inlink = ctx->inputs[0];
+    ThumbContext *s = ctx->priv;
+
+    if (s->factor_w > 1 || s->factor_h > 1) {
+        outlink->w = inlink->w / s->factor_w;
+        outlink->h = inlink->h / s->factor_h;
+        s->thread_sum = av_calloc(s->nb_threads, outlink->w * 3 * sizeof(*s->thread_sum));
+        if (!s->thread_sum)
+            return AVERROR(ENOMEM);
+        av_log(ctx, AV_LOG_VERBOSE, "candidates downscaled by %dx%d to %dx%d\n",
+               s->factor_w, s->factor_h, outlink->w, outlink->h);
+    }
     return 0;
 }
 
@@ -220,6 +318,7 @@ static const AVFilterPad thumbnail_outputs[] = {
         .name          = "default",
         .type          = AVMEDIA_TYPE_VIDEO,
         .request_frame = request_frame,
+        .config_props  = config_output,
     },
     { NULL }
 };
@@ -234,4 +333,5 @@ AVFilter ff_vf_thumbnail = {
     .inputs        = thumbnail_inputs,
     .outputs       = thumbnail_outputs,
     .priv_class    = &thumbnail_class,
+    .flags         = AVFILTER_FLAG_SLICE_THREADS,
 };
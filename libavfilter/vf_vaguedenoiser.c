@@ -52,6 +52,8 @@ typedef struct VagueDenoiserContext {
     float *in;
     float *out;
     float *tmp;
+    int nb_threads;
+    int scratch_size;
 
     int hlowsize[4][32];
     int hhighsize[4][32];
@@ -60,7 +62,8 @@ typedef struct VagueDenoiserContext {
 
     void (*thresholding)(float *block, const int width, const int height,
                          const int stride, const float threshold,
-                         const float percent, const int nsteps);
+                         const float percent, const int nsteps,
+                         const int slice_start, const int slice_end);
 } VagueDenoiserContext;
 
 #define OFFSET(x) offsetof(VagueDenoiserContext, x)
@@ -131,7 +134,8 @@ static int query_formats(AVFilterContext *ctx)
 
 static int config_input(AVFilterLink *inlink)
 {
-    VagueDenoiserContext *s = inlink->dst->priv;
+    AVFilterContext *ctx = inlink->dst;
+    VagueDenoiserContext *s = ctx->priv;
     const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(inlink->format);
     int p, i, nsteps_width, nsteps_height, nsteps_max;
 
@@ -144,10 +148,13 @@ static int config_input(AVFilterLink *inlink)
     s->planewidth[1]  = s->planewidth[2]  = AV_CEIL_RSHIFT(inlink->w, desc->log2_chroma_w);
     s->planewidth[0]  = s->planewidth[3]  = inlink->w;
 
+    s->nb_threads   = ff_filter_get_nb_threads(ctx);
+    s->scratch_size = 32 + FFMAX(inlink->w, inlink->h);
+
     s->block = av_malloc_array(inlink->w * inlink->h, sizeof(*s->block));
-    s->in    = av_malloc_array(32 + FFMAX(inlink->w, inlink->h), sizeof(*s->in));
-    s->out   = av_malloc_array(32 + FFMAX(inlink->w, inlink->h), sizeof(*s->out));
-    s->tmp   = av_malloc_array(32 + FFMAX(inlink->w, inlink->h), sizeof(*s->tmp));
+    s->in    = av_malloc_array(s->scratch_size, s->nb_threads * sizeof(*s->in));
+    s->out   = av_malloc_array(s->scratch_size, s->nb_threads * sizeof(*s->out));
+    s->tmp   = av_malloc_array(s->scratch_size, s->nb_threads * sizeof(*s->tmp));
 
     if (!s->block || !s->in || !s->out || !s->tmp)
         return AVERROR(ENOMEM);
@@ -328,12 +335,14 @@ static void invert_step(const float *input, float *output, float *temp, const in
 
 static void hard_thresholding(float *block, const int width, const int height,
                               const int stride, const float threshold,
-                              const float percent, const int unused)
+                              const float percent, const int unused,
+                              const int slice_start, const int slice_end)
 {
     const float frac = 1.f - percent * 0.01f;
     int y, x;
 
-    for (y = 0; y < height; y++) {
+    block += stride * slice_start;
+    for (y = slice_start; y < slice_end; y++) {
         for (x = 0; x < width; x++) {
             if (FFABS(block[x]) <= threshold)
                 block[x] *= frac;
@@ -343,7 +352,8 @@ static void hard_thresholding(float *block, const int width, const int height,
 }
 
 static void soft_thresholding(float *block, const int width, const int height, const int stride,
-                              const float threshold, const float percent, const int nsteps)
+                              const float threshold, const float percent, const int nsteps,
+                              const int slice_start, const int slice_end)
 {
     const float frac = 1.f - percent * 0.01f;
     const float shift = threshold * 0.01f * percent;
@@ -356,7 +366,8 @@ static void soft_thresholding(float *block, const int width, const int height, c
         h = (h + 1) >> 1;
     }
 
-    for (y = 0; y < height; y++) {
+    block += stride * slice_start;
+    for (y = slice_start; y < slice_end; y++) {
         const int x0 = (y < h) ? w : 0;
         for (x = x0; x < width; x++) {
             const float temp = FFABS(block[x]);
@@ -371,14 +382,16 @@ static void soft_thresholding(float *block, const int width, const int height, c
 
 static void qian_thresholding(float *block, const int width, const int height,
                               const int stride, const float threshold,
-                              const float percent, const int unused)
+                              const float percent, const int unused,
+                              const int slice_start, const int slice_end)
 {
     const float percent01 = percent * 0.01f;
     const float tr2 = threshold * threshold * percent01;
     const float frac = 1.f - percent01;
     int y, x;
 
-    for (y = 0; y < height; y++) {
+    block += stride * slice_start;
+    for (y = slice_start; y < slice_end; y++) {
         for (x = 0; x < width; x++) {
             const float temp = FFABS(block[x]);
             if (temp <= threshold) {
@@ -392,23 +405,203 @@ static void qian_thresholding(float *block, const int width, const int height,
     }
 }
 
-static void filter(VagueDenoiserContext *s, AVFrame *in, AVFrame *out)
+typedef struct ThreadData {
+    AVFrame *in, *out;
+    int plane;
+    int width, height;
+    int hsize, vsize;   ///< size of the area transformed at the current level
+} ThreadData;
+
+static int import_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    VagueDenoiserContext *s = ctx->priv;
+    ThreadData *td = arg;
+    const int p = td->plane;
+    const int width = td->width;
+    const int slice_start = (td->height *  jobnr   ) / nb_jobs;
+    const int slice_end   = (td->height * (jobnr+1)) / nb_jobs;
+    const int linesize = td->in->linesize[p];
+    float *output = s->block + slice_start * width;
+    int x, y;
+
+    if (s->depth <= 8) {
+        const uint8_t *srcp8 = td->in->data[p] + slice_start * linesize;
+
+        for (y = slice_start; y < slice_end; y++) {
+            for (x = 0; x < width; x++)
+                output[x] = srcp8[x];
+            srcp8 += linesize;
+            output += width;
+        }
+    } else {
+        const uint16_t *srcp16 = (const uint16_t *)(td->in->data[p] + slice_start * linesize);
+
+        for (y = slice_start; y < slice_end; y++) {
+            for (x = 0; x < width; x++)
+                output[x] = srcp16[x];
+            srcp16 += linesize / 2;
+            output += width;
+        }
+    }
+
+    return 0;
+}
+
+static int transform_rows(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    VagueDenoiserContext *s = ctx->priv;
+    ThreadData *td = arg;
+    const int width = td->width;
+    const int h_low_size0 = td->hsize;
+    const int low_size = (h_low_size0 + 1) >> 1;
+    const int slice_start = (td->vsize *  jobnr   ) / nb_jobs;
+    const int slice_end   = (td->vsize * (jobnr+1)) / nb_jobs;
+    float *in  = s->in  + jobnr * s->scratch_size;
+    float *out = s->out + jobnr * s->scratch_size;
+    float *input = s->block + slice_start * width;
+    int j;
+
+    for (j = slice_start; j < slice_end; j++) {
+        copy(input, in + NPAD, h_low_size0);
+        transform_step(in, out, h_low_size0, low_size, s);
+        copy(out + NPAD, input, h_low_size0);
+        input += width;
+    }
+
+    return 0;
+}
+
+static int transform_columns(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    VagueDenoiserContext *s = ctx->priv;
+    ThreadData *td = arg;
+    const int width = td->width;
+    const int v_low_size0 = td->vsize;
+    const int low_size = (v_low_size0 + 1) >> 1;
+    const int slice_start = (td->hsize *  jobnr   ) / nb_jobs;
+    const int slice_end   = (td->hsize * (jobnr+1)) / nb_jobs;
+    float *in  = s->in  + jobnr * s->scratch_size;
+    float *out = s->out + jobnr * s->scratch_size;
+    float *input = s->block + slice_start;
+    int j;
+
+    for (j = slice_start; j < slice_end; j++) {
+        copyv(input, width, in + NPAD, v_low_size0);
+        transform_step(in, out, v_low_size0, low_size, s);
+        copyh(out + NPAD, input, width, v_low_size0);
+        input++;
+    }
+
+    return 0;
+}
+
+static int threshold_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    VagueDenoiserContext *s = ctx->priv;
+    ThreadData *td = arg;
+    const int slice_start = (td->height *  jobnr   ) / nb_jobs;
+    const int slice_end   = (td->height * (jobnr+1)) / nb_jobs;
+
+    s->thresholding(s->block, td->width, td->height, td->width, s->threshold,
+                    s->percent, s->nsteps, slice_start, slice_end);
+
+    return 0;
+}
+
+static int invert_columns(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    VagueDenoiserContext *s = ctx->priv;
+    ThreadData *td = arg;
+    const int width = td->width;
+    const int idx = td->vsize;
+    const int slice_start = (td->hsize *  jobnr   ) / nb_jobs;
+    const int slice_end   = (td->hsize * (jobnr+1)) / nb_jobs;
+    float *in  = s->in  + jobnr * s->scratch_size;
+    float *out = s->out + jobnr * s->scratch_size;
+    float *tmp = s->tmp + jobnr * s->scratch_size;
+    float *idx3 = s->block + slice_start;
+    int i;
+
+    for (i = slice_start; i < slice_end; i++) {
+        copyv(idx3, width, in + NPAD, idx);
+        invert_step(in, out, tmp, idx, s);
+        copyh(out + NPAD, idx3, width, idx);
+        idx3++;
+    }
+
+    return 0;
+}
+
+static int invert_rows(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    VagueDenoiserContext *s = ctx->priv;
+    ThreadData *td = arg;
+    const int width = td->width;
+    const int idx2 = td->hsize;
+    const int slice_start = (td->vsize *  jobnr   ) / nb_jobs;
+    const int slice_end   = (td->vsize * (jobnr+1)) / nb_jobs;
+    float *in  = s->in  + jobnr * s->scratch_size;
+    float *out = s->out + jobnr * s->scratch_size;
+    float *tmp = s->tmp + jobnr * s->scratch_size;
+    float *idx3 = s->block + slice_start * width;
+    int i;
+
+    for (i = slice_start; i < slice_end; i++) {
+        copy(idx3, in + NPAD, idx2);
+        invert_step(in, out, tmp, idx2, s);
+        copy(out + NPAD, idx3, idx2);
+        idx3 += width;
+    }
+
+    return 0;
+}
+
+static int export_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
 {
-    int p, y, x, i, j;
+    VagueDenoiserContext *s = ctx->priv;
+    ThreadData *td = arg;
+    const int p = td->plane;
+    const int width = td->width;
+    const int slice_start = (td->height *  jobnr   ) / nb_jobs;
+    const int slice_end   = (td->height * (jobnr+1)) / nb_jobs;
+    const int linesize = td->out->linesize[p];
+    const float *input = s->block + slice_start * width;
+    int x, y;
+
+    if (s->depth <= 8) {
+        uint8_t *dstp8 = td->out->data[p] + slice_start * linesize;
+
+        for (y = slice_start; y < slice_end; y++) {
+            for (x = 0; x < width; x++)
+                dstp8[x] = av_clip_uint8(input[x] + 0.5f);
+            input += width;
+            dstp8 += linesize;
+        }
+    } else {
+        uint16_t *dstp16 = (uint16_t *)(td->out->data[p] + slice_start * linesize);
+
+        for (y = slice_start; y < slice_end; y++) {
+            for (x = 0; x < width; x++)
+                dstp16[x] = av_clip(input[x] + 0.5f, 0, s->peak);
+            input += width;
+            dstp16 += linesize / 2;
+        }
+    }
+
+    return 0;
+}
+
+static void filter(AVFilterContext *ctx, AVFrame *in, AVFrame *out)
+{
+    VagueDenoiserContext *s = ctx->priv;
+    int p;
 
     for (p = 0; p < s->nb_planes; p++) {
         const int height = s->planeheight[p];
         const int width = s->planewidth[p];
-        const uint8_t *srcp8 = in->data[p];
-        const uint16_t *srcp16 = (const uint16_t *)in->data[p];
-        uint8_t *dstp8 = out->data[p];
-        uint16_t *dstp16 = (uint16_t *)out->data[p];
-        float *output = s->block;
-        int h_low_size0 = width;
-        int v_low_size0 = height;
         int nsteps_transform = s->nsteps;
         int nsteps_invert = s->nsteps;
-        const float *input = s->block;
+        ThreadData td;
 
         if (!((1 << p) & s->planes)) {
             av_image_copy_plane(out->data[p], out->linesize[p], in->data[p], in->linesize[p],
@@ -416,89 +609,50 @@ static void filter(VagueDenoiserContext *s, AVFrame *in, AVFrame *out)
             continue;
         }
 
-        if (s->depth <= 8) {
-            for (y = 0; y < height; y++) {
-                for (x = 0; x < width; x++)
-                    output[x] = srcp8[x];
-                srcp8 += in->linesize[p];
-                output += width;
-            }
-        } else {
-            for (y = 0; y < height; y++) {
-                for (x = 0; x < width; x++)
-                    output[x] = srcp16[x];
-                srcp16 += in->linesize[p] / 2;
-                output += width;
-            }
-        }
+        td.in = in;
+        td.out = out;
+        td.plane = p;
+        td.width = width;
+        td.height = height;
+        td.hsize = width;
+        td.vsize = height;
 
-        while (nsteps_transform--) {
-            int low_size = (h_low_size0 + 1) >> 1;
-            float *input = s->block;
-            for (j = 0; j < v_low_size0; j++) {
-                copy(input, s->in + NPAD, h_low_size0);
-                transform_step(s->in, s->out, h_low_size0, low_size, s);
-                copy(s->out + NPAD, input, h_low_size0);
-                input += width;
-            }
+        ctx->internal->execute(ctx, import_slice, &td, NULL,
+                               FFMIN(height, s->nb_threads));
 
-            low_size = (v_low_size0 + 1) >> 1;
-            input = s->block;
-            for (j = 0; j < h_low_size0; j++) {
-                copyv(input, width, s->in + NPAD, v_low_size0);
-                transform_step(s->in, s->out, v_low_size0, low_size, s);
-                copyh(s->out + NPAD, input, width, v_low_size0);
-                input++;
-            }
+        /* Rows and columns of one level are independent of each other, the
+         * levels and the two passes of a level have to run in order. */
+        while (nsteps_transform--) {
+            ctx->internal->execute(ctx, transform_rows, &td, NULL,
+                                   FFMIN(td.vsize, s->nb_threads));
+            ctx->internal->execute(ctx, transform_columns, &td, NULL,
+                                   FFMIN(td.hsize, s->nb_threads));
 
-            h_low_size0 = (h_low_size0 + 1) >> 1;
-            v_low_size0 = (v_low_size0 + 1) >> 1;
+            td.hsize = (td.hsize + 1) >> 1;
+            td.vsize = (td.vsize + 1) >> 1;
         }
 
-        s->thresholding(s->block, width, height, width, s->threshold, s->percent, s->nsteps);
+        ctx->internal->execute(ctx, threshold_slice, &td, NULL,
+                               FFMIN(height, s->nb_threads));
 
         while (nsteps_invert--) {
-            const int idx = s->vlowsize[p][nsteps_invert]  + s->vhighsize[p][nsteps_invert];
-            const int idx2 = s->hlowsize[p][nsteps_invert] + s->hhighsize[p][nsteps_invert];
-            float * idx3 = s->block;
-            for (i = 0; i < idx2; i++) {
-                copyv(idx3, width, s->in + NPAD, idx);
-                invert_step(s->in, s->out, s->tmp, idx, s);
-                copyh(s->out + NPAD, idx3, width, idx);
-                idx3++;
-            }
+            td.vsize = s->vlowsize[p][nsteps_invert] + s->vhighsize[p][nsteps_invert];
+            td.hsize = s->hlowsize[p][nsteps_invert] + s->hhighsize[p][nsteps_invert];
 
-            idx3 = s->block;
-            for (i = 0; i < idx; i++) {
-                copy(idx3, s->in + NPAD, idx2);
-                invert_step(s->in, s->out, s->tmp, idx2, s);
-                copy(s->out + NPAD, idx3, idx2);
-                idx3 += width;
-            }
+            ctx->internal->execute(ctx, invert_columns, &td, NULL,
+                                   FFMIN(td.hsize, s->nb_threads));
+            ctx->internal->execute(ctx, invert_rows, &td, NULL,
+                                   FFMIN(td.vsize, s->nb_threads));
         }
 
-        if (s->depth <= 8) {
-            for (y = 0; y < height; y++) {
-                for (x = 0; x < width; x++)
-                    dstp8[x] = av_clip_uint8(input[x] + 0.5f);
-                input += width;
-                dstp8 += out->linesize[p];
-            }
-        } else {
-            for (y = 0; y < height; y++) {
-                for (x = 0; x < width; x++)
-                    dstp16[x] = av_clip(input[x] + 0.5f, 0, s->peak);
-                input += width;
-                dstp16 += out->linesize[p] / 2;
-            }
-        }
+        ctx->internal->execute(ctx, export_slice, &td, NULL,
+                               FFMIN(height, s->nb_threads));
     }
 }
 
 static int filter_frame(AVFilterLink *inlink, AVFrame *in)
 {
     AVFilterContext *ctx  = inlink->dst;
-    VagueDenoiserContext *s = ctx->priv;
     AVFilterLink *outlink = ctx->outputs[0];
     AVFrame *out;
     int direct = av_frame_is_writable(in);
@@ -515,7 +669,7 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *in)
         av_frame_copy_props(out, in);
     }
 
-    filter(s, in, out);
+    filter(ctx, in, out);
 
     if (!direct)
         av_frame_free(&in);
@@ -581,5 +735,5 @@ AVFilter ff_vf_vaguedenoiser = {
     .query_formats = query_formats,
     .inputs        = vaguedenoiser_inputs,
     .outputs       = vaguedenoiser_outputs,
-    .flags         = AVFILTER_FLAG_SUPPORT_TIMELINE_GENERIC,
+    .flags         = AVFILTER_FLAG_SUPPORT_TIMELINE_GENERIC | AVFILTER_FLAG_SLICE_THREADS,
 };
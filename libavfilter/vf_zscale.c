@@ -74,6 +74,43 @@ enum var_name {
     VARS_NB
 };
 
+#define MAX_THREADS      32
+#define GRAPH_CACHE_SIZE 4
+
+/**
+ * Frame properties the zimg graphs are built for.
+ */
+typedef struct ZScaleKey {
+    int in_w, in_h, in_format;
+    int out_w, out_h, out_format;
+    int colorspace;
+    int trc;
+    int primaries;
+    int range;
+    int chroma_location;
+} ZScaleKey;
+
+/**
+ * zimg graphs converting frames with the same properties, one per
+ * horizontal tile.
+ */
+typedef struct ZScaleGraphs {
+    ZScaleKey key;
+    unsigned last_use;
+
+    zimg_image_format src_format, dst_format;
+    int nb_slices;
+    int slice_start[MAX_THREADS + 1];   ///< first output row of each tile
+    zimg_filter_graph *graph[MAX_THREADS];
+    zimg_filter_graph *alpha_graph[MAX_THREADS];
+    size_t tmp_size;
+} ZScaleGraphs;
+
+typedef struct ThreadData {
+    AVFrame *in, *out;
+    const ZScaleGraphs *graphs;
+} ThreadData;
+
 typedef struct ZScaleContext {
     const AVClass *class;
 
@@ -110,19 +147,16 @@ typedef struct ZScaleContext {
 
     int force_original_aspect_ratio;
 
-    void *tmp;
-    size_t tmp_size;
+    void *tmp[MAX_THREADS];
+    size_t tmp_size[MAX_THREADS];
 
-    zimg_image_format src_format, dst_format;
-    zimg_image_format alpha_src_format, alpha_dst_format;
-    zimg_graph_builder_params alpha_params, params;
-    zimg_filter_graph *alpha_graph, *graph;
-
-    enum AVColorSpace in_colorspace, out_colorspace;
-    enum AVColorTransferCharacteristic in_trc, out_trc;
-    enum AVColorPrimaries in_primaries, out_primaries;
-    enum AVColorRange in_range, out_range;
-    enum AVChromaLocation in_chromal, out_chromal;
+    /**
+     * Graphs built for the last frame properties seen, so that streams
+     * alternating between a few of them do not rebuild graphs every time.
+     */
+    ZScaleGraphs cache[GRAPH_CACHE_SIZE];
+    int nb_cached;
+    unsigned use_count;
 } ZScaleContext;
 
 static av_cold int init_dict(AVFilterContext *ctx, AVDictionary **opts)
@@ -457,7 +491,7 @@ static int convert_range(enum AVColorRange color_range)
     return ZIMG_RANGE_LIMITED;
 }
 
-static void format_init(zimg_image_format *format, AVFrame *frame, const AVPixFmtDescriptor *desc,
+static void format_init(zimg_image_format *format, const AVFrame *frame, const AVPixFmtDescriptor *desc,
                         int colorspace, int primaries, int transfer, int range, int location)
 {
     format->width = frame->width;
@@ -474,209 +508,348 @@ static void format_init(zimg_image_format *format, AVFrame *frame, const AVPixFm
     format->chroma_location = location == -1 ? convert_chroma_location(frame->chroma_location) : location;
 }
 
-static int graph_build(zimg_filter_graph **graph, zimg_graph_builder_params *params,
-                       zimg_image_format *src_format, zimg_image_format *dst_format,
-                       void **tmp, size_t *tmp_size)
+static void graphs_free(ZScaleGraphs *g)
+{
+    int i;
+
+    for (i = 0; i < g->nb_slices; i++) {
+        zimg_filter_graph_free(g->graph[i]);
+        zimg_filter_graph_free(g->alpha_graph[i]);
+        g->graph[i] = g->alpha_graph[i] = NULL;
+    }
+    g->nb_slices = 0;
+}
+
+static int graph_build(AVFilterContext *ctx, zimg_filter_graph **graph,
+                       const zimg_graph_builder_params *params,
+                       const zimg_image_format *src_format,
+                       const zimg_image_format *dst_format, size_t *tmp_size)
 {
-    int ret;
     size_t size;
 
-    zimg_filter_graph_free(*graph);
     *graph = zimg_filter_graph_build(src_format, dst_format, params);
     if (!*graph)
-        return print_zimg_error(NULL);
-
-    ret = zimg_filter_graph_get_tmp_size(*graph, &size);
-    if (ret)
-        return print_zimg_error(NULL);
+        return print_zimg_error(ctx);
 
-    if (size > *tmp_size) {
-        av_freep(tmp);
-        *tmp = av_malloc(size);
-        if (!*tmp)
-            return AVERROR(ENOMEM);
-
-        *tmp_size = size;
-    }
+    if (zimg_filter_graph_get_tmp_size(*graph, &size))
+        return print_zimg_error(ctx);
+    *tmp_size = FFMAX(*tmp_size, size);
 
     return 0;
 }
 
-static int filter_frame(AVFilterLink *link, AVFrame *in)
+/**
+ * Set the source active region and the destination height of the tile
+ * producing output rows start to end - 1.
+ */
+static void tile_format(zimg_image_format *src_tile, zimg_image_format *dst_tile,
+                        const zimg_image_format *src, const zimg_image_format *dst,
+                        int start, int end)
 {
-    ZScaleContext *s = link->dst->priv;
-    AVFilterLink *outlink = link->dst->outputs[0];
-    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(link->format);
-    const AVPixFmtDescriptor *odesc = av_pix_fmt_desc_get(outlink->format);
-    zimg_image_buffer_const src_buf = { ZIMG_API_VERSION };
-    zimg_image_buffer dst_buf = { ZIMG_API_VERSION };
-    char buf[32];
-    int ret = 0, plane;
-    AVFrame *out;
+    *src_tile = *src;
+    *dst_tile = *dst;
+    src_tile->active_region.left   = 0;
+    src_tile->active_region.width  = src->width;
+    src_tile->active_region.top    = start      * (double)src->height / dst->height;
+    src_tile->active_region.height = (end - start) * (double)src->height / dst->height;
+    dst_tile->height = end - start;
+}
 
-    out = ff_get_video_buffer(outlink, outlink->w, outlink->h);
-    if (!out) {
-        av_frame_free(&in);
-        return AVERROR(ENOMEM);
+static int graphs_build(AVFilterContext *ctx, ZScaleGraphs *g,
+                        const AVFrame *in, const AVFrame *out)
+{
+    ZScaleContext *s = ctx->priv;
+    const AVPixFmtDescriptor *desc  = av_pix_fmt_desc_get(in->format);
+    const AVPixFmtDescriptor *odesc = av_pix_fmt_desc_get(out->format);
+    const int alpha = desc->flags & AV_PIX_FMT_FLAG_ALPHA && odesc->flags & AV_PIX_FMT_FLAG_ALPHA;
+    /* tiles must start on a chroma row of both frames */
+    const int align = 1 << FFMAX(desc->log2_chroma_h, odesc->log2_chroma_h);
+    zimg_image_format alpha_src_format, alpha_dst_format;
+    zimg_graph_builder_params params, alpha_params;
+    int i, nb_slices, ret;
+
+    zimg_image_format_default(&g->src_format, ZIMG_API_VERSION);
+    zimg_image_format_default(&g->dst_format, ZIMG_API_VERSION);
+    zimg_graph_builder_params_default(&params, ZIMG_API_VERSION);
+
+    params.dither_type = s->dither;
+    params.cpu_type = ZIMG_CPU_AUTO;
+    params.resample_filter = s->filter;
+    params.resample_filter_uv = s->filter;
+    params.nominal_peak_luminance = s->nominal_peak_luminance;
+    params.allow_approximate_gamma = s->approximate_gamma;
+
+    format_init(&g->src_format, in, desc, s->colorspace_in,
+                s->primaries_in, s->trc_in, s->range_in, s->chromal_in);
+    format_init(&g->dst_format, out, odesc, s->colorspace,
+                s->primaries, s->trc, s->range, s->chromal);
+
+    if (alpha) {
+        zimg_image_format_default(&alpha_src_format, ZIMG_API_VERSION);
+        zimg_image_format_default(&alpha_dst_format, ZIMG_API_VERSION);
+        zimg_graph_builder_params_default(&alpha_params, ZIMG_API_VERSION);
+
+        alpha_params.dither_type = s->dither;
+        alpha_params.cpu_type = ZIMG_CPU_AUTO;
+        alpha_params.resample_filter = s->filter;
+
+        alpha_src_format.width = in->width;
+        alpha_src_format.height = in->height;
+        alpha_src_format.depth = desc->comp[0].depth;
+        alpha_src_format.pixel_type = (desc->flags & AV_PIX_FMT_FLAG_FLOAT) ? ZIMG_PIXEL_FLOAT : desc->comp[0].depth > 8 ? ZIMG_PIXEL_WORD : ZIMG_PIXEL_BYTE;
+        alpha_src_format.color_family = ZIMG_COLOR_GREY;
+
+        alpha_dst_format.width = out->width;
+        alpha_dst_format.height = out->height;
+        alpha_dst_format.depth = odesc->comp[0].depth;
+        alpha_dst_format.pixel_type = (odesc->flags & AV_PIX_FMT_FLAG_FLOAT) ? ZIMG_PIXEL_FLOAT : odesc->comp[0].depth > 8 ? ZIMG_PIXEL_WORD : ZIMG_PIXEL_BYTE;
+        alpha_dst_format.color_family = ZIMG_COLOR_GREY;
     }
 
-    av_frame_copy_props(out, in);
-    out->width  = outlink->w;
-    out->height = outlink->h;
-
-    if(   in->width  != link->w
-       || in->height != link->h
-       || in->format != link->format
-       || s->in_colorspace != in->colorspace
-       || s->in_trc  != in->color_trc
-       || s->in_primaries != in->color_primaries
-       || s->in_range != in->color_range
-       || s->out_colorspace != out->colorspace
-       || s->out_trc  != out->color_trc
-       || s->out_primaries != out->color_primaries
-       || s->out_range != out->color_range
-       || s->in_chromal != in->chroma_location
-       || s->out_chromal != out->chroma_location) {
-        snprintf(buf, sizeof(buf)-1, "%d", outlink->w);
-        av_opt_set(s, "w", buf, 0);
-        snprintf(buf, sizeof(buf)-1, "%d", outlink->h);
-        av_opt_set(s, "h", buf, 0);
-
-        link->dst->inputs[0]->format = in->format;
-        link->dst->inputs[0]->w      = in->width;
-        link->dst->inputs[0]->h      = in->height;
-
-        if ((ret = config_props(outlink)) < 0) {
-            av_frame_free(&in);
-            av_frame_free(&out);
-            return ret;
+    /* Dithering restarts its pattern, its noise and its error diffusion at
+     * the first row of each tile, so the output would depend on the number
+     * of threads. */
+    nb_slices = s->dither != ZIMG_DITHER_NONE ? 1 :
+                FFMIN(ff_filter_get_nb_threads(ctx), MAX_THREADS);
+    nb_slices = av_clip(FFMIN(nb_slices, out->height / (16 * align)), 1, MAX_THREADS);
+
+    g->tmp_size = 0;
+    g->slice_start[0] = 0;
+    for (i = 1; i < nb_slices; i++)
+        g->slice_start[i] = out->height * i / nb_slices / align * align;
+    g->slice_start[nb_slices] = out->height;
+
+    for (i = 0; i < nb_slices; i++) {
+        zimg_image_format src_tile, dst_tile;
+
+        g->nb_slices = i + 1;
+        if (nb_slices == 1) {
+            src_tile = g->src_format;
+            dst_tile = g->dst_format;
+        } else {
+            tile_format(&src_tile, &dst_tile, &g->src_format, &g->dst_format,
+                        g->slice_start[i], g->slice_start[i + 1]);
         }
+        ret = graph_build(ctx, &g->graph[i], &params, &src_tile, &dst_tile,
+                          &g->tmp_size);
+        if (ret < 0)
+            goto fail;
 
-        zimg_image_format_default(&s->src_format, ZIMG_API_VERSION);
-        zimg_image_format_default(&s->dst_format, ZIMG_API_VERSION);
-        zimg_graph_builder_params_default(&s->params, ZIMG_API_VERSION);
-
-        s->params.dither_type = s->dither;
-        s->params.cpu_type = ZIMG_CPU_AUTO;
-        s->params.resample_filter = s->filter;
-        s->params.resample_filter_uv = s->filter;
-        s->params.nominal_peak_luminance = s->nominal_peak_luminance;
-        s->params.allow_approximate_gamma = s->approximate_gamma;
-
-        format_init(&s->src_format, in, desc, s->colorspace_in,
-                    s->primaries_in, s->trc_in, s->range_in, s->chromal_in);
-        format_init(&s->dst_format, out, odesc, s->colorspace,
-                    s->primaries, s->trc, s->range, s->chromal);
-
-        if (s->colorspace != -1)
-            out->colorspace = (int)s->dst_format.matrix_coefficients;
-
-        if (s->primaries != -1)
-            out->color_primaries = (int)s->dst_format.color_primaries;
-
-        if (s->range != -1)
-            out->color_range = (int)s->dst_format.pixel_range + 1;
-
-        if (s->trc != -1)
-            out->color_trc = (int)s->dst_format.transfer_characteristics;
-
-        if (s->chromal != -1)
-            out->chroma_location = (int)s->dst_format.chroma_location - 1;
-
-        ret = graph_build(&s->graph, &s->params, &s->src_format, &s->dst_format,
-                          &s->tmp, &s->tmp_size);
+        if (!alpha)
+            continue;
+        if (nb_slices == 1) {
+            src_tile = alpha_src_format;
+            dst_tile = alpha_dst_format;
+        } else {
+            tile_format(&src_tile, &dst_tile, &alpha_src_format, &alpha_dst_format,
+                        g->slice_start[i], g->slice_start[i + 1]);
+        }
+        ret = graph_build(ctx, &g->alpha_graph[i], &alpha_params, &src_tile, &dst_tile,
+                          &g->tmp_size);
         if (ret < 0)
             goto fail;
+    }
 
-        s->in_colorspace  = in->colorspace;
-        s->in_trc         = in->color_trc;
-        s->in_primaries   = in->color_primaries;
-        s->in_range       = in->color_range;
-        s->out_colorspace = out->colorspace;
-        s->out_trc        = out->color_trc;
-        s->out_primaries  = out->color_primaries;
-        s->out_range      = out->color_range;
-
-        if (desc->flags & AV_PIX_FMT_FLAG_ALPHA && odesc->flags & AV_PIX_FMT_FLAG_ALPHA) {
-            zimg_image_format_default(&s->alpha_src_format, ZIMG_API_VERSION);
-            zimg_image_format_default(&s->alpha_dst_format, ZIMG_API_VERSION);
-            zimg_graph_builder_params_default(&s->alpha_params, ZIMG_API_VERSION);
-
-            s->alpha_params.dither_type = s->dither;
-            s->alpha_params.cpu_type = ZIMG_CPU_AUTO;
-            s->alpha_params.resample_filter = s->filter;
-
-            s->alpha_src_format.width = in->width;
-            s->alpha_src_format.height = in->height;
-            s->alpha_src_format.depth = desc->comp[0].depth;
-            s->alpha_src_format.pixel_type = (desc->flags & AV_PIX_FMT_FLAG_FLOAT) ? ZIMG_PIXEL_FLOAT : desc->comp[0].depth > 8 ? ZIMG_PIXEL_WORD : ZIMG_PIXEL_BYTE;
-            s->alpha_src_format.color_family = ZIMG_COLOR_GREY;
-
-            s->alpha_dst_format.width = out->width;
-            s->alpha_dst_format.height = out->height;
-            s->alpha_dst_format.depth = odesc->comp[0].depth;
-            s->alpha_dst_format.pixel_type = (odesc->flags & AV_PIX_FMT_FLAG_FLOAT) ? ZIMG_PIXEL_FLOAT : odesc->comp[0].depth > 8 ? ZIMG_PIXEL_WORD : ZIMG_PIXEL_BYTE;
-            s->alpha_dst_format.color_family = ZIMG_COLOR_GREY;
-
-            zimg_filter_graph_free(s->alpha_graph);
-            s->alpha_graph = zimg_filter_graph_build(&s->alpha_src_format, &s->alpha_dst_format, &s->alpha_params);
-            if (!s->alpha_graph) {
-                ret = print_zimg_error(link->dst);
+    for (i = 0; i < nb_slices; i++) {
+        if (g->tmp_size > s->tmp_size[i]) {
+            av_freep(&s->tmp[i]);
+            s->tmp_size[i] = 0;
+            s->tmp[i] = av_malloc(g->tmp_size);
+            if (!s->tmp[i]) {
+                ret = AVERROR(ENOMEM);
                 goto fail;
             }
+            s->tmp_size[i] = g->tmp_size;
         }
     }
 
-    if (s->colorspace != -1)
-        out->colorspace = (int)s->dst_format.matrix_coefficients;
+    av_log(ctx, AV_LOG_DEBUG, "Built graphs for %dx%d %s -> %dx%d %s in %d tiles\n",
+           in->width, in->height, desc->name, out->width, out->height,
+           odesc->name, nb_slices);
+    return 0;
 
-    if (s->primaries != -1)
-        out->color_primaries = (int)s->dst_format.color_primaries;
+fail:
+    graphs_free(g);
+    return ret;
+}
 
-    if (s->range != -1)
-        out->color_range = (int)s->dst_format.pixel_range;
+/**
+ * Find the graphs for the properties of a frame in the cache, building them
+ * in place of the least recently used ones if needed.
+ */
+static int get_graphs(AVFilterContext *ctx, const ZScaleGraphs **pg,
+                      const AVFrame *in, const AVFrame *out)
+{
+    ZScaleContext *s = ctx->priv;
+    ZScaleGraphs *g;
+    ZScaleKey key;
+    int i, j, ret;
+
+    memset(&key, 0, sizeof(key));
+    key.in_w            = in->width;
+    key.in_h            = in->height;
+    key.in_format       = in->format;
+    key.out_w           = out->width;
+    key.out_h           = out->height;
+    key.out_format      = out->format;
+    key.colorspace      = in->colorspace;
+    key.trc             = in->color_trc;
+    key.primaries       = in->color_primaries;
+    key.range           = in->color_range;
+    key.chroma_location = in->chroma_location;
+
+    for (i = 0; i < s->nb_cached; i++)
+        if (!memcmp(&s->cache[i].key, &key, sizeof(key)))
+            break;
+
+    if (i == s->nb_cached) {
+        if (s->nb_cached < GRAPH_CACHE_SIZE) {
+            s->nb_cached++;
+        } else {
+            for (i = 0, j = 1; j < GRAPH_CACHE_SIZE; j++)
+                if (s->cache[j].last_use < s->cache[i].last_use)
+                    i = j;
+        }
+        g = &s->cache[i];
+        graphs_free(g);
+        if ((ret = graphs_build(ctx, g, in, out)) < 0) {
+            g->key.in_w = 0;
+            return ret;
+        }
+        g->key = key;
+    }
 
-    if (s->trc != -1)
-        out->color_trc = (int)s->dst_format.transfer_characteristics;
+    g = &s->cache[i];
+    g->last_use = ++s->use_count;
+    *pg = g;
+    return 0;
+}
 
-    av_reduce(&out->sample_aspect_ratio.num, &out->sample_aspect_ratio.den,
-              (int64_t)in->sample_aspect_ratio.num * outlink->h * link->w,
-              (int64_t)in->sample_aspect_ratio.den * outlink->w * link->h,
-              INT_MAX);
+static int filter_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    ZScaleContext *s = ctx->priv;
+    ThreadData *td = arg;
+    const ZScaleGraphs *g = td->graphs;
+    const AVFrame *in = td->in;
+    AVFrame *out = td->out;
+    const AVPixFmtDescriptor *desc  = av_pix_fmt_desc_get(in->format);
+    const AVPixFmtDescriptor *odesc = av_pix_fmt_desc_get(out->format);
+    const int start = g->slice_start[jobnr];
+    zimg_image_buffer_const src_buf = { ZIMG_API_VERSION };
+    zimg_image_buffer dst_buf = { ZIMG_API_VERSION };
+    int plane;
 
     for (plane = 0; plane < 3; plane++) {
+        const int vsub = plane == 1 || plane == 2 ? odesc->log2_chroma_h : 0;
         int p = desc->comp[plane].plane;
         src_buf.plane[plane].data   = in->data[p];
         src_buf.plane[plane].stride = in->linesize[p];
         src_buf.plane[plane].mask   = -1;
 
         p = odesc->comp[plane].plane;
-        dst_buf.plane[plane].data   = out->data[p];
+        dst_buf.plane[plane].data   = out->data[p] + (start >> vsub) * out->linesize[p];
         dst_buf.plane[plane].stride = out->linesize[p];
         dst_buf.plane[plane].mask   = -1;
     }
 
-    ret = zimg_filter_graph_process(s->graph, &src_buf, &dst_buf, s->tmp, 0, 0, 0, 0);
-    if (ret) {
-        ret = print_zimg_error(link->dst);
-        goto fail;
-    }
+    if (zimg_filter_graph_process(g->graph[jobnr], &src_buf, &dst_buf,
+                                  s->tmp[jobnr], 0, 0, 0, 0))
+        return print_zimg_error(ctx);
 
-    if (desc->flags & AV_PIX_FMT_FLAG_ALPHA && odesc->flags & AV_PIX_FMT_FLAG_ALPHA) {
+    if (g->alpha_graph[jobnr]) {
         src_buf.plane[0].data   = in->data[3];
         src_buf.plane[0].stride = in->linesize[3];
         src_buf.plane[0].mask   = -1;
 
-        dst_buf.plane[0].data   = out->data[3];
+        dst_buf.plane[0].data   = out->data[3] + start * out->linesize[3];
         dst_buf.plane[0].stride = out->linesize[3];
         dst_buf.plane[0].mask   = -1;
 
-        ret = zimg_filter_graph_process(s->alpha_graph, &src_buf, &dst_buf, s->tmp, 0, 0, 0, 0);
-        if (ret) {
-            ret = print_zimg_error(link->dst);
+        if (zimg_filter_graph_process(g->alpha_graph[jobnr], &src_buf, &dst_buf,
+                                      s->tmp[jobnr], 0, 0, 0, 0))
+            return print_zimg_error(ctx);
+    }
+
+    return 0;
+}
+
+static int filter_frame(AVFilterLink *link, AVFrame *in)
+{
+    AVFilterContext *ctx = link->dst;
+    ZScaleContext *s = ctx->priv;
+    AVFilterLink *outlink = ctx->outputs[0];
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(in->format);
+    const AVPixFmtDescriptor *odesc = av_pix_fmt_desc_get(outlink->format);
+    const ZScaleGraphs *g;
+    ThreadData td;
+    int rets[MAX_THREADS];
+    char buf[32];
+    int ret = 0, i;
+    AVFrame *out;
+
+    if (   in->width  != link->w
+        || in->height != link->h
+        || in->format != link->format) {
+        snprintf(buf, sizeof(buf)-1, "%d", outlink->w);
+        av_opt_set(s, "w", buf, 0);
+        snprintf(buf, sizeof(buf)-1, "%d", outlink->h);
+        av_opt_set(s, "h", buf, 0);
+
+        link->format = in->format;
+        link->w      = in->width;
+        link->h      = in->height;
+
+        if ((ret = config_props(outlink)) < 0) {
+            av_frame_free(&in);
+            return ret;
+        }
+    }
+
+    out = ff_get_video_buffer(outlink, outlink->w, outlink->h);
+    if (!out) {
+        av_frame_free(&in);
+        return AVERROR(ENOMEM);
+    }
+
+    av_frame_copy_props(out, in);
+    out->width  = outlink->w;
+    out->height = outlink->h;
+
+    if ((ret = get_graphs(ctx, &g, in, out)) < 0)
+        goto fail;
+
+    if (s->colorspace != -1)
+        out->colorspace = (int)g->dst_format.matrix_coefficients;
+
+    if (s->primaries != -1)
+        out->color_primaries = (int)g->dst_format.color_primaries;
+
+    if (s->range != -1)
+        out->color_range = (int)g->dst_format.pixel_range + 1;
+
+    if (s->trc != -1)
+        out->color_trc = (int)g->dst_format.transfer_characteristics;
+
+    if (s->chromal != -1)
+        out->chroma_location = (int)g->dst_format.chroma_location - 1;
+
+    av_reduce(&out->sample_aspect_ratio.num, &out->sample_aspect_ratio.den,
+              (int64_t)in->sample_aspect_ratio.num * outlink->h * link->w,
+              (int64_t)in->sample_aspect_ratio.den * outlink->w * link->h,
+              INT_MAX);
+
+    td.in     = in;
+    td.out    = out;
+    td.graphs = g;
+    ctx->internal->execute(ctx, filter_slice, &td, rets, g->nb_slices);
+    for (i = 0; i < g->nb_slices; i++) {
+        if (rets[i] < 0) {
+            ret = rets[i];
             goto fail;
         }
-    } else if (odesc->flags & AV_PIX_FMT_FLAG_ALPHA) {
+    }
+
+    if (!(desc->flags & AV_PIX_FMT_FLAG_ALPHA) && odesc->flags & AV_PIX_FMT_FLAG_ALPHA) {
         int x, y;
 
         if (odesc->flags & AV_PIX_FMT_FLAG_FLOAT) {
@@ -705,11 +878,15 @@ fail:
 static void uninit(AVFilterContext *ctx)
 {
     ZScaleContext *s = ctx->priv;
-
-    zimg_filter_graph_free(s->graph);
-    zimg_filter_graph_free(s->alpha_graph);
-    av_freep(&s->tmp);
-    s->tmp_size = 0;
+    int i;
+
+    for (i = 0; i < s->nb_cached; i++)
+        graphs_free(&s->cache[i]);
+    s->nb_cached = 0;
+    for (i = 0; i < MAX_THREADS; i++) {
+        av_freep(&s->tmp[i]);
+        s->tmp_size[i] = 0;
+    }
 }
 
 static int process_command(AVFilterContext *ctx, const char *cmd, const char *args,
@@ -890,4 +1067,5 @@ AVFilter ff_vf_zscale = {
     .inputs          = avfilter_vf_zscale_inputs,
     .outputs         = avfilter_vf_zscale_outputs,
     .process_command = process_command,
+    .flags           = AVFILTER_FLAG_SLICE_THREADS,
 };
@@ -0,0 +1,301 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * Check all transform types of libavutil/tx against direct O(n^2)
+ * evaluations done in double precision. With -s, the speed of the single
+ * precision transforms is measured instead.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "libavutil/common.h"
+#include "libavutil/lfg.h"
+#include "libavutil/mem.h"
+#include "libavutil/time.h"
+#include "libavutil/tx.h"
+
+enum Kind { KIND_FFT, KIND_MDCT, KIND_RDFT, KIND_DCT };
+enum Sample { SAMPLE_FLT, SAMPLE_DBL, SAMPLE_S32 };
+
+static const char * const kind_names[]   = { "fft", "mdct", "rdft", "dct" };
+static const char * const sample_names[] = { "float", "double", "int32" };
+
+static const enum AVTXType tx_types[3][4] = {
+    { AV_TX_FLOAT_FFT,  AV_TX_FLOAT_MDCT,  AV_TX_FLOAT_RDFT,  AV_TX_FLOAT_DCT  },
+    { AV_TX_DOUBLE_FFT, AV_TX_DOUBLE_MDCT, AV_TX_DOUBLE_RDFT, AV_TX_DOUBLE_DCT },
+    { AV_TX_INT32_FFT,  AV_TX_INT32_MDCT,  AV_TX_INT32_RDFT,  AV_TX_INT32_DCT  },
+};
+
+static const int sample_size[] = { sizeof(float), sizeof(double), sizeof(int32_t) };
+
+/* Maximum error relative to the largest output value */
+static const double max_error[] = { 1e-5, 1e-12, 1e-4 };
+
+static const int lengths[4][10] = {
+    { 4, 8, 16, 32, 48, 60, 80, 256, 960, 2048 },
+    { 8, 16, 32, 64, 96, 120, 160, 256, 480, 1024 },
+    { 8, 16, 32, 64, 96, 120, 160, 512, 960, 2048 },
+    { 8, 16, 32, 64, 96, 120, 160, 512, 960, 2048 },
+};
+
+/* Number of real input and output values of a transform */
+static void get_sizes(enum Kind kind, int inv, int len, int *nb_in, int *nb_out)
+{
+    switch (kind) {
+    case KIND_FFT:  *nb_in = *nb_out = 2*len;                break;
+    case KIND_MDCT: *nb_in = inv ? len : 2*len; *nb_out = len; break;
+    case KIND_RDFT: *nb_in = inv ? len + 2 : len;
+                    *nb_out = inv ? len : len + 2;           break;
+    case KIND_DCT:  *nb_in = *nb_out = len;                  break;
+    }
+}
+
+static void reference(enum Kind kind, int inv, int len, double scale,
+                      double *out, const double *in)
+{
+    switch (kind) {
+    case KIND_FFT:
+        for (int k = 0; k < len; k++) {
+            double re = 0, im = 0;
+            for (int n = 0; n < len; n++) {
+                double a = 2 * M_PI * (int64_t)n * k / len * (inv ? 1 : -1);
+                re += in[2*n] * cos(a) - in[2*n + 1] * sin(a);
+                im += in[2*n] * sin(a) + in[2*n + 1] * cos(a);
+            }
+            out[2*k] = re;
+            out[2*k + 1] = im;
+        }
+        break;
+    case KIND_MDCT:
+        if (!inv) {
+            for (int k = 0; k < len; k++) {
+                double sum = 0;
+                for (int n = 0; n < 2*len; n++)
+                    sum += in[n] * cos(M_PI / len * (n + 0.5 + len / 2.0) * (k + 0.5));
+                out[k] = sum * scale;
+            }
+        } else { /* Middle half of the output, with an inverted sign */
+            for (int n = 0; n < len; n++) {
+                double sum = 0;
+                for (int k = 0; k < len; k++)
+                    sum -= in[k] * cos(M_PI / len * (n + len + 0.5) * (k + 0.5));
+                out[n] = sum * scale;
+            }
+        }
+        break;
+    case KIND_RDFT:
+        if (!inv) {
+            for (int k = 0; k <= len / 2; k++) {
+                double re = 0, im = 0;
+                for (int n = 0; n < len; n++) {
+                    double a = -2 * M_PI * (int64_t)n * k / len;
+                    re += in[n] * cos(a);
+                    im += in[n] * sin(a);
+                }
+                out[2*k] = re;
+                out[2*k + 1] = im;
+            }
+        } else {
+            for (int n = 0; n < len; n++) {
+                double sum = in[0] + in[len] * (n & 1 ? -1 : 1);
+                for (int k = 1; k < len / 2; k++) {
+                    double a = 2 * M_PI * (int64_t)n * k / len;
+                    sum += 2 * (in[2*k] * cos(a) - in[2*k + 1] * sin(a));
+                }
+                out[n] = sum;
+            }
+        }
+        break;
+    case KIND_DCT:
+        for (int k = 0; k < len; k++) {
+            double sum = 0;
+            for (int n = 0; n < len; n++) {
+                if (!inv)
+                    sum += in[n] * cos(M_PI * (2 * n + 1) * k / (2 * len));
+                else
+                    sum += in[n] * cos(M_PI * (2 * k + 1) * n / (2 * len)) * (n ? 2 : 1);
+            }
+            out[k] = sum;
+        }
+        break;
+    }
+}
+
+static void store(enum Sample fmt, void *dst, int idx, double v)
+{
+    switch (fmt) {
+    case SAMPLE_FLT: ((float   *)dst)[idx] = v;        break;
+    case SAMPLE_DBL: ((double  *)dst)[idx] = v;        break;
+    case SAMPLE_S32: ((int32_t *)dst)[idx] = lrint(v); break;
+    }
+}
+
+static double load(enum Sample fmt, const void *src, int idx)
+{
+    switch (fmt) {
+    case SAMPLE_FLT: return ((const float   *)src)[idx];
+    case SAMPLE_DBL: return ((const double  *)src)[idx];
+    default:         return ((const int32_t *)src)[idx];
+    }
+}
+
+/* Position of real value i in the buffer for the given stride, counted in
+ * complex values for the RDFT and in real ones otherwise */
+static int strided(enum Kind kind, int i, int stride)
+{
+    return kind == KIND_RDFT ? (i >> 1) * 2 * stride + (i & 1) : i * stride;
+}
+
+static int check(AVLFG *lfg, enum Sample fmt, enum Kind kind, int inv,
+                 int len, int stride)
+{
+    const int size = sample_size[fmt];
+    /* The int32 transforms do not scale, leave enough headroom */
+    const double amp = fmt == SAMPLE_S32 ? (1 << 30) / (double)len : 1.0;
+    const double scale = 0.5;
+    const float fscale = scale;
+    int nb_in, nb_out, ret, in_stride = 1, out_stride = 1;
+    double *ref_in = NULL, *ref_out = NULL, err = 0, peak = 0;
+    void *in = NULL, *out = NULL;
+    AVTXContext *ctx = NULL;
+    av_tx_fn tx;
+
+    get_sizes(kind, inv, len, &nb_in, &nb_out);
+    if (kind != KIND_FFT)
+        *(inv ? &in_stride : &out_stride) = stride;
+
+    ref_in  = av_malloc_array(nb_in,  sizeof(*ref_in));
+    ref_out = av_malloc_array(nb_out, sizeof(*ref_out));
+    in      = av_mallocz_array(nb_in  * in_stride,  size);
+    out     = av_mallocz_array(nb_out * out_stride, size);
+    if (!ref_in || !ref_out || !in || !out) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+
+    for (int i = 0; i < nb_in; i++) {
+        double v = (av_lfg_get(lfg) / (double)UINT_MAX - 0.5) * amp;
+        store(fmt, in, strided(kind, i, in_stride), v);
+        ref_in[i] = load(fmt, in, strided(kind, i, in_stride));
+    }
+    /* The imaginary parts of the DC and Nyquist bins are ignored */
+    if (kind == KIND_RDFT && inv)
+        ref_in[1] = ref_in[len + 1] = 0;
+
+    ret = av_tx_init(&ctx, &tx, tx_types[fmt][kind], inv, len,
+                     fmt == SAMPLE_DBL ? (const void *)&scale : &fscale, 0);
+    if (ret < 0)
+        goto end;
+    tx(ctx, out, in, (kind == KIND_RDFT ? 2 : 1) * size * stride);
+
+    reference(kind, inv, len, scale, ref_out, ref_in);
+    for (int i = 0; i < nb_out; i++) {
+        err  = FFMAX(err, fabs(load(fmt, out, strided(kind, i, out_stride)) - ref_out[i]));
+        peak = FFMAX(peak, fabs(ref_out[i]));
+    }
+    if (err > max_error[fmt] * peak) {
+        fprintf(stderr, "%s %s%s, length %d, stride %d: error %g, peak %g\n",
+                sample_names[fmt], inv ? "inverse " : "", kind_names[kind],
+                len, stride, err, peak);
+        ret = 1;
+    }
+
+end:
+    av_tx_uninit(&ctx);
+    av_free(ref_in);
+    av_free(ref_out);
+    av_free(in);
+    av_free(out);
+    return ret;
+}
+
+static int speed(AVLFG *lfg)
+{
+    static const int len[] = { 64, 256, 1024, 4096, 960 };
+    const float scale = 1.0;
+
+    for (int kind = KIND_FFT; kind <= KIND_DCT; kind++) {
+        for (int i = 0; i < FF_ARRAY_ELEMS(len); i++) {
+            const int nb = 2 * len[i] + 2;
+            const int iterations = (1 << 24) / len[i];
+            float *in  = av_malloc_array(nb, sizeof(*in));
+            float *out = av_malloc_array(nb, sizeof(*out));
+            AVTXContext *ctx = NULL;
+            av_tx_fn tx;
+            int64_t t;
+            int ret;
+
+            if (!in || !out) {
+                av_free(in);
+                av_free(out);
+                return AVERROR(ENOMEM);
+            }
+            for (int j = 0; j < nb; j++)
+                in[j] = av_lfg_get(lfg) / (float)UINT_MAX - 0.5f;
+
+            ret = av_tx_init(&ctx, &tx, tx_types[SAMPLE_FLT][kind], 0, len[i],
+                             &scale, 0);
+            if (ret >= 0) {
+                t = av_gettime_relative();
+                for (int j = 0; j < iterations; j++)
+                    tx(ctx, out, in, kind == KIND_RDFT ? sizeof(AVComplexFloat)
+                                                       : sizeof(float));
+                t = av_gettime_relative() - t;
+                printf("float %-4s %5d: %8.1f ns\n", kind_names[kind], len[i],
+                       1000.0 * t / iterations);
+            }
+            av_tx_uninit(&ctx);
+            av_free(in);
+            av_free(out);
+            if (ret < 0)
+                return ret;
+        }
+    }
+
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    AVLFG lfg;
+    int ret = 0;
+
+    av_lfg_init(&lfg, 0xdeadbeef);
+
+    if (argc > 1 && !strcmp(argv[1], "-s"))
+        return !!speed(&lfg);
+
+    for (int fmt = SAMPLE_FLT; fmt <= SAMPLE_S32; fmt++) {
+        for (int kind = KIND_FFT; kind <= KIND_DCT; kind++) {
+            for (int i = 0; i < FF_ARRAY_ELEMS(lengths[kind]); i++) {
+                for (int inv = 0; inv < 2; inv++) {
+                    int len = lengths[kind][i];
+                    if (check(&lfg, fmt, kind, inv, len, 1))
+                        ret = 1;
+                    if (kind != KIND_FFT && len <= 256 &&
+                        check(&lfg, fmt, kind, inv, len, 3))
+                        ret = 1;
+                }
+            }
+        }
+    }
+    return ret;
+}
@@ -28,6 +28,14 @@ typedef struct AVComplexFloat {
     float re, im;
 } AVComplexFloat;
 
+typedef struct AVComplexDouble {
+    double re, im;
+} AVComplexDouble;
+
+typedef struct AVComplexInt32 {
+    int32_t re, im;
+} AVComplexInt32;
+
 enum AVTXType {
     /**
      * Standard complex to complex FFT with sample data type AVComplexFloat.
@@ -39,6 +47,65 @@ enum AVTXType {
      * float. Length is the frame size, not the window size (which is 2x frame)
      */
     AV_TX_FLOAT_MDCT = 1,
+    /**
+     * Same as AV_TX_FLOAT_FFT with a data type of AVComplexDouble.
+     */
+    AV_TX_DOUBLE_FFT = 2,
+    /**
+     * Same as AV_TX_FLOAT_MDCT with data and scale type of double.
+     */
+    AV_TX_DOUBLE_MDCT = 3,
+    /**
+     * Same as AV_TX_FLOAT_FFT with a data type of AVComplexInt32.
+     * Twiddle factors are in Q31, no scaling is done.
+     */
+    AV_TX_INT32_FFT = 4,
+    /**
+     * Same as AV_TX_FLOAT_MDCT with data type of int32_t and scale type of
+     * float. The absolute value of the scale must not exceed 1.
+     */
+    AV_TX_INT32_MDCT = 5,
+    /**
+     * Real to complex and complex to real DFT.
+     * The forward transform takes len floats and outputs len/2 + 1
+     * AVComplexFloat, the imaginary parts of the first and last ones being
+     * zero. The inverse transform takes len/2 + 1 AVComplexFloat and
+     * outputs len floats. len must be even.
+     * Scaling currently unsupported, an inverse transform of a forward one
+     * gives the input multiplied by len. The stride is the distance between
+     * two complex values.
+     */
+    AV_TX_FLOAT_RDFT = 6,
+    /**
+     * Same as AV_TX_FLOAT_RDFT with data types of double and AVComplexDouble.
+     */
+    AV_TX_DOUBLE_RDFT = 7,
+    /**
+     * Same as AV_TX_FLOAT_RDFT with data types of int32_t and AVComplexInt32.
+     * As for all integer transforms, the input must have enough headroom
+     * for the unscaled output.
+     */
+    AV_TX_INT32_RDFT = 8,
+    /**
+     * DCT-II as forward transform and DCT-III as inverse transform, with a
+     * sample data type of float, len samples in and len samples out.
+     * The forward transform computes
+     * X[k] = sum(x[n] * cos(M_PI * (2 * n + 1) * k / (2 * len)))
+     * and the inverse one
+     * x[n] = X[0] + 2 * sum(X[k] * cos(M_PI * (2 * n + 1) * k / (2 * len))),
+     * so that an inverse transform of a forward one gives the input
+     * multiplied by len. len must be even.
+     * Scaling currently unsupported.
+     */
+    AV_TX_FLOAT_DCT = 9,
+    /**
+     * Same as AV_TX_FLOAT_DCT with a data type of double.
+     */
+    AV_TX_DOUBLE_DCT = 10,
+    /**
+     * Same as AV_TX_FLOAT_DCT with a data type of int32_t.
+     */
+    AV_TX_INT32_DCT = 11,
 };
 
 /**
@@ -51,7 +118,9 @@ enum AVTXType {
  * @param out the output array
  * @param in the input array
  * @param stride the input or output stride (depending on transform direction)
- * in bytes, currently implemented for all MDCT transforms
+ * in bytes, currently implemented for all MDCT, RDFT and DCT transforms.
+ * It applies to the output of forward transforms and to the input of
+ * inverse ones.
  */
 typedef void (*av_tx_fn)(AVTXContext *s, void *out, void *in, ptrdiff_t stride);
 
@@ -59,6 +128,7 @@ typedef void (*av_tx_fn)(AVTXContext *s, void *out, void *in, ptrdiff_t stride);
  * Initialize a transform context with the given configuration
  * Currently power of two lengths from 4 to 131072 are supported, along with
  * any length decomposable to a power of two and either 3, 5 or 15.
+ * RDFT and DCT lengths are twice those.
  *
  * @param ctx the context to allocate, will be NULL on error
  * @param tx pointer to the transform function pointer to set
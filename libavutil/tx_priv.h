@@ -0,0 +1,139 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef AVUTIL_TX_PRIV_H
+#define AVUTIL_TX_PRIV_H
+
+#include "tx.h"
+#include <stddef.h>
+#include "thread.h"
+#include "mem.h"
+#include "avassert.h"
+#include "attributes.h"
+#include "common.h"
+
+#ifdef TX_FLOAT
+#define TX_NAME(x) x ## _float
+#define TX_TYPE(x) AV_TX_FLOAT_ ## x
+#define SCALE_TYPE float
+typedef float FFTSample;
+typedef AVComplexFloat FFTComplex;
+#elif defined(TX_DOUBLE)
+#define TX_NAME(x) x ## _double
+#define TX_TYPE(x) AV_TX_DOUBLE_ ## x
+#define SCALE_TYPE double
+typedef double FFTSample;
+typedef AVComplexDouble FFTComplex;
+#elif defined(TX_INT32)
+#define TX_NAME(x) x ## _int32
+#define TX_TYPE(x) AV_TX_INT32_ ## x
+#define SCALE_TYPE float
+typedef int32_t FFTSample;
+typedef AVComplexInt32 FFTComplex;
+#else
+typedef void FFTComplex;
+#endif
+
+#if defined(TX_FLOAT) || defined(TX_DOUBLE)
+
+#define MUL(x, y) ((x) * (y))
+
+#define CMUL(dre, dim, are, aim, bre, bim) do {                                \
+        (dre) = (are) * (bre) - (aim) * (bim);                                 \
+        (dim) = (are) * (bim) + (aim) * (bre);                                 \
+    } while (0)
+
+#define HALF(x) ((x) * 0.5f)
+
+#define RESCALE(x) (x)
+
+#elif defined(TX_INT32)
+
+/* Q31 multiplication, properly rounded */
+#define MUL(x, y) ((int32_t)(((int64_t)(x) * (y) + 0x40000000) >> 31))
+
+#define CMUL(dre, dim, are, aim, bre, bim) do {                                \
+        int64_t accu;                                                          \
+        (accu)  = (int64_t)(bre) * (are);                                      \
+        (accu) -= (int64_t)(bim) * (aim);                                      \
+        (dre)   = (int32_t)(((accu) + 0x40000000) >> 31);                      \
+        (accu)  = (int64_t)(bim) * (are);                                      \
+        (accu) += (int64_t)(bre) * (aim);                                      \
+        (dim)   = (int32_t)(((accu) + 0x40000000) >> 31);                      \
+    } while (0)
+
+#define HALF(x) ((x) >> 1)
+
+#define RESCALE(x) ((int32_t)av_clip64(llrint((x) * 2147483648.0),             \
+                                       INT32_MIN, INT32_MAX))
+
+#endif
+
+#define BF(x, y, a, b) do {                                                    \
+        x = (a) - (b);                                                         \
+        y = (a) + (b);                                                         \
+    } while (0)
+
+#define CMUL3(c, a, b) CMUL((c).re, (c).im, (a).re, (a).im, (b).re, (b).im)
+
+struct AVTXContext {
+    int n;              /* Nptwo part */
+    int m;              /* Ptwo part */
+    int inv;            /* Is inverted */
+    int type;           /* Type */
+
+    FFTComplex *exptab; /* MDCT exptab, RDFT/DCT twiddles */
+    FFTComplex *tmp;    /* Temporary buffer needed for all compound transforms */
+    int        *pfatab; /* Input/Output mapping for compound transforms */
+    int        *revtab; /* Input mapping for power of two transforms */
+
+    av_tx_fn    fft;    /* Half-length FFT of RDFT and DCT transforms */
+    FFTComplex *buf;    /* Work buffer of RDFT and DCT transforms */
+};
+
+/* Shared functions */
+int ff_tx_type_is_mdct(enum AVTXType type);
+int ff_tx_gen_compound_mapping(AVTXContext *s);
+int ff_tx_gen_ptwo_revtab(AVTXContext *s);
+
+/* Templated functions */
+int ff_tx_init_mdct_fft_float(AVTXContext *s, av_tx_fn *tx,
+                              enum AVTXType type, int inv, int len,
+                              const void *scale, uint64_t flags);
+int ff_tx_init_mdct_fft_double(AVTXContext *s, av_tx_fn *tx,
+                               enum AVTXType type, int inv, int len,
+                               const void *scale, uint64_t flags);
+int ff_tx_init_mdct_fft_int32(AVTXContext *s, av_tx_fn *tx,
+                              enum AVTXType type, int inv, int len,
+                              const void *scale, uint64_t flags);
+int ff_tx_init_rdft_dct_float(AVTXContext *s, av_tx_fn *tx,
+                              enum AVTXType type, int inv, int len,
+                              const void *scale, uint64_t flags);
+int ff_tx_init_rdft_dct_double(AVTXContext *s, av_tx_fn *tx,
+                               enum AVTXType type, int inv, int len,
+                               const void *scale, uint64_t flags);
+int ff_tx_init_rdft_dct_int32(AVTXContext *s, av_tx_fn *tx,
+                              enum AVTXType type, int inv, int len,
+                              const void *scale, uint64_t flags);
+
+typedef struct CosTabsInitOnce {
+    void (*func)(void);
+    AVOnce control;
+} CosTabsInitOnce;
+
+#endif /* AVUTIL_TX_PRIV_H */
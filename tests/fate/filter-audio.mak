@@ -99,6 +99,53 @@ fate-filter-asetrate: tests/data/asynth-44100-2.wav
 fate-filter-asetrate: SRC = $(TARGET_PATH)/tests/data/asynth-44100-2.wav
 fate-filter-asetrate: CMD = framecrc -i $(SRC) -frames:a 20 -af asetrate=20000
 
+FATE_FILTER_ATEMPO += fate-filter-atempo-u8
+fate-filter-atempo-u8: tests/data/asynth-44100-2.wav
+fate-filter-atempo-u8: SRC = $(TARGET_PATH)/tests/data/asynth-44100-2.wav
+fate-filter-atempo-u8: CMD = framecrc -i $(SRC) -af aformat=u8,atempo=0.7
+
+FATE_FILTER_ATEMPO += fate-filter-atempo-s16
+fate-filter-atempo-s16: tests/data/asynth-44100-2.wav
+fate-filter-atempo-s16: SRC = $(TARGET_PATH)/tests/data/asynth-44100-2.wav
+fate-filter-atempo-s16: CMD = framecrc -i $(SRC) -af atempo=1.6
+
+FATE_FILTER_ATEMPO += fate-filter-atempo-flt
+fate-filter-atempo-flt: tests/data/asynth-44100-2.wav
+fate-filter-atempo-flt: SRC = $(TARGET_PATH)/tests/data/asynth-44100-2.wav
+fate-filter-atempo-flt: CMD = framecrc -i $(SRC) -af aformat=flt,atempo=0.85
+
+FATE_AFILTER-$(call FILTERDEMDECENCMUX, ATEMPO AFORMAT ARESAMPLE, WAV, PCM_S16LE, PCM_S16LE, WAV) += $(FATE_FILTER_ATEMPO)
+
+# the output of biquadchain is bit-exact with the one of the equivalent chain
+# of filters: both are output as separate streams, which have the same CRCs
+
+FATE_FILTER_BIQUADCHAIN-$(call FILTERDEMDECENCMUX, BIQUADCHAIN EQUALIZER LOWPASS AFORMAT ARESAMPLE ASPLIT, WAV, PCM_S16LE, PCM_S16LE, FRAMECRC) += fate-filter-biquadchain-s16p
+fate-filter-biquadchain-s16p: tests/data/asynth-44100-2.wav
+fate-filter-biquadchain-s16p: tests/data/filtergraphs/biquadchain-s16p
+fate-filter-biquadchain-s16p: SRC = $(TARGET_PATH)/tests/data/asynth-44100-2.wav
+fate-filter-biquadchain-s16p: CMD = framecrc -i $(SRC) -frames:a 20 -filter_complex_script $(TARGET_PATH)/tests/data/filtergraphs/biquadchain-s16p -map "[c]" -map "[d]" -c:a pcm_s16le
+
+FATE_FILTER_BIQUADCHAIN-$(call FILTERDEMDECENCMUX, BIQUADCHAIN EQUALIZER LOWPASS AFORMAT ARESAMPLE ASPLIT, WAV, PCM_S16LE, PCM_S32LE, FRAMECRC) += fate-filter-biquadchain-s32p
+fate-filter-biquadchain-s32p: tests/data/asynth-44100-2.wav
+fate-filter-biquadchain-s32p: tests/data/filtergraphs/biquadchain-s32p
+fate-filter-biquadchain-s32p: SRC = $(TARGET_PATH)/tests/data/asynth-44100-2.wav
+fate-filter-biquadchain-s32p: CMD = framecrc -i $(SRC) -frames:a 20 -filter_complex_script $(TARGET_PATH)/tests/data/filtergraphs/biquadchain-s32p -map "[c]" -map "[d]" -c:a pcm_s32le
+
+FATE_FILTER_BIQUADCHAIN-$(call FILTERDEMDECENCMUX, BIQUADCHAIN EQUALIZER LOWPASS AFORMAT ARESAMPLE ASPLIT, WAV, PCM_S16LE, PCM_F32LE, FRAMECRC) += fate-filter-biquadchain-fltp
+fate-filter-biquadchain-fltp: tests/data/asynth-44100-2.wav
+fate-filter-biquadchain-fltp: tests/data/filtergraphs/biquadchain-fltp
+fate-filter-biquadchain-fltp: SRC = $(TARGET_PATH)/tests/data/asynth-44100-2.wav
+fate-filter-biquadchain-fltp: CMD = framecrc -i $(SRC) -frames:a 20 -filter_complex_script $(TARGET_PATH)/tests/data/filtergraphs/biquadchain-fltp -map "[c]" -map "[d]" -c:a pcm_f32le
+
+FATE_FILTER_BIQUADCHAIN-$(call FILTERDEMDECENCMUX, BIQUADCHAIN EQUALIZER LOWPASS AFORMAT ARESAMPLE ASPLIT, WAV, PCM_S16LE, PCM_F64LE, FRAMECRC) += fate-filter-biquadchain-dblp
+fate-filter-biquadchain-dblp: tests/data/asynth-44100-2.wav
+fate-filter-biquadchain-dblp: tests/data/filtergraphs/biquadchain-dblp
+fate-filter-biquadchain-dblp: SRC = $(TARGET_PATH)/tests/data/asynth-44100-2.wav
+fate-filter-biquadchain-dblp: CMD = framecrc -i $(SRC) -frames:a 20 -filter_complex_script $(TARGET_PATH)/tests/data/filtergraphs/biquadchain-dblp -map "[c]" -map "[d]" -c:a pcm_f64le
+
+FATE_AFILTER-yes += $(FATE_FILTER_BIQUADCHAIN-yes)
+fate-filter-biquadchain: $(FATE_FILTER_BIQUADCHAIN-yes)
+
 FATE_AFILTER-$(call FILTERDEMDECENCMUX, CHORUS, WAV, PCM_S16LE, PCM_S16LE, WAV) += fate-filter-chorus
 fate-filter-chorus: tests/data/asynth-22050-1.wav
 fate-filter-chorus: SRC = $(TARGET_PATH)/tests/data/asynth-22050-1.wav
@@ -186,6 +233,11 @@ FATE_AFILTER_SAMPLES-$(call FILTERDEMDECENCMUX, STEREOTOOLS, WAV, PCM_S16LE, PCM
 fate-filter-stereotools: SRC = $(TARGET_SAMPLES)/audio-reference/luckynight_2ch_44kHz_s16.wav
 fate-filter-stereotools: CMD = framecrc -i $(SRC) -frames:a 20 -af stereotools=mlev=0.015625
 
+FATE_AFILTER-$(call FILTERDEMDECENCMUX, SHOWWAVESPIC, WAV, PCM_S16LE, WRAPPED_AVFRAME, NULL) += fate-filter-showwavespic-peaks
+fate-filter-showwavespic-peaks: tests/data/asynth-44100-2.wav
+fate-filter-showwavespic-peaks: SRC = $(TARGET_PATH)/tests/data/asynth-44100-2.wav
+fate-filter-showwavespic-peaks: CMD = ffmpeg -i $(SRC) -lavfi showwavespic=s=16x16:peaks_file=- -f null -
+
 FATE_AFILTER-$(call FILTERDEMDECENCMUX, TREMOLO, WAV, PCM_S16LE, PCM_S16LE, WAV) += fate-filter-tremolo
 fate-filter-tremolo: tests/data/asynth-44100-2.wav
 fate-filter-tremolo: SRC = $(TARGET_PATH)/tests/data/asynth-44100-2.wav
@@ -394,6 +446,29 @@ FATE_AFILTER-yes += fate-filter-formats
 fate-filter-formats: libavfilter/tests/formats$(EXESUF)
 fate-filter-formats: CMD = run libavfilter/tests/formats$(EXESUF)
 
+# a sine at a quarter of the sample rate whose samples miss its peaks
+FATE_AFILTER_FFPROBE-$(call ALLYES, FFPROBE AVDEVICE LAVFI_INDEV AEVALSRC_FILTER EBUR128_FILTER) += fate-filter-metadata-ebur128-peak
+fate-filter-metadata-ebur128-peak: CMD = run $(FILTER_METADATA_COMMAND) "aevalsrc=0.9*sin(2*PI*12000*t+PI/4)|0.5*sin(2*PI*997*t):s=48000:d=4,ebur128=metadata=1:peak=true+sample:framelog=quiet"
+
+ASTATS_METADATA_DEPS = FFPROBE AVDEVICE LAVFI_INDEV AMOVIE_FILTER WAV_DEMUXER PCM_S16LE_DECODER ATRIM_FILTER ASETNSAMPLES_FILTER ASTATS_FILTER
+ASTATS_METADATA_INPUT = amovie='$(SRC)',atrim=end=0.5,asetnsamples=n=4410
+
+FATE_AFILTER_FFPROBE-$(call ALLYES, $(ASTATS_METADATA_DEPS)) += fate-filter-metadata-astats
+fate-filter-metadata-astats: tests/data/asynth-44100-2.wav
+fate-filter-metadata-astats: SRC = $(TARGET_PATH)/tests/data/asynth-44100-2.wav
+fate-filter-metadata-astats: CMD = run $(FILTER_METADATA_COMMAND) "$(ASTATS_METADATA_INPUT),astats=metadata=1:length=0.01"
+
+FATE_AFILTER_FFPROBE-$(call ALLYES, $(ASTATS_METADATA_DEPS)) += fate-filter-metadata-astats-subsets
+fate-filter-metadata-astats-subsets: tests/data/asynth-44100-2.wav
+fate-filter-metadata-astats-subsets: SRC = $(TARGET_PATH)/tests/data/asynth-44100-2.wav
+fate-filter-metadata-astats-subsets: CMD = run $(FILTER_METADATA_COMMAND) "$(ASTATS_METADATA_INPUT),astats=metadata=1:length=0.01:measure_perchannel=Peak_level+RMS_peak+Flat_factor+Zero_crossings_rate+Max_difference:measure_overall=DC_offset+Min_level+RMS_trough+Peak_count+Mean_difference+Bit_depth+Number_of_samples"
+
+FATE_AFILTER_FFPROBE-$(call ALLYES, $(ASTATS_METADATA_DEPS) AFORMAT_FILTER) += fate-filter-metadata-astats-flt
+fate-filter-metadata-astats-flt: tests/data/asynth-44100-2.wav
+fate-filter-metadata-astats-flt: SRC = $(TARGET_PATH)/tests/data/asynth-44100-2.wav
+fate-filter-metadata-astats-flt: CMD = run $(FILTER_METADATA_COMMAND) "$(ASTATS_METADATA_INPUT),aformat=sample_fmts=flt,astats=metadata=1:length=0.01:measure_perchannel=Min_level+Max_level+Bit_depth+Number_of_NaNs+Number_of_Infs+Number_of_denormals:measure_overall=none"
+
 FATE_SAMPLES_AVCONV += $(FATE_AFILTER_SAMPLES-yes)
 FATE_FFMPEG += $(FATE_AFILTER-yes)
-fate-afilter: $(FATE_AFILTER-yes) $(FATE_AFILTER_SAMPLES-yes)
+FATE_FFPROBE += $(FATE_AFILTER_FFPROBE-yes)
+fate-afilter: $(FATE_AFILTER-yes) $(FATE_AFILTER_SAMPLES-yes) $(FATE_AFILTER_FFPROBE-yes)
@@ -153,6 +153,13 @@ fate-filter-gradfun: CMD = framecrc -c:v pgmyuv -i $(SRC) -vf gradfun
 FATE_FILTER_VSYNTH-$(CONFIG_HQDN3D_FILTER) += fate-filter-hqdn3d
 fate-filter-hqdn3d: CMD = framecrc -c:v pgmyuv -i $(SRC) -vf hqdn3d
 
+# frames made inside the graph are filtered in place, frames from the lavfi
+# device are not; both must give the same output
+FATE_FILTER-$(call ALLYES, TESTSRC2_FILTER FORMAT_FILTER HQDN3D_FILTER) += fate-filter-hqdn3d-slices-inplace
+fate-filter-hqdn3d-slices-inplace: CMD = framecrc -lavfi testsrc2=s=176x144:r=5:d=2,format=yuv420p,hqdn3d=slices=3
+FATE_FILTER-$(call ALLYES, AVDEVICE LAVFI_INDEV TESTSRC2_FILTER FORMAT_FILTER HQDN3D_FILTER) += fate-filter-hqdn3d-slices-copy
+fate-filter-hqdn3d-slices-copy: CMD = framecrc -f lavfi -i testsrc2=s=176x144:r=5:d=2,format=yuv420p -vf hqdn3d=slices=3
+
 FATE_FILTER_VSYNTH-$(CONFIG_INTERLACE_FILTER) += fate-filter-interlace
 fate-filter-interlace: CMD = framecrc -c:v pgmyuv -i $(SRC) -vf interlace
 
@@ -207,6 +214,17 @@ FATE_FILTER_VSYNTH-$(CONFIG_VSTACK_FILTER) += fate-filter-vstack
 fate-filter-vstack: tests/data/filtergraphs/vstack
 fate-filter-vstack: CMD = framecrc -c:v pgmyuv -i $(SRC) -c:v pgmyuv -i $(SRC) -filter_complex_script $(TARGET_PATH)/tests/data/filtergraphs/vstack
 
+# inputs rendered in place, overlapping inputs copied, inputs at other rates
+FATE_FILTER-$(call ALLYES, TESTSRC2_FILTER SPLIT_FILTER HFLIP_FILTER VFLIP_FILTER NEGATE_FILTER XSTACK_FILTER) += fate-filter-xstack-direct fate-filter-xstack-overlap
+fate-filter-xstack-direct: tests/data/filtergraphs/xstack-direct
+fate-filter-xstack-direct: CMD = framecrc -filter_complex_script $(TARGET_PATH)/tests/data/filtergraphs/xstack-direct
+fate-filter-xstack-overlap: tests/data/filtergraphs/xstack-overlap
+fate-filter-xstack-overlap: CMD = framecrc -filter_complex_script $(TARGET_PATH)/tests/data/filtergraphs/xstack-overlap
+
+FATE_FILTER-$(call ALLYES, TESTSRC2_FILTER HFLIP_FILTER VFLIP_FILTER XSTACK_FILTER) += fate-filter-xstack-rates
+fate-filter-xstack-rates: tests/data/filtergraphs/xstack-rates
+fate-filter-xstack-rates: CMD = framecrc -filter_complex_script $(TARGET_PATH)/tests/data/filtergraphs/xstack-rates
+
 FATE_FILTER_VSYNTH-$(CONFIG_OVERLAY_FILTER) += fate-filter-overlay
 fate-filter-overlay: tests/data/filtergraphs/overlay
 fate-filter-overlay: CMD = framecrc -c:v pgmyuv -i $(SRC) -c:v pgmyuv -i $(SRC) -filter_complex_script $(TARGET_PATH)/tests/data/filtergraphs/overlay
@@ -499,6 +517,17 @@ fate-filter-vflip_crop: CMD = video_filter "vflip,crop=iw-100:ih-100:100:100"
 FATE_FILTER_VSYNTH-$(CONFIG_VFLIP_FILTER) += fate-filter-vflip_vflip
 fate-filter-vflip_vflip: CMD = video_filter "vflip,vflip"
 
+# the threaded runs must give the same output as the single threaded ones
+FATE_FILTER_VSYNTH-$(CONFIG_DESHAKE_FILTER) += fate-filter-deshake fate-filter-deshake-threads
+fate-filter-deshake: CMD = framecrc -c:v pgmyuv -i $(SRC) -filter_threads 1 -vf deshake -frames:v 20
+fate-filter-deshake-threads: CMD = framecrc -c:v pgmyuv -i $(SRC) -filter_threads 4 -vf deshake -frames:v 20
+fate-filter-deshake-threads: REF = $(SRC_PATH)/tests/ref/fate/filter-deshake
+
+FATE_FILTER_VSYNTH-$(CONFIG_DESHAKE_FILTER) += fate-filter-deshake-predictive fate-filter-deshake-predictive-threads
+fate-filter-deshake-predictive: CMD = framecrc -c:v pgmyuv -i $(SRC) -filter_threads 1 -vf deshake=search=predictive -frames:v 20
+fate-filter-deshake-predictive-threads: CMD = framecrc -c:v pgmyuv -i $(SRC) -filter_threads 4 -vf deshake=search=predictive -frames:v 20
+fate-filter-deshake-predictive-threads: REF = $(SRC_PATH)/tests/ref/fate/filter-deshake-predictive
+
 FATE_FILTER_VSYNTH-$(call ALLYES, FORMAT_FILTER PERMS_FILTER EDGEDETECT_FILTER) += fate-filter-edgedetect
 fate-filter-edgedetect: CMD = video_filter "format=gray,perms=random,edgedetect" -frames:v 20
 
@@ -541,6 +570,19 @@ fate-filter-qp: CMD = video_filter "qp=17,pp=be/hb/vb/tn/l5/al"
 FATE_FILTER_VSYNTH-$(CONFIG_SELECT_FILTER) += fate-filter-select
 fate-filter-select: CMD = framecrc -flags bitexact -idct simple -i $(SRC) -vf "select=not(eq(mod(n\,2)\,0)+eq(mod(n\,3)\,0))" -frames:v 25 -flags +bitexact
 
+# scene scores across a cut, which must not depend on the number of threads
+define FATE_SCENE_THREADS
+FATE_FILTER-$(call ALLYES, TESTSRC2_FILTER DRAWBOX_FILTER $(2)) += fate-filter-$(1) fate-filter-$(1)-threads
+fate-filter-$(1) fate-filter-$(1)-threads: tests/data/filtergraphs/$(1)
+fate-filter-$(1): CMD = $(3) -filter_complex_threads 1 -filter_complex_script $$(TARGET_PATH)/tests/data/filtergraphs/$(1) $(4)
+fate-filter-$(1)-threads: CMD = $(3) -filter_complex_threads 4 -filter_complex_script $$(TARGET_PATH)/tests/data/filtergraphs/$(1) $(4)
+fate-filter-$(1)-threads: REF = $$(SRC_PATH)/tests/ref/fate/filter-$(1)
+endef
+
+$(eval $(call FATE_SCENE_THREADS,select-scene-hist,SELECT_FILTER METADATA_FILTER NULL_MUXER,ffmpeg,-f null -))
+$(eval $(call FATE_SCENE_THREADS,select-scene-step,SELECT_FILTER METADATA_FILTER NULL_MUXER,ffmpeg,-f null -))
+$(eval $(call FATE_SCENE_THREADS,minterpolate-scd-hist,MINTERPOLATE_FILTER FRAMECRC_MUXER,framecrc))
+
 FATE_FILTER_VSYNTH-$(CONFIG_SETDAR_FILTER) += fate-filter-setdar
 fate-filter-setdar: CMD = video_filter "setdar=dar=16/9"
 
@@ -619,6 +661,55 @@ FATE_FILTER_VSYNTH-$(CONFIG_STEREO3D_FILTER) += $(FATE_STEREO3D)
 FATE_FILTER_VSYNTH-$(CONFIG_THUMBNAIL_FILTER) += fate-filter-thumbnail
 fate-filter-thumbnail: CMD = video_filter "thumbnail=10"
 
+FATE_FILTER_VSYNTH-$(call ALLYES, SPLIT_FILTER THUMBNAIL_FILTER) += fate-filter-thumbnail-max_size
+fate-filter-thumbnail-max_size: tests/data/filtergraphs/thumbnail-max_size
+fate-filter-thumbnail-max_size: CMD = framecrc -c:v pgmyuv -i $(SRC) -filter_complex_script $(TARGET_PATH)/tests/data/filtergraphs/thumbnail-max_size
+
+FATE_FILTER-$(call ALLYES, TESTSRC2_FILTER THUMBNAIL_FILTER) += fate-filter-thumbnail-max_size-tall fate-filter-thumbnail-max_size-wide
+fate-filter-thumbnail-max_size-tall: CMD = framecrc -lavfi testsrc2=s=2x4096:r=5:d=2,thumbnail=n=4:max_size=1x1
+fate-filter-thumbnail-max_size-wide: CMD = framecrc -lavfi testsrc2=s=4096x2:r=5:d=2,thumbnail=n=4:max_size=1x1
+
+# zscale must give the same output with one and several threads, the
+# single threaded output is the reference
+ZSCALE_THREADS_GRAPH = testsrc2=s=320x240:d=0.2,format=yuv444p16,zscale=w=256:h=192:f=bicubic:d=$(1),format=yuv420p
+
+tests/data/zscale-threads-%.framecrc: TAG = GEN
+tests/data/zscale-threads-%.framecrc: ffmpeg$(PROGSSUF)$(EXESUF) | tests/data
+	$(M)$(TARGET_EXEC) $(TARGET_PATH)/$< -nostdin -filter_complex_threads 1 \
+        -lavfi $(call ZSCALE_THREADS_GRAPH,$*) -bitexact -f framecrc -y $(TARGET_PATH)/$@ 2>/dev/null
+
+define FATE_ZSCALE_THREADS
+FATE_FILTER-$(call ALLYES, TESTSRC2_FILTER FORMAT_FILTER SCALE_FILTER ZSCALE_FILTER FRAMECRC_MUXER) += fate-filter-zscale-threads-$(1)
+fate-filter-zscale-threads-$(1): tests/data/zscale-threads-$(1).framecrc
+fate-filter-zscale-threads-$(1): CMD = framecrc -filter_complex_threads 4 -lavfi $(call ZSCALE_THREADS_GRAPH,$(1))
+fate-filter-zscale-threads-$(1): REF = tests/data/zscale-threads-$(1).framecrc
+endef
+
+$(foreach D,none ordered random error_diffusion,$(eval $(call FATE_ZSCALE_THREADS,$(D))))
+
+# the baked table must give the same output as the interpolation it caches
+tests/data/lut3d.cube: TAG = GEN
+tests/data/lut3d.cube: | tests/data
+	$(M)awk 'BEGIN { n = 9; print "LUT_3D_SIZE", n;                           \
+	                 for (b = 0; b < n; b++) for (g = 0; g < n; g++) for (r = 0; r < n; r++) \
+	                     printf "%f %f %f\n", (r * r / (n - 1) + b) / (2 * n - 2), \
+	                            sqrt(g / (n - 1)), (n - 1 - b + r / 2) / (1.5 * n - 1.5) }' > $@
+
+define FATE_LUT3D_BAKE
+FATE_FILTER_VSYNTH-$(call ALLYES, FORMAT_FILTER LUT3D_FILTER) += fate-filter-lut3d-$(1)-$(2) fate-filter-lut3d-$(1)-$(2)-bake
+fate-filter-lut3d-$(1)-$(2) fate-filter-lut3d-$(1)-$(2)-bake: tests/data/lut3d.cube
+fate-filter-lut3d-$(1)-$(2): CMD = framecrc -c:v pgmyuv -i $$(SRC) -vf format=$(1),lut3d=file=$$(TARGET_PATH)/tests/data/lut3d.cube:interp=$(2) -frames:v 5
+fate-filter-lut3d-$(1)-$(2)-bake: CMD = framecrc -c:v pgmyuv -i $$(SRC) -vf format=$(1),lut3d=file=$$(TARGET_PATH)/tests/data/lut3d.cube:interp=$(2):bake=1 -frames:v 5
+fate-filter-lut3d-$(1)-$(2)-bake: REF = $$(SRC_PATH)/tests/ref/fate/filter-lut3d-$(1)-$(2)
+endef
+
+$(foreach I,nearest trilinear tetrahedral,$(eval $(call FATE_LUT3D_BAKE,rgb24,$(I))))
+$(eval $(call FATE_LUT3D_BAKE,gbrp,tetrahedral))
+
+FATE_FILTER-$(call ALLYES, COLOR_FILTER OVERLAY_FILTER BLEND_FILTER NULLSINK_FILTER HFLIP_FILTER FORMAT_FILTER SCALE_FILTER AFORMAT_FILTER ARESAMPLE_FILTER ANULLSINK_FILTER) += fate-filter-graphtemplate
+fate-filter-graphtemplate: libavfilter/tests/graphtemplate$(EXESUF)
+fate-filter-graphtemplate: CMD = run libavfilter/tests/graphtemplate$(EXESUF)
+
 FATE_FILTER_VSYNTH-$(CONFIG_TILE_FILTER) += fate-filter-tile
 fate-filter-tile: CMD = video_filter "tile=3x3:nb_frames=5:padding=7:margin=2"
 
@@ -162,6 +162,11 @@ FATE_LIBAVUTIL += fate-tea
 fate-tea: libavutil/tests/tea$(EXESUF)
 fate-tea: CMD = run libavutil/tests/tea$(EXESUF)
 
+FATE_LIBAVUTIL += fate-tx
+fate-tx: libavutil/tests/tx$(EXESUF)
+fate-tx: CMD = run libavutil/tests/tx$(EXESUF)
+fate-tx: CMP = null
+
 FATE_LIBAVUTIL += fate-opt
 fate-opt: libavutil/tests/opt$(EXESUF)
 fate-opt: CMD = run libavutil/tests/opt$(EXESUF)
@@ -0,0 +1,173 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * Measure the filter graph configuration and scheduling overhead against
+ * the graph size.
+ *
+ * A tiny video source is split into a number of branches, each made of a
+ * chain of null filters ending in a buffersink, and the whole graph is
+ * configured and run to completion. Since the filters themselves do no
+ * work, the time per frame is dominated by the cost of activating filters.
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libavutil/avassert.h"
+#include "libavutil/bprint.h"
+#include "libavutil/frame.h"
+#include "libavutil/time.h"
+#include "libavfilter/avfilter.h"
+#include "libavfilter/buffersink.h"
+
+static int run_graph(int branches, int chain, int frames,
+                     unsigned *nb_filters, int64_t *config, int64_t *elapsed)
+{
+    AVFilterGraph *graph;
+    AVFilterInOut *outputs = NULL, *cur;
+    AVFilterContext **sinks = NULL;
+    AVFrame *frame = NULL;
+    AVBPrint desc;
+    int64_t t0;
+    int i, j, nb_eof = 0, ret;
+
+    av_bprint_init(&desc, 0, AV_BPRINT_SIZE_UNLIMITED);
+    av_bprintf(&desc, "nullsrc=s=16x16:r=25,trim=end_frame=%d,split=%d",
+               frames, branches);
+    for (i = 0; i < branches; i++)
+        av_bprintf(&desc, "[b%d]", i);
+    for (i = 0; i < branches; i++) {
+        av_bprintf(&desc, ";[b%d]", i);
+        for (j = 0; j < chain; j++)
+            av_bprintf(&desc, "%snull", j ? "," : "");
+        av_bprintf(&desc, "[o%d]", i);
+    }
+    if (!av_bprint_is_complete(&desc)) {
+        av_bprint_finalize(&desc, NULL);
+        return AVERROR(ENOMEM);
+    }
+
+    graph = avfilter_graph_alloc();
+    sinks = av_calloc(branches, sizeof(*sinks));
+    frame = av_frame_alloc();
+    if (!graph || !sinks || !frame) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+    graph->nb_threads = 1;
+
+    ret = avfilter_graph_parse_ptr(graph, desc.str, NULL, &outputs, NULL);
+    if (ret < 0)
+        goto end;
+    for (cur = outputs, i = 0; cur; cur = cur->next, i++) {
+        av_assert0(i < branches);
+        ret = avfilter_graph_create_filter(&sinks[i],
+                                           avfilter_get_by_name("buffersink"),
+                                           NULL, NULL, NULL, graph);
+        if (ret < 0)
+            goto end;
+        ret = avfilter_link(cur->filter_ctx, cur->pad_idx, sinks[i], 0);
+        if (ret < 0)
+            goto end;
+    }
+    t0 = av_gettime_relative();
+    ret = avfilter_graph_config(graph, NULL);
+    if (ret < 0)
+        goto end;
+    *config = av_gettime_relative() - t0;
+
+    *nb_filters = graph->nb_filters;
+    t0 = av_gettime_relative();
+    while (nb_eof < branches) {
+        for (i = 0; i < branches; i++) {
+            if (!sinks[i])
+                continue;
+            ret = av_buffersink_get_frame(sinks[i], frame);
+            if (ret == AVERROR_EOF) {
+                sinks[i] = NULL;
+                nb_eof++;
+            } else if (ret < 0) {
+                goto end;
+            }
+            av_frame_unref(frame);
+        }
+    }
+    *elapsed = av_gettime_relative() - t0;
+    ret = 0;
+
+end:
+    av_bprint_finalize(&desc, NULL);
+    avfilter_inout_free(&outputs);
+    avfilter_graph_free(&graph);
+    av_frame_free(&frame);
+    av_freep(&sinks);
+    return ret;
+}
+
+int main(int argc, char **argv)
+{
+    static const int default_branches[] = { 1, 4, 16, 64, 256 };
+    int chain = 2, frames = 500, i, ret;
+
+    if (argc > 1 && (!strcmp(argv[1], "-h") || argc > 4)) {
+        fprintf(stderr,
+                "Usage: %s [frames [chain [branches]]]\n\n"
+                "Run graphs of 'branches' chains of 'chain' null filters for\n"
+                "'frames' frames and print the time spent configuring the graph\n"
+                "and per frame and filter activation. Without branches, a range\n"
+                "of graph sizes is measured.\n", argv[0]);
+        return 1;
+    }
+    if (argc > 1)
+        frames = atoi(argv[1]);
+    if (argc > 2)
+        chain  = atoi(argv[2]);
+    if (frames <= 0 || chain <= 0) {
+        fprintf(stderr, "Invalid parameters\n");
+        return 1;
+    }
+
+    printf("%8s %12s %8s %12s %12s\n",
+           "filters", "config (us)", "frames", "us/frame", "ns/filter");
+    for (i = 0; i < FF_ARRAY_ELEMS(default_branches); i++) {
+        int branches = argc > 3 ? atoi(argv[3]) : default_branches[i];
+        unsigned nb_filters = 0;
+        int64_t config = 0, elapsed = 0;
+
+        if (branches <= 0) {
+            fprintf(stderr, "Invalid number of branches\n");
+            return 1;
+        }
+        ret = run_graph(branches, chain, frames, &nb_filters, &config, &elapsed);
+        if (ret < 0) {
+            fprintf(stderr, "Error running graph: %s\n", av_err2str(ret));
+            return 1;
+        }
+        printf("%8u %12"PRId64" %8d %12.2f %12.2f\n", nb_filters, config, frames,
+               (double)elapsed / frames,
+               1000.0 * elapsed / ((double)frames * nb_filters));
+        if (argc > 3)
+            break;
+    }
+
+    return 0;
+}